@@ -1,18 +1,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
-#include <unistd.h> // For usleep()
+#include <unistd.h>
 #include <signal.h> // Defines signal-handling functions (i.e. trap Ctrl-C)
+#include <poll.h>
+#include <time.h>
 #include "gpio.h"
+#include "stepper.h"
 
 #define PIN_MUX_PATH "/sys/kernel/debug/omap_mux/"
 #define MAX_BUF 64
 
+#define SCAN_STEPS 20		//Positions sampled while looking for the light
+#define SAMPLE_MS 20		//Sensor period while tracking
+#define PRINT_EVERY 25		//Print every this many samples
+#define THRESHOLD 150		//Smaller differences between the sensors are ignored
+
 /****************************************************************
 * Global variables
 ****************************************************************/
 int keepgoing = 1;	// Set to 0 when ctrl-c is pressed
 unsigned int controller[4] = {30, 31, 48, 51};	//number of gpios to be used for driving the motor
+struct stepper motor;
 
 /****************************************************************
 * signal_handler
@@ -20,13 +29,8 @@ unsigned int controller[4] = {30, 31, 48, 51};	//number of gpios to be used for
 // Callback executed when SIGINT is sent to the process (Ctrl-C)
 void signal_handler(int sig)
 {
-	int i;
 	printf( "Ctrl-C pressed, cleaning up and exiting..\n" );
 	keepgoing = 0;
-	//Unxport gpios
-	for (i = 0; i < 4; i++){
-		gpio_unexport(controller[i]);
-	}
 }
 
 /****************************************************************
@@ -84,8 +88,6 @@ void initIO(){
 	char gpio48[] = "gpmc_a0";
 	char gpio5[] = "spi0_cs0";
 
-	int i;
-
 	//Set pin mux in gpio output mode for controllers
 #ifdef SET_PIN_MUX
 mode_gpio_out(gpio30);
@@ -94,94 +96,60 @@ mode_gpio_out(gpio30);
 	mode_gpio_out(gpio5);
 #endif
 
-	//Export gpios and set up output direction for controllers
-	for (i = 0; i < 4; i++){
-		gpio_export(controller[i]);
-		gpio_set_direction(controller[i], 1);
+	//Export gpios, set them to outputs and hold them open for the motor
+	if (stepper_open(&motor, controller, STEP_FULL) < 0) {
+		printf("Can't set up the motor\n");
+		exit(1);
 	}
-	
 }
 
 /****************************************************************
-* Delay Function
+* Wait for the motor
 ****************************************************************/
-void delay (unsigned int loops)
+//Steps the motor for up to ms milliseconds (-1 for as long as it
+//moves); returns early when it stops or Ctrl-C is pressed
+void run_motor(int ms)
 {
-	int i, j;
-#ifdef HACK
-	for (i = 0; i < loops; i++)
-		for (j = 0; j < 50000; j++);
-#else
-    usleep(1000*loops);
-#endif
-}
+	struct pollfd pfd;
+	struct timespec now;
+	long long end = 0, left;
 
-/****************************************************************
-* Clockwise Rotate
-****************************************************************/
-void cRotate (int *pos){
-	//Use a 4 state position to decide how to rotate
-	switch (*pos){
-		case 0:
-			gpio_set_value(controller[0], 0);
-			gpio_set_value(controller[1], 1);
-			gpio_set_value(controller[2], 1);
-			gpio_set_value(controller[3], 0);
-			break;
-		case 1:
-			gpio_set_value(controller[0], 1);
-			gpio_set_value(controller[1], 1);	
-			gpio_set_value(controller[2], 0);
-			gpio_set_value(controller[3], 0);
-			break;
-		case 2:
-			gpio_set_value(controller[0], 1);
-			gpio_set_value(controller[1], 0);
-			gpio_set_value(controller[2], 0);
-			gpio_set_value(controller[3], 1);
-			break;
-		case 3:
-			gpio_set_value(controller[0], 0);
-			gpio_set_value(controller[1], 0);
-			gpio_set_value(controller[2], 1);
-			gpio_set_value(controller[3], 1);
+	pfd.fd = stepper_fd(&motor);
+	pfd.events = POLLIN;
+
+	if (ms >= 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		end = now.tv_sec * 1000LL + now.tv_nsec / 1000000 + ms;
 	}
-	delay(50);
-	*pos = (*pos+1)%4; 	
-}
 
-/****************************************************************
-* Counter Clockwise Rotate
-****************************************************************/
-void ccRotate (int *pos){
-	//Use a 4 state position to decide how to rotate
-	switch (*pos){
-		case 0:
-			gpio_set_value(controller[0], 1);
-			gpio_set_value(controller[1], 0);
-			gpio_set_value(controller[2], 0);
-			gpio_set_value(controller[3], 1);
-			break;
-		case 1:
-			gpio_set_value(controller[0], 0);
-			gpio_set_value(controller[1], 0);	
-			gpio_set_value(controller[2], 1);
-			gpio_set_value(controller[3], 1);
-			break;
-		case 2:
-			gpio_set_value(controller[0], 0);
-			gpio_set_value(controller[1], 1);
-			gpio_set_value(controller[2], 1);
-			gpio_set_value(controller[3], 0);
-			break;
-		case 3:
-			gpio_set_value(controller[0], 1);
-			gpio_set_value(controller[1], 1);
-			gpio_set_value(controller[2], 0);
-			gpio_set_value(controller[3], 0);
+	while (keepgoing) {
+		left = -1;
+		if (ms >= 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			left = end - (now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+			if (left <= 0)
+				return;
+		}
+		else if (!stepper_moving(&motor))
+			return;
+
+		if (poll(&pfd, 1, left) > 0)
+			stepper_service(&motor);
 	}
-	delay(50);
-	*pos = (*pos-1+4)%4; 	
+}
+
+//Steps the motor until it reaches pos going forward, and no further,
+//so the caller can sample there; returns early if it stops or Ctrl-C
+void run_motor_to(long pos)
+{
+	struct pollfd pfd;
+
+	pfd.fd = stepper_fd(&motor);
+	pfd.events = POLLIN;
+
+	while (keepgoing && stepper_moving(&motor) && stepper_position(&motor) < pos)
+		if (poll(&pfd, 1, -1) > 0)
+			stepper_service(&motor);
 }
 
 /****************************************************************
@@ -190,69 +158,67 @@ void ccRotate (int *pos){
 int main(int argc, char *argv[]){
 	
 	char PT1[] = "AIN4", PT2[] = "AIN6";
-	int PT1_val[20], PT2_val[20], PT_sum[20];
-	int min, minPos, pos, PT1_now, PT2_now, i;
+	int PT1_val[SCAN_STEPS], PT2_val[SCAN_STEPS], PT_sum[SCAN_STEPS];
+	int min, minPos, PT1_now, PT2_now, i, samples;
+	long pos;
 
 	// Set the signal callback for Ctrl-C
 	signal(SIGINT, signal_handler);
 
 	initIO();
 
-	pos = 0;
-
-	//Since we don't know the initial position of motor, we'd better let it rotate 2 steps first
-	cRotate(&pos);
-	cRotate(&pos);
-
-	//Clockwise rotate for a cycle and record the value in different directions
-	for(i = 0; i < 20; i++) {
+	//Clockwise rotate for a cycle and record the value in different directions,
+	//sampling at each position as the motor passes it. The next step is
+	//not serviced until the sample is taken, so none is skipped
+	stepper_move_to(&motor, SCAN_STEPS - 1);
+	for(i = 0; i < SCAN_STEPS && keepgoing; i++) {
+		run_motor_to(i);
 		PT1_val[i] = analogIn(PT1);
 		PT2_val[i] = analogIn(PT2);
 		printf("PT1:%4d PT2:%4d\n", PT1_val[i], PT2_val[i]);
-		cRotate(&pos);
-		delay(100);
 	}
 
-	for(i = 0; i < 20; i++) {
+	for(i = 0; i < SCAN_STEPS; i++) {
 		PT_sum[i] = PT1_val[i] + PT2_val[i];
 	}
 
 	min = 50000;	//Initialize a large number as min to garantee to be replaced later
+	minPos = 0;
 	//Find the direction with minimum value, which has the strongest light	
-	for(i = 0; i < 20; i++)		
+	for(i = 0; i < SCAN_STEPS; i++)		
 		if(PT_sum[i] < min) {
 			min = PT_sum[i];
 			minPos = i;
 		}
 	printf("min:%d minPos:%d\n", min, minPos);
 
-	//Counter clockwise rotate to the direction with strongest light
-	for(i = 19; i >= 0; i--) {
-		ccRotate(&pos);
-		delay(100);
-		if((i-minPos) == 0) break;
-	}
+	//Rotate back to the direction with strongest light
+	stepper_move_to(&motor, minPos);
+	run_motor(-1);
 
-	//Tracking mode. Find the strongest light and rotate to its direction
-	while(keepgoing) {
+	//Tracking mode. Sample the sensors every SAMPLE_MS and keep the motor
+	//heading for the stronger light while it runs
+	for (samples = 0; keepgoing; samples++) {
 		//Read analog inputs
 		PT1_now = analogIn(PT1);
 		PT2_now = analogIn(PT2);
+		pos = stepper_position(&motor);
 		//Set a threshold. If the difference between the phototransistors is too small, we will not rotate	
-		if (PT1_now - PT2_now < 150 && PT1_now - PT2_now > -150){
-			delay(300);
+		if (PT1_now - PT2_now < THRESHOLD && PT1_now - PT2_now > -THRESHOLD){
+			stepper_move_to(&motor, pos);
 		}
-		//Decide which direction to rotate
+		//Decide which direction to rotate, further ahead the bigger the difference
 		else if (PT1_now > PT2_now){
-			cRotate(&pos);
+			stepper_move_to(&motor, pos + (PT1_now - PT2_now) / THRESHOLD);
 		}		
 		else if (PT1_now < PT2_now){
-			ccRotate(&pos);
+			stepper_move_to(&motor, pos - (PT2_now - PT1_now) / THRESHOLD);
 		}
-		printf("PT1:%4d PT2:%4d\n", PT1_now, PT2_now);
-        delay(500);
+		if (samples % PRINT_EVERY == 0)
+			printf("PT1:%4d PT2:%4d pos:%ld\n", PT1_now, PT2_now, pos);
+		run_motor(SAMPLE_MS);
 	}
+
+	stepper_close(&motor);
 	return 0;
 }
-
-
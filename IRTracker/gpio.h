@@ -4,8 +4,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <unistd.h>
 
+#ifndef SYSFS_GPIO_DIR	//Override with -D to run against a copy of the tree
 #define SYSFS_GPIO_DIR "/sys/class/gpio"
+#endif
 #define MAX_BUF 64
 
 /****************************************************************
@@ -132,4 +135,44 @@ int gpio_get_value(unsigned int gpio, unsigned int *value)
 	return 0;
 }
 
+/****************************************************************
+* gpio_value_open
+****************************************************************/
+//Open a pin's value file once, for gpio_set_values()
+int gpio_value_open(unsigned int gpio)
+{
+	int fd;
+	char buf[MAX_BUF];
+
+	snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR "/gpio%d/value", gpio);
+
+	fd = open(buf, O_WRONLY);
+	if (fd < 0)
+		perror("gpio/value-open");
+	return fd;
+}
+
+/****************************************************************
+* gpio_set_values
+****************************************************************/
+//Set several pins at once: bit i of values goes to fds[i], but only
+//for the bits in mask. Pins are written in place through descriptors
+//from gpio_value_open(), with no open or close per write.
+int gpio_set_values(const int *fds, int n, unsigned int values, unsigned int mask)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		if (!(mask & (1u << i)))
+			continue;
+		if (pwrite(fds[i], (values & (1u << i)) ? "1" : "0", 1, 0) != 1)
+		{
+			perror("gpio/set-values");
+			return -1;
+		}
+	}
+	return 0;
+}
+
 #endif
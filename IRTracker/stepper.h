@@ -0,0 +1,256 @@
+#ifndef STEPPER_H
+#define STEPPER_H
+
+/****************************************************************
+* Stepper motor driver
+*
+* The four controller pins are driven from a step table, so full,
+* half and wave drive are just different tables. Only the pins that
+* change between two entries are written. Steps are timed by a
+* timerfd, so nothing here sleeps: the caller polls stepper_fd()
+* along with whatever else it waits on, and calls stepper_service()
+* when it is readable. The step rate ramps up from minRate to
+* maxRate at accel steps/s^2 and back down in time to stop on the
+* target. If a new target lies behind the motor, the driver slows
+* down to minRate before reversing.
+*
+* Positions count steps of the chosen table, so a half-step
+* revolution is twice as many steps as a full-step one.
+****************************************************************/
+
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include "gpio.h"
+
+#define STEPPER_PINS 4
+
+#define STEP_FULL 0	//Two coils on at a time, full torque
+#define STEP_HALF 1	//Alternates two coils and one, twice the resolution
+#define STEP_WAVE 2	//One coil on at a time, least current
+
+//Bit i drives pins[i]
+static const unsigned char stepFull[] = { 0x6, 0x3, 0x9, 0xc };
+static const unsigned char stepHalf[] = { 0x6, 0x2, 0x3, 0x1, 0x9, 0x8, 0xc, 0x4 };
+static const unsigned char stepWave[] = { 0x2, 0x1, 0x8, 0x4 };
+
+struct stepper {
+	unsigned int pins[STEPPER_PINS];
+	int fd[STEPPER_PINS];		//Value files, opened once
+	int timer;			//timerfd that paces the steps
+	const unsigned char *table;
+	int tableLen;
+	unsigned int coils;		//Pattern on the pins now
+
+	long position, target;
+	int dir;			//+1 or -1 while moving, 0 when idle
+	double rate;			//Steps/s of the step being timed now
+	double minRate, maxRate, accel;
+	struct timespec next;		//When the next step is due
+	unsigned long steps;
+};
+
+/****************************************************************
+* stepper_write
+****************************************************************/
+static int stepper_write(struct stepper *s, unsigned int coils)
+{
+	int rc = gpio_set_values(s->fd, STEPPER_PINS, coils, coils ^ s->coils);
+
+	s->coils = coils;
+	return rc;
+}
+
+/****************************************************************
+* stepper_arm
+****************************************************************/
+//Fire at s->next, or at once if that has already passed
+static void stepper_arm(struct stepper *s)
+{
+	struct itimerspec its;
+
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	its.it_value = s->next;
+	timerfd_settime(s->timer, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/****************************************************************
+* stepper_open
+****************************************************************/
+int stepper_open(struct stepper *s, const unsigned int *pins, int mode)
+{
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	for (i = 0; i < STEPPER_PINS; i++)
+		s->fd[i] = -1;
+	s->timer = -1;
+
+	switch (mode) {
+		case STEP_HALF:
+			s->table = stepHalf;
+			s->tableLen = sizeof(stepHalf);
+			break;
+		case STEP_WAVE:
+			s->table = stepWave;
+			s->tableLen = sizeof(stepWave);
+			break;
+		default:
+			s->table = stepFull;
+			s->tableLen = sizeof(stepFull);
+	}
+	s->minRate = 20;
+	s->maxRate = 200;
+	s->accel = 400;
+
+	//Export gpios and set up output direction for controllers
+	for (i = 0; i < STEPPER_PINS; i++) {
+		s->pins[i] = pins[i];
+		gpio_export(pins[i]);
+		gpio_set_direction(pins[i], 1);
+		if ((s->fd[i] = gpio_value_open(pins[i])) < 0)
+			return -1;
+	}
+
+	s->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (s->timer < 0) {
+		perror("stepper/timerfd");
+		return -1;
+	}
+
+	//Energise the coils for position 0, whatever the pins held before
+	s->coils = ~0u;
+	return stepper_write(s, s->table[0]);
+}
+
+/****************************************************************
+* stepper_set_speed
+****************************************************************/
+//Rates in steps/s, accel in steps/s^2
+void stepper_set_speed(struct stepper *s, double minRate, double maxRate, double accel)
+{
+	s->minRate = minRate;
+	s->maxRate = maxRate > minRate ? maxRate : minRate;
+	s->accel = accel;
+}
+
+/****************************************************************
+* stepper_move_to
+****************************************************************/
+void stepper_move_to(struct stepper *s, long target)
+{
+	s->target = target;
+	if (s->dir == 0 && target != s->position) {
+		//Start now; stepper_service() picks the direction
+		s->rate = s->minRate;
+		clock_gettime(CLOCK_MONOTONIC, &s->next);
+		stepper_arm(s);
+		s->dir = target > s->position ? 1 : -1;
+	}
+}
+
+/****************************************************************
+* stepper_move
+****************************************************************/
+void stepper_move(struct stepper *s, long steps)
+{
+	stepper_move_to(s, s->target + steps);
+}
+
+/****************************************************************
+* stepper_fd, stepper_moving, stepper_position
+****************************************************************/
+int stepper_fd(const struct stepper *s)
+{
+	return s->timer;
+}
+
+int stepper_moving(const struct stepper *s)
+{
+	return s->dir != 0;
+}
+
+long stepper_position(const struct stepper *s)
+{
+	return s->position;
+}
+
+/****************************************************************
+* stepper_service
+****************************************************************/
+//Takes the step that is due, if any, and schedules the next one.
+//Returns 1 while the motor is still moving, 0 once it is idle.
+int stepper_service(struct stepper *s)
+{
+	uint64_t expired;
+	long dist;
+	double stopSteps;
+	int idx;
+
+	if (s->dir == 0)
+		return 0;
+	if (read(s->timer, &expired, sizeof(expired)) != sizeof(expired))
+		return 1;	//Not due yet
+
+	//Steps left in the direction we are going (negative if past it).
+	//The ramp ends within one increment of minRate, which is as slow
+	//as the motor ever goes, so it may stop or turn round from there.
+	dist = (s->target - s->position) * s->dir;
+	if (dist <= 0 && s->rate <= s->minRate + s->accel / s->minRate) {
+		if (dist == 0) {
+			s->dir = 0;
+			return 0;
+		}
+		s->dir = -s->dir;
+		s->rate = s->minRate;
+		dist = -dist;
+	}
+
+	s->position += s->dir;
+	idx = s->position % s->tableLen;
+	if (idx < 0)
+		idx += s->tableLen;
+	stepper_write(s, s->table[idx]);
+	s->steps++;
+
+	//Speed up while there is room to stop, otherwise slow down
+	stopSteps = s->rate * s->rate / (2 * s->accel);
+	if (dist - 1 > stopSteps)
+		s->rate += s->accel / s->rate;
+	else
+		s->rate -= s->accel / s->rate;
+	if (s->rate > s->maxRate)
+		s->rate = s->maxRate;
+	if (s->rate < s->minRate)
+		s->rate = s->minRate;
+
+	s->next.tv_nsec += (long)(1e9 / s->rate);
+	while (s->next.tv_nsec >= 1000000000L) {
+		s->next.tv_nsec -= 1000000000L;
+		s->next.tv_sec++;
+	}
+	stepper_arm(s);
+	return 1;
+}
+
+/****************************************************************
+* stepper_close
+****************************************************************/
+//Coils off, pins released
+void stepper_close(struct stepper *s)
+{
+	int i;
+
+	stepper_write(s, 0);
+	if (s->timer >= 0)
+		close(s->timer);
+	for (i = 0; i < STEPPER_PINS; i++) {
+		if (s->fd[i] >= 0)
+			close(s->fd[i]);
+		gpio_unexport(s->pins[i]);
+	}
+}
+
+#endif
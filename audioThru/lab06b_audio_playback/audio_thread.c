@@ -20,8 +20,9 @@
 #include     "debug.h"                          // DBG and ERR macros
 #include     "audio_thread.h"                   // Audio thread definitions
 #include     "audio_input_output.h"             // Audio driver input and output functions
+#include     "playlist.h"                       // Gapless playlist with read-ahead
 
-/* Input audio file */
+/* Input audio file, played when no playlist is given */
 #define     INPUTFILE        "/tmp/audio.raw"
 
 // ALSA device
@@ -48,6 +49,8 @@
 //*                            as defined in audio_thread.h                    **
 //*                                                                            **
 //*          envByRef.quit -- when quit != 0, thread will cleanup and exit     **
+//*          envByRef.files, numFiles -- raw or WAV files, played back to    **
+//*                            back; INPUTFILE when numFiles is 0            **
 //*                                                                            **
 //*  Return Value:                                                             **
 //*      void *            --  AUDIO_THREAD_SUCCESS or AUDIO_THREAD_FAILURE as **
@@ -64,38 +67,43 @@ void *audio_thread_fxn( void *envByRef )
     void             * status = AUDIO_THREAD_SUCCESS;      // < see above >
 
     // The levels of initialization for initMask
-    #define     INPUT_FILE_OPENED           0x1
+    #define     PLAYLIST_STARTED            0x1
     #define     OUTPUT_ALSA_INITIALIZED     0x4
     #define     OUTPUT_BUFFER_ALLOCATED     0x8
 
             unsigned  int   initMask =  0x0;	// Used to only cleanup items that were init'd
 
     // Input and output driver variables
-    FILE	* inputFile = NULL;		// Input file pointer (i.e. handle)
     snd_pcm_t	*pcm_output_handle;		// Handle for the PCM device
     snd_pcm_uframes_t exact_bufsize;		// bufsize is in frames.  Each frame is 4 bytes
 
     int   blksize = BLOCKSIZE;			// Raw input or output frame size in bytes
     char *outputBuffer = NULL;			// Output buffer for driver to read from
+    char *defaultFile = INPUTFILE;
 
 // Thread Create Phase -- secure and initialize resources
 // ******************************************************
 
-    // Open input file
+    // Start reading ahead through the playlist
     // ************************
 	
-    inputFile = fopen( INPUTFILE, "r" );
+    if( envPtr->numFiles == 0 )
+    {
+        envPtr->files    = &defaultFile;
+        envPtr->numFiles = 1;
+    }
 
-    if( inputFile == NULL )
+    if( playlist_start( envPtr->files, envPtr->numFiles, BYTESPERFRAME,
+			SAMPLE_RATE * BYTESPERFRAME ) == PLAYLIST_FAILURE )
     {
-        ERR( "Failed to open file %s\n", INPUTFILE );
+        ERR( "Failed to start the playlist\n" );
         status = AUDIO_THREAD_FAILURE;
         goto  cleanup ;
     }
-    DBG( "Opened %s.\n", INPUTFILE);
+    DBG( "Started playlist of %d files.\n", envPtr->numFiles );
 
-    // Record that input file was opened in initialization bitmask
-    initMask |= INPUT_FILE_OPENED;
+    // Record that the playlist was started in initialization bitmask
+    initMask |= PLAYLIST_STARTED;
 
     // Initialize audio output device
     // ******************************
@@ -113,7 +121,7 @@ void *audio_thread_fxn( void *envByRef )
     }
 	DBG( "pcm_output_handle after audio_output_setup = %d\n", (int) pcm_output_handle);
 	DBG( "blksize = %d, exact_bufsize = %d\n", blksize, (int) exact_bufsize);
-	blksize = exact_bufsize;
+	blksize = exact_bufsize * BYTESPERFRAME;
 
     // Record that input ALSA device was opened in initialization bitmask
     initMask |= OUTPUT_ALSA_INITIALIZED;
@@ -149,18 +157,18 @@ void *audio_thread_fxn( void *envByRef )
 //
     DBG( "Entering audio_thread_fxn processing loop\n" );
 
-    int count = 0;
+    int count = 0, n;
     while( !envPtr->quit )
     {
-        // Read buffer from audio file
-        if ((blksize = fread(outputBuffer, sizeof(char), blksize, inputFile)) == 0 )
+        // Read the next block of the playlist; items run on without a break
+        if ((n = playlist_read(outputBuffer, blksize)) == 0 )
         {
-            DBG( "Reached end of file from FILE ptr %p\n", inputFile );
+            DBG( "Reached end of playlist\n" );
             goto  cleanup ;
         }
 
         // Write output buffer into ALSA output device
-      while (snd_pcm_writei(pcm_output_handle, outputBuffer, blksize/BYTESPERFRAME) < 0) {
+      while (snd_pcm_writei(pcm_output_handle, outputBuffer, n/BYTESPERFRAME) < 0) {
         snd_pcm_prepare(pcm_output_handle);
         ERR( "<<<<<<<<<<<<<<< Buffer Underrun >>>>>>>>>>>>>>>\n");
         status = AUDIO_THREAD_FAILURE;
@@ -185,11 +193,11 @@ cleanup:
     //  - Uses the initMask to only free resources that were allocated.
     //  - Nothing to be done for mixer device, as it was closed after init.
 
-    // Close input file
-    if( initMask & INPUT_FILE_OPENED )
+    // Stop the prefetch thread
+    if( initMask & PLAYLIST_STARTED )
     {
-        DBG( "Closing FILE ptr %p\n", inputFile );
-        fclose( inputFile );
+        DBG( "Stopping playlist\n" );
+        playlist_stop( );
     }
 
     // Close output ALSA device
@@ -210,6 +218,10 @@ cleanup:
         DBG( "Freed audio output buffer at location %p\n", outputBuffer );
     }
 
+    // Lead time and gaps per item, once the device has drained
+    if( initMask & PLAYLIST_STARTED )
+        playlist_report( stdout );
+
     // Return from audio_thread_fxn function
     // *************************************
 	
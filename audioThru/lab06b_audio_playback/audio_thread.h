@@ -10,6 +10,8 @@
 typedef  struct  audio_thread_env
 {
     int quit;                // Thread will run as long as quit = 0
+    char **files;            // Played back to back, without a gap
+    int numFiles;            // 0 plays the default input file
 } audio_thread_env;
 
 // Function prototypes
@@ -46,6 +46,10 @@ int main( int argc, char *argv[] )
     void *audioThreadReturn;
 
 
+    // Any arguments are the playlist
+    audio_env.files    = argv + 1;
+    audio_env.numFiles = argc - 1;
+
     // Set the signal callback for Ctrl-C
     pSigPrev = signal(SIGINT, signal_handler);
 
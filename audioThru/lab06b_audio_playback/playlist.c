@@ -0,0 +1,390 @@
+/*
+ *   playlist.c
+ *
+ *   The FIFO counts bytes written and read since the start, so an item's
+ *   place in the stream is just the write count when it began. Each item
+ *   is cut to whole frames; a stray byte or two at the end of a file would
+ *   otherwise swap left and right for everything after it.
+ *
+ *   Lead time is how long before the player reached an item its first
+ *   samples were already buffered; a gap is time the player spent waiting
+ *   on an empty FIFO, charged to the item it was waiting for.
+ */
+
+//* Standard Linux headers **
+#include     <stdio.h>                          // Always include stdio.h
+#include     <stdlib.h>                         // Always include stdlib.h
+#include     <string.h>                         // Defines memcpy, strcmp
+#include     <time.h>                           // clock_gettime
+#include     <pthread.h>
+
+//* Application headers **
+#include     "debug.h"                          // DBG and ERR macros
+#include     "playlist.h"
+
+typedef  struct  PlaylistItem
+{
+    char                *path;
+    unsigned long long   start;		// Stream offset of the first byte
+    unsigned long long   bytes;
+    unsigned long long   openedUs;	// Prefetch opened it
+    unsigned long long   queuedUs;	// First samples in the FIFO
+    unsigned long long   playedUs;	// Player reached it
+    unsigned long long   gapUs;		// Player starved waiting for it
+    int                  ready;		// start is known
+    int                  done;		// All of it is in the FIFO
+    int                  failed;
+} PlaylistItem;
+
+static PlaylistItem      items[ PLAYLIST_MAX_ITEMS ];
+static int               numItems, playing;
+static int               frameSize, byteRate;
+
+static char             *fifo = NULL;
+static unsigned long long written, consumed;
+static int               prefetchDone, stopping;
+static pthread_t         prefetcher;
+static int               prefetcherRunning = 0;
+static pthread_mutex_t   lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    dataReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t    spaceReady = PTHREAD_COND_INITIALIZER;
+
+static unsigned long long now_us( void )
+{
+    struct timespec  ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( unsigned long long ) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//*******************************************************************************
+//*  skip_wav_header                                                           **
+//*******************************************************************************
+//*  The one decoding step: for a .wav file, checks the format matches the     **
+//*  device, leaves the file at the first sample and returns the length of     **
+//*  the samples in dataBytes, so chunks after them (LIST and the like) are    **
+//*  not played. Raw files are left as is and played to the end.               **
+//*******************************************************************************
+static int skip_wav_header( FILE * f, const char * path, unsigned long long * dataBytes )
+{
+    unsigned char  hdr[ 8 ], fmt[ 16 ];
+    unsigned int   size;
+    const char    *dot = strrchr( path, '.' );
+
+    *dataBytes = ~0ULL;
+    if( dot == NULL || strcasecmp( dot, ".wav" ) != 0 )
+        return PLAYLIST_SUCCESS;
+
+    if( fread( hdr, 1, 4, f ) != 4 || memcmp( hdr, "RIFF", 4 ) != 0 ||
+        fread( hdr, 1, 8, f ) != 8 || memcmp( hdr + 4, "WAVE", 4 ) != 0 )
+        goto bad;
+
+    // Walk the chunks to "data", checking "fmt " on the way
+    while( fread( hdr, 1, 8, f ) == 8 ) {
+        size = hdr[ 4 ] | hdr[ 5 ] << 8 | hdr[ 6 ] << 16 | ( unsigned int ) hdr[ 7 ] << 24;
+
+        if( memcmp( hdr, "data", 4 ) == 0 ) {
+            // 0xffffffff is what streaming writers leave when they never
+            // came back to fill the size in
+            if( size != 0xffffffff )
+                *dataBytes = size;
+            return PLAYLIST_SUCCESS;
+        }
+
+        if( memcmp( hdr, "fmt ", 4 ) == 0 && size >= 16 ) {
+            if( fread( fmt, 1, 16, f ) != 16 )
+                goto bad;
+            // PCM, and the device's block align and byte rate
+            if( ( fmt[ 0 ] | fmt[ 1 ] << 8 ) != 1 || ( fmt[ 12 ] | fmt[ 13 ] << 8 ) != frameSize ||
+                ( fmt[ 8 ] | fmt[ 9 ] << 8 | fmt[ 10 ] << 16 ) != byteRate ) {
+                ERR( "%s is not 16-bit stereo PCM at the device's rate\n", path );
+                return PLAYLIST_FAILURE;
+            }
+            size -= 16;
+        }
+        if( fseek( f, size + ( size & 1 ), SEEK_CUR ) != 0 )
+            goto bad;
+    }
+
+bad:
+    ERR( "%s is not a WAV file\n", path );
+    return PLAYLIST_FAILURE;
+}
+
+// Copies whole frames into the FIFO, waiting for room; returns 0 if stopped
+static int fifo_put( const char * buf, int  bytes )
+{
+    int  n, at;
+
+    pthread_mutex_lock( &lock );
+    while( bytes > 0 ) {
+        while( !stopping && written - consumed == PLAYLIST_FIFO_BYTES )
+            pthread_cond_wait( &spaceReady, &lock );
+        if( stopping )
+            break;
+
+        n  = PLAYLIST_FIFO_BYTES - ( int ) ( written - consumed );
+        at = written % PLAYLIST_FIFO_BYTES;
+        if( n > bytes )
+            n = bytes;
+        if( n > PLAYLIST_FIFO_BYTES - at )
+            n = PLAYLIST_FIFO_BYTES - at;
+
+        // Copied unlocked: the player never reads past `written`
+        pthread_mutex_unlock( &lock );
+        memcpy( fifo + at, buf, n );
+        pthread_mutex_lock( &lock );
+
+        written += n;
+        buf     += n;
+        bytes   -= n;
+        pthread_cond_signal( &dataReady );
+    }
+    n = !stopping;
+    pthread_mutex_unlock( &lock );
+
+    return n;
+}
+
+//*******************************************************************************
+//*  prefetch_fxn                                                              **
+//*******************************************************************************
+//*  Streams every item into the FIFO in order. An item that cannot be opened  **
+//*  is skipped; the next one follows straight on.                             **
+//*******************************************************************************
+static void *prefetch_fxn( void * arg )
+{
+    char                chunk[ PLAYLIST_CHUNK ];
+    int                 i, n, carry, whole;
+    unsigned long long  left;		// Sample bytes still to read
+    FILE               *f;
+
+    for( i = 0; i < numItems && !stopping; i++ ) {
+        PlaylistItem  *it = &items[ i ];
+
+        it->openedUs = now_us( );
+        f = fopen( it->path, "r" );
+        if( f == NULL || skip_wav_header( f, it->path, &left ) == PLAYLIST_FAILURE ) {
+            if( f == NULL )
+                ERR( "Failed to open file %s\n", it->path );
+            else
+                fclose( f );
+            pthread_mutex_lock( &lock );
+            it->failed = 1;
+            pthread_mutex_unlock( &lock );
+            continue;
+        }
+        DBG( "Prefetching %s\n", it->path );
+
+        pthread_mutex_lock( &lock );
+        it->start = written;
+        it->ready = 1;
+        pthread_mutex_unlock( &lock );
+
+        carry = 0;
+        while( left > 0 ) {
+            n = sizeof( chunk ) - carry;
+            if( ( unsigned long long ) n > left )
+                n = ( int ) left;
+            if( ( n = fread( chunk + carry, 1, n, f ) ) <= 0 )
+                break;
+            left -= n;
+            n    += carry;
+            whole = n - n % frameSize;
+            // The player reads the item under the lock (see reached())
+            pthread_mutex_lock( &lock );
+            if( it->queuedUs == 0 )
+                it->queuedUs = now_us( );
+            pthread_mutex_unlock( &lock );
+            if( !fifo_put( chunk, whole ) )
+                break;
+            pthread_mutex_lock( &lock );
+            it->bytes += whole;
+            pthread_mutex_unlock( &lock );
+            carry = n - whole;
+            memmove( chunk, chunk + whole, carry );
+        }
+        if( carry ) {
+            DBG( "Dropped %d bytes of partial frame at the end of %s\n", carry, it->path );
+        }
+        fclose( f );
+
+        // An empty item is reached as soon as the player gets to its start
+        pthread_mutex_lock( &lock );
+        if( it->queuedUs == 0 )
+            it->queuedUs = now_us( );
+        it->done = 1;
+        pthread_mutex_unlock( &lock );
+    }
+
+    pthread_mutex_lock( &lock );
+    prefetchDone = 1;
+    pthread_cond_signal( &dataReady );
+    pthread_mutex_unlock( &lock );
+
+    return NULL;
+}
+
+//*******************************************************************************
+//*  playlist_start                                                            **
+//*******************************************************************************
+//*  Input Parameters:                                                         **
+//*      char **files     -- paths, played in order                            **
+//*      int numFiles                                                          **
+//*      int frameBytes   -- bytes per sample frame (all channels)             **
+//*      int bytesPerSec  -- device byte rate, to turn bytes into time         **
+//*                                                                            **
+//*  Return Value:                                                             **
+//*      int -- PLAYLIST_SUCCESS or PLAYLIST_FAILURE                           **
+//*******************************************************************************
+int playlist_start( char ** files, int  numFiles, int  frameBytes, int  bytesPerSec )
+{
+    int  i;
+
+    if( numFiles > PLAYLIST_MAX_ITEMS ) {
+        ERR( "Only the first %d of %d files will be played\n", PLAYLIST_MAX_ITEMS, numFiles );
+        numFiles = PLAYLIST_MAX_ITEMS;
+    }
+
+    memset( items, 0, sizeof( items ) );
+    for( i = 0; i < numFiles; i++ )
+        items[ i ].path = files[ i ];
+    numItems  = numFiles;
+    playing   = -1;
+    frameSize = frameBytes;
+    byteRate  = bytesPerSec;
+    written   = consumed = 0;
+    prefetchDone = stopping = 0;
+
+    if( ( fifo = malloc( PLAYLIST_FIFO_BYTES ) ) == NULL ) {
+        ERR( "Failed to allocate the %d byte playlist FIFO\n", PLAYLIST_FIFO_BYTES );
+        return PLAYLIST_FAILURE;
+    }
+
+    if( pthread_create( &prefetcher, NULL, prefetch_fxn, NULL ) != 0 ) {
+        ERR( "Failed to create the prefetch thread\n" );
+        free( fifo );
+        fifo = NULL;
+        return PLAYLIST_FAILURE;
+    }
+    prefetcherRunning = 1;
+
+    return PLAYLIST_SUCCESS;
+}
+
+// Whether the player has got to an item: past its first byte, or for one
+// with no bytes at all, complete and with the player at its start
+static int reached( const PlaylistItem * it, unsigned long long  upTo )
+{
+    if( it->failed )
+        return 1;
+    return it->ready &&
+           ( it->start < upTo || ( it->done && it->start + it->bytes <= upTo ) );
+}
+
+// Marks the items the player has now reached
+static void note_played( unsigned long long  upTo, unsigned long long  t )
+{
+    while( playing + 1 < numItems && reached( &items[ playing + 1 ], upTo ) ) {
+        playing++;
+        if( !items[ playing ].failed ) {
+            items[ playing ].playedUs = t;
+            DBG( "Now playing %s\n", items[ playing ].path );
+        }
+    }
+}
+
+//*******************************************************************************
+//*  playlist_read                                                             **
+//*******************************************************************************
+//*  Fills buf with the next bytes of the stream, whichever items they come    **
+//*  from. Blocks until bytes are available; less than that only at the end    **
+//*  of the playlist, 0 once everything has been read.                        **
+//*******************************************************************************
+int playlist_read( char * buf, int  bytes )
+{
+    unsigned long long  t0, waited;
+    int                 got = 0, n, at;
+
+    pthread_mutex_lock( &lock );
+    while( got < bytes ) {
+        if( written == consumed ) {
+            if( prefetchDone )
+                break;
+
+            // Starved: the time counts against the item we are waiting on
+            t0 = now_us( );
+            while( written == consumed && !prefetchDone )
+                pthread_cond_wait( &dataReady, &lock );
+            waited = now_us( ) - t0;
+            if( consumed > 0 ) {
+                n = playing + 1 < numItems && items[ playing + 1 ].start <= consumed ?
+                    playing + 1 : playing;
+                if( n >= 0 )
+                    items[ n ].gapUs += waited;
+            }
+            continue;
+        }
+
+        n  = ( int ) ( written - consumed );
+        at = consumed % PLAYLIST_FIFO_BYTES;
+        if( n > bytes - got )
+            n = bytes - got;
+        if( n > PLAYLIST_FIFO_BYTES - at )
+            n = PLAYLIST_FIFO_BYTES - at;
+
+        memcpy( buf + got, fifo + at, n );
+        got      += n;
+        consumed += n;
+        pthread_cond_signal( &spaceReady );
+    }
+    note_played( consumed, now_us( ) );
+    pthread_mutex_unlock( &lock );
+
+    return got;
+}
+
+//*******************************************************************************
+//*  playlist_stop                                                             **
+//*******************************************************************************
+void playlist_stop( void )
+{
+    if( prefetcherRunning ) {
+        pthread_mutex_lock( &lock );
+        stopping = 1;
+        pthread_cond_signal( &spaceReady );
+        pthread_mutex_unlock( &lock );
+        pthread_join( prefetcher, NULL );
+        prefetcherRunning = 0;
+    }
+
+    free( fifo );
+    fifo = NULL;
+}
+
+//*******************************************************************************
+//*  playlist_report                                                           **
+//*******************************************************************************
+void playlist_report( FILE * fp )
+{
+    unsigned long long  gapTotal = 0;
+    int                 i;
+
+    for( i = 0; i < numItems; i++ ) {
+        PlaylistItem  *it = &items[ i ];
+
+        if( it->failed ) {
+            fprintf( fp, "%2d  %-32s  skipped\n", i, it->path );
+            continue;
+        }
+        fprintf( fp, "%2d  %-32s  %8.3f s", i, it->path, ( double ) it->bytes / byteRate );
+        if( it->playedUs )
+            fprintf( fp, "  opened %6.1f ms, buffered %6.1f ms ahead, gap %.1f ms\n",
+                     ( it->playedUs - it->openedUs ) / 1000.0,
+                     ( it->playedUs - it->queuedUs ) / 1000.0, it->gapUs / 1000.0 );
+        else
+            fprintf( fp, "  not reached\n" );
+        gapTotal += it->gapUs;
+    }
+    fprintf( fp, "Playlist: %d items, %.1f ms of gaps in total\n", numItems, gapTotal / 1000.0 );
+}
@@ -0,0 +1,26 @@
+/*
+ *   playlist.h
+ *
+ *   Gapless playback of a list of raw (or WAV) files. A prefetch thread
+ *   opens each item, strips any WAV header and streams its samples into
+ *   one FIFO while the one before it is still playing, so the player
+ *   sees a single continuous stream and crosses from one item to the
+ *   next on a frame boundary, without touching the ALSA device.
+ */
+
+// Success and failure definitions for the playlist functions
+#define     PLAYLIST_SUCCESS     0
+#define     PLAYLIST_FAILURE     -1
+
+#define     PLAYLIST_MAX_ITEMS   64
+#define     PLAYLIST_FIFO_BYTES  ( 4 * 48000 * 4 )	// Read-ahead: 4 s of 48 kHz stereo
+#define     PLAYLIST_CHUNK       16384		// Bytes per file read
+
+// Function prototypes
+int  playlist_start( char ** files, int  numFiles, int  frameBytes, int  bytesPerSec );
+
+int  playlist_read( char * buf, int  bytes );
+
+void playlist_stop( void );
+
+void playlist_report( FILE * fp );
@@ -0,0 +1,43 @@
+/*
+ *   audio_process.emu_stub.c
+ *
+ *   Host stand-in for the generated audio_process.gpp_stub.c (see
+ *   c6run_build/emu/c6run_emu.h). Unqualified pointers are in/out, as
+ *   the C6Run front end treats them.
+ */
+
+#include     "c6run_emu.h"
+#include     "audio_process.h"
+
+// The DSP-side function, renamed when built for emulation
+extern int audio_process_dsp(short *outputBuffer, short *inputBuffer, int samples);
+
+typedef  struct  audio_process_args
+{
+    short  *outputBuffer;
+    short  *inputBuffer;
+    int     samples;
+    int     ret;
+} audio_process_args;
+
+static void audio_process_call( void * p )
+{
+    audio_process_args  *a = p;
+
+    a->ret = audio_process_dsp( a->outputBuffer, a->inputBuffer, a->samples );
+}
+
+int audio_process(short *outputBuffer, short *inputBuffer, int samples)
+{
+    audio_process_args  a;
+
+    a.outputBuffer = c6run_emu_arg( outputBuffer, C6RUN_EMU_INOUT );
+    a.inputBuffer  = c6run_emu_arg( inputBuffer, C6RUN_EMU_INOUT );
+    a.samples      = samples;
+
+    c6run_emu_dispatch( "audio_process", audio_process_call, &a );
+
+    c6run_emu_arg_done( outputBuffer, C6RUN_EMU_INOUT );
+    c6run_emu_arg_done( inputBuffer, C6RUN_EMU_INOUT );
+    return a.ret;
+}
@@ -13,6 +13,9 @@
 #include     "audio_thread.h"		// Audio thread definitions
 #include     "audio_input_output.h"	// Audio driver input and output functions
 #include     "audio_process.h"
+#include     "trace.h"			// Timeline trace points
+#include     "watchdog.h"		// Block budget and DSP bypass
+#include     "dsp_offload.h"		// Sync or pipelined audio_process calls
 
 // Timing routines
 #include <time.h>
@@ -81,6 +84,7 @@ void *audio_thread_fxn( void *envByRef )
     #define     INPUT_BUFFER_ALLOCATED      0x2
     #define     OUTPUT_ALSA_INITIALIZED     0x4
     #define     OUTPUT_BUFFER_ALLOCATED     0x8
+    #define     OFFLOAD_INITIALIZED         0x10
 
     unsigned  int   initMask =  0x0;               // Used to only cleanup items that were init'd
 
@@ -91,6 +95,9 @@ void *audio_thread_fxn( void *envByRef )
     int   blksize = BLOCKSIZE;	// Raw input or output frame size
     char *inputBuffer = NULL;	// Input buffer for driver to read into
     char *outputBuffer = NULL;	// Output buffer for driver to read from
+    int   wdAudio;		// Watchdog loop id
+    char *inBlock;		// Offload slot being captured into
+    char *outBlock;		// Processed block being played, NULL = none yet
 
 // Thread Create Phase -- secure and initialize resources
 // ******************************************************
@@ -160,6 +167,16 @@ void *audio_thread_fxn( void *envByRef )
     // Record that input ALSA device was opened in initialization bitmask
     initMask |= OUTPUT_ALSA_INITIALIZED;
 
+    // Slots the blocks are captured into and processed in
+    if( offload_init( blksize, envPtr->offload ) == OFFLOAD_FAILURE ) {
+        status = AUDIO_THREAD_FAILURE;
+        goto  cleanup ;
+    }
+    initMask |= OFFLOAD_INITIALIZED;
+
+    // Processing and writing a block must take less time than it plays for
+    wdAudio = wd_loop( "audio", (unsigned long long) exact_bufsize * 1000000000ULL / SAMPLE_RATE );
+
 // Thread Execute Phase -- perform I/O and processing
 // **************************************************
     int err;
@@ -175,8 +192,12 @@ void *audio_thread_fxn( void *envByRef )
     printf( "Starting DSP..." );
     t_start = get_timestamp();
 
-    // Do the dummy call
-    audio_process((short *)outputBuffer, (short *)outputBuffer, blksize/2);
+    // Do the dummy call. The ring loop has already been started (and now
+    // holds the DSP), so there is nothing to warm up in that mode.
+    TRACE_BEGIN( "dsp.warmup" );
+    if( envPtr->offload != OFFLOAD_RING )
+        audio_process((short *)outputBuffer, (short *)outputBuffer, blksize/2);
+    TRACE_END( "dsp.warmup" );
 
     t_proc = get_timestamp();
     printf("%f s\n", (t_proc-t_start)/1000000.0);
@@ -206,31 +227,49 @@ void *audio_thread_fxn( void *envByRef )
 //	The main loop
 //
     while( !envPtr->quit ) {
-	// Read capture buffer from ALSA input device
+	// Read capture buffer from ALSA input device into the next free slot
+	inBlock = offload_input();
 	t_start = get_timestamp();
-        while( snd_pcm_readi(pcm_capture_handle, inputBuffer, exact_bufsize) < 0 ) {
+	TRACE_BEGIN( "audio.read" );
+        while( snd_pcm_readi(pcm_capture_handle, inBlock, exact_bufsize) < 0 ) {
 	    snd_pcm_prepare(pcm_capture_handle);
 	    ERR( "<<<<<<<<<<<<<<< Buffer Overrun >>>>>>>>>>>>>>>\n");
             ERR( "Error reading the data from file descriptor %d\n", 
 			(int) pcm_capture_handle );
         }
 	t_read = get_timestamp();
+	TRACE_END( "audio.read" );
+	wd_begin( wdAudio );
 	// Audio process
-	//  I'm passing the data as short since we are processing 16-bit audio.
-	//	memcpy(outputBuffer, inputBuffer, blksize);
-	audio_process((short *)outputBuffer, (short *)inputBuffer, blksize/2);
+	//  Hand the block to the DSP. In async mode this returns at once and
+	//  what comes back is the previous block; the first time round there
+	//  is none yet, so silence goes out instead.
+	//  While the watchdog says the DSP keeps us late, pass the audio through.
+	offload_submit( wd_shedding( WD_BYPASS_DSP ) );
+	outBlock = offload_collect();
 	t_proc = get_timestamp();
+	if( outBlock == NULL && offload_stalled() ) {
+	    ERR( "DSP stopped answering, leaving the audio loop\n" );
+	    status = AUDIO_THREAD_FAILURE;
+	    break;
+	}
 
 	// Write output buffer into ALSA output device
 	errcnt = 0;	
+	TRACE_BEGIN( "audio.write" );
 	// The Beagle gets an underrun error the first time it trys to write,
 	// so I ignore the first error and it appears to work fine.
-	while ((err = snd_pcm_writei(pcm_output_handle, outputBuffer, exact_bufsize)) < 0) {
+	while ((err = snd_pcm_writei(pcm_output_handle, outBlock ? outBlock : outputBuffer,
+			exact_bufsize)) < 0) {
 	    snd_pcm_prepare(pcm_output_handle);
 	    ERR( "<<<<<<<<<<<<<<< Buffer Underrun >>>>>>>>>>>>>>> err=%d, errcnt=%d\n", err, errcnt);
 	    memset(outputBuffer, 0, blksize);		// Clear the buffer
 	    snd_pcm_writei(pcm_output_handle, outputBuffer, exact_bufsize);
 	}
+	if( outBlock )
+	    offload_release();
+	TRACE_END( "audio.write" );
+	wd_end( wdAudio );
 	t_write= get_timestamp();
 //	DBG( "%d\t%d\t%d\t%d\n", t_start-t_old, t_read-t_start, t_proc-t_read, t_write-t_proc);
 	t_old = t_start;
@@ -267,6 +306,12 @@ cleanup:
             status = AUDIO_THREAD_FAILURE;
         }
 
+    // Stop the offload and say what it cost
+    if( initMask & OFFLOAD_INITIALIZED ) {
+        offload_report( stdout );
+        offload_cleanup( );
+    }
+
     // Free allocated buffers
     // **********************
 
@@ -10,6 +10,7 @@
 typedef  struct  audio_thread_env
 {
     int quit;                // Thread will run as long as quit = 0
+    int offload;             // OFFLOAD_SYNC, OFFLOAD_ASYNC or OFFLOAD_RING
 } audio_thread_env;
 
 // Function prototypes
@@ -0,0 +1,354 @@
+/*
+ * c6run_emu.c
+ *
+ * See c6run_emu.h. The DSP is one worker thread, so calls from several
+ * ARM threads are served one at a time, in the order they win the lock,
+ * as the real single-core DSP would.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "c6run_emu.h"
+
+
+/************************************************************
+* Local Typedef Declarations                                *
+************************************************************/
+
+// One C6RUN_MEM allocation: the ARM's copy and the DSP's
+typedef struct EmuBuf
+{
+  char           *arm;
+  char           *shadow;
+  size_t          size;
+  struct EmuBuf  *next;
+} EmuBuf;
+
+
+/************************************************************
+* Local Variable Definitions                                *
+************************************************************/
+
+static EmuBuf           *bufList = NULL;
+static pthread_mutex_t   bufLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t    dspOnce = PTHREAD_ONCE_INIT;
+static pthread_t         dspThread;
+static pthread_mutex_t   rpcLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    rpcCond = PTHREAD_COND_INITIALIZER;
+static int               rpcBusy = 0, rpcPosted = 0, rpcDone = 0;
+static void            (*rpcFxn)(void *);
+static void             *rpcArgs;
+
+static int               rpcUs = 0, loadMs = 0;
+
+// Statistics
+static unsigned long        numCalls = 0, numStrays = 0;
+static unsigned long long   callUs = 0, dspUs = 0, wbBytes = 0, invBytes = 0;
+
+
+/************************************************************
+* Local Function Definitions                                *
+************************************************************/
+
+static unsigned long long now_us( void )
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Finds the allocation holding ptr; call with bufLock held
+static EmuBuf *find_buf(const void *ptr)
+{
+  EmuBuf *b;
+
+  for (b = bufList; b != NULL; b = b->next)
+    if ((const char *) ptr >= b->arm && (const char *) ptr < b->arm + b->size)
+      return b;
+  return NULL;
+}
+
+// Copies [ptr, ptr+size) of whichever allocation holds ptr, clipped to it
+static void sync_range(void *ptr, size_t size, int toShadow)
+{
+  EmuBuf *b;
+  size_t  off;
+
+  pthread_mutex_lock(&bufLock);
+  if ((b = find_buf(ptr)) != NULL)
+  {
+    off = (char *) ptr - b->arm;
+    if (size > b->size - off)
+      size = b->size - off;
+    if (toShadow)
+    {
+      memcpy(b->shadow + off, b->arm + off, size);
+      wbBytes += size;
+    }
+    else
+    {
+      memcpy(b->arm + off, b->shadow + off, size);
+      invBytes += size;
+    }
+  }
+  pthread_mutex_unlock(&bufLock);
+}
+
+static void sync_all(int toShadow)
+{
+  EmuBuf *b;
+
+  pthread_mutex_lock(&bufLock);
+  for (b = bufList; b != NULL; b = b->next)
+  {
+    if (toShadow)
+      memcpy(b->shadow, b->arm, b->size);
+    else
+      memcpy(b->arm, b->shadow, b->size);
+    if (toShadow)
+      wbBytes += b->size;
+    else
+      invBytes += b->size;
+  }
+  pthread_mutex_unlock(&bufLock);
+}
+
+static void *dsp_fxn(void *arg)
+{
+  unsigned long long t0;
+  int first = 1;
+
+  pthread_mutex_lock(&rpcLock);
+  for (;;)
+  {
+    while (!rpcPosted)
+      pthread_cond_wait(&rpcCond, &rpcLock);
+    rpcPosted = 0;
+    pthread_mutex_unlock(&rpcLock);
+
+    if (first && loadMs)
+      usleep(loadMs * 1000);
+    first = 0;
+    if (rpcUs)
+      usleep(rpcUs);
+
+    t0 = now_us();
+    rpcFxn(rpcArgs);
+    t0 = now_us() - t0;
+
+    pthread_mutex_lock(&rpcLock);
+    dspUs += t0;
+    rpcDone = 1;
+    pthread_cond_broadcast(&rpcCond);
+  }
+
+  return NULL;
+}
+
+static void report_at_exit( void )
+{
+  c6run_emu_report(stderr);
+}
+
+// The equivalent of C6RUN_libInit: read the knobs, start the DSP
+static void emu_init( void )
+{
+  char *s;
+
+  if ((s = getenv("C6RUN_EMU_RPC_US")) != NULL)
+    rpcUs = atoi(s);
+  if ((s = getenv("C6RUN_EMU_LOAD_MS")) != NULL)
+    loadMs = atoi(s);
+  if (getenv("C6RUN_EMU_REPORT") != NULL)
+    atexit(report_at_exit);
+
+  if (pthread_create(&dspThread, NULL, dsp_fxn, NULL) != 0)
+  {
+    printf("c6run_emu: failed to start the DSP thread\n");
+    exit(1);
+  }
+  pthread_detach(dspThread);
+}
+
+
+/************************************************************
+* Global Function Definitions                               *
+************************************************************/
+
+void *C6RUN_MEM_malloc(size_t size)
+{
+  EmuBuf *b = malloc(sizeof(EmuBuf));
+
+  if (b == NULL)
+    return NULL;
+
+  // Both copies start out equal, as after a fresh allocation and flush
+  b->size   = size ? size : 1;
+  b->arm    = calloc(1, b->size);
+  b->shadow = calloc(1, b->size);
+  if (b->arm == NULL || b->shadow == NULL)
+  {
+    free(b->arm);
+    free(b->shadow);
+    free(b);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&bufLock);
+  b->next = bufList;
+  bufList = b;
+  pthread_mutex_unlock(&bufLock);
+
+  return b->arm;
+}
+
+void *C6RUN_MEM_calloc(size_t nmemb, size_t size)
+{
+  return C6RUN_MEM_malloc(nmemb * size);
+}
+
+void *C6RUN_MEM_realloc(void *ptr, size_t size)
+{
+  EmuBuf *b;
+  void   *p;
+  size_t  old;
+
+  if (ptr == NULL)
+    return C6RUN_MEM_malloc(size);
+
+  pthread_mutex_lock(&bufLock);
+  b = find_buf(ptr);
+  old = b ? b->size : 0;
+  pthread_mutex_unlock(&bufLock);
+  if (b == NULL)
+    return realloc(ptr, size);
+
+  if ((p = C6RUN_MEM_malloc(size)) != NULL)
+  {
+    memcpy(p, ptr, old < size ? old : size);
+    C6RUN_MEM_free(ptr);
+  }
+  return p;
+}
+
+// Pointers that did not come from here (libc internals) are passed on to free()
+void C6RUN_MEM_free(void *ptr)
+{
+  EmuBuf **pb, *b = NULL;
+
+  if (ptr == NULL)
+    return;
+
+  pthread_mutex_lock(&bufLock);
+  for (pb = &bufList; *pb != NULL; pb = &(*pb)->next)
+    if ((*pb)->arm == ptr)
+    {
+      b = *pb;
+      *pb = b->next;
+      break;
+    }
+  pthread_mutex_unlock(&bufLock);
+
+  if (b == NULL)
+  {
+    free(ptr);
+    return;
+  }
+  free(b->arm);
+  free(b->shadow);
+  free(b);
+}
+
+void C6RUN_CACHE_wb(void *ptr, size_t size)     { sync_range(ptr, size, 1); }
+void C6RUN_CACHE_inv(void *ptr, size_t size)    { sync_range(ptr, size, 0); }
+void C6RUN_CACHE_wbInv(void *ptr, size_t size)  { sync_range(ptr, size, 1); sync_range(ptr, size, 0); }
+void C6RUN_CACHE_globalWb( void )               { sync_all(1); }
+void C6RUN_CACHE_globalInv( void )              { sync_all(0); }
+void C6RUN_CACHE_globalWbInv( void )            { sync_all(1); sync_all(0); }
+
+// Translates an argument to the DSP's view, doing the INBUF writeback
+void *c6run_emu_arg(void *armPtr, int qualifier)
+{
+  EmuBuf *b;
+  void   *dspPtr;
+
+  if (armPtr == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&bufLock);
+  b = find_buf(armPtr);
+  dspPtr = b ? b->shadow + ((char *) armPtr - b->arm) : NULL;
+  pthread_mutex_unlock(&bufLock);
+
+  // The real stub gives up here (C6RUN_MEM_lookupBuffer failed); sharing the
+  // pointer keeps the program running, and the count flags it
+  if (dspPtr == NULL)
+  {
+    if (numStrays++ == 0)
+      printf("c6run_emu: pointer %p not from C6RUN_MEM_malloc, passed uncached\n", armPtr);
+    return armPtr;
+  }
+
+  if (qualifier & C6RUN_EMU_INBUF)
+    C6RUN_CACHE_wb(armPtr, (size_t) -1);
+  else if (qualifier & C6RUN_EMU_OUTBUF)
+    C6RUN_CACHE_wbInv(armPtr, (size_t) -1);
+
+  return dspPtr;
+}
+
+// The OUTBUF invalidate once the call has returned
+void c6run_emu_arg_done(void *armPtr, int qualifier)
+{
+  if (armPtr != NULL && (qualifier & C6RUN_EMU_OUTBUF))
+    C6RUN_CACHE_inv(armPtr, (size_t) -1);
+}
+
+// Runs fxn(args) on the DSP thread and waits for it, like C6RUN_RPC_dispatch
+void c6run_emu_dispatch(const char *name, void (*fxn)(void *), void *args)
+{
+  unsigned long long t0 = now_us();
+
+  pthread_once(&dspOnce, emu_init);
+
+  pthread_mutex_lock(&rpcLock);
+  while (rpcBusy)
+    pthread_cond_wait(&rpcCond, &rpcLock);
+  rpcBusy   = 1;
+  rpcFxn    = fxn;
+  rpcArgs   = args;
+  rpcDone   = 0;
+  rpcPosted = 1;
+  pthread_cond_broadcast(&rpcCond);
+
+  while (!rpcDone)
+    pthread_cond_wait(&rpcCond, &rpcLock);
+  rpcBusy = 0;
+  numCalls++;
+  callUs += now_us() - t0;
+  pthread_cond_broadcast(&rpcCond);
+  pthread_mutex_unlock(&rpcLock);
+}
+
+void c6run_emu_dsp_cache(void *ptr, size_t size)
+{
+}
+
+void c6run_emu_dsp_global_cache( void )
+{
+}
+
+void c6run_emu_report(FILE *fp)
+{
+  fprintf(fp, "c6run_emu: %lu calls, %.1f us/call (%.1f us on the DSP), "
+          "%llu bytes written back, %llu invalidated, %lu stray pointers\n",
+          numCalls, numCalls ? (double) callUs / numCalls : 0.0,
+          numCalls ? (double) dspUs / numCalls : 0.0, wbBytes, invBytes, numStrays);
+}
@@ -0,0 +1,79 @@
+/*
+ * c6run_emu.h
+ *
+ * Host emulation of the ARM-side C6Run runtime. A library built for the
+ * emulator keeps its DSP-side sources unchanged (compiled natively, every
+ * exported function renamed <name>_dsp), and a hand-written
+ * <lib>.emu_stub.c takes the place of the generated <lib>.gpp_stub.c:
+ * same functions, same arguments, but each call is dispatched to a
+ * worker thread that plays the DSP.
+ *
+ * Every C6RUN_MEM allocation has two copies: the one the ARM code uses
+ * (its "cache") and a shadow the DSP-side code works on ("memory").
+ * C6RUN_CACHE_wb copies ARM to shadow, C6RUN_CACHE_inv shadow to ARM and
+ * C6RUN_CACHE_wbInv does both in that order, so a missing cache operation
+ * shows up as stale data on the host just as it would on the DM3730, only
+ * every time instead of now and then.
+ *
+ * Environment:
+ *   C6RUN_EMU_RPC_US   added to every call (default 0)
+ *   C6RUN_EMU_LOAD_MS  added to the first call, for loading the DSP (default 0)
+ *   C6RUN_EMU_REPORT   if set, print call and copy statistics at exit
+ */
+
+#ifndef _C6RUN_EMU_H_
+#define _C6RUN_EMU_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Prevent C++ name mangling
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************
+* Global Macro Declarations                                *
+***********************************************************/
+
+// Argument qualifiers, as in the C6Run front end
+#define C6RUN_EMU_NONE    (0)   // Translated only; cache is the caller's job
+#define C6RUN_EMU_INBUF   (1)   // Written back before the call
+#define C6RUN_EMU_OUTBUF  (2)   // Invalidated after the call
+#define C6RUN_EMU_INOUT   (C6RUN_EMU_INBUF | C6RUN_EMU_OUTBUF)   // Unqualified pointers
+
+
+/***********************************************************
+* Global Function Declarations                             *
+***********************************************************/
+
+// ARM-side runtime calls, as provided by a C6Run library
+extern void    *C6RUN_MEM_malloc(size_t size);
+extern void    *C6RUN_MEM_calloc(size_t nmemb, size_t size);
+extern void    *C6RUN_MEM_realloc(void *ptr, size_t size);
+extern void     C6RUN_MEM_free(void *ptr);
+
+extern void     C6RUN_CACHE_globalInv( void );
+extern void     C6RUN_CACHE_globalWb( void );
+extern void     C6RUN_CACHE_globalWbInv( void );
+extern void     C6RUN_CACHE_inv(void *ptr,size_t size);
+extern void     C6RUN_CACHE_wb(void *ptr,size_t size);
+extern void     C6RUN_CACHE_wbInv(void *ptr,size_t size);
+
+// Used by the emu stubs
+extern void    *c6run_emu_arg(void *armPtr, int qualifier);
+extern void     c6run_emu_arg_done(void *armPtr, int qualifier);
+extern void     c6run_emu_dispatch(const char *name, void (*fxn)(void *), void *args);
+
+// DSP-side cache calls are no-ops: the DSP works on the shadow directly
+extern void     c6run_emu_dsp_cache(void *ptr, size_t size);
+extern void     c6run_emu_dsp_global_cache( void );
+
+extern void     c6run_emu_report(FILE *fp);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_C6RUN_EMU_H_
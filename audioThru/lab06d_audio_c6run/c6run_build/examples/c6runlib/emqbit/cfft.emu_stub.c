@@ -0,0 +1,59 @@
+/*
+ * cfft.emu_stub.c
+ *
+ * Host stand-in for the generated cfft.gpp_stub.c; see
+ * c6run_build/emu/c6run_emu.h. in is an unqualified pointer, so it is
+ * written back before fft_exec and invalidated after it.
+ */
+
+#include "c6run_emu.h"
+#include "cfft.h"
+
+// The DSP-side functions, renamed when built for emulation
+extern void fft_init_dsp (int N);
+extern void fft_end_dsp (void);
+extern void fft_exec_dsp (int N, complex * in);
+
+typedef struct
+{
+  int N;
+  complex *in;
+} fft_args;
+
+static void fft_init_call (void *p)
+{
+  fft_init_dsp (((fft_args *) p)->N);
+}
+
+static void fft_end_call (void *p)
+{
+  fft_end_dsp ();
+}
+
+static void fft_exec_call (void *p)
+{
+  fft_exec_dsp (((fft_args *) p)->N, ((fft_args *) p)->in);
+}
+
+void fft_init (int N)
+{
+  fft_args a;
+
+  a.N = N;
+  c6run_emu_dispatch ("fft_init", fft_init_call, &a);
+}
+
+void fft_end ()
+{
+  c6run_emu_dispatch ("fft_end", fft_end_call, NULL);
+}
+
+void fft_exec (int N, complex * in)
+{
+  fft_args a;
+
+  a.N = N;
+  a.in = c6run_emu_arg (in, C6RUN_EMU_INOUT);
+  c6run_emu_dispatch ("fft_exec", fft_exec_call, &a);
+  c6run_emu_arg_done (in, C6RUN_EMU_INOUT);
+}
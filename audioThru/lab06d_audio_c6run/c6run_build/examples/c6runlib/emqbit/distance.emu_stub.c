@@ -0,0 +1,58 @@
+/*
+ * distance.emu_stub.c
+ *
+ * Host stand-in for the generated distance.gpp_stub.c; see
+ * c6run_build/emu/c6run_emu.h.
+ */
+
+#include "c6run_emu.h"
+#include "distance.h"
+
+// The DSP-side functions, renamed when built for emulation
+extern float dot_c_dsp (float *v1, float *v2, int N);
+extern float distance_c_dsp (float *v1, float *v2, int N);
+
+typedef struct
+{
+  float *v1;
+  float *v2;
+  int N;
+  float ret;
+} distance_args;
+
+static void dot_c_call (void *p)
+{
+  distance_args *a = p;
+
+  a->ret = dot_c_dsp (a->v1, a->v2, a->N);
+}
+
+static void distance_c_call (void *p)
+{
+  distance_args *a = p;
+
+  a->ret = distance_c_dsp (a->v1, a->v2, a->N);
+}
+
+static float call (const char *name, void (*fxn) (void *), float *v1, float *v2, int N)
+{
+  distance_args a;
+
+  a.v1 = c6run_emu_arg (v1, C6RUN_EMU_INOUT);
+  a.v2 = c6run_emu_arg (v2, C6RUN_EMU_INOUT);
+  a.N = N;
+  c6run_emu_dispatch (name, fxn, &a);
+  c6run_emu_arg_done (v1, C6RUN_EMU_INOUT);
+  c6run_emu_arg_done (v2, C6RUN_EMU_INOUT);
+  return a.ret;
+}
+
+float dot_c (float *v1, float *v2, int N)
+{
+  return call ("dot_c", dot_c_call, v1, v2, N);
+}
+
+float distance_c (float *v1, float *v2, int N)
+{
+  return call ("distance_c", distance_c_call, v1, v2, N);
+}
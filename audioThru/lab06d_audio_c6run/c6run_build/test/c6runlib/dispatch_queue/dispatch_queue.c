@@ -0,0 +1,112 @@
+/*
+ * dispatch_queue.c
+ *
+ * DSP side of the dispatch queue. The operations are the scalar_args and
+ * arg_cnts test functions, linked into the same library, so a batched
+ * call does exactly what the direct RPC of the same function does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scalar_args.h"
+#include "arg_cnts.h"
+#include "dispatch_queue.h"
+
+/************************************************************
+* Explicit External Declarations                            *
+************************************************************/
+
+
+/************************************************************
+* Local Macro Declarations                                  *
+************************************************************/
+
+
+/************************************************************
+* Local Typedef Declarations                                *
+************************************************************/
+
+
+/************************************************************
+* Local Function Declarations                               *
+************************************************************/
+
+static int32_t LOCAL_argCnt(const DQ_Call *call);
+
+
+/************************************************************
+* Local Variable Definitions                                *
+************************************************************/
+
+
+/************************************************************
+* Global Variable Definitions                               *
+************************************************************/
+
+
+/************************************************************
+* Global Function Definitions                               *
+************************************************************/
+
+int dispatch_queue_run(DQ_Call *calls, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    DQ_Call *call = &calls[i];
+
+    switch (call->op)
+    {
+      case DQ_OP_SCALAR_ARG_I:
+        call->result = scalar_arg_i(call->args[0]);
+        break;
+      case DQ_OP_SCALAR_ARG_UI:
+        call->result = (int32_t) scalar_arg_ui((unsigned int) call->args[0]);
+        break;
+      case DQ_OP_ARG_CNT:
+        call->result = LOCAL_argCnt(call);
+        break;
+      default:
+        call->result = DQ_BAD_CALL;
+        break;
+    }
+  }
+
+  return count;
+}
+
+
+/***********************************************************
+* Local Function Definitions                               *
+***********************************************************/
+
+static int32_t LOCAL_argCnt(const DQ_Call *call)
+{
+  const int32_t *a = call->args;
+
+  switch (call->nargs)
+  {
+    case 0:  return arg_cnt_0();
+    case 1:  return arg_cnt_1(a[0]);
+    case 2:  return arg_cnt_2(a[0], a[1]);
+    case 3:  return arg_cnt_3(a[0], a[1], a[2]);
+    case 4:  return arg_cnt_4(a[0], a[1], a[2], a[3]);
+    case 5:  return arg_cnt_5(a[0], a[1], a[2], a[3], a[4]);
+    case 6:  return arg_cnt_6(a[0], a[1], a[2], a[3], a[4], a[5]);
+    case 7:  return arg_cnt_7(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+    case 8:  return arg_cnt_8(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+    case 9:  return arg_cnt_9(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+    case 10: return arg_cnt_10(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]);
+    case 11: return arg_cnt_11(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10]);
+    case 12: return arg_cnt_12(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11]);
+    case 13: return arg_cnt_13(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12]);
+    default: return DQ_BAD_CALL;
+  }
+}
+
+
+/***********************************************************
+* End file                                                 *
+***********************************************************/
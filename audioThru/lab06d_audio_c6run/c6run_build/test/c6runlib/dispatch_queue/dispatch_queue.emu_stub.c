@@ -0,0 +1,103 @@
+/*
+ * dispatch_queue.emu_stub.c
+ *
+ * Host stand-in for the generated gpp stubs of the functions main.c and
+ * dispatcher.c call on the DSP (see c6run_build/emu/c6run_emu.h). The
+ * batch is an unqualified pointer, so in/out, as the C6Run front end
+ * treats it.
+ */
+
+#include "c6run_emu.h"
+#include "scalar_args.h"
+#include "arg_cnts.h"
+#include "dispatch_queue.h"
+
+/************************************************************
+* Explicit External Declarations                            *
+************************************************************/
+
+// The DSP-side functions, renamed when built for emulation
+extern int dispatch_queue_run_dsp(DQ_Call *calls, int count);
+extern int scalar_arg_i_dsp(int arg);
+extern int arg_cnt_4_dsp(int arg1, int arg2, int arg3, int arg4);
+
+
+/************************************************************
+* Local Typedef Declarations                                *
+************************************************************/
+
+typedef struct _EmuArgs_
+{
+  DQ_Call  *calls;
+  int       a[4];
+  int       ret;
+}
+EmuArgs;
+
+
+/***********************************************************
+* Local Function Definitions                               *
+***********************************************************/
+
+static void dispatch_queue_run_call(void *p)
+{
+  EmuArgs *e = p;
+
+  e->ret = dispatch_queue_run_dsp(e->calls, e->a[0]);
+}
+
+static void scalar_arg_i_call(void *p)
+{
+  EmuArgs *e = p;
+
+  e->ret = scalar_arg_i_dsp(e->a[0]);
+}
+
+static void arg_cnt_4_call(void *p)
+{
+  EmuArgs *e = p;
+
+  e->ret = arg_cnt_4_dsp(e->a[0], e->a[1], e->a[2], e->a[3]);
+}
+
+
+/************************************************************
+* Global Function Definitions                               *
+************************************************************/
+
+int dispatch_queue_run(DQ_Call *calls, int count)
+{
+  EmuArgs e;
+
+  e.calls = c6run_emu_arg(calls, C6RUN_EMU_INOUT);
+  e.a[0]  = count;
+  c6run_emu_dispatch("dispatch_queue_run", dispatch_queue_run_call, &e);
+  c6run_emu_arg_done(calls, C6RUN_EMU_INOUT);
+  return e.ret;
+}
+
+int scalar_arg_i(int arg)
+{
+  EmuArgs e;
+
+  e.a[0] = arg;
+  c6run_emu_dispatch("scalar_arg_i", scalar_arg_i_call, &e);
+  return e.ret;
+}
+
+int arg_cnt_4(int arg1, int arg2, int arg3, int arg4)
+{
+  EmuArgs e;
+
+  e.a[0] = arg1;
+  e.a[1] = arg2;
+  e.a[2] = arg3;
+  e.a[3] = arg4;
+  c6run_emu_dispatch("arg_cnt_4", arg_cnt_4_call, &e);
+  return e.ret;
+}
+
+
+/***********************************************************
+* End file                                                 *
+***********************************************************/
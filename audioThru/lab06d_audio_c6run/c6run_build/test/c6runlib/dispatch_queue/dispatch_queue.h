@@ -0,0 +1,67 @@
+/*
+ * dispatch_queue.h
+ *
+ * Shared by both sides: the layout of one queued call and the DSP-side
+ * entry point that runs a batch of them. A batch is an array of DQ_Call
+ * in one C6RUN_MEM buffer, so it crosses to the DSP as a single cache
+ * write-back and a single RPC however many calls it holds.
+ */
+
+#ifndef _DISPATCH_QUEUE_H_
+#define _DISPATCH_QUEUE_H_
+
+#include <stdint.h>
+
+// Prevent C++ name mangling
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************
+* Global Macro Declarations                                *
+***********************************************************/
+
+#define DQ_MAX_ARGS (13)
+
+// Operations the DSP side knows how to run
+#define DQ_OP_SCALAR_ARG_I    (0)   // scalar_arg_i(args[0])
+#define DQ_OP_SCALAR_ARG_UI   (1)   // scalar_arg_ui(args[0])
+#define DQ_OP_ARG_CNT         (2)   // arg_cnt_<nargs>(args[0..nargs-1])
+#define DQ_OP_CNT             (3)
+
+// Result of a call the DSP side did not recognise
+#define DQ_BAD_CALL           (INT32_MIN)
+
+
+/***********************************************************
+* Global Typedef Declarations                              *
+***********************************************************/
+
+// 64 bytes, so a batch of them is whole cache lines on both cores
+typedef struct _DQ_Call_
+{
+  int32_t op;
+  int32_t nargs;
+  int32_t args[DQ_MAX_ARGS];
+  int32_t result;
+}
+DQ_Call;
+
+
+/***********************************************************
+* Global Function Declarations                             *
+***********************************************************/
+
+// Runs calls[0..count-1] in order, filling in each result; returns count
+extern int dispatch_queue_run(DQ_Call *calls, int count);
+
+
+/***********************************************************
+* End file                                                 *
+***********************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_DISPATCH_QUEUE_H_
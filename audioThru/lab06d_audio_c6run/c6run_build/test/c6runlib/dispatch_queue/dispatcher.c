@@ -0,0 +1,273 @@
+/*
+ * dispatcher.c
+ *
+ * Futures are chained through their own next pointers, so the queue
+ * needs no storage of its own. Calls are copied into the batch buffer
+ * under the lock; the RPC itself runs unlocked so callers can keep
+ * queueing the next batch while this one is on the DSP. Every waiter
+ * sleeps on the one condition, broadcast once per batch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "dispatcher.h"
+
+/************************************************************
+* Explicit External Declarations                            *
+************************************************************/
+
+#if defined(DSP_IN_USE)
+  extern void *C6RUN_MEM_malloc(size_t size);
+  extern void C6RUN_MEM_free(void *ptr);
+#endif
+
+
+/************************************************************
+* Local Macro Declarations                                  *
+************************************************************/
+
+
+/************************************************************
+* Local Typedef Declarations                                *
+************************************************************/
+
+
+/************************************************************
+* Local Function Declarations                               *
+************************************************************/
+
+static void *LOCAL_dispatchThread(void *arg);
+
+
+/************************************************************
+* Local Variable Definitions                                *
+************************************************************/
+
+static pthread_mutex_t   LOCAL_lock      = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    LOCAL_pending   = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t    LOCAL_completed = PTHREAD_COND_INITIALIZER;
+
+static DISPATCH_Future  *LOCAL_head, *LOCAL_tail;
+static DQ_Call          *LOCAL_batch;
+static int               LOCAL_batchMax;
+static int               LOCAL_stop;
+static int               LOCAL_running = 0;
+static pthread_t         LOCAL_thread;
+
+// Statistics
+static unsigned long     LOCAL_rpcs, LOCAL_calls, LOCAL_largest;
+static unsigned long     LOCAL_sizes[DISPATCH_BATCH_MAX + 1];
+
+
+/************************************************************
+* Global Variable Definitions                               *
+************************************************************/
+
+
+/************************************************************
+* Global Function Definitions                               *
+************************************************************/
+
+int DISPATCH_init(int batchMax)
+{
+  if (batchMax < 1 || batchMax > DISPATCH_BATCH_MAX)
+  {
+    fprintf(stderr, "Batch limit must be 1..%d\n", DISPATCH_BATCH_MAX);
+    return -1;
+  }
+
+#if defined(DSP_IN_USE)
+  // Must be dynamic using C6RUN APIs in order to give to the DSP
+  LOCAL_batch = (DQ_Call *) C6RUN_MEM_malloc(batchMax * sizeof(DQ_Call));
+#else
+  LOCAL_batch = (DQ_Call *) malloc(batchMax * sizeof(DQ_Call));
+#endif
+  if (LOCAL_batch == NULL)
+  {
+    fprintf(stderr, "Failed to allocate the %d call batch buffer\n", batchMax);
+    return -1;
+  }
+
+  LOCAL_batchMax = batchMax;
+  LOCAL_head     = LOCAL_tail = NULL;
+  LOCAL_stop     = 0;
+  LOCAL_rpcs     = LOCAL_calls = LOCAL_largest = 0;
+  memset(LOCAL_sizes, 0, sizeof(LOCAL_sizes));
+
+  if (pthread_create(&LOCAL_thread, NULL, LOCAL_dispatchThread, NULL) != 0)
+  {
+    fprintf(stderr, "Failed to create the dispatcher thread\n");
+    DISPATCH_shutdown();
+    return -1;
+  }
+  LOCAL_running = 1;
+
+  return 0;
+}
+
+void DISPATCH_shutdown(void)
+{
+  // Whatever is still queued is run before the thread exits
+  if (LOCAL_running)
+  {
+    pthread_mutex_lock(&LOCAL_lock);
+    LOCAL_stop = 1;
+    pthread_cond_signal(&LOCAL_pending);
+    pthread_mutex_unlock(&LOCAL_lock);
+    pthread_join(LOCAL_thread, NULL);
+    LOCAL_running = 0;
+  }
+
+#if defined(DSP_IN_USE)
+  C6RUN_MEM_free(LOCAL_batch);
+#else
+  free(LOCAL_batch);
+#endif
+  LOCAL_batch = NULL;
+}
+
+int DISPATCH_submit(DISPATCH_Future *f, int32_t op, int32_t nargs, const int32_t *args)
+{
+  f->call.op     = op;
+  f->call.result = 0;
+  f->next        = NULL;
+
+  // A call that does not fit is never queued; its future is already done
+  if (nargs < 0 || nargs > DQ_MAX_ARGS)
+  {
+    fprintf(stderr, "DISPATCH_submit: %d arguments, at most %d\n", (int) nargs, DQ_MAX_ARGS);
+    f->call.nargs  = 0;
+    f->call.result = -1;
+    f->done        = 1;
+    return -1;
+  }
+
+  f->call.nargs = nargs;
+  if (nargs > 0)
+  {
+    memcpy(f->call.args, args, nargs * sizeof(int32_t));
+  }
+  f->done = 0;
+
+  pthread_mutex_lock(&LOCAL_lock);
+  if (LOCAL_tail == NULL)
+  {
+    LOCAL_head = f;
+    pthread_cond_signal(&LOCAL_pending);
+  }
+  else
+  {
+    LOCAL_tail->next = f;
+  }
+  LOCAL_tail = f;
+  pthread_mutex_unlock(&LOCAL_lock);
+
+  return 0;
+}
+
+int32_t DISPATCH_wait(DISPATCH_Future *f)
+{
+  pthread_mutex_lock(&LOCAL_lock);
+  while (!f->done)
+  {
+    pthread_cond_wait(&LOCAL_completed, &LOCAL_lock);
+  }
+  pthread_mutex_unlock(&LOCAL_lock);
+
+  return f->call.result;
+}
+
+int32_t DISPATCH_call(int32_t op, int32_t nargs, const int32_t *args)
+{
+  DISPATCH_Future f;
+
+  DISPATCH_submit(&f, op, nargs, args);
+  return DISPATCH_wait(&f);
+}
+
+void DISPATCH_report(FILE *fp)
+{
+  int i;
+
+  pthread_mutex_lock(&LOCAL_lock);
+  fprintf(fp, "Dispatcher: %lu calls in %lu RPCs, %.2f calls per RPC, largest batch %lu\n",
+          LOCAL_calls, LOCAL_rpcs,
+          LOCAL_rpcs ? (double) LOCAL_calls / LOCAL_rpcs : 0.0, LOCAL_largest);
+  fprintf(fp, "  batch size:");
+  for (i = 1; i <= LOCAL_batchMax; i++)
+  {
+    if (LOCAL_sizes[i])
+    {
+      fprintf(fp, " %d:%lu", i, LOCAL_sizes[i]);
+    }
+  }
+  fprintf(fp, "\n");
+  pthread_mutex_unlock(&LOCAL_lock);
+}
+
+
+/***********************************************************
+* Local Function Definitions                               *
+***********************************************************/
+
+static void *LOCAL_dispatchThread(void *arg)
+{
+  DISPATCH_Future *taken[DISPATCH_BATCH_MAX];
+  int i, n;
+
+  pthread_mutex_lock(&LOCAL_lock);
+  for (;;)
+  {
+    while (LOCAL_head == NULL && !LOCAL_stop)
+    {
+      pthread_cond_wait(&LOCAL_pending, &LOCAL_lock);
+    }
+    if (LOCAL_head == NULL)
+    {
+      break;
+    }
+
+    // Take everything queued, oldest first, up to the batch limit
+    for (n = 0; LOCAL_head != NULL && n < LOCAL_batchMax; n++)
+    {
+      taken[n] = LOCAL_head;
+      LOCAL_batch[n] = LOCAL_head->call;
+      LOCAL_head = LOCAL_head->next;
+    }
+    if (LOCAL_head == NULL)
+    {
+      LOCAL_tail = NULL;
+    }
+    pthread_mutex_unlock(&LOCAL_lock);
+
+    // One transfer, one RPC; the calls run in order on the DSP
+    dispatch_queue_run(LOCAL_batch, n);
+
+    pthread_mutex_lock(&LOCAL_lock);
+    for (i = 0; i < n; i++)
+    {
+      taken[i]->call.result = LOCAL_batch[i].result;
+      taken[i]->done = 1;
+    }
+    LOCAL_rpcs++;
+    LOCAL_calls += n;
+    LOCAL_sizes[n]++;
+    if (n > LOCAL_largest)
+    {
+      LOCAL_largest = n;
+    }
+    pthread_cond_broadcast(&LOCAL_completed);
+  }
+  pthread_mutex_unlock(&LOCAL_lock);
+
+  return NULL;
+}
+
+
+/***********************************************************
+* End file                                                 *
+***********************************************************/
@@ -0,0 +1,74 @@
+/*
+ * dispatcher.h
+ *
+ * ARM side of the dispatch queue. Any number of threads submit calls;
+ * one dispatcher thread takes everything queued (up to the batch limit)
+ * each time the DSP is free, runs it as one dispatch_queue_run() RPC and
+ * completes the callers' futures. Nothing waits to fill a batch: a lone
+ * caller costs one RPC as before, and batches grow by themselves while
+ * calls arrive faster than the DSP link can turn them around.
+ */
+
+#ifndef _DISPATCHER_H_
+#define _DISPATCHER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "dispatch_queue.h"
+
+// Prevent C++ name mangling
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************
+* Global Macro Declarations                                *
+***********************************************************/
+
+#define DISPATCH_BATCH_MAX  (256)
+
+
+/***********************************************************
+* Global Typedef Declarations                              *
+***********************************************************/
+
+// Caller-owned; must stay put until DISPATCH_wait() returns
+typedef struct _DISPATCH_Future_
+{
+  DQ_Call                     call;
+  volatile int                done;
+  struct _DISPATCH_Future_   *next;
+}
+DISPATCH_Future;
+
+
+/***********************************************************
+* Global Function Declarations                             *
+***********************************************************/
+
+// Returns 0, or -1 if the batch buffer or the thread cannot be created
+extern int      DISPATCH_init(int batchMax);
+extern void     DISPATCH_shutdown(void);
+
+// Queues a call; calls run on the DSP in the order they were submitted.
+// Returns -1 for more than DQ_MAX_ARGS arguments: nothing is queued and
+// the future completes at once with a result of -1.
+extern int      DISPATCH_submit(DISPATCH_Future *f, int32_t op, int32_t nargs, const int32_t *args);
+extern int32_t  DISPATCH_wait(DISPATCH_Future *f);
+
+// Submit and wait
+extern int32_t  DISPATCH_call(int32_t op, int32_t nargs, const int32_t *args);
+
+extern void     DISPATCH_report(FILE *fp);
+
+
+/***********************************************************
+* End file                                                 *
+***********************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_DISPATCHER_H_
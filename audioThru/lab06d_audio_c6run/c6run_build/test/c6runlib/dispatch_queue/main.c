@@ -0,0 +1,282 @@
+/*
+ * main.c
+ *
+ * Several threads make small DSP calls (scalar_arg_i and arg_cnt_4),
+ * first as direct RPCs, which serialise on the link one at a time, then
+ * through the dispatch queue, which batches whatever is waiting into a
+ * single RPC. Prints calls per second for both and checks every result,
+ * including that calls ran in the order they were submitted.
+ *
+ * Usage: dispatch_queue_<arm|dsp> [threads [calls [window [batch]]]]
+ *   threads  client threads (default 4)
+ *   calls    calls per thread (default 2000)
+ *   window   calls a thread keeps in flight on the queue (default 8)
+ *   batch    most calls per RPC (default 64)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/time.h>
+#include <pthread.h>
+
+#include "scalar_args.h"
+#include "arg_cnts.h"
+#include "dispatch_queue.h"
+#include "dispatcher.h"
+
+/************************************************************
+* Explicit External Declarations                            *
+************************************************************/
+
+#if defined(DSP_IN_USE)
+  extern int C6RUN_libInit(void);
+#endif
+
+
+/************************************************************
+* Local Macro Declarations                                  *
+************************************************************/
+
+#define MAX_THREADS (32)
+#define MAX_WINDOW  (64)
+#define PASS (0xAA5511EE)
+
+
+/************************************************************
+* Local Typedef Declarations                                *
+************************************************************/
+
+typedef struct _ThreadArgs_
+{
+  int32_t   id;
+  int       queued;
+  int       errors;
+}
+ThreadArgs;
+
+
+/************************************************************
+* Local Function Declarations                               *
+************************************************************/
+
+static void   *threadfunc(void *pArgs);
+static double  runPhase(int queued, int *errors);
+static void    buildCall(ThreadArgs *t, int32_t i, DQ_Call *call);
+static int     checkCall(ThreadArgs *t, int32_t i, const DQ_Call *call, int32_t *lastSum);
+
+
+/************************************************************
+* Local Variable Definitions                                *
+************************************************************/
+
+static int numThreads = 4;
+static int numCalls   = 2000;
+static int window     = 8;
+
+// Direct calls go one at a time, as they do on the DSP link. Built for
+// the ARM alone, scalar_arg_i's running sum would otherwise race.
+static pthread_mutex_t directLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/************************************************************
+* Global Variable Definitions                               *
+************************************************************/
+
+
+/************************************************************
+* Global Function Definitions                               *
+************************************************************/
+
+int main (int argc, char *argv[])
+{
+  int     batchMax = 64;
+  int     errors = 0;
+  double  direct, queued;
+
+  if (argc > 1) numThreads = atoi(argv[1]);
+  if (argc > 2) numCalls   = atoi(argv[2]);
+  if (argc > 3) window     = atoi(argv[3]);
+  if (argc > 4) batchMax   = atoi(argv[4]);
+
+  if (numThreads < 1 || numThreads > MAX_THREADS || numCalls < 1 ||
+      window < 1 || window > MAX_WINDOW)
+  {
+    fprintf(stderr, "Usage: %s [threads(1..%d) [calls [window(1..%d) [batch]]]]\n",
+            argv[0], MAX_THREADS, MAX_WINDOW);
+    exit(1);
+  }
+
+#if defined(DSP_IN_USE)
+  C6RUN_libInit();
+#endif
+
+  if (DISPATCH_init(batchMax) != 0)
+  {
+    exit(1);
+  }
+
+  // First call loads the DSP; keep it out of the timing
+  scalar_arg_i(0);
+
+  direct = runPhase(0, &errors);
+  queued = runPhase(1, &errors);
+
+  printf("%d threads x %d calls, window %d, batch limit %d\n",
+         numThreads, numCalls, window, batchMax);
+  printf("  direct RPC:     %10.0f calls/s\n", direct);
+  printf("  dispatch queue: %10.0f calls/s  (%.2fx)\n", queued, queued / direct);
+  DISPATCH_report(stdout);
+
+  DISPATCH_shutdown();
+
+  if (errors)
+  {
+    printf("---->%d wrong results.\n", errors);
+    exit(1);
+  }
+  printf("---->All results correct.\n");
+
+  return 0;
+}
+
+
+/***********************************************************
+* Local Function Definitions                               *
+***********************************************************/
+
+// Runs every thread through one phase; returns calls per second
+static double runPhase(int queued, int *errors)
+{
+  pthread_t       thread[MAX_THREADS];
+  ThreadArgs      args[MAX_THREADS];
+  struct timeval  start, end;
+  int32_t         before, after, expected;
+  void           *status;
+  double          secs;
+  int             i;
+
+  // scalar_arg_i keeps a running sum; each thread adds 1 per scalar call
+  before = queued ? DISPATCH_call(DQ_OP_SCALAR_ARG_I, 1, &(int32_t){0}) : scalar_arg_i(0);
+
+  gettimeofday(&start, NULL);
+  for (i = 0; i < numThreads; i++)
+  {
+    args[i].id     = i;
+    args[i].queued = queued;
+    args[i].errors = 0;
+    pthread_create(&thread[i], NULL, threadfunc, &args[i]);
+  }
+  for (i = 0; i < numThreads; i++)
+  {
+    pthread_join(thread[i], &status);
+    if ((uint32_t) (uintptr_t) status != PASS)
+    {
+      printf("---->Thread %d failed.\n", i);
+    }
+    *errors += args[i].errors;
+  }
+  gettimeofday(&end, NULL);
+
+  after    = queued ? DISPATCH_call(DQ_OP_SCALAR_ARG_I, 1, &(int32_t){0}) : scalar_arg_i(0);
+  expected = numThreads * ((numCalls + 1) / 2);
+  if (after - before != expected)
+  {
+    printf("---->%s: running sum moved by %d, expected %d\n",
+           queued ? "queued" : "direct", after - before, expected);
+    (*errors)++;
+  }
+
+  secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+  return numThreads * numCalls / secs;
+}
+
+// Even calls add 1 to the running sum, odd calls are arg_cnt_4
+static void buildCall(ThreadArgs *t, int32_t i, DQ_Call *call)
+{
+  if ((i & 1) == 0)
+  {
+    call->op      = DQ_OP_SCALAR_ARG_I;
+    call->nargs   = 1;
+    call->args[0] = 1;
+  }
+  else
+  {
+    call->op      = DQ_OP_ARG_CNT;
+    call->nargs   = 4;
+    call->args[0] = t->id;
+    call->args[1] = i;
+    call->args[2] = i * 3;
+    call->args[3] = 1000;
+  }
+}
+
+// The running sum only grows, so a thread must see it increase call by call
+static int checkCall(ThreadArgs *t, int32_t i, const DQ_Call *call, int32_t *lastSum)
+{
+  if (call->op == DQ_OP_SCALAR_ARG_I)
+  {
+    if (call->result <= *lastSum)
+    {
+      return 1;
+    }
+    *lastSum = call->result;
+    return 0;
+  }
+
+  return call->result != t->id + i + i * 3 + 1000;
+}
+
+static void *threadfunc(void *pArgs)
+{
+  ThreadArgs      *t = (ThreadArgs *) pArgs;
+  DISPATCH_Future  f[MAX_WINDOW];
+  DQ_Call          call;
+  int32_t          lastSum = INT32_MIN;
+  int32_t          i, j, n;
+
+  for (i = 0; i < numCalls; i += n)
+  {
+    n = numCalls - i < window ? numCalls - i : window;
+
+    if (!t->queued)
+    {
+      // One RPC per call
+      n = 1;
+      buildCall(t, i, &call);
+      pthread_mutex_lock(&directLock);
+      if (call.op == DQ_OP_SCALAR_ARG_I)
+      {
+        call.result = scalar_arg_i(call.args[0]);
+      }
+      else
+      {
+        call.result = arg_cnt_4(call.args[0], call.args[1], call.args[2], call.args[3]);
+      }
+      pthread_mutex_unlock(&directLock);
+      t->errors += checkCall(t, i, &call, &lastSum);
+      continue;
+    }
+
+    // Keep a window of calls in flight, then collect them in order
+    for (j = 0; j < n; j++)
+    {
+      buildCall(t, i + j, &call);
+      DISPATCH_submit(&f[j], call.op, call.nargs, call.args);
+    }
+    for (j = 0; j < n; j++)
+    {
+      DISPATCH_wait(&f[j]);
+      t->errors += checkCall(t, i + j, &f[j].call, &lastSum);
+    }
+  }
+
+  return ((void *)PASS);
+}
+
+
+/***********************************************************
+* End file                                                 *
+***********************************************************/
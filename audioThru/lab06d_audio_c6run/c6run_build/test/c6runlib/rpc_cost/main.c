@@ -0,0 +1,388 @@
+/*
+ * main.c
+ *
+ * Round-trip latency of one DSP call for each argument shape: 0 to 13
+ * int arguments, wide and typedef'd scalars, a struct by pointer, and
+ * byte vectors from 16 B to 1 MB passed in, out and both ways. Prints
+ * the latency distribution of every shape, then a cost model fitted to
+ * the medians:
+ *
+ *   call  =  base us  +  per-argument us * ints  +  ns/byte * bytes
+ *
+ * A function is worth offloading when the time it saves on the ARM is
+ * well above that. Built as rpc_cost_emu (make emu_exec) the calls go
+ * through the host loopback in c6run_build/emu, which times the
+ * marshalling itself on any Linux box.
+ *
+ * Usage: rpc_cost_<arm|dsp|emu> [calls per shape (default 2000)]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <time.h>
+
+#include "arg_cnts.h"
+#include "rpc_cost.h"
+
+/************************************************************
+* Explicit External Declarations                            *
+************************************************************/
+
+#if defined(DSP_IN_USE)
+  extern void *C6RUN_MEM_malloc(size_t size);
+  extern void C6RUN_MEM_free(void *ptr);
+#endif
+
+
+/************************************************************
+* Local Macro Declarations                                  *
+************************************************************/
+
+#define MAX_VECTOR   (1024 * 1024)
+#define VECTOR_SIZES (6)
+
+// Big vectors get fewer calls: no more than this many bytes per shape
+#define BYTES_PER_SHAPE (64 * 1024 * 1024)
+#define MIN_CALLS       (20)
+
+
+/************************************************************
+* Local Typedef Declarations                                *
+************************************************************/
+
+typedef enum _ShapeKind_
+{
+  SHAPE_INTS,       // arg = number of int arguments
+  SHAPE_SCALAR,     // wide, typedef'd and struct arguments
+  SHAPE_IN,         // arg = bytes
+  SHAPE_OUT,
+  SHAPE_INOUT
+}
+ShapeKind;
+
+typedef struct _Shape_
+{
+  const char  *name;
+  ShapeKind    kind;
+  int32_t      arg;
+  int32_t    (*call)(struct _Shape_ *s);
+  uint8_t     *buf;       // Vector shapes: a C6RUN_MEM buffer of arg bytes
+  double       median;    // us, filled in by timeShape()
+}
+Shape;
+
+
+/************************************************************
+* Local Function Declarations                               *
+************************************************************/
+
+static uint64_t  now_ns(void);
+static int       cmp_u64(const void *a, const void *b);
+static void      timeShape(Shape *s, int calls, uint64_t *samples);
+static void      fitLine(Shape *shapes, int n, ShapeKind kind, double *base, double *slope);
+
+static int32_t   call_ints(Shape *s);
+static int32_t   call_ll(Shape *s);
+static int32_t   call_d(Shape *s);
+static int32_t   call_typedef(Shape *s);
+static int32_t   call_struct(Shape *s);
+static int32_t   call_in(Shape *s);
+static int32_t   call_out(Shape *s);
+static int32_t   call_inout(Shape *s);
+
+
+/************************************************************
+* Local Variable Definitions                                *
+************************************************************/
+
+static uint8_t          *vectors[VECTOR_SIZES];
+static RPC_CostParams   *params;
+static int               errors = 0;
+
+static const int32_t vectorSizes[VECTOR_SIZES] =
+  { 16, 256, 4096, 65536, 262144, MAX_VECTOR };
+
+
+/************************************************************
+* Global Variable Definitions                               *
+************************************************************/
+
+
+/************************************************************
+* Global Function Definitions                               *
+************************************************************/
+
+int main (int argc, char *argv[])
+{
+  static const int32_t intCounts[] = { 0, 1, 2, 4, 8, 13 };
+  Shape     shapes[64];
+  uint64_t *samples;
+  int       calls = (argc > 1) ? atoi(argv[1]) : 2000;
+  int       n = 0, i, k;
+  double    base, perInt, inBase, inNs, outBase, outNs, ioBase, ioNs;
+  char      name[32];
+
+  if (calls < MIN_CALLS)
+  {
+    calls = MIN_CALLS;
+  }
+
+  // Each size gets its own buffer: cache operations cover the whole
+  // allocation, so one big shared buffer would make every call cost 1 MB
+  for (i = 0; i < VECTOR_SIZES; i++)
+  {
+#if defined(DSP_IN_USE)
+    // Must be dynamic using C6RUN APIs in order to give to the DSP
+    vectors[i] = (uint8_t *) C6RUN_MEM_malloc(vectorSizes[i]);
+#else
+    vectors[i] = (uint8_t *) malloc(vectorSizes[i]);
+#endif
+    if (vectors[i] == NULL)
+    {
+      printf("---->Out of memory.\n");
+      exit(1);
+    }
+    memset(vectors[i], 1, vectorSizes[i]);
+  }
+#if defined(DSP_IN_USE)
+  params = (RPC_CostParams *) C6RUN_MEM_malloc(sizeof(RPC_CostParams));
+#else
+  params = (RPC_CostParams *) malloc(sizeof(RPC_CostParams));
+#endif
+  samples = (uint64_t *) calloc(calls, sizeof(uint64_t));
+  if (params == NULL || samples == NULL)
+  {
+    printf("---->Out of memory.\n");
+    exit(1);
+  }
+  memset(params, 0, sizeof(RPC_CostParams));
+  params->gain  = 3;
+  params->shift = 1;
+  for (i = 0; i < RPC_COST_TAPS; i++)
+  {
+    params->taps[i] = i;
+  }
+
+  // Build the shape table
+  for (i = 0; i < (int) (sizeof(intCounts) / sizeof(intCounts[0])); i++)
+  {
+    shapes[n].kind = SHAPE_INTS;
+    shapes[n].arg  = intCounts[i];
+    shapes[n].call = call_ints;
+    shapes[n].name = NULL;
+    n++;
+  }
+  shapes[n++] = (Shape) { "long long",      SHAPE_SCALAR, 0, call_ll };
+  shapes[n++] = (Shape) { "double",         SHAPE_SCALAR, 0, call_d };
+  shapes[n++] = (Shape) { "typedef x2",     SHAPE_SCALAR, 0, call_typedef };
+  shapes[n++] = (Shape) { "struct* (64 B)", SHAPE_SCALAR, 0, call_struct };
+  for (k = SHAPE_IN; k <= SHAPE_INOUT; k++)
+  {
+    for (i = 0; i < VECTOR_SIZES; i++)
+    {
+      shapes[n].kind = (ShapeKind) k;
+      shapes[n].arg  = vectorSizes[i];
+      shapes[n].call = (k == SHAPE_IN) ? call_in : (k == SHAPE_OUT) ? call_out : call_inout;
+      shapes[n].buf  = vectors[i];
+      shapes[n].name = NULL;
+      n++;
+    }
+  }
+
+  // First call loads the DSP; keep it out of the timing
+  arg_cnt_0();
+
+  printf("%-18s %7s %9s %9s %9s %9s %9s   (us)\n",
+         "shape", "calls", "min", "median", "p90", "p99", "max");
+  for (i = 0; i < n; i++)
+  {
+    if (shapes[i].name == NULL)
+    {
+      static const char *kinds[] = { "ints", "", "in", "out", "in/out" };
+      if (shapes[i].kind == SHAPE_INTS)
+        snprintf(name, sizeof(name), "%d int%s", shapes[i].arg, shapes[i].arg == 1 ? "" : "s");
+      else if (shapes[i].arg >= 1024)
+        snprintf(name, sizeof(name), "%s %d KB", kinds[shapes[i].kind], shapes[i].arg / 1024);
+      else
+        snprintf(name, sizeof(name), "%s %d B", kinds[shapes[i].kind], shapes[i].arg);
+      shapes[i].name = strdup(name);
+    }
+    timeShape(&shapes[i], calls, samples);
+  }
+
+  // Fit the model to the medians
+  fitLine(shapes, n, SHAPE_INTS, &base, &perInt);
+  fitLine(shapes, n, SHAPE_IN, &inBase, &inNs);
+  fitLine(shapes, n, SHAPE_OUT, &outBase, &outNs);
+  fitLine(shapes, n, SHAPE_INOUT, &ioBase, &ioNs);
+
+  printf("\nCost model (medians):\n");
+  printf("  call            %8.2f us %+.3f us per int argument\n", base, perInt);
+  printf("  in vector       %8.2f us %+.3f ns/byte\n", inBase, inNs * 1000.0);
+  printf("  out vector      %8.2f us %+.3f ns/byte\n", outBase, outNs * 1000.0);
+  printf("  in/out vector   %8.2f us %+.3f ns/byte\n", ioBase, ioNs * 1000.0);
+  printf("Offload a function when its ARM time is well above the DSP time plus\n"
+         "the call and byte costs of its arguments.\n");
+
+  free(samples);
+  for (i = 0; i < VECTOR_SIZES; i++)
+  {
+#if defined(DSP_IN_USE)
+    C6RUN_MEM_free(vectors[i]);
+#else
+    free(vectors[i]);
+#endif
+  }
+#if defined(DSP_IN_USE)
+  C6RUN_MEM_free(params);
+#else
+  free(params);
+#endif
+
+  if (errors)
+  {
+    printf("---->%d wrong results.\n", errors);
+    exit(1);
+  }
+  return 0;
+}
+
+
+/***********************************************************
+* Local Function Definitions                               *
+***********************************************************/
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+  return (x > y) - (x < y);
+}
+
+static void timeShape(Shape *s, int calls, uint64_t *samples)
+{
+  uint64_t t0;
+  int      i;
+
+  if (s->kind >= SHAPE_IN && calls > BYTES_PER_SHAPE / s->arg)
+  {
+    calls = BYTES_PER_SHAPE / s->arg;
+    if (calls < MIN_CALLS)
+    {
+      calls = MIN_CALLS;
+    }
+  }
+
+  for (i = 0; i < calls; i++)
+  {
+    t0 = now_ns();
+    if (s->call(s) != 0)
+    {
+      errors++;
+    }
+    samples[i] = now_ns() - t0;
+  }
+
+  qsort(samples, calls, sizeof(uint64_t), cmp_u64);
+  s->median = samples[calls / 2] / 1000.0;
+
+  printf("%-18s %7d %9.2f %9.2f %9.2f %9.2f %9.2f\n", s->name, calls,
+         samples[0] / 1000.0, s->median, samples[calls * 90 / 100] / 1000.0,
+         samples[calls * 99 / 100] / 1000.0, samples[calls - 1] / 1000.0);
+}
+
+// Least squares over the shapes of one kind: median = base + slope * arg
+static void fitLine(Shape *shapes, int n, ShapeKind kind, double *base, double *slope)
+{
+  double sx = 0, sy = 0, sxx = 0, sxy = 0, m = 0;
+  int    i;
+
+  for (i = 0; i < n; i++)
+  {
+    if (shapes[i].kind == kind)
+    {
+      sx  += shapes[i].arg;
+      sy  += shapes[i].median;
+      sxx += (double) shapes[i].arg * shapes[i].arg;
+      sxy += shapes[i].arg * shapes[i].median;
+      m++;
+    }
+  }
+
+  *slope = (m * sxy - sx * sy) / (m * sxx - sx * sx);
+  *base  = (sy - *slope * sx) / m;
+}
+
+// Each call returns 0 when the DSP's answer is right. Each vector holds
+// ones until the first out call, and the in shapes are timed before it.
+
+static int32_t call_ints(Shape *s)
+{
+  switch (s->arg)
+  {
+    case 0:  return arg_cnt_0();
+    case 1:  return arg_cnt_1(1) - 1;
+    case 2:  return arg_cnt_2(1, 2) - 3;
+    case 4:  return arg_cnt_4(1, 2, 3, 4) - 10;
+    case 8:  return arg_cnt_8(1, 2, 3, 4, 5, 6, 7, 8) - 36;
+    case 13: return arg_cnt_13(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13) - 91;
+  }
+  return -1;
+}
+
+static int32_t call_ll(Shape *s)
+{
+  return rpc_cost_ll(0x100000000ll) != 0x100000001ll;
+}
+
+static int32_t call_d(Shape *s)
+{
+  return rpc_cost_d(3.0) != 1.5;
+}
+
+static int32_t call_typedef(Shape *s)
+{
+  return rpc_cost_typedef(1000, 512) != 2000;
+}
+
+static int32_t call_struct(Shape *s)
+{
+  // Taps 0..15 sum to 120; * 3 >> 1
+  return rpc_cost_struct(params) != 180;
+}
+
+static int32_t call_in(Shape *s)
+{
+  return rpc_cost_in(s->arg, s->buf) != s->arg;
+}
+
+static int32_t call_out(Shape *s)
+{
+  int32_t bytes = rpc_cost_out(s->arg, s->buf);
+
+  return bytes != s->arg || s->buf[s->arg - 1] != (uint8_t) (s->arg - 1);
+}
+
+static int32_t call_inout(Shape *s)
+{
+  uint8_t last = s->buf[s->arg - 1];
+  int32_t bytes = rpc_cost_inout(s->arg, s->buf);
+
+  return bytes != s->arg || s->buf[s->arg - 1] != (uint8_t) (last + 1);
+}
+
+
+/***********************************************************
+* End file                                                 *
+***********************************************************/
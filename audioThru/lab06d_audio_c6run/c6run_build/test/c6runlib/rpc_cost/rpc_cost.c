@@ -0,0 +1,123 @@
+/*
+ * rpc_cost.c
+ *
+ * DSP side of the marshalling benchmark. The buffer qualifiers tell the
+ * C6Run front end which cache operations a vector needs, so the in, out
+ * and in/out cases are timed as a real caller would see them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rpc_cost.h"
+
+/************************************************************
+* Explicit External Declarations                            *
+************************************************************/
+
+
+/************************************************************
+* Local Macro Declarations                                  *
+************************************************************/
+
+// Buffer qualifiers are C6Run front end keywords; plain C elsewhere
+#if !defined(_TMS320C6X)
+  #define INBUF
+  #define OUTBUF
+#endif
+
+
+/************************************************************
+* Local Typedef Declarations                                *
+************************************************************/
+
+
+/************************************************************
+* Local Function Declarations                               *
+************************************************************/
+
+
+/************************************************************
+* Local Variable Definitions                                *
+************************************************************/
+
+
+/************************************************************
+* Global Variable Definitions                               *
+************************************************************/
+
+
+/************************************************************
+* Global Function Definitions                               *
+************************************************************/
+
+long long rpc_cost_ll ( long long arg )
+{
+  return arg + 1;
+}
+
+double rpc_cost_d ( double arg )
+{
+  return arg * 0.5;
+}
+
+rpc_sample_t rpc_cost_typedef ( rpc_sample_t sample, rpc_gain_t gain )
+{
+  return (sample * gain) >> 8;
+}
+
+int32_t rpc_cost_struct ( INBUF RPC_CostParams *params )
+{
+  int32_t sum = 0;
+  int i;
+
+  for (i = 0; i < RPC_COST_TAPS; i++)
+  {
+    sum += params->taps[i];
+  }
+  return (sum * params->gain) >> params->shift;
+}
+
+int32_t rpc_cost_in ( int32_t bytes, INBUF uint8_t *buf )
+{
+  int32_t sum = 0;
+  int32_t i;
+
+  for (i = 0; i < bytes; i++)
+  {
+    sum += buf[i];
+  }
+  return sum;
+}
+
+int32_t rpc_cost_out ( int32_t bytes, OUTBUF uint8_t *buf )
+{
+  int32_t i;
+
+  for (i = 0; i < bytes; i++)
+  {
+    buf[i] = (uint8_t) i;
+  }
+  return bytes;
+}
+
+int32_t rpc_cost_inout ( int32_t bytes, uint8_t *buf )
+{
+  int32_t i;
+
+  for (i = 0; i < bytes; i++)
+  {
+    buf[i]++;
+  }
+  return bytes;
+}
+
+
+/***********************************************************
+* Local Function Definitions                               *
+***********************************************************/
+
+
+/***********************************************************
+* End file                                                 *
+***********************************************************/
@@ -0,0 +1,196 @@
+/*
+ * rpc_cost.emu_stub.c
+ *
+ * Host stand-in for the generated gpp stubs (see c6run_build/emu/c6run_emu.h):
+ * the loopback transport the benchmark times on a machine without a DSP.
+ * Each stub packs its arguments, hands them to the emulated DSP thread and
+ * applies the same cache operations the front end derives from INBUF,
+ * OUTBUF or an unqualified pointer.
+ */
+
+#include "c6run_emu.h"
+#include "arg_cnts.h"
+#include "rpc_cost.h"
+
+/************************************************************
+* Explicit External Declarations                            *
+************************************************************/
+
+// The DSP-side functions, renamed when built for emulation
+extern int          arg_cnt_0_dsp         ( void );
+extern int          arg_cnt_1_dsp         ( int a1 );
+extern int          arg_cnt_2_dsp         ( int a1, int a2 );
+extern int          arg_cnt_4_dsp         ( int a1, int a2, int a3, int a4 );
+extern int          arg_cnt_8_dsp         ( int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8 );
+extern int          arg_cnt_13_dsp        ( int a1, int a2, int a3, int a4, int a5, int a6, int a7,
+                                            int a8, int a9, int a10, int a11, int a12, int a13 );
+extern long long    rpc_cost_ll_dsp       ( long long arg );
+extern double       rpc_cost_d_dsp        ( double arg );
+extern rpc_sample_t rpc_cost_typedef_dsp  ( rpc_sample_t sample, rpc_gain_t gain );
+extern int32_t      rpc_cost_struct_dsp   ( RPC_CostParams *params );
+extern int32_t      rpc_cost_in_dsp       ( int32_t bytes, uint8_t *buf );
+extern int32_t      rpc_cost_out_dsp      ( int32_t bytes, uint8_t *buf );
+extern int32_t      rpc_cost_inout_dsp    ( int32_t bytes, uint8_t *buf );
+
+
+/************************************************************
+* Local Typedef Declarations                                *
+************************************************************/
+
+// Everything one call carries, like the message the real stubs build
+typedef struct _EmuArgs_
+{
+  int         a[13];
+  long long   ll;
+  double      d;
+  void       *ptr;
+  long long   retLl;
+  double      retD;
+  int         ret;
+}
+EmuArgs;
+
+
+/***********************************************************
+* Local Function Definitions                               *
+***********************************************************/
+
+static void call_arg_cnt_0(void *p)  { EmuArgs *e = p; e->ret = arg_cnt_0_dsp(); }
+static void call_arg_cnt_1(void *p)  { EmuArgs *e = p; e->ret = arg_cnt_1_dsp(e->a[0]); }
+static void call_arg_cnt_2(void *p)  { EmuArgs *e = p; e->ret = arg_cnt_2_dsp(e->a[0], e->a[1]); }
+static void call_arg_cnt_4(void *p)
+{
+  EmuArgs *e = p;
+  e->ret = arg_cnt_4_dsp(e->a[0], e->a[1], e->a[2], e->a[3]);
+}
+static void call_arg_cnt_8(void *p)
+{
+  EmuArgs *e = p;
+  e->ret = arg_cnt_8_dsp(e->a[0], e->a[1], e->a[2], e->a[3], e->a[4], e->a[5], e->a[6], e->a[7]);
+}
+static void call_arg_cnt_13(void *p)
+{
+  EmuArgs *e = p;
+  e->ret = arg_cnt_13_dsp(e->a[0], e->a[1], e->a[2], e->a[3], e->a[4], e->a[5], e->a[6],
+                          e->a[7], e->a[8], e->a[9], e->a[10], e->a[11], e->a[12]);
+}
+static void call_ll(void *p)      { EmuArgs *e = p; e->retLl = rpc_cost_ll_dsp(e->ll); }
+static void call_d(void *p)       { EmuArgs *e = p; e->retD = rpc_cost_d_dsp(e->d); }
+static void call_typedef(void *p) { EmuArgs *e = p; e->ret = rpc_cost_typedef_dsp(e->a[0], (rpc_gain_t) e->a[1]); }
+static void call_struct(void *p)  { EmuArgs *e = p; e->ret = rpc_cost_struct_dsp(e->ptr); }
+static void call_in(void *p)      { EmuArgs *e = p; e->ret = rpc_cost_in_dsp(e->a[0], e->ptr); }
+static void call_out(void *p)     { EmuArgs *e = p; e->ret = rpc_cost_out_dsp(e->a[0], e->ptr); }
+static void call_inout(void *p)   { EmuArgs *e = p; e->ret = rpc_cost_inout_dsp(e->a[0], e->ptr); }
+
+// Scalars only: copy in, dispatch, copy the result out
+static int ints(const char *name, void (*fxn)(void *), int n, const int *a)
+{
+  EmuArgs e;
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    e.a[i] = a[i];
+  }
+  c6run_emu_dispatch(name, fxn, &e);
+  return e.ret;
+}
+
+static int32_t vector(const char *name, void (*fxn)(void *), int32_t bytes, void *buf, int qualifier)
+{
+  EmuArgs e;
+
+  e.a[0] = bytes;
+  e.ptr  = c6run_emu_arg(buf, qualifier);
+  c6run_emu_dispatch(name, fxn, &e);
+  c6run_emu_arg_done(buf, qualifier);
+  return e.ret;
+}
+
+
+/************************************************************
+* Global Function Definitions                               *
+************************************************************/
+
+int arg_cnt_0 ( void )
+{
+  return ints("arg_cnt_0", call_arg_cnt_0, 0, NULL);
+}
+
+int arg_cnt_1 ( int arg1 )
+{
+  return ints("arg_cnt_1", call_arg_cnt_1, 1, &arg1);
+}
+
+int arg_cnt_2 ( int arg1, int arg2 )
+{
+  int a[2] = { arg1, arg2 };
+  return ints("arg_cnt_2", call_arg_cnt_2, 2, a);
+}
+
+int arg_cnt_4 ( int arg1, int arg2, int arg3, int arg4 )
+{
+  int a[4] = { arg1, arg2, arg3, arg4 };
+  return ints("arg_cnt_4", call_arg_cnt_4, 4, a);
+}
+
+int arg_cnt_8 ( int arg1, int arg2, int arg3, int arg4, int arg5, int arg6, int arg7, int arg8 )
+{
+  int a[8] = { arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8 };
+  return ints("arg_cnt_8", call_arg_cnt_8, 8, a);
+}
+
+int arg_cnt_13 ( int arg1, int arg2, int arg3, int arg4, int arg5, int arg6, int arg7, int arg8, int arg9, int arg10, int arg11, int arg12, int arg13 )
+{
+  int a[13] = { arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10, arg11, arg12, arg13 };
+  return ints("arg_cnt_13", call_arg_cnt_13, 13, a);
+}
+
+long long rpc_cost_ll ( long long arg )
+{
+  EmuArgs e;
+
+  e.ll = arg;
+  c6run_emu_dispatch("rpc_cost_ll", call_ll, &e);
+  return e.retLl;
+}
+
+double rpc_cost_d ( double arg )
+{
+  EmuArgs e;
+
+  e.d = arg;
+  c6run_emu_dispatch("rpc_cost_d", call_d, &e);
+  return e.retD;
+}
+
+rpc_sample_t rpc_cost_typedef ( rpc_sample_t sample, rpc_gain_t gain )
+{
+  int a[2] = { sample, gain };
+  return ints("rpc_cost_typedef", call_typedef, 2, a);
+}
+
+int32_t rpc_cost_struct ( RPC_CostParams *params )
+{
+  return vector("rpc_cost_struct", call_struct, 0, params, C6RUN_EMU_INBUF);
+}
+
+int32_t rpc_cost_in ( int32_t bytes, uint8_t *buf )
+{
+  return vector("rpc_cost_in", call_in, bytes, buf, C6RUN_EMU_INBUF);
+}
+
+int32_t rpc_cost_out ( int32_t bytes, uint8_t *buf )
+{
+  return vector("rpc_cost_out", call_out, bytes, buf, C6RUN_EMU_OUTBUF);
+}
+
+int32_t rpc_cost_inout ( int32_t bytes, uint8_t *buf )
+{
+  return vector("rpc_cost_inout", call_inout, bytes, buf, C6RUN_EMU_INOUT);
+}
+
+
+/***********************************************************
+* End file                                                 *
+***********************************************************/
@@ -0,0 +1,69 @@
+/*
+ * rpc_cost.h
+ *
+ * DSP-side functions that do next to nothing with arguments of every
+ * shape C6Run marshals: wide scalars, typedef'd scalars, a struct passed
+ * by pointer and byte vectors in, out and both ways. Together with the
+ * arg_cnts functions they give the benchmark in main.c one call per
+ * shape, so what it times is the cost of getting there and back.
+ */
+
+#ifndef _RPC_COST_H_
+#define _RPC_COST_H_
+
+#include <stdint.h>
+
+// Prevent C++ name mangling
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************
+* Global Macro Declarations                                *
+***********************************************************/
+
+#define RPC_COST_TAPS (16)
+
+
+/***********************************************************
+* Global Typedef Declarations                              *
+***********************************************************/
+
+typedef int32_t  rpc_sample_t;
+typedef uint16_t rpc_gain_t;
+
+// 64 bytes, the size of a small filter's parameter block
+typedef struct _RPC_CostParams_
+{
+  int32_t   gain;
+  int32_t   shift;
+  int16_t   taps[RPC_COST_TAPS];
+  int32_t   state[6];
+}
+RPC_CostParams;
+
+
+/***********************************************************
+* Global Function Declarations                             *
+***********************************************************/
+
+extern long long    rpc_cost_ll       ( long long arg );
+extern double       rpc_cost_d        ( double arg );
+extern rpc_sample_t rpc_cost_typedef  ( rpc_sample_t sample, rpc_gain_t gain );
+extern int32_t      rpc_cost_struct   ( RPC_CostParams *params );
+
+// Each touches every byte, so the DSP really sees what was sent
+extern int32_t      rpc_cost_in       ( int32_t bytes, uint8_t *buf );
+extern int32_t      rpc_cost_out      ( int32_t bytes, uint8_t *buf );
+extern int32_t      rpc_cost_inout    ( int32_t bytes, uint8_t *buf );
+
+
+/***********************************************************
+* End file                                                 *
+***********************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_RPC_COST_H_
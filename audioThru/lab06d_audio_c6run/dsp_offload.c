@@ -0,0 +1,640 @@
+/*
+ *   dsp_offload.c
+ *
+ *   Slots go round in order. A slot belongs to the ARM (SLOT_ARM) while the
+ *   audio thread fills its input, to the DSP side (SLOT_DSP) from
+ *   offload_submit() until the worker has processed it, and back to the
+ *   ARM (SLOT_DONE) until offload_release() once its output is played.
+ *   The ARM never reads or writes a slot the DSP owns, so the cache
+ *   writeback of the input and invalidate of the output that the C6Run
+ *   stub does for each call happen exactly once per hand-off, and no dirty
+ *   ARM cache line can land on top of the DSP's result.
+ *
+ *   OFFLOAD_RING keeps the same slots but puts them in a dsp_ring region:
+ *   the worker's only call is dsp_ring_loop(), and a hand-off is a
+ *   descriptor plus a doorbell, with the cache operations done here.
+ */
+
+//* Standard Linux headers **
+#include     <stdio.h>		// Always include stdio.h
+#include     <stdlib.h>		// Always include stdlib.h
+#include     <string.h>		// Defines memcpy, memset
+#include     <unistd.h>		// usleep
+#include     <time.h>		// clock_gettime
+#include     <sched.h>		// sched_yield
+#include     <pthread.h>
+
+//* Application headers **
+#include     "debug.h"		// DBG and ERR macros
+#include     "audio_process.h"	// The function being offloaded
+#include     "dsp_offload.h"
+#include     "dsp_ring.h"		// Persistent DSP loop
+#include     "trace.h"		// Timeline trace points
+
+#define     SLOT_ARM         0	// ARM may fill the input
+#define     SLOT_DSP         1	// Queued for or on the DSP
+#define     SLOT_DONE        2	// Output ready for the ARM to play
+
+// OFFLOAD_RING: how long to wait for the DSP before giving up on it
+#define     RING_START_TIMEOUT_US  10000000	// Loading and starting the loop
+#define     RING_BLOCK_TIMEOUT_US  2000000	// One block, on top of dspDelayUs
+#define     RING_SPINS             64		// Yields before sleeping
+#define     RING_MAX_SLEEP_US      1000		// Longest sleep between polls
+
+// Present only when linked against the C6Run DSP library
+extern void *C6RUN_MEM_malloc( size_t size ) __attribute__(( weak ));
+extern void  C6RUN_MEM_free( void *ptr ) __attribute__(( weak ));
+extern void  C6RUN_CACHE_inv( void *ptr, size_t size ) __attribute__(( weak ));
+extern void  C6RUN_CACHE_wb( void *ptr, size_t size ) __attribute__(( weak ));
+
+static void ring_inv( void * p, size_t  n )
+{
+    if( C6RUN_CACHE_inv )
+        C6RUN_CACHE_inv( p, n );
+    __sync_synchronize( );
+}
+
+static void ring_wb( void * p, size_t  n )
+{
+    __sync_synchronize( );
+    if( C6RUN_CACHE_wb )
+        C6RUN_CACHE_wb( p, n );
+}
+
+typedef  struct  OffloadSlot
+{
+    char                *in;
+    char                *out;
+    int                  state;
+    int                  bypass;	// Copy instead of calling the DSP
+    unsigned long long   submitted;	// us
+    unsigned long long   started;
+    unsigned long long   processed;
+} OffloadSlot;
+
+static OffloadSlot       slots[ OFFLOAD_SLOTS ];
+static int               blkBytes;
+static int               offloadMode;
+static unsigned int      head, tail, next;	// Next to fill, to collect, to process
+static int               workerRunning = 0;
+static int               workerQuit;
+static pthread_t         worker;
+static pthread_mutex_t   lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    toDsp = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t    toArm = PTHREAD_COND_INITIALIZER;
+static int               dspDelayUs = 0;	// Benchmark only: emulated DSP time
+static DspRing          *ring = NULL;	// OFFLOAD_RING only
+static int               ringServed;	// What dsp_ring_loop() returned
+static int               ringStalled;	// The DSP missed a timeout
+
+// Statistics since offload_init
+static unsigned long     numBlocks;
+static unsigned long long dspTotal, latencyTotal, latencyMax, waitTotal;
+
+static const char *modeNames[] = { "sync", "async", "ring" };
+
+static unsigned long long now_us( void )
+{
+    struct timespec  ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( unsigned long long ) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//*******************************************************************************
+//*  process_slot                                                              **
+//*******************************************************************************
+//*  The DSP's part of a hand-off: one audio_process() call (a C6Run RPC in    **
+//*  the DSP build), or a plain copy for a block the watchdog bypassed.        **
+//*******************************************************************************
+static void process_slot( OffloadSlot * s )
+{
+    s->started = now_us( );
+
+    if( s->bypass )
+        memcpy( s->out, s->in, blkBytes );
+    else {
+        TRACE_BEGIN( "dsp.audio_process" );
+        audio_process( ( short * ) s->out, ( short * ) s->in, blkBytes / 2 );
+        if( dspDelayUs )
+            usleep( dspDelayUs );
+        TRACE_END( "dsp.audio_process" );
+    }
+
+    s->processed = now_us( );
+}
+
+static void *worker_fxn( void * arg )
+{
+    OffloadSlot  *s;
+
+    trace_thread_name( "dsp.offload" );
+
+    pthread_mutex_lock( &lock );
+    for( ;; ) {
+        s = &slots[ next % OFFLOAD_SLOTS ];
+        while( !workerQuit && s->state != SLOT_DSP )
+            pthread_cond_wait( &toDsp, &lock );
+        if( workerQuit )
+            break;
+
+        pthread_mutex_unlock( &lock );
+        process_slot( s );
+        pthread_mutex_lock( &lock );
+
+        s->state = SLOT_DONE;
+        next++;
+        pthread_cond_signal( &toArm );
+    }
+    pthread_mutex_unlock( &lock );
+
+    return NULL;
+}
+
+// OFFLOAD_RING: the one long call that serves every block
+static void *ring_worker_fxn( void * arg )
+{
+    trace_thread_name( "dsp.ring" );
+    ringServed = dsp_ring_loop( ring );
+    return NULL;
+}
+
+//*******************************************************************************
+//*  ring_wait                                                                 **
+//*******************************************************************************
+//*  Polls a word the DSP writes until it is non-zero (want < 0) or equals     **
+//*  want. Yields at first, then sleeps for longer and longer so a slow or     **
+//*  dead DSP does not keep a core busy.                                       **
+//*                                                                            **
+//*  Return Value:                                                             **
+//*      int -- OFFLOAD_SUCCESS, or OFFLOAD_FAILURE after timeoutUs            **
+//*******************************************************************************
+static int ring_wait( volatile int * word, int  want, unsigned long long  timeoutUs )
+{
+    unsigned long long  start = now_us( );
+    int                 polls = 0, sleepUs = 1;
+
+    for( ;; ) {
+        ring_inv( ( void * ) word, sizeof( *word ) );
+        if( want < 0 ? *word != 0 : *word == want )
+            return OFFLOAD_SUCCESS;
+        if( now_us( ) - start > timeoutUs )
+            return OFFLOAD_FAILURE;
+
+        if( ++polls < RING_SPINS )
+            sched_yield( );
+        else {
+            usleep( sleepUs );
+            if( sleepUs < RING_MAX_SLEEP_US )
+                sleepUs *= 2;
+        }
+    }
+}
+
+//*******************************************************************************
+//*  ring_setup                                                                **
+//*******************************************************************************
+//*  Lays out the ring header, then an input and an output block per slot,     **
+//*  each rounded up to a cache line, in one C6Run allocation (plain malloc    **
+//*  in the ARM-only build).                                                   **
+//*******************************************************************************
+static int ring_setup( int  blksize )
+{
+    int     i, line = ( blksize + RING_LINE - 1 ) / RING_LINE * RING_LINE;
+    size_t  size = sizeof( DspRing ) + 2 * OFFLOAD_SLOTS * line;
+    char   *base;
+
+    base = C6RUN_MEM_malloc ? C6RUN_MEM_malloc( size ) : malloc( size );
+    if( base == NULL ) {
+        ERR( "Failed to allocate the DSP ring (%lu bytes)\n", ( unsigned long ) size );
+        return OFFLOAD_FAILURE;
+    }
+    memset( base, 0, size );
+    ring = ( DspRing * ) base;
+    ring->slots   = OFFLOAD_SLOTS;
+    ring->delayUs = dspDelayUs;
+
+    for( i = 0; i < OFFLOAD_SLOTS; i++ ) {
+        ring->desc[ i ].inOffset  = sizeof( DspRing ) + 2 * i * line;
+        ring->desc[ i ].outOffset = ring->desc[ i ].inOffset + line;
+        slots[ i ].in  = base + ring->desc[ i ].inOffset;
+        slots[ i ].out = base + ring->desc[ i ].outOffset;
+    }
+    ring_wb( base, size );
+
+    return OFFLOAD_SUCCESS;
+}
+
+//*******************************************************************************
+//*  offload_init                                                              **
+//*******************************************************************************
+//*  Input Parameters:                                                         **
+//*      int blksize -- bytes per audio block                                  **
+//*      int mode    -- OFFLOAD_SYNC or OFFLOAD_ASYNC                          **
+//*                                                                            **
+//*  Return Value:                                                             **
+//*      int -- OFFLOAD_SUCCESS or OFFLOAD_FAILURE                             **
+//*******************************************************************************
+int offload_init( int  blksize, int  mode )
+{
+    int  i;
+
+    memset( slots, 0, sizeof( slots ) );
+    blkBytes    = blksize;
+    offloadMode = mode;
+    head = tail = next = 0;
+    numBlocks = 0;
+    ringStalled = 0;
+    dspTotal = latencyTotal = latencyMax = waitTotal = 0;
+
+    if( mode == OFFLOAD_RING ) {
+        if( ring_setup( blksize ) == OFFLOAD_FAILURE )
+            return OFFLOAD_FAILURE;
+
+        // Starting the loop is the slow first call; wait it out here
+        workerQuit = 0;
+        if( pthread_create( &worker, NULL, ring_worker_fxn, NULL ) != 0 ) {
+            ERR( "Failed to create DSP ring thread\n" );
+            offload_cleanup( );
+            return OFFLOAD_FAILURE;
+        }
+        workerRunning = 1;
+        if( ring_wait( &ring->running, -1, RING_START_TIMEOUT_US ) == OFFLOAD_FAILURE ) {
+            ERR( "DSP ring loop did not start within %d s\n",
+                 RING_START_TIMEOUT_US / 1000000 );
+            ringStalled = 1;
+            offload_cleanup( );
+            return OFFLOAD_FAILURE;
+        }
+
+        DBG( "DSP offload: ring, %d slots of %d bytes\n", OFFLOAD_SLOTS, blksize );
+        return OFFLOAD_SUCCESS;
+    }
+
+    for( i = 0; i < OFFLOAD_SLOTS; i++ ) {
+        slots[ i ].in  = malloc( blksize );
+        slots[ i ].out = malloc( blksize );
+        if( slots[ i ].in == NULL || slots[ i ].out == NULL ) {
+            ERR( "Failed to allocate offload slot %d (%d bytes)\n", i, blksize );
+            offload_cleanup( );
+            return OFFLOAD_FAILURE;
+        }
+        memset( slots[ i ].out, 0, blksize );
+    }
+
+    if( mode == OFFLOAD_ASYNC ) {
+        workerQuit = 0;
+        if( pthread_create( &worker, NULL, worker_fxn, NULL ) != 0 ) {
+            ERR( "Failed to create DSP offload thread\n" );
+            offload_cleanup( );
+            return OFFLOAD_FAILURE;
+        }
+        workerRunning = 1;
+    }
+
+    DBG( "DSP offload: %s, %d slots of %d bytes\n", modeNames[ mode ], OFFLOAD_SLOTS, blksize );
+    return OFFLOAD_SUCCESS;
+}
+
+//*******************************************************************************
+//*  offload_input                                                             **
+//*******************************************************************************
+//*  Returns the ARM-owned input buffer to capture the next block into.        **
+//*******************************************************************************
+char *offload_input( void )
+{
+    return slots[ head % OFFLOAD_SLOTS ].in;
+}
+
+//*******************************************************************************
+//*  offload_submit                                                            **
+//*******************************************************************************
+//*  Hands the block in offload_input() to the DSP. With bypass != 0 it is     **
+//*  copied through instead of processed (still in order).                    **
+//*******************************************************************************
+void offload_submit( int  bypass )
+{
+    OffloadSlot  *s = &slots[ head % OFFLOAD_SLOTS ];
+
+    if( ringStalled )
+        return;		// The DSP may still own every slot
+
+    s->bypass    = bypass;
+    s->submitted = now_us( );
+    head++;
+
+    if( offloadMode == OFFLOAD_RING ) {
+        DspRingDesc  *d = &ring->desc[ ( head - 1 ) % OFFLOAD_SLOTS ];
+
+        d->bypass = bypass;
+        d->bytes  = blkBytes;
+        d->state  = RING_READY;
+        ring_wb( s->in, blkBytes );
+        ring_wb( d, sizeof( *d ) );
+
+        // The doorbell goes last: the DSP only looks at what it counts
+        s->state = SLOT_DSP;
+        ring->doorbell = head;
+        ring_wb( ( void * ) &ring->doorbell, sizeof( ring->doorbell ) );
+        return;
+    }
+
+    if( offloadMode == OFFLOAD_SYNC ) {
+        process_slot( s );
+        s->state = SLOT_DONE;
+        next++;
+        return;
+    }
+
+    pthread_mutex_lock( &lock );
+    s->state = SLOT_DSP;
+    pthread_cond_signal( &toDsp );
+    pthread_mutex_unlock( &lock );
+}
+
+//*******************************************************************************
+//*  collect_oldest                                                            **
+//*******************************************************************************
+//*  Waits for the oldest block in flight and returns its output, now owned    **
+//*  by the ARM. NULL if the DSP ring stalled (see offload_stalled).           **
+//*******************************************************************************
+static char *collect_oldest( void )
+{
+    OffloadSlot        *s = &slots[ tail % OFFLOAD_SLOTS ];
+    unsigned long long  t0 = now_us( ), t1, latency;
+
+    if( offloadMode == OFFLOAD_RING ) {
+        DspRingDesc  *d = &ring->desc[ tail % OFFLOAD_SLOTS ];
+
+        if( ringStalled )
+            return NULL;
+        if( ring_wait( &d->state, RING_DONE,
+                       RING_BLOCK_TIMEOUT_US + dspDelayUs ) == OFFLOAD_FAILURE ) {
+            ERR( "DSP ring stalled: block %u not back after %d ms\n", tail,
+                 ( RING_BLOCK_TIMEOUT_US + dspDelayUs ) / 1000 );
+            ringStalled = 1;
+            return NULL;
+        }
+        ring_inv( d, sizeof( *d ) );
+        ring_inv( s->out, blkBytes );
+
+        // The DSP keeps no clock we can read, so all of it counts as DSP time
+        s->started   = s->submitted;
+        s->processed = now_us( );
+        s->state     = SLOT_DONE;
+    }
+    else {
+        pthread_mutex_lock( &lock );
+        while( s->state != SLOT_DONE )
+            pthread_cond_wait( &toArm, &lock );
+        pthread_mutex_unlock( &lock );
+    }
+
+    t1      = now_us( );
+    latency = t1 - s->submitted;
+    numBlocks++;
+    waitTotal    += t1 - t0;
+    dspTotal     += s->processed - s->started;
+    latencyTotal += latency;
+    if( latency > latencyMax )
+        latencyMax = latency;
+
+    return s->out;
+}
+
+//*******************************************************************************
+//*  offload_collect                                                           **
+//*******************************************************************************
+//*  Returns the output of the oldest block once the pipeline is full, or      **
+//*  NULL while it is still filling (the first call in async mode). Play it,   **
+//*  then call offload_release().                                              **
+//*******************************************************************************
+char *offload_collect( void )
+{
+    if( head - tail == 0 ||
+        ( offloadMode != OFFLOAD_SYNC && head - tail < OFFLOAD_SLOTS ) )
+        return NULL;
+
+    return collect_oldest( );
+}
+
+//*******************************************************************************
+//*  offload_drain                                                             **
+//*******************************************************************************
+//*  Like offload_collect, but also returns blocks from a pipeline that is     **
+//*  not full; NULL once nothing is in flight.                                 **
+//*******************************************************************************
+char *offload_drain( void )
+{
+    if( head == tail )
+        return NULL;
+
+    return collect_oldest( );
+}
+
+//*******************************************************************************
+//*  offload_stalled                                                           **
+//*******************************************************************************
+//*  Non-zero once the DSP ring has missed a timeout. Nothing more will come   **
+//*  back from it, so the caller should stop and clean up.                     **
+//*******************************************************************************
+int offload_stalled( void )
+{
+    return ringStalled;
+}
+
+void offload_release( void )
+{
+    OffloadSlot  *s = &slots[ tail % OFFLOAD_SLOTS ];
+
+    if( offloadMode == OFFLOAD_RING ) {
+        ring->desc[ tail % OFFLOAD_SLOTS ].state = RING_FREE;
+        s->state = SLOT_ARM;
+        tail++;
+        return;
+    }
+
+    pthread_mutex_lock( &lock );
+    s->state = SLOT_ARM;
+    pthread_mutex_unlock( &lock );
+    tail++;
+}
+
+//*******************************************************************************
+//*  offload_cleanup                                                           **
+//*******************************************************************************
+void offload_cleanup( void )
+{
+    int  i;
+
+    if( ring != NULL ) {
+        if( workerRunning && ringStalled ) {
+            // The DSP may never return from the loop or may still write to
+            // the ring, so leave the worker and the ring memory to it
+            ring->stop = 1;
+            ring_wb( ( void * ) &ring->stop, sizeof( ring->stop ) );
+            pthread_detach( worker );
+            workerRunning = 0;
+            ring = NULL;
+            for( i = 0; i < OFFLOAD_SLOTS; i++ )
+                slots[ i ].in = slots[ i ].out = NULL;
+            return;
+        }
+        if( workerRunning ) {
+            ring->stop = 1;
+            ring_wb( ( void * ) &ring->stop, sizeof( ring->stop ) );
+            pthread_join( worker, NULL );
+            workerRunning = 0;
+            DBG( "DSP ring loop served %d blocks\n", ringServed );
+        }
+        if( C6RUN_MEM_free )
+            C6RUN_MEM_free( ring );
+        else
+            free( ring );
+        ring = NULL;
+        for( i = 0; i < OFFLOAD_SLOTS; i++ )
+            slots[ i ].in = slots[ i ].out = NULL;
+        return;
+    }
+
+    if( workerRunning ) {
+        pthread_mutex_lock( &lock );
+        workerQuit = 1;
+        pthread_cond_signal( &toDsp );
+        pthread_mutex_unlock( &lock );
+        pthread_join( worker, NULL );
+        workerRunning = 0;
+    }
+
+    for( i = 0; i < OFFLOAD_SLOTS; i++ ) {
+        free( slots[ i ].in );
+        free( slots[ i ].out );
+        slots[ i ].in = slots[ i ].out = NULL;
+    }
+}
+
+//*******************************************************************************
+//*  offload_report                                                            **
+//*******************************************************************************
+//*  Latency is submit to output-ready-to-play; async mode adds about one      **
+//*  block period to it. ARM wait is how long the audio thread sat in          **
+//*  offload_collect, i.e. the DSP time it failed to hide.                     **
+//*******************************************************************************
+void offload_report( FILE * fp )
+{
+    if( numBlocks == 0 )
+        return;
+
+    fprintf( fp, "DSP offload (%s): %lu blocks, DSP %llu us/block, latency %llu us mean "
+             "%llu us max, ARM waited %llu us/block\n",
+             modeNames[ offloadMode ], numBlocks,
+             dspTotal / numBlocks, latencyTotal / numBlocks, latencyMax, waitTotal / numBlocks );
+}
+
+// Checks a benchmark block came back intact and in order, then releases it
+static int check_block( const char * out, int  blksize, int  expect )
+{
+    int  bad = out[ 0 ] != ( char ) expect || out[ blksize - 1 ] != ( char ) expect;
+
+    offload_release( );
+    return bad;
+}
+
+//*******************************************************************************
+//*  offload_benchmark                                                         **
+//*******************************************************************************
+//*  Runs the same block stream through every mode without ALSA.               **
+//*  dspUs is added to every DSP call and armUs is spent sleeping per block    **
+//*  (standing in for capture and playback), so the overlap can be seen even   **
+//*  where the DSP is emulated on the ARM. Every output block is checked to    **
+//*  come back whole and in order.                                             **
+//*                                                                            **
+//*  Return Value:                                                             **
+//*      int -- OFFLOAD_SUCCESS, or OFFLOAD_FAILURE if a block came back wrong **
+//*******************************************************************************
+int offload_benchmark( int  blksize, int  blocks, int  dspUs, int  armUs, FILE * fp )
+{
+    double              rate[ 3 ], latency[ 3 ];
+    unsigned long long  t0, elapsed;
+    char               *out;
+    int                 mode, i, expect, errors = 0;
+
+    dspDelayUs = dspUs;
+
+    for( mode = OFFLOAD_SYNC; mode <= OFFLOAD_RING; mode++ ) {
+        if( offload_init( blksize, mode ) == OFFLOAD_FAILURE )
+            return OFFLOAD_FAILURE;
+
+        expect = 0;
+        t0 = now_us( );
+        for( i = 0; i < blocks; i++ ) {
+            memset( offload_input( ), i & 0xff, blksize );
+            if( armUs )
+                usleep( armUs );
+            offload_submit( 0 );
+            if( ( out = offload_collect( ) ) != NULL )
+                errors += check_block( out, blksize, expect++ );
+        }
+        while( ( out = offload_drain( ) ) != NULL )
+            errors += check_block( out, blksize, expect++ );
+        elapsed = now_us( ) - t0;
+
+        rate[ mode ]    = blocks * 1e6 / ( elapsed ? elapsed : 1 );
+        latency[ mode ] = numBlocks ? ( double ) latencyTotal / numBlocks : 0;
+        fprintf( fp, "%-5s: %d blocks of %d bytes in %llu ms, %.1f blocks/s\n",
+                 modeNames[ mode ], blocks, blksize,
+                 elapsed / 1000, rate[ mode ] );
+        offload_report( fp );
+        offload_cleanup( );
+
+        if( expect != blocks )
+            errors++;
+    }
+
+    for( mode = OFFLOAD_ASYNC; mode <= OFFLOAD_RING; mode++ )
+        fprintf( fp, "%-5s: %.2fx the throughput of sync, %+.0f us latency per block\n",
+                 modeNames[ mode ], rate[ mode ] / rate[ OFFLOAD_SYNC ],
+                 latency[ mode ] - latency[ OFFLOAD_SYNC ] );
+    if( errors )
+        ERR( "%d blocks came back wrong or out of order\n", errors );
+
+    dspDelayUs = 0;
+    return errors ? OFFLOAD_FAILURE : OFFLOAD_SUCCESS;
+}
+
+//*******************************************************************************
+//*  offload_overhead                                                          **
+//*******************************************************************************
+//*  What a hand-off costs with nothing to process: calls empty RPCs, timed    **
+//*  like c6run_build/test/c6runlib/void_fxn_time, against the same number    **
+//*  of one-sample blocks sent round the ring and waited for one at a time.    **
+//*                                                                            **
+//*  Return Value:                                                             **
+//*      int -- OFFLOAD_SUCCESS or OFFLOAD_FAILURE                             **
+//*******************************************************************************
+int offload_overhead( int  calls, FILE * fp )
+{
+    unsigned long long  t0, rpcUs, ringUs;
+    char               *out;
+    int                 i;
+
+    t0 = now_us( );
+    for( i = 0; i < calls; i++ )
+        dsp_ring_nop( );
+    rpcUs = now_us( ) - t0;
+
+    if( offload_init( 4, OFFLOAD_RING ) == OFFLOAD_FAILURE )
+        return OFFLOAD_FAILURE;
+    t0 = now_us( );
+    for( i = 0; i < calls; i++ ) {
+        offload_submit( 0 );
+        if( ( out = offload_drain( ) ) != NULL )
+            offload_release( );
+    }
+    ringUs = now_us( ) - t0;
+    offload_cleanup( );
+
+    fprintf( fp, "%d calls: RPC %.3f us/call, ring round trip %.3f us/block\n",
+             calls, ( double ) rpcUs / calls, ( double ) ringUs / calls );
+    return OFFLOAD_SUCCESS;
+}
@@ -0,0 +1,48 @@
+/*
+ *   dsp_offload.h
+ *
+ *   Pipelined audio_process() offload. In OFFLOAD_ASYNC mode a worker
+ *   thread makes the (blocking) C6Run call, so block N is on the DSP while
+ *   the audio thread captures block N+1 and plays block N-1. Built as
+ *   audioThru_arm, audio_process() runs natively in the same worker, which
+ *   stands in for the DSP and lets the pipeline run on any Linux host.
+ *
+ *   OFFLOAD_RING pipelines the same way but the worker makes one call,
+ *   dsp_ring_loop(), which then polls a shared-memory ring for blocks.
+ *
+ *   Each slot (input and output block) is owned by either the ARM or the
+ *   DSP side, never both; see dsp_offload.c.
+ */
+
+// Success and failure definitions for the offload functions
+#define     OFFLOAD_SUCCESS      0
+#define     OFFLOAD_FAILURE      -1
+
+#define     OFFLOAD_SYNC         0		// Call audio_process() in place
+#define     OFFLOAD_ASYNC        1		// Overlap it with capture and playback
+#define     OFFLOAD_RING         2		// As async, through a persistent DSP loop
+
+#define     OFFLOAD_SLOTS        2		// Double-buffered: one on the DSP, one on the ARM
+
+// Function prototypes
+int   offload_init( int  blksize, int  mode );
+
+char *offload_input( void );
+
+void  offload_submit( int  bypass );
+
+char *offload_collect( void );
+
+char *offload_drain( void );
+
+int   offload_stalled( void );
+
+void  offload_release( void );
+
+void  offload_cleanup( void );
+
+void  offload_report( FILE * fp );
+
+int   offload_benchmark( int  blksize, int  blocks, int  dspUs, int  armUs, FILE * fp );
+
+int   offload_overhead( int  calls, FILE * fp );
@@ -0,0 +1,98 @@
+/*
+ *   dsp_ring.c
+ *
+ *   The DSP end of the ring. dsp_ring_loop() is called once and keeps
+ *   polling the doorbell until the ARM sets stop, so after that first call
+ *   a block costs a cache invalidate and writeback on each side instead of
+ *   a C6Run RPC. Descriptors are served strictly in order.
+ *
+ *   Built into audioThru_arm.lib the same code runs natively in the offload
+ *   worker thread, the cache operations become memory barriers and an empty
+ *   poll yields the CPU.
+ */
+
+//* Standard Linux headers **
+#include     <stdio.h>		// Always include stdio.h
+#include     <stdlib.h>		// Always include stdlib.h
+#include     <string.h>		// Defines memcpy
+
+//* Application headers **
+#include     "audio_process.h"
+#include     "dsp_ring.h"
+
+#if defined(_TMS320C6X)		// On the DSP
+extern void C6RUN_CACHE_inv( void *ptr, size_t size );
+extern void C6RUN_CACHE_wb( void *ptr, size_t size );
+#define     RING_INV( p, n )     C6RUN_CACHE_inv( ( void * ) ( p ), ( n ) )
+#define     RING_WB( p, n )      C6RUN_CACHE_wb( ( void * ) ( p ), ( n ) )
+#define     RING_IDLE( )
+#define     RING_DELAY( us )
+#else				// Host stand-in
+#include     <sched.h>		// sched_yield
+#include     <unistd.h>		// usleep
+#define     RING_INV( p, n )     __sync_synchronize( )
+#define     RING_WB( p, n )      __sync_synchronize( )
+#define     RING_IDLE( )         sched_yield( )
+#define     RING_DELAY( us )     do { if( us ) usleep( us ); } while( 0 )
+#endif
+
+//*******************************************************************************
+//*  dsp_ring_loop                                                             **
+//*******************************************************************************
+//*  Input Parameters:                                                         **
+//*      DspRing *ring -- the shared ring, set up by the ARM                   **
+//*                                                                            **
+//*  Return Value:                                                             **
+//*      int -- number of blocks served                                        **
+//*******************************************************************************
+int dsp_ring_loop( DspRing * ring )
+{
+    char         *base = ( char * ) ring;
+    DspRingDesc  *d;
+    int           served = 0;
+
+    ring->running = 1;
+    RING_WB( &ring->running, sizeof( ring->running ) );
+
+    for( ;; ) {
+        RING_INV( ring, sizeof( ring->doorbell ) + sizeof( ring->stop ) );
+        if( ring->doorbell == served ) {
+            if( ring->stop )
+                break;
+            RING_IDLE( );
+            continue;
+        }
+
+        d = &ring->desc[ served % ring->slots ];
+        RING_INV( d, sizeof( *d ) );
+        RING_INV( base + d->inOffset, d->bytes );
+
+        if( d->bypass )
+            memcpy( base + d->outOffset, base + d->inOffset, d->bytes );
+        else {
+            audio_process( ( short * ) ( base + d->outOffset ),
+                           ( short * ) ( base + d->inOffset ), d->bytes / 2 );
+            RING_DELAY( ring->delayUs );
+        }
+        RING_WB( base + d->outOffset, d->bytes );
+
+        d->state = RING_DONE;
+        RING_WB( d, sizeof( *d ) );
+        served++;
+    }
+
+    ring->running = 0;
+    RING_WB( &ring->running, sizeof( ring->running ) );
+    return served;
+}
+
+//*******************************************************************************
+//*  dsp_ring_nop                                                              **
+//*******************************************************************************
+//*  An empty call, timed the way void_fxn_time does to give the cost of the   **
+//*  RPC the ring replaces.                                                    **
+//*******************************************************************************
+int dsp_ring_nop( void )
+{
+    return 0;
+}
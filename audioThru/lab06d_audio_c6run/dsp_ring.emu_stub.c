@@ -0,0 +1,52 @@
+/*
+ *   dsp_ring.emu_stub.c
+ *
+ *   Host stand-in for the generated dsp_ring.gpp_stub.c. The ring is
+ *   in/out like any unqualified pointer; while dsp_ring_loop() runs, the
+ *   ARM side reaches it only through its own cache operations.
+ */
+
+#include     "c6run_emu.h"
+#include     "dsp_ring.h"
+
+// The DSP-side functions, renamed when built for emulation
+extern int dsp_ring_loop_dsp( DspRing * ring );
+extern int dsp_ring_nop_dsp( void );
+
+typedef  struct  dsp_ring_args
+{
+    DspRing  *ring;
+    int       ret;
+} dsp_ring_args;
+
+static void dsp_ring_loop_call( void * p )
+{
+    dsp_ring_args  *a = p;
+
+    a->ret = dsp_ring_loop_dsp( a->ring );
+}
+
+static void dsp_ring_nop_call( void * p )
+{
+    dsp_ring_args  *a = p;
+
+    a->ret = dsp_ring_nop_dsp( );
+}
+
+int dsp_ring_loop( DspRing * ring )
+{
+    dsp_ring_args  a;
+
+    a.ring = c6run_emu_arg( ring, C6RUN_EMU_INOUT );
+    c6run_emu_dispatch( "dsp_ring_loop", dsp_ring_loop_call, &a );
+    c6run_emu_arg_done( ring, C6RUN_EMU_INOUT );
+    return a.ret;
+}
+
+int dsp_ring_nop( void )
+{
+    dsp_ring_args  a;
+
+    c6run_emu_dispatch( "dsp_ring_nop", dsp_ring_nop_call, &a );
+    return a.ret;
+}
@@ -0,0 +1,52 @@
+/*
+ *   dsp_ring.h
+ *
+ *   Shared-memory descriptor ring between the ARM and a persistent loop on
+ *   the DSP. The whole ring, header, descriptors and blocks, is one
+ *   contiguous C6Run allocation, and descriptors hold byte offsets from its
+ *   start rather than pointers, so only the ring's own address has to be
+ *   translated (once, when dsp_ring_loop() is called).
+ *
+ *   Everything one side writes and the other reads sits on its own cache
+ *   line, so a writeback never carries a stale copy of the other side's
+ *   data with it.
+ */
+
+#define     RING_LINE            128	// C64x+ L2 line; a multiple of the ARM's
+#define     RING_MAX_SLOTS       4
+
+// Descriptor states: FREE and DONE belong to the ARM, READY to the DSP
+#define     RING_FREE            0
+#define     RING_READY           1
+#define     RING_DONE            2
+
+typedef  struct  DspRingDesc
+{
+    volatile int  state;
+    int           bypass;	// Copy the block through instead of processing it
+    int           bytes;
+    int           inOffset;	// From the start of the ring
+    int           outOffset;
+    int           pad[ RING_LINE / sizeof( int ) - 5 ];
+} DspRingDesc;
+
+typedef  struct  DspRing
+{
+    // Written by the ARM
+    volatile int  doorbell;	// Blocks posted so far
+    volatile int  stop;
+    int           slots;
+    int           delayUs;	// Host stand-in only: emulated DSP time per block
+    int           pad0[ RING_LINE / sizeof( int ) - 4 ];
+
+    // Written by the DSP
+    volatile int  running;
+    int           pad1[ RING_LINE / sizeof( int ) - 1 ];
+
+    DspRingDesc   desc[ RING_MAX_SLOTS ];
+} DspRing;
+
+// Function prototypes (these run on the DSP)
+int dsp_ring_loop( DspRing * ring );
+
+int dsp_ring_nop( void );
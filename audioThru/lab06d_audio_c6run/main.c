@@ -13,11 +13,20 @@
 #include     <stdio.h>              // Always include this header
 #include     <stdlib.h>             // Always include this header
 #include     <signal.h>             // Defines signal-handling functions (i.e. trap Ctrl-C)
+#include     <unistd.h>             // getopt
 
 
 // Application headers
 #include     "debug.h"
 #include     "audio_thread.h"
+#include     "trace.h"              // Chrome trace export
+#include     "watchdog.h"           // Overload shedding
+#include     "dsp_offload.h"        // Offload benchmark
+#include     "shm_pool.h"           // Shared buffer pool benchmark
+#include     "shm_heap.h"           // Shared-memory heap benchmark
+
+// Block size for -B: a 10 ms stereo 16-bit block at 48 kHz
+#define BENCH_BLOCK_BYTES   ( 480 * 4 )
 
 // Global audio thread environment
 audio_thread_env audio_env = {0};
@@ -44,7 +53,70 @@ int main( int argc, char *argv[] )
     int   status = EXIT_SUCCESS;
 
     void *audioThreadReturn;
+    int   opt;
+    int   benchBlocks = 0, dspUs = 0, armUs = 0, overheadCalls = 0, poolCalls = 0;
+    int   heapCalls = 0, misuseCheck = 0;
+
+    // -t <file>: record a Chrome trace, written on exit and on SIGUSR1
+    // -a: process block N on the DSP while block N+1 is captured
+    // -r: as -a, but feed a persistent DSP loop through a shared-memory ring
+    // -B blocks[,dsp_us[,arm_us]]: compare the offload modes without ALSA
+    // -C calls: time an empty RPC against an empty ring round trip
+    // -S calls: compare pool hand-offs with per-call cache maintenance
+    // -M: check the pool refuses a slab the ARM does not own (prints errors)
+    // -H calls: compare the slab heap with C6RUN_MEM_malloc (malloc on the host)
+    while( ( opt = getopt( argc, argv, "t:arB:C:S:MH:" ) ) != -1 ) {
+        switch( opt ) {
+        case 't':
+            if( trace_init( optarg ) == TRACE_FAILURE )
+                exit( EXIT_FAILURE );
+            break;
+        case 'a':
+            audio_env.offload = OFFLOAD_ASYNC;
+            break;
+        case 'r':
+            audio_env.offload = OFFLOAD_RING;
+            break;
+        case 'B':
+            sscanf( optarg, "%d,%d,%d", &benchBlocks, &dspUs, &armUs );
+            break;
+        case 'C':
+            overheadCalls = atoi( optarg );
+            break;
+        case 'S':
+            poolCalls = atoi( optarg );
+            break;
+        case 'M':
+            misuseCheck = 1;
+            break;
+        case 'H':
+            heapCalls = atoi( optarg );
+            break;
+        default:
+            fprintf( stderr, "Usage: %s [-t trace.json] [-a | -r] [-B blocks[,dsp_us[,arm_us]]] [-C calls] [-S calls] [-M] [-H calls]\n", argv[0] );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    if( benchBlocks > 0 || overheadCalls > 0 || poolCalls > 0 || heapCalls > 0 || misuseCheck ) {
+        if( poolCalls > 0 && shmpool_benchmark( poolCalls, stdout ) == SHMPOOL_FAILURE )
+            status = EXIT_FAILURE;
+        if( misuseCheck && shmpool_misuse_check( stdout ) == SHMPOOL_FAILURE )
+            status = EXIT_FAILURE;
+        if( heapCalls > 0 && shmheap_benchmark( heapCalls, BENCH_BLOCK_BYTES, stdout ) == SHMHEAP_FAILURE )
+            status = EXIT_FAILURE;
+        if( overheadCalls > 0 && offload_overhead( overheadCalls, stdout ) == OFFLOAD_FAILURE )
+            status = EXIT_FAILURE;
+        if( benchBlocks > 0 && status == EXIT_SUCCESS &&
+            offload_benchmark( BENCH_BLOCK_BYTES, benchBlocks, dspUs, armUs, stdout ) == OFFLOAD_FAILURE )
+            status = EXIT_FAILURE;
+        trace_shutdown( );
+        exit( status );
+    }
+
 
+    // If the DSP keeps making blocks late, bypass it rather than glitch
+    wd_init( WD_BYPASS_DSP );
 
     // Set the signal callback for Ctrl-C
     pSigPrev = signal(SIGINT, signal_handler);
@@ -60,6 +132,9 @@ int main( int argc, char *argv[] )
     else
         DBG( "Audio thread exited with SUCCESS status\n" );
 
+    trace_shutdown( );
+    wd_report( stdout );
+
     exit( status );
 }
 
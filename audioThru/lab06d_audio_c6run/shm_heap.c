@@ -0,0 +1,572 @@
+/*
+ *   shm_heap.c
+ *
+ *   Each thread's cache holds up to SHMHEAP_CACHE free blocks per class
+ *   as a plain stack, so the common alloc and free touch no lock and no
+ *   shared cache line. When a stack runs dry it takes SHMHEAP_BATCH
+ *   blocks from the class (its free list first, then the rest of the
+ *   class's newest page, then a fresh page from the arena); when one
+ *   fills up it gives SHMHEAP_BATCH back. A page keeps its class for
+ *   good, which is what makes free O(1): the page number gives the size.
+ *
+ *   Counters live in the caches too and are only summed for a report, so
+ *   the figures are a snapshot if other threads are still allocating.
+ */
+
+//* Standard Linux headers **
+#include     <stdio.h>		// Always include stdio.h
+#include     <stdlib.h>		// Always include stdlib.h
+#include     <string.h>		// Defines memset
+#include     <stdint.h>		// uintptr_t
+#include     <time.h>		// clock_gettime
+#include     <pthread.h>
+
+//* Application headers **
+#include     "debug.h"		// DBG and ERR macros
+#include     "shm_heap.h"
+
+// Present only when linked against the C6Run DSP library
+extern void *C6RUN_MEM_malloc( size_t size ) __attribute__(( weak ));
+extern void  C6RUN_MEM_free( void *ptr ) __attribute__(( weak ));
+
+#define     NO_CLASS        0xff
+#define     LINE            ( 1 << SHMHEAP_MIN_SHIFT )	// Block alignment
+
+struct  ShmHeapCache
+{
+    ShmHeap             *heap;
+    ShmHeapCache        *next;
+    int                  count[ SHMHEAP_CLASSES ];
+    void                *blocks[ SHMHEAP_CLASSES ][ SHMHEAP_CACHE ];
+
+    unsigned long        allocs[ SHMHEAP_CLASSES ], frees[ SHMHEAP_CLASSES ];
+    unsigned long long   requested, granted;
+    unsigned long        large, largeFrees, refills, flushes, failures;
+};
+
+static void *dsp_malloc( size_t  n )
+{
+    return C6RUN_MEM_malloc ? C6RUN_MEM_malloc( n ) : malloc( n );
+}
+
+static void dsp_free( void * p )
+{
+    if( C6RUN_MEM_free )
+        C6RUN_MEM_free( p );
+    else
+        free( p );
+}
+
+// CMEM and malloc only promise 8 or 16 byte alignment. Take a line more,
+// round up to the next line and keep what dsp_malloc returned in the word
+// below, which lies outside the block.
+static void *dsp_malloc_lines( size_t  n )
+{
+    char  *raw = dsp_malloc( n + LINE ), *p;
+
+    if( raw == NULL )
+        return NULL;
+    p = ( char * ) ( ( ( uintptr_t ) raw + LINE ) & ~( uintptr_t ) ( LINE - 1 ) );
+    ( ( void ** ) p )[ -1 ] = raw;
+    return p;
+}
+
+static void dsp_free_lines( void * p )
+{
+    dsp_free( ( ( void ** ) p )[ -1 ] );
+}
+
+// Sub-microsecond: a fill of 64 KB blocks is only 16 calls
+static double now_us( void )
+{
+    struct timespec  ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int size_class( size_t  size )
+{
+    if( size <= ( 1 << SHMHEAP_MIN_SHIFT ) )
+        return 0;
+    return 32 - __builtin_clz( ( unsigned int ) size - 1 ) - SHMHEAP_MIN_SHIFT;
+}
+
+// Adds a cache's counters into the heap's totals; heap->lock held
+static void fold_counters( ShmHeap * heap, ShmHeapCache * c )
+{
+    int  k;
+
+    for( k = 0; k < SHMHEAP_CLASSES; k++ ) {
+        heap->allocs[ k ] += c->allocs[ k ];
+        heap->frees[ k ]  += c->frees[ k ];
+    }
+    heap->requested  += c->requested;
+    heap->granted    += c->granted;
+    heap->large      += c->large;
+    heap->largeFrees += c->largeFrees;
+    heap->refills    += c->refills;
+    heap->flushes    += c->flushes;
+    heap->failures   += c->failures;
+}
+
+// Returns up to n blocks from the top of a cache stack to the class
+static void flush( ShmHeap * heap, ShmHeapCache * c, int  k, int  n )
+{
+    ShmHeapClass  *cls = &heap->classes[ k ];
+    void          *b;
+
+    pthread_mutex_lock( &cls->lock );
+    while( n-- > 0 && c->count[ k ] > 0 ) {
+        b = c->blocks[ k ][ --c->count[ k ] ];
+        *( void ** ) b = cls->freeList;
+        cls->freeList  = b;
+    }
+    pthread_mutex_unlock( &cls->lock );
+    c->flushes++;
+}
+
+// Thread exit: blocks go back to the heap, counters into its totals
+static void cache_destructor( void * p )
+{
+    ShmHeapCache   *c = p, **pp;
+    ShmHeap        *heap = c->heap;
+    int             k;
+
+    for( k = 0; k < SHMHEAP_CLASSES; k++ )
+        flush( heap, c, k, SHMHEAP_CACHE );
+
+    pthread_mutex_lock( &heap->lock );
+    for( pp = &heap->caches; *pp != NULL; pp = &( *pp )->next )
+        if( *pp == c ) {
+            *pp = c->next;
+            break;
+        }
+    fold_counters( heap, c );
+    pthread_mutex_unlock( &heap->lock );
+
+    free( c );
+}
+
+static ShmHeapCache *thread_cache( ShmHeap * heap )
+{
+    ShmHeapCache  *c = pthread_getspecific( heap->key );
+
+    if( c != NULL )
+        return c;
+
+    // Plain malloc: the cache itself never goes near the DSP
+    if( ( c = calloc( 1, sizeof( *c ) ) ) == NULL )
+        return NULL;
+    c->heap = heap;
+    pthread_setspecific( heap->key, c );
+
+    pthread_mutex_lock( &heap->lock );
+    c->next      = heap->caches;
+    heap->caches = c;
+    pthread_mutex_unlock( &heap->lock );
+
+    return c;
+}
+
+// Moves up to SHMHEAP_BATCH blocks of class k into the cache
+static void refill( ShmHeap * heap, ShmHeapCache * c, int  k )
+{
+    ShmHeapClass  *cls = &heap->classes[ k ];
+    size_t         bs = ( size_t ) 1 << ( SHMHEAP_MIN_SHIFT + k );
+    void          *b;
+    int            n, page;
+
+    pthread_mutex_lock( &cls->lock );
+    for( n = 0; n < SHMHEAP_BATCH; n++ ) {
+        if( cls->freeList != NULL ) {
+            b = cls->freeList;
+            cls->freeList = *( void ** ) b;
+        }
+        else {
+            if( cls->carve == cls->carveEnd ) {
+                pthread_mutex_lock( &heap->lock );
+                page = heap->usedPages < heap->numPages ? heap->usedPages++ : -1;
+                if( page != -1 )
+                    heap->pageClass[ page ] = k;
+                pthread_mutex_unlock( &heap->lock );
+                if( page == -1 )
+                    break;
+
+                cls->carve    = heap->base + ( size_t ) page * SHMHEAP_PAGE;
+                cls->carveEnd = cls->carve + SHMHEAP_PAGE;
+                cls->pages++;
+            }
+            b = cls->carve;
+            cls->carve += bs;
+        }
+        c->blocks[ k ][ c->count[ k ]++ ] = b;
+    }
+    pthread_mutex_unlock( &cls->lock );
+    c->refills++;
+}
+
+/******************************************************************************
+ * shmheap_create
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      ShmHeap *heap      -- filled in                                       */
+/*      size_t arenaBytes  -- rounded down to whole pages                     */
+/*                                                                            */
+/*  return value: SHMHEAP_SUCCESS or SHMHEAP_FAILURE                          */
+/******************************************************************************/
+int shmheap_create( ShmHeap * heap, size_t  arenaBytes )
+{
+    int  k;
+
+    memset( heap, 0, sizeof( *heap ) );
+    heap->numPages = arenaBytes / SHMHEAP_PAGE;
+    heap->size     = ( size_t ) heap->numPages * SHMHEAP_PAGE;
+
+    if( heap->numPages == 0 ) {
+        ERR( "A heap needs at least one %d byte page\n", SHMHEAP_PAGE );
+        return SHMHEAP_FAILURE;
+    }
+
+    heap->pageClass = malloc( heap->numPages );
+    heap->base      = dsp_malloc_lines( heap->size );
+    if( heap->pageClass == NULL || heap->base == NULL ) {
+        ERR( "Failed to allocate a %lu byte heap arena\n", ( unsigned long ) heap->size );
+        free( heap->pageClass );
+        if( heap->base != NULL )
+            dsp_free_lines( heap->base );
+        return SHMHEAP_FAILURE;
+    }
+    memset( heap->pageClass, NO_CLASS, heap->numPages );
+
+    if( pthread_key_create( &heap->key, cache_destructor ) != 0 ) {
+        ERR( "Failed to create the heap's thread cache key\n" );
+        free( heap->pageClass );
+        dsp_free_lines( heap->base );
+        return SHMHEAP_FAILURE;
+    }
+
+    pthread_mutex_init( &heap->lock, NULL );
+    for( k = 0; k < SHMHEAP_CLASSES; k++ )
+        pthread_mutex_init( &heap->classes[ k ].lock, NULL );
+
+    DBG( "Heap of %d pages at %p (%s)\n", heap->numPages, heap->base,
+         C6RUN_MEM_malloc ? "CMEM" : "malloc" );
+
+    return SHMHEAP_SUCCESS;
+}
+
+/******************************************************************************
+ * shmheap_destroy
+ ******************************************************************************/
+/*  Every thread must be done with the heap; their caches go with it.        */
+/******************************************************************************/
+void shmheap_destroy( ShmHeap * heap )
+{
+    ShmHeapCache  *c;
+    int            k;
+
+    if( heap->base == NULL )
+        return;
+
+    pthread_key_delete( heap->key );
+    while( ( c = heap->caches ) != NULL ) {
+        heap->caches = c->next;
+        free( c );
+    }
+
+    for( k = 0; k < SHMHEAP_CLASSES; k++ )
+        pthread_mutex_destroy( &heap->classes[ k ].lock );
+    pthread_mutex_destroy( &heap->lock );
+
+    dsp_free_lines( heap->base );
+    free( heap->pageClass );
+    heap->base = NULL;
+}
+
+/******************************************************************************
+ * shmheap_alloc
+ ******************************************************************************/
+/*  return value: a block of at least size bytes, aligned to 128 bytes, or    */
+/*                NULL when the arena has no page left for its class          */
+/******************************************************************************/
+void *shmheap_alloc( ShmHeap * heap, size_t  size )
+{
+    ShmHeapCache  *c = thread_cache( heap );
+    int            k;
+
+    if( c == NULL )
+        return NULL;
+
+    if( size > SHMHEAP_MAX_BLOCK ) {
+        c->large++;
+        return dsp_malloc_lines( size );
+    }
+
+    k = size_class( size );
+    if( c->count[ k ] == 0 ) {
+        refill( heap, c, k );
+        if( c->count[ k ] == 0 ) {
+            c->failures++;
+            return NULL;
+        }
+    }
+
+    c->allocs[ k ]++;
+    c->requested += size;
+    c->granted   += ( size_t ) 1 << ( SHMHEAP_MIN_SHIFT + k );
+    return c->blocks[ k ][ --c->count[ k ] ];
+}
+
+/******************************************************************************
+ * shmheap_free
+ ******************************************************************************/
+void shmheap_free( ShmHeap * heap, void * ptr )
+{
+    ShmHeapCache  *c;
+    long           off = ( char * ) ptr - heap->base;
+    int            k;
+
+    if( ptr == NULL )
+        return;
+
+    c = thread_cache( heap );
+
+    // Not from the arena: one of the large blocks
+    if( off < 0 || ( size_t ) off >= heap->size ) {
+        if( c != NULL )
+            c->largeFrees++;
+        dsp_free_lines( ptr );
+        return;
+    }
+
+    k = heap->pageClass[ off / SHMHEAP_PAGE ];
+    if( k == NO_CLASS || off % ( 1L << ( SHMHEAP_MIN_SHIFT + k ) ) != 0 ) {
+        ERR( "shmheap_free: %p is not a block of this heap\n", ptr );
+        return;
+    }
+
+    if( c == NULL ) {
+        // No cache to park it in: straight back to the class
+        ShmHeapClass  *cls = &heap->classes[ k ];
+
+        pthread_mutex_lock( &cls->lock );
+        *( void ** ) ptr = cls->freeList;
+        cls->freeList    = ptr;
+        pthread_mutex_unlock( &cls->lock );
+        return;
+    }
+
+    if( c->count[ k ] == SHMHEAP_CACHE )
+        flush( heap, c, k, SHMHEAP_BATCH );
+
+    c->blocks[ k ][ c->count[ k ]++ ] = ptr;
+    c->frees[ k ]++;
+}
+
+/******************************************************************************
+ * shmheap_report
+ ******************************************************************************/
+/*  Internal fragmentation is what rounding up to a class has cost over all   */
+/*  allocations; external is how much of the pages given to classes is not   */
+/*  in use right now (free lists, thread caches, uncarved page tails).       */
+/******************************************************************************/
+void shmheap_report( ShmHeap * heap, FILE * fp )
+{
+    ShmHeapCache        *c;
+    ShmHeap              t;
+    unsigned long        live;
+    unsigned long long   liveBytes = 0, pageBytes = 0;
+    int                  k, caches = 0;
+
+    pthread_mutex_lock( &heap->lock );
+    t = *heap;
+    for( c = heap->caches; c != NULL; c = c->next, caches++ )
+        fold_counters( &t, c );
+    pthread_mutex_unlock( &heap->lock );
+
+    fprintf( fp, "%8s %6s %8s %10s %10s\n", "class", "pages", "live", "allocs", "idle KB" );
+    for( k = 0; k < SHMHEAP_CLASSES; k++ ) {
+        size_t  bs = ( size_t ) 1 << ( SHMHEAP_MIN_SHIFT + k );
+
+        if( t.classes[ k ].pages == 0 )
+            continue;
+        live = t.allocs[ k ] - t.frees[ k ];
+        fprintf( fp, "%8lu %6lu %8lu %10lu %10.1f\n", ( unsigned long ) bs, t.classes[ k ].pages,
+                 live, t.allocs[ k ],
+                 ( t.classes[ k ].pages * ( double ) SHMHEAP_PAGE - live * ( double ) bs ) / 1024 );
+        liveBytes += ( unsigned long long ) live * bs;
+        pageBytes += ( unsigned long long ) t.classes[ k ].pages * SHMHEAP_PAGE;
+    }
+
+    fprintf( fp, "Arena: %d of %d pages in use (%lu KB)\n", t.usedPages, t.numPages,
+             ( unsigned long ) ( t.size / 1024 ) );
+    fprintf( fp, "Fragmentation: internal %.1f%% (rounding to class), external %.1f%% (idle in class pages)\n",
+             t.granted ? 100.0 * ( t.granted - t.requested ) / t.granted : 0.0,
+             pageBytes ? 100.0 * ( pageBytes - liveBytes ) / pageBytes : 0.0 );
+    fprintf( fp, "Thread caches: %d live, %lu refills, %lu flushes; large: %lu allocs, %lu frees; %lu failed\n",
+             caches, t.refills, t.flushes, t.large, t.largeFrees, t.failures );
+}
+
+//*******************************************************************************
+//*  Benchmark                                                                 **
+//*******************************************************************************
+
+#define     BENCH_TOTAL_MEM      ( 1024 * 1024 )	// As in test/common/malloc_test
+#define     BENCH_ARENA          ( 16 * 1024 * 1024 )
+#define     BENCH_THREADS        4
+#define     BENCH_WINDOW         16
+
+static ShmHeap   *benchHeap;		// NULL: time the current allocator
+
+static void *bench_alloc( size_t  n )
+{
+    return benchHeap ? shmheap_alloc( benchHeap, n ) : dsp_malloc( n );
+}
+
+static void bench_free( void * p )
+{
+    if( benchHeap )
+        shmheap_free( benchHeap, p );
+    else
+        dsp_free( p );
+}
+
+// malloc_test's pattern: 1 MB in blocks of n, then all freed; us per op
+static int bench_fill( size_t  n, double * allocUs, double * freeUs )
+{
+    static void         *ptr[ BENCH_TOTAL_MEM / 64 ];
+    int                  count = BENCH_TOTAL_MEM / n, i, round, errors = 0;
+    double               t0;
+
+    // The second round is timed: both allocators have their memory by then
+    for( round = 0; round < 2; round++ ) {
+        t0 = now_us( );
+        for( i = 0; i < count; i++ )
+            ptr[ i ] = bench_alloc( n );
+        *allocUs = ( now_us( ) - t0 ) / count;
+
+        for( i = 0; i < count; i++ ) {
+            if( ptr[ i ] == NULL )
+                return -1;
+            *( int * ) ptr[ i ] = i;
+            ( ( char * ) ptr[ i ] )[ n - 1 ] = ( char ) i;
+        }
+        for( i = 0; i < count; i++ )
+            errors += *( int * ) ptr[ i ] != i || ( ( char * ) ptr[ i ] )[ n - 1 ] != ( char ) i;
+
+        t0 = now_us( );
+        for( i = 0; i < count; i++ )
+            bench_free( ptr[ i ] );
+        *freeUs = ( now_us( ) - t0 ) / count;
+    }
+
+    return errors;
+}
+
+// The offload pattern: an input and an output block per call, both freed
+static double bench_churn( int  calls, size_t  n )
+{
+    double               t0 = now_us( );
+    char                *in, *out;
+    int                  i;
+
+    for( i = 0; i < calls; i++ ) {
+        in  = bench_alloc( n );
+        out = bench_alloc( n );
+        if( in == NULL || out == NULL )
+            return -1;
+        in[ 0 ] = out[ n - 1 ] = ( char ) i;
+        bench_free( in );
+        bench_free( out );
+    }
+
+    return ( now_us( ) - t0 ) / calls;
+}
+
+// Several threads each keep a window of mixed-size blocks, replacing one a call
+static void *bench_thread( void * arg )
+{
+    void          *win[ BENCH_WINDOW ] = { NULL };
+    unsigned int   seed = ( unsigned int ) ( long ) arg * 2654435761u + 1;
+    int            calls = ( int ) ( ( long ) arg >> 8 ), i, slot;
+
+    for( i = 0; i < calls; i++ ) {
+        seed = seed * 1103515245 + 12345;
+        slot = ( seed >> 8 ) % BENCH_WINDOW;
+        bench_free( win[ slot ] );
+        win[ slot ] = bench_alloc( 64 << ( ( seed >> 16 ) % 8 ) );	// 64 B .. 8 KB
+    }
+    for( i = 0; i < BENCH_WINDOW; i++ )
+        bench_free( win[ i ] );
+
+    return NULL;
+}
+
+static double bench_threads( int  calls )
+{
+    pthread_t            th[ BENCH_THREADS ];
+    double               t0 = now_us( );
+    long                 i;
+
+    for( i = 0; i < BENCH_THREADS; i++ )
+        pthread_create( &th[ i ], NULL, bench_thread, ( void * ) ( ( ( long ) calls << 8 ) | i ) );
+    for( i = 0; i < BENCH_THREADS; i++ )
+        pthread_join( th[ i ], NULL );
+
+    return ( now_us( ) - t0 ) / ( ( double ) calls * BENCH_THREADS );
+}
+
+/******************************************************************************
+ * shmheap_benchmark
+ ******************************************************************************/
+/*  Times the current allocator (C6RUN_MEM_malloc, or malloc on the host)     */
+/*  against the heap: malloc_test's 1 MB fills, the per-block churn of an     */
+/*  offload path, and several threads churning mixed sizes at once.           */
+/*                                                                            */
+/*  return value: SHMHEAP_SUCCESS, or SHMHEAP_FAILURE if blocks overlapped    */
+/*                or an allocation failed                                    */
+/******************************************************************************/
+int shmheap_benchmark( int  calls, size_t  blockBytes, FILE * fp )
+{
+    static const size_t  sizes[] = { 64, 128, 256, 1024, 2048, 4096, 16384, 32768, 65536 };
+    const char          *cur = C6RUN_MEM_malloc ? "CMEM" : "malloc";
+    ShmHeap              heap;
+    double               a[ 2 ], f[ 2 ], churn[ 2 ], mt[ 2 ];
+    int                  s, h, errors = 0;
+
+    if( shmheap_create( &heap, BENCH_ARENA ) == SHMHEAP_FAILURE )
+        return SHMHEAP_FAILURE;
+
+    fprintf( fp, "1 MB in blocks of n, per op (us)\n" );
+    fprintf( fp, "%8s %10s %10s %10s %10s\n", "n", cur, "free", "heap", "free" );
+    for( s = 0; s < sizeof( sizes ) / sizeof( sizes[ 0 ] ); s++ ) {
+        for( h = 0; h < 2; h++ ) {
+            benchHeap = h ? &heap : NULL;
+            if( bench_fill( sizes[ s ], &a[ h ], &f[ h ] ) != 0 )
+                errors++;
+        }
+        fprintf( fp, "%8lu %10.3f %10.3f %10.3f %10.3f\n", ( unsigned long ) sizes[ s ],
+                 a[ 0 ], f[ 0 ], a[ 1 ], f[ 1 ] );
+    }
+
+    for( h = 0; h < 2; h++ ) {
+        benchHeap = h ? &heap : NULL;
+        churn[ h ] = bench_churn( calls, blockBytes );
+        mt[ h ]    = bench_threads( calls );
+        if( churn[ h ] < 0 )
+            errors++;
+    }
+    benchHeap = NULL;
+
+    fprintf( fp, "Offload churn, 2 x %lu B per call: %s %.3f us, heap %.3f us\n",
+             ( unsigned long ) blockBytes, cur, churn[ 0 ], churn[ 1 ] );
+    fprintf( fp, "%d threads, 64 B..8 KB, per call: %s %.3f us, heap %.3f us\n",
+             BENCH_THREADS, cur, mt[ 0 ], mt[ 1 ] );
+    shmheap_report( &heap, fp );
+    shmheap_destroy( &heap );
+
+    if( errors )
+        ERR( "%d heap benchmark checks failed\n", errors );
+    return errors ? SHMHEAP_FAILURE : SHMHEAP_SUCCESS;
+}
@@ -0,0 +1,69 @@
+/*
+ *   shm_heap.h
+ *
+ *   A general-purpose allocator for DSP-visible memory. One arena is
+ *   taken from C6Run's CMEM heap up front (plain malloc on the host) and
+ *   cut into 64 KB pages; each page serves one power-of-two size class
+ *   from 128 B to 64 KB. Alloc and free are O(1): a thread first uses its
+ *   own cache of blocks per class and only takes the class lock to move
+ *   a batch to or from the shared free list. Requests above 64 KB go
+ *   straight to C6RUN_MEM_malloc/malloc.
+ *
+ *   Blocks are whole 128-byte lines, so the cache operations done on one
+ *   never touch a neighbour.
+ */
+
+#include     <pthread.h>
+
+/* SUCCESS and FAILURE definitions for the heap functions */
+#define     SHMHEAP_SUCCESS      0
+#define     SHMHEAP_FAILURE      -1
+
+#define     SHMHEAP_MIN_SHIFT    7			// Smallest class, 128 B
+#define     SHMHEAP_CLASSES      10			// 128 B .. 64 KB
+#define     SHMHEAP_PAGE         ( 64 * 1024 )
+#define     SHMHEAP_MAX_BLOCK    ( 1 << ( SHMHEAP_MIN_SHIFT + SHMHEAP_CLASSES - 1 ) )
+#define     SHMHEAP_CACHE        32			// Blocks a thread keeps per class
+#define     SHMHEAP_BATCH        16			// Blocks moved per trip to the shared list
+
+typedef  struct  ShmHeapClass
+{
+    pthread_mutex_t  lock;
+    void            *freeList;		// Linked through the first word of each block
+    char            *carve, *carveEnd;	// Untouched part of the newest page
+    unsigned long    pages;
+} ShmHeapClass;
+
+/* Per-thread block cache and counters; see shm_heap.c */
+typedef  struct  ShmHeapCache  ShmHeapCache;
+
+typedef  struct  ShmHeap
+{
+    char            *base;
+    size_t           size;
+    int              numPages, usedPages;
+    unsigned char   *pageClass;		// Class of each page, 0xff if unused
+    ShmHeapClass     classes[ SHMHEAP_CLASSES ];
+
+    pthread_mutex_t  lock;		// Arena pages, cache list, totals
+    pthread_key_t    key;
+    ShmHeapCache    *caches;
+
+    /* Counters folded in from the caches of threads that have exited */
+    unsigned long        allocs[ SHMHEAP_CLASSES ], frees[ SHMHEAP_CLASSES ];
+    unsigned long long   requested, granted;
+    unsigned long        large, largeFrees, refills, flushes, failures;
+} ShmHeap;
+
+/* Function prototypes */
+int   shmheap_create( ShmHeap * heap, size_t  arenaBytes );
+
+void  shmheap_destroy( ShmHeap * heap );
+
+void *shmheap_alloc( ShmHeap * heap, size_t  size );
+
+void  shmheap_free( ShmHeap * heap, void * ptr );
+
+void  shmheap_report( ShmHeap * heap, FILE * fp );
+
+int   shmheap_benchmark( int  calls, size_t  blockBytes, FILE * fp );
@@ -0,0 +1,423 @@
+/*
+ *   shm_pool.c
+ *
+ *   Free slabs are kept on a stack of indices and a slab's owner in a byte
+ *   per slab, so every call is O(1) and needs no lock (the pool belongs to
+ *   the thread that talks to the DSP). The cache hooks are the C6Run calls
+ *   when audioThru_dsp.lib provides them and are counted but otherwise
+ *   skipped on the host, where the memfd region stands in for CMEM.
+ */
+
+//* Standard Linux headers **
+#include     <stdio.h>		// Always include stdio.h
+#include     <stdlib.h>		// Always include stdlib.h
+#include     <string.h>		// Defines memset, memcpy
+#include     <errno.h>
+#include     <unistd.h>		// ftruncate, close, syscall
+#include     <time.h>		// clock_gettime
+#include     <sys/mman.h>		// mmap
+#include     <sys/syscall.h>		// __NR_memfd_create
+
+//* Application headers **
+#include     "debug.h"		// DBG and ERR macros
+#include     "shm_pool.h"
+
+// Present only when linked against the C6Run DSP library
+extern void *C6RUN_MEM_malloc( size_t size ) __attribute__(( weak ));
+extern void  C6RUN_MEM_free( void *ptr ) __attribute__(( weak ));
+extern void  C6RUN_CACHE_inv( void *ptr, size_t size ) __attribute__(( weak ));
+extern void  C6RUN_CACHE_wb( void *ptr, size_t size ) __attribute__(( weak ));
+extern void  C6RUN_CACHE_globalInv( void ) __attribute__(( weak ));
+extern void  C6RUN_CACHE_globalWb( void ) __attribute__(( weak ));
+
+static void cache_wb( void * p, size_t  n )
+{
+    if( C6RUN_CACHE_wb )
+        C6RUN_CACHE_wb( p, n );
+}
+
+static void cache_inv( void * p, size_t  n )
+{
+    if( C6RUN_CACHE_inv )
+        C6RUN_CACHE_inv( p, n );
+}
+
+// The benchmark's stand-in for the DSP's work, run on the ARM: its result
+// must reach memory before the invalidate, as the DSP's own writeback would
+// put it there (not counted as a hand-off operation)
+static void standin_copy( char * out, const char * in, size_t  n )
+{
+    memcpy( out, in, n );
+    cache_wb( out, n );
+}
+
+static unsigned long long now_us( void )
+{
+    struct timespec  ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( unsigned long long ) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Maps a region the size of the pool: a memfd, so it could be shared with
+// another process the way CMEM is, or anonymous memory if there is none
+static char *map_region( size_t  size, int * fd )
+{
+    void  *p;
+
+    *fd = -1;
+#ifdef __NR_memfd_create
+    *fd = syscall( __NR_memfd_create, "shm_pool", 0 );
+    if( *fd != -1 && ftruncate( *fd, size ) == -1 ) {
+        close( *fd );
+        *fd = -1;
+    }
+#endif
+
+    if( *fd != -1 )
+        p = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0 );
+    else
+        p = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+    if( p == MAP_FAILED ) {
+        if( *fd != -1 ) {
+            close( *fd );
+            *fd = -1;
+        }
+        return NULL;
+    }
+    return p;
+}
+
+// Slab index of buf, or -1 if it is not the start of one of our slabs
+static int slab_index( ShmPool * pool, void * buf )
+{
+    long  off = ( char * ) buf - pool->base;
+
+    if( buf == NULL || off < 0 || off % pool->slabSize ||
+        off / pool->slabSize >= ( unsigned long ) pool->slabs )
+        return -1;
+
+    return off / pool->slabSize;
+}
+
+/******************************************************************************
+ * shmpool_create
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      ShmPool *pool  -- filled in                                           */
+/*      size_t slabSize, int slabs                                            */
+/*                                                                            */
+/*  return value: SHMPOOL_SUCCESS or SHMPOOL_FAILURE                          */
+/******************************************************************************/
+int shmpool_create( ShmPool * pool, size_t  slabSize, int  slabs )
+{
+    size_t  size;
+    int     i;
+
+    memset( pool, 0, sizeof( *pool ) );
+    pool->slabSize = ( slabSize + SHMPOOL_ALIGN - 1 ) / SHMPOOL_ALIGN * SHMPOOL_ALIGN;
+    pool->slabs    = slabs;
+    pool->memfd    = -1;
+    size = pool->slabSize * slabs;
+
+    pool->owner    = calloc( slabs, sizeof( *pool->owner ) );
+    pool->freeList = malloc( slabs * sizeof( *pool->freeList ) );
+    if( pool->owner == NULL || pool->freeList == NULL )
+        goto fail;
+
+    if( C6RUN_MEM_malloc )
+        pool->base = C6RUN_MEM_malloc( size );
+    else
+        pool->base = map_region( size, &pool->memfd );
+    if( pool->base == NULL )
+        goto fail;
+
+    // Hand out the lowest addresses first
+    for( i = 0; i < slabs; i++ )
+        pool->freeList[ i ] = slabs - 1 - i;
+    pool->numFree = slabs;
+
+    DBG( "Shared pool: %d slabs of %lu bytes (%s)\n", slabs, ( unsigned long ) pool->slabSize,
+         C6RUN_MEM_malloc ? "CMEM" : pool->memfd != -1 ? "memfd" : "anonymous" );
+    return SHMPOOL_SUCCESS;
+
+fail:
+    ERR( "Failed to create a pool of %d x %lu bytes: %s\n", slabs,
+         ( unsigned long ) slabSize, strerror( errno ) );
+    pool->base = NULL;
+    shmpool_destroy( pool );
+    return SHMPOOL_FAILURE;
+}
+
+/******************************************************************************
+ * shmpool_destroy
+ ******************************************************************************/
+void shmpool_destroy( ShmPool * pool )
+{
+    if( pool->base != NULL ) {
+        if( C6RUN_MEM_free )
+            C6RUN_MEM_free( pool->base );
+        else
+            munmap( pool->base, pool->slabSize * pool->slabs );
+    }
+    if( pool->memfd != -1 )
+        close( pool->memfd );
+
+    free( pool->owner );
+    free( pool->freeList );
+    memset( pool, 0, sizeof( *pool ) );
+    pool->memfd = -1;
+}
+
+/******************************************************************************
+ * shmpool_get / shmpool_put
+ ******************************************************************************/
+/*  get returns an ARM-owned slab, or NULL if all are in use. Only the ARM    */
+/*  can give a slab back.                                                     */
+/******************************************************************************/
+void *shmpool_get( ShmPool * pool )
+{
+    int  i;
+
+    if( pool->numFree == 0 )
+        return NULL;
+
+    i = pool->freeList[ --pool->numFree ];
+    pool->owner[ i ] = SHMPOOL_ARM;
+    return pool->base + i * pool->slabSize;
+}
+
+int shmpool_put( ShmPool * pool, void * buf )
+{
+    int  i = slab_index( pool, buf );
+
+    if( i == -1 || pool->owner[ i ] != SHMPOOL_ARM ) {
+        ERR( "shmpool_put: %p is not an ARM-owned slab\n", buf );
+        return SHMPOOL_FAILURE;
+    }
+
+    pool->owner[ i ] = SHMPOOL_FREE;
+    pool->freeList[ pool->numFree++ ] = i;
+    return SHMPOOL_SUCCESS;
+}
+
+/******************************************************************************
+ * shmpool_to_dsp
+ ******************************************************************************/
+/*  Gives an ARM-owned slab to the DSP, writing back the first `written`      */
+/*  bytes: what the ARM filled in. Pass 0 for a slab the DSP will only write  */
+/*  to; lines the ARM merely read since the last invalidate are clean and    */
+/*  cannot be evicted on top of the DSP's data.                               */
+/******************************************************************************/
+int shmpool_to_dsp( ShmPool * pool, void * buf, size_t  written )
+{
+    int  i = slab_index( pool, buf );
+
+    if( i == -1 || pool->owner[ i ] != SHMPOOL_ARM || written > pool->slabSize ) {
+        ERR( "shmpool_to_dsp: %p is not an ARM-owned slab\n", buf );
+        return SHMPOOL_FAILURE;
+    }
+
+    if( written ) {
+        cache_wb( buf, written );
+        pool->wbOps++;
+        pool->wbBytes += written;
+    }
+    pool->owner[ i ] = SHMPOOL_DSP;
+    pool->handoffs++;
+    return SHMPOOL_SUCCESS;
+}
+
+/******************************************************************************
+ * shmpool_to_arm
+ ******************************************************************************/
+/*  Takes a slab back from the DSP, invalidating the `produced` bytes it     */
+/*  wrote (0 if it only read the slab).                                       */
+/******************************************************************************/
+int shmpool_to_arm( ShmPool * pool, void * buf, size_t  produced )
+{
+    int  i = slab_index( pool, buf );
+
+    if( i == -1 || pool->owner[ i ] != SHMPOOL_DSP || produced > pool->slabSize ) {
+        ERR( "shmpool_to_arm: %p is not a DSP-owned slab\n", buf );
+        return SHMPOOL_FAILURE;
+    }
+
+    if( produced ) {
+        cache_inv( buf, produced );
+        pool->invOps++;
+        pool->invBytes += produced;
+    }
+    pool->owner[ i ] = SHMPOOL_ARM;
+    pool->handoffs++;
+    return SHMPOOL_SUCCESS;
+}
+
+int shmpool_owner( ShmPool * pool, void * buf )
+{
+    int  i = slab_index( pool, buf );
+
+    return i == -1 ? SHMPOOL_FAILURE : pool->owner[ i ];
+}
+
+/******************************************************************************
+ * shmpool_report
+ ******************************************************************************/
+void shmpool_report( ShmPool * pool, FILE * fp )
+{
+    fprintf( fp, "Shared pool: %d/%d slabs free, %lu hand-offs, %lu writebacks (%llu bytes), "
+             "%lu invalidates (%llu bytes)\n", pool->numFree, pool->slabs, pool->handoffs,
+             pool->wbOps, pool->wbBytes, pool->invOps, pool->invBytes );
+}
+
+/******************************************************************************
+ * shmpool_benchmark
+ ******************************************************************************/
+/*  One round trip is an input block the ARM fills and an output block the   */
+/*  DSP fills (a copy here, done while the DSP owns both). Three ways:        */
+/*      malloc -- both buffers allocated per call, ranged writeback and      */
+/*                invalidate, as in vector_args_malloc and manual_cache_ops   */
+/*      global -- fixed buffers, C6RUN_CACHE_globalWb/globalInv per call      */
+/*      pool   -- slabs from the pool, one operation per hand-off             */
+/*  On the host the cache calls do nothing, so the times show only the       */
+/*  allocation and bookkeeping cost; the operation counts hold everywhere.    */
+/*                                                                            */
+/*  return value: SHMPOOL_SUCCESS, or SHMPOOL_FAILURE if data came back      */
+/*                wrong                                                       */
+/******************************************************************************/
+int shmpool_benchmark( int  calls, FILE * fp )
+{
+    static const size_t  sizes[] = { 256, 1024, 4096, 16384, 65536, 262144 };
+    ShmPool              pool;
+    unsigned long long   t0, us[ 3 ];
+    unsigned long        ops[ 3 ];
+    char                *in, *out;
+    int                  s, i, errors = 0;
+
+    fprintf( fp, "%8s %14s %14s %14s   cache ops per round trip (malloc/global/pool)\n",
+             "bytes", "malloc us", "global us", "pool us" );
+
+    for( s = 0; s < sizeof( sizes ) / sizeof( sizes[ 0 ] ); s++ ) {
+        size_t  n = sizes[ s ];
+
+        // Per-call allocation and ranged cache operations
+        ops[ 0 ] = 0;
+        t0 = now_us( );
+        for( i = 0; i < calls; i++ ) {
+            in  = C6RUN_MEM_malloc ? C6RUN_MEM_malloc( n ) : malloc( n );
+            out = C6RUN_MEM_malloc ? C6RUN_MEM_malloc( n ) : malloc( n );
+            if( in == NULL || out == NULL ) {
+                ERR( "Benchmark allocation of %lu bytes failed\n", ( unsigned long ) n );
+                return SHMPOOL_FAILURE;
+            }
+            memset( in, i, n );
+            cache_wb( in, n );
+            cache_wb( out, n );		// Nothing dirty may land on the result
+            standin_copy( out, in, n );
+            cache_inv( out, n );
+            ops[ 0 ] += 3;
+            errors += out[ n - 1 ] != ( char ) i;
+            if( C6RUN_MEM_free ) {
+                C6RUN_MEM_free( in );
+                C6RUN_MEM_free( out );
+            }
+            else {
+                free( in );
+                free( out );
+            }
+        }
+        us[ 0 ] = now_us( ) - t0;
+
+        // Fixed buffers, whole-cache operations
+        in  = C6RUN_MEM_malloc ? C6RUN_MEM_malloc( n ) : malloc( n );
+        out = C6RUN_MEM_malloc ? C6RUN_MEM_malloc( n ) : malloc( n );
+        if( in == NULL || out == NULL )
+            return SHMPOOL_FAILURE;
+        ops[ 1 ] = 0;
+        t0 = now_us( );
+        for( i = 0; i < calls; i++ ) {
+            memset( in, i, n );
+            if( C6RUN_CACHE_globalWb )
+                C6RUN_CACHE_globalWb( );
+            standin_copy( out, in, n );
+            if( C6RUN_CACHE_globalInv )
+                C6RUN_CACHE_globalInv( );
+            ops[ 1 ] += 2;
+            errors += out[ n - 1 ] != ( char ) i;
+        }
+        us[ 1 ] = now_us( ) - t0;
+        if( C6RUN_MEM_free ) {
+            C6RUN_MEM_free( in );
+            C6RUN_MEM_free( out );
+        }
+        else {
+            free( in );
+            free( out );
+        }
+
+        // Pool slabs with ownership transfer
+        if( shmpool_create( &pool, n, 2 ) == SHMPOOL_FAILURE )
+            return SHMPOOL_FAILURE;
+        t0 = now_us( );
+        for( i = 0; i < calls; i++ ) {
+            in  = shmpool_get( &pool );
+            out = shmpool_get( &pool );
+            memset( in, i, n );
+            shmpool_to_dsp( &pool, in, n );
+            shmpool_to_dsp( &pool, out, 0 );
+            standin_copy( out, in, n );
+            shmpool_to_arm( &pool, out, n );
+            shmpool_to_arm( &pool, in, 0 );
+            errors += out[ n - 1 ] != ( char ) i;
+            shmpool_put( &pool, in );
+            shmpool_put( &pool, out );
+        }
+        us[ 2 ] = now_us( ) - t0;
+        ops[ 2 ] = pool.wbOps + pool.invOps;
+
+        fprintf( fp, "%8lu %14.2f %14.2f %14.2f   %.0f/%.0f/%.0f\n", ( unsigned long ) n,
+                 ( double ) us[ 0 ] / calls, ( double ) us[ 1 ] / calls, ( double ) us[ 2 ] / calls,
+                 ( double ) ops[ 0 ] / calls, ( double ) ops[ 1 ] / calls, ( double ) ops[ 2 ] / calls );
+        shmpool_destroy( &pool );
+    }
+
+    if( errors )
+        ERR( "%d pool benchmark checks failed\n", errors );
+    return errors ? SHMPOOL_FAILURE : SHMPOOL_SUCCESS;
+}
+
+/******************************************************************************
+ * shmpool_misuse_check
+ ******************************************************************************/
+/*  Hands a slab to the DSP twice and then puts it back while the DSP still  */
+/*  owns it. Both must be refused, so the two ERR lines are expected.         */
+/*                                                                            */
+/*  return value: SHMPOOL_SUCCESS, or SHMPOOL_FAILURE if ownership was not   */
+/*                enforced                                                    */
+/******************************************************************************/
+int shmpool_misuse_check( FILE * fp )
+{
+    ShmPool  pool;
+    void    *buf;
+    int      errors = 0;
+
+    if( shmpool_create( &pool, SHMPOOL_ALIGN, 1 ) == SHMPOOL_FAILURE )
+        return SHMPOOL_FAILURE;
+
+    fprintf( fp, "Handing a slab to the DSP twice, two errors expected:\n" );
+    fflush( fp );			// Ahead of the ERR lines on stderr
+    buf = shmpool_get( &pool );
+    shmpool_to_dsp( &pool, buf, SHMPOOL_ALIGN );
+    if( shmpool_to_dsp( &pool, buf, SHMPOOL_ALIGN ) != SHMPOOL_FAILURE )
+        errors++;
+    if( shmpool_put( &pool, buf ) != SHMPOOL_FAILURE )
+        errors++;
+    shmpool_to_arm( &pool, buf, 0 );
+    if( shmpool_put( &pool, buf ) != SHMPOOL_SUCCESS )
+        errors++;
+    shmpool_destroy( &pool );
+
+    fprintf( fp, "Ownership %s\n", errors ? "NOT enforced" : "enforced" );
+    return errors ? SHMPOOL_FAILURE : SHMPOOL_SUCCESS;
+}
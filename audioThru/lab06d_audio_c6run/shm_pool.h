@@ -0,0 +1,57 @@
+/*
+ *   shm_pool.h
+ *
+ *   Fixed-size slabs carved from one contiguous shared region (C6Run's
+ *   CMEM heap in audioThru_dsp, a memfd mapping otherwise). Every slab is
+ *   owned by the ARM or the DSP. shmpool_to_dsp() and shmpool_to_arm()
+ *   move ownership and do the one cache operation that hand-off needs, so
+ *   a buffer is flushed once per trip instead of on every call it is
+ *   passed to, and handing over a slab the caller does not own is refused.
+ */
+
+/* SUCCESS and FAILURE definitions for the pool functions */
+#define     SHMPOOL_SUCCESS      0
+#define     SHMPOOL_FAILURE      -1
+
+#define     SHMPOOL_ALIGN        128	// Slabs never share a cache line
+
+/* Slab owners */
+#define     SHMPOOL_FREE         0
+#define     SHMPOOL_ARM          1
+#define     SHMPOOL_DSP          2
+
+typedef  struct  ShmPool
+{
+    char           *base;
+    size_t          slabSize;		// Rounded up to SHMPOOL_ALIGN
+    int             slabs;
+    int             memfd;		// -1 when the region came from C6Run
+    unsigned char  *owner;
+    int            *freeList;
+    int             numFree;
+
+    /* Cache maintenance done through the pool */
+    unsigned long       handoffs, wbOps, invOps;
+    unsigned long long  wbBytes, invBytes;
+} ShmPool;
+
+/* Function prototypes */
+int   shmpool_create( ShmPool * pool, size_t  slabSize, int  slabs );
+
+void  shmpool_destroy( ShmPool * pool );
+
+void *shmpool_get( ShmPool * pool );
+
+int   shmpool_put( ShmPool * pool, void * buf );
+
+int   shmpool_to_dsp( ShmPool * pool, void * buf, size_t  written );
+
+int   shmpool_to_arm( ShmPool * pool, void * buf, size_t  produced );
+
+int   shmpool_owner( ShmPool * pool, void * buf );
+
+void  shmpool_report( ShmPool * pool, FILE * fp );
+
+int   shmpool_benchmark( int  calls, FILE * fp );
+
+int   shmpool_misuse_check( FILE * fp );
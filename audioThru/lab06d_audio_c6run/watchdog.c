@@ -0,0 +1,202 @@
+/*
+ *   watchdog.c
+ *
+ *   A loop's counters are written only by the thread that runs it; the
+ *   shedding level and the time of the last miss are shared and changed
+ *   with atomics, so any loop can push the level up and any on-time loop
+ *   can bring it back down. Audio and video share one level on purpose:
+ *   an audio loop running late is what makes the video loop shed work.
+ */
+
+/* Standard Linux headers */
+#include     <stdio.h>			// Always include stdio.h
+#include     <stdlib.h>			// Always include stdlib.h
+#include     <string.h>			// Defines strncpy
+#include     <time.h>			// clock_gettime
+
+/* Application headers */
+#include     "watchdog.h"
+#include     "debug.h"			// DBG and ERR macros
+
+typedef  struct  WdLoop
+{
+    char                name[ 24 ];
+    unsigned long long  budget;		// ns per iteration
+    unsigned long long  start;
+    unsigned long long  runs;
+    unsigned long long  misses;
+    unsigned long long  worst;		// ns
+    int                 inARow;		// Consecutive misses
+} WdLoop;
+
+static WdLoop              loops[ WD_MAX_LOOPS ];
+static int                 numLoops = 0;
+
+static unsigned int        modeOrder[ 32 ];	// Available modes, in escalation order
+static int                 numModes = 0;
+static int                 level = 0;		// Modes currently shed
+static int                 maxLevel = 0;
+static unsigned long long  lastMiss = 0;
+
+static unsigned long long now_ns( void )
+{
+    struct timespec  ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( unsigned long long ) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const char *mode_name( unsigned int  mode )
+{
+    switch( mode ) {
+    case WD_SKIP_OPTIONAL:  return "optional stages";
+    case WD_HALF_RATE:      return "every other frame";
+    case WD_BYPASS_DSP:     return "DSP offload";
+    default:                return "?";
+    }
+}
+
+/******************************************************************************
+ * wd_init
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      unsigned int modes -- WD_* modes this program can apply; call before  */
+/*                            the loops start                                 */
+/******************************************************************************/
+void wd_init( unsigned int  modes )
+{
+    unsigned int  bit;
+
+    numModes = 0;
+    for( bit = 1; bit != 0; bit <<= 1 )
+        if( modes & bit )
+            modeOrder[ numModes++ ] = bit;
+
+    level = maxLevel = 0;
+    lastMiss = 0;
+}
+
+/******************************************************************************
+ * wd_loop
+ ******************************************************************************/
+/*  return value:                                                             */
+/*      int  -- loop id for wd_begin/wd_end, or WD_FAILURE if all are taken   */
+/******************************************************************************/
+int wd_loop( const char * name, unsigned long long  budgetNs )
+{
+    int  id = __atomic_fetch_add( &numLoops, 1, __ATOMIC_RELAXED );
+
+    if( id >= WD_MAX_LOOPS ) {
+        __atomic_fetch_sub( &numLoops, 1, __ATOMIC_RELAXED );
+        ERR( "Watchdog: no room for loop %s\n", name );
+        return WD_FAILURE;
+    }
+
+    memset( &loops[ id ], 0, sizeof( loops[ id ] ) );
+    strncpy( loops[ id ].name, name, sizeof( loops[ id ].name ) - 1 );
+    loops[ id ].budget = budgetNs;
+    return id;
+}
+
+void wd_begin( int  loop )
+{
+    if( loop >= 0 )
+        loops[ loop ].start = now_ns( );
+}
+
+/******************************************************************************
+ * wd_end
+ ******************************************************************************/
+/*  Closes one iteration, sheds more after WD_ESCALATE_AFTER misses in a     */
+/*  row and sheds less after WD_RECOVER_NS without a miss anywhere.           */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  -- 1 if this iteration was over budget, 0 otherwise              */
+/******************************************************************************/
+int wd_end( int  loop )
+{
+    WdLoop             *lp;
+    unsigned long long  now, elapsed, last;
+    int                 l;
+
+    if( loop < 0 )
+        return 0;
+
+    lp      = &loops[ loop ];
+    now     = now_ns( );
+    elapsed = now - lp->start;
+    lp->runs++;
+    if( elapsed > lp->worst )
+        lp->worst = elapsed;
+
+    if( elapsed > lp->budget ) {
+        lp->misses++;
+        __atomic_store_n( &lastMiss, now, __ATOMIC_RELAXED );
+
+        if( ++lp->inARow >= WD_ESCALATE_AFTER ) {
+            lp->inARow = 0;
+            l = __atomic_load_n( &level, __ATOMIC_RELAXED );
+            if( l < numModes &&
+                __atomic_compare_exchange_n( &level, &l, l + 1, 0,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED ) ) {
+                if( l + 1 > maxLevel )
+                    maxLevel = l + 1;
+                DBG( "Watchdog: %s took %llu us of %llu us, shedding %s\n", lp->name,
+                     elapsed / 1000, lp->budget / 1000, mode_name( modeOrder[ l ] ) );
+            }
+        }
+        return 1;
+    }
+
+    lp->inARow = 0;
+
+    // Step back one mode per quiet WD_RECOVER_NS
+    l    = __atomic_load_n( &level, __ATOMIC_RELAXED );
+    last = __atomic_load_n( &lastMiss, __ATOMIC_RELAXED );
+    if( l > 0 && now - last > WD_RECOVER_NS &&
+        __atomic_compare_exchange_n( &lastMiss, &last, now, 0,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED ) ) {
+        __atomic_fetch_sub( &level, 1, __ATOMIC_RELAXED );
+        DBG( "Watchdog: on time again, restoring %s\n", mode_name( modeOrder[ l - 1 ] ) );
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+ * wd_shedding
+ ******************************************************************************/
+/*  return value:                                                             */
+/*      int  -- nonzero if the given WD_* mode is currently applied           */
+/******************************************************************************/
+int wd_shedding( unsigned int  mode )
+{
+    int  i, l = __atomic_load_n( &level, __ATOMIC_RELAXED );
+
+    for( i = 0; i < l; i++ )
+        if( modeOrder[ i ] == mode )
+            return 1;
+
+    return 0;
+}
+
+/******************************************************************************
+ * wd_report
+ ******************************************************************************/
+void wd_report( FILE * fp )
+{
+    int  i, n = __atomic_load_n( &numLoops, __ATOMIC_RELAXED );
+
+    if( n > WD_MAX_LOOPS )
+        n = WD_MAX_LOOPS;
+
+    fprintf( fp, "%-16s %9s %10s %8s %10s\n", "loop", "budget us", "runs", "misses", "worst us" );
+    for( i = 0; i < n; i++ )
+        fprintf( fp, "%-16s %9llu %10llu %8llu %10llu\n", loops[ i ].name,
+                 loops[ i ].budget / 1000, loops[ i ].runs, loops[ i ].misses,
+                 loops[ i ].worst / 1000 );
+    fprintf( fp, "Deepest shedding: %d of %d modes (", maxLevel, numModes );
+    for( i = 0; i < numModes; i++ )
+        fprintf( fp, "%s%s", i ? ", " : "", mode_name( modeOrder[ i ] ) );
+    fprintf( fp, ")\n" );
+}
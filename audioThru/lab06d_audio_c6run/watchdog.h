@@ -0,0 +1,35 @@
+/*
+ *   watchdog.h
+ *
+ *   Deadline-miss watchdog for the real-time loops. Each loop brackets
+ *   its work with wd_begin/wd_end against a per-iteration budget. Misses
+ *   in a row step the whole program down through the degraded modes it
+ *   said it can apply (in the order of the mode bits); a quiet spell
+ *   steps it back up. Loops ask wd_shedding() which modes are on.
+ */
+
+/* SUCCESS and FAILURE definitions for the watchdog functions */
+#define     WD_SUCCESS           0
+#define     WD_FAILURE           -1
+
+/* Degraded modes, applied lowest bit first */
+#define     WD_SKIP_OPTIONAL     0x1	// Skip optional stages (AGC, messages)
+#define     WD_HALF_RATE         0x2	// Process every other video frame
+#define     WD_BYPASS_DSP        0x4	// Pass audio through instead of offloading
+
+#define     WD_MAX_LOOPS         8
+#define     WD_ESCALATE_AFTER    2		// Misses in a row before shedding more
+#define     WD_RECOVER_NS        2000000000ULL	// Miss-free time before shedding less
+
+/* Function prototypes */
+void wd_init( unsigned int  modes );
+
+int  wd_loop( const char * name, unsigned long long  budgetNs );
+
+void wd_begin( int  loop );
+
+int  wd_end( int  loop );
+
+int  wd_shedding( unsigned int  mode );
+
+void wd_report( FILE * fp );
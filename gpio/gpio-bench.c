@@ -0,0 +1,238 @@
+/*
+ * gpio-bench.c
+ *
+ * Toggle and sample rate of the per-call gpio-utils functions against a
+ * gpio-lines group held open, one pin at a time and all pins at once.
+ *
+ *	gpio-bench [-b backend]... [-n count] [-r dir] gpio...
+ *
+ * Each -b adds a backend spec to time (default sysfs), so sysfs, chip and
+ * mmap can be compared in one run.
+ *
+ * -r builds a fake sysfs tree (export, gpioN/direction, value, edge) under
+ * dir and points everything at it, so the benchmark and the API can be
+ * exercised on a machine without GPIOs. The rates then measure plain file
+ * I/O, which is still a fair comparison of the call overheads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "gpio-utils.h"
+#include "gpio-lines.h"
+
+#define PATH_BUF 256
+#define BENCH_MAX 8		/* -b options */
+
+/****************************************************************
+ * now_sec
+ ****************************************************************/
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/****************************************************************
+ * make_file
+ ****************************************************************/
+static int make_file(const char *path, const char *contents)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	write(fd, contents, strlen(contents));
+	close(fd);
+	return 0;
+}
+
+/****************************************************************
+ * make_fake_root
+ ****************************************************************/
+static int make_fake_root(const char *dir, const unsigned int *pins, int n)
+{
+	char buf[PATH_BUF];
+	int i;
+
+	mkdir(dir, 0755);
+	snprintf(buf, sizeof(buf), "%s/export", dir);
+	if (make_file(buf, "") < 0)
+		return -1;
+	snprintf(buf, sizeof(buf), "%s/unexport", dir);
+	make_file(buf, "");
+
+	for (i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "%s/gpio%d", dir, pins[i]);
+		mkdir(buf, 0755);
+		snprintf(buf, sizeof(buf), "%s/gpio%d/direction", dir, pins[i]);
+		make_file(buf, "in\n");
+		snprintf(buf, sizeof(buf), "%s/gpio%d/edge", dir, pins[i]);
+		make_file(buf, "none\n");
+		snprintf(buf, sizeof(buf), "%s/gpio%d/value", dir, pins[i]);
+		if (make_file(buf, "0\n") < 0)
+			return -1;
+	}
+	gpio_set_root(dir);
+	return 0;
+}
+
+/****************************************************************
+ * report
+ ****************************************************************/
+static void report(const char *what, int count, double sec, double base)
+{
+	printf("%-28s %10.0f /s %9.2f us", what, count / sec,
+	       sec * 1e6 / count);
+	if (base > 0)
+		printf("   x%.1f", base / sec);
+	printf("\n");
+}
+
+/****************************************************************
+ * bench_backend
+ ****************************************************************/
+static int bench_backend(const char *spec, const unsigned int *pins, int n,
+			 int count, const double *base)
+{
+	struct gpio_lines *one, *all;
+	unsigned int v, want;
+	char what[MAX_BUF];
+	double t;
+	int i;
+
+	/* One group at a time: a chip line can only be requested once */
+	one = gpio_lines_open(spec, pins, 1, GPIO_LINES_OUT);
+	if (one == NULL) {
+		fprintf(stderr, "Cannot open gpio %d through %s\n", pins[0], spec);
+		return -1;
+	}
+
+	t = now_sec();
+	for (i = 0; i < count; i++)
+		gpio_line_set(one, 0, i & 1);
+	snprintf(what, sizeof(what), "%s gpio_line_set", one->backend->name);
+	report(what, count, now_sec() - t, base[0]);
+
+	t = now_sec();
+	for (i = 0; i < count; i++)
+		gpio_lines_get(one, &v);
+	snprintf(what, sizeof(what), "%s gpio_lines_get", one->backend->name);
+	report(what, count, now_sec() - t, base[1]);
+
+	gpio_line_set(one, 0, 0);
+	gpio_lines_close(one);
+	if (n == 1)
+		return 0;
+
+	all = gpio_lines_open(spec, pins, n, GPIO_LINES_OUT);
+	if (all == NULL) {
+		fprintf(stderr, "Cannot open gpios %d.. through %s\n", pins[0], spec);
+		return -1;
+	}
+
+	t = now_sec();
+	for (i = 0; i < count; i++)
+		gpio_lines_set(all, i & 1 ? ~0u : 0, ~0u);
+	snprintf(what, sizeof(what), "%s gpio_lines_set all", all->backend->name);
+	report(what, count, now_sec() - t, base[2]);
+
+	/* Read back a pattern to check the group's bit order */
+	want = 0x55555555 & (n < 32 ? (1u << n) - 1 : ~0u);
+	gpio_lines_set(all, want, ~0u);
+	if (gpio_lines_get(all, &v) == 0 && v != want)
+		printf("%s: read back 0x%x, wrote 0x%x\n", spec, v, want);
+	gpio_lines_set(all, 0, ~0u);
+
+	gpio_lines_close(all);
+	return 0;
+}
+
+/****************************************************************
+ * Main
+ ****************************************************************/
+int main(int argc, char **argv)
+{
+	unsigned int pins[GPIO_LINES_MAX];
+	const char *specs[BENCH_MAX];
+	const char *fake = NULL;
+	char path[PATH_BUF];
+	unsigned int v;
+	double t, base[3] = { 0, 0, 0 };
+	int count = 10000;
+	int nspecs = 0, n = 0, i, j, opt, status = 0;
+
+	while ((opt = getopt(argc, argv, "b:n:r:")) != -1) {
+		switch (opt) {
+		case 'b':
+			if (nspecs < BENCH_MAX)
+				specs[nspecs++] = optarg;
+			break;
+		case 'n': count = atoi(optarg); break;
+		case 'r': fake = optarg; break;
+		default: goto usage;
+		}
+	}
+	for (; optind < argc && n < GPIO_LINES_MAX; optind++)
+		pins[n++] = atoi(argv[optind]);
+	if (n == 0 || count < 2)
+		goto usage;
+	if (nspecs == 0)
+		specs[nspecs++] = "sysfs";
+
+	if (fake != NULL && make_fake_root(fake, pins, n) < 0)
+		exit(-1);
+
+	printf("%d toggles of gpio %d", count, pins[0]);
+	if (n > 1)
+		printf(" (and of %d gpios together)", n);
+	printf("\n");
+	fflush(stdout);
+
+	/* The per-call functions are the baseline for every backend */
+	snprintf(path, sizeof(path), "%s/gpio%d/value", gpio_get_root(), pins[0]);
+	if (access(path, W_OK) == 0) {
+		t = now_sec();
+		for (i = 0; i < count; i++)
+			gpio_set_value(pins[0], i & 1);
+		base[0] = now_sec() - t;
+		report("gpio_set_value", count, base[0], 0);
+
+		t = now_sec();
+		for (i = 0; i < count; i++)
+			gpio_get_value(pins[0], &v);
+		base[1] = now_sec() - t;
+		report("gpio_get_value", count, base[1], 0);
+
+		/* Against n separate per-call writes for every toggle */
+		if (n > 1) {
+			t = now_sec();
+			for (i = 0; i < count; i++)
+				for (j = 0; j < n; j++)
+					gpio_set_value(pins[j], i & 1);
+			base[2] = now_sec() - t;
+			report("gpio_set_value x all", count, base[2], 0);
+		}
+		gpio_set_value(pins[0], 0);
+	}
+
+	for (i = 0; i < nspecs; i++)
+		if (bench_backend(specs[i], pins, n, count, base) < 0)
+			status = -1;
+	return status;
+
+usage:
+	printf("Usage: %s [-b backend]... [-n count] [-r fake-sysfs-dir] gpio...\n\n",
+	       argv[0]);
+	printf("Times gpio_set_value/gpio_get_value against gpio-lines\n");
+	printf("through each backend given, e.g. -b sysfs -b chip -b mmap\n");
+	exit(-1);
+}
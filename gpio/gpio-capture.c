@@ -0,0 +1,138 @@
+/*
+ * gpio-capture.c
+ *
+ * Edge capture through gpio-edges, the counterpart of gpio-int-test: the
+ * edges are stamped by the kernel and collected by a capture thread that
+ * never prints, and this program drains them once every 100 ms.
+ *
+ *	gpio-capture [-c chip] [-e rising|falling|both] [-t seconds]
+ *		     [-r ring] [-o file] offset...
+ *
+ * Prints the edge rate once a second and, on Ctrl-C or after -t seconds,
+ * the lost-event counts and the edge-to-user-space latency histogram.
+ * -o writes every edge (timestamp in ns, line, rising/falling, latency).
+ * With gpio-sim.sh, edges can be made by writing "pull-up"/"pull-down" to
+ * sim_gpioN/pull under the simulated chip's /sys/devices/platform entry.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>	// Defines signal-handling functions (i.e. trap Ctrl-C)
+#include <time.h>
+#include "gpio-lines.h"
+#include "gpio-edges.h"
+
+#define DRAIN_MS	100
+#define DRAIN_MAX	1024
+
+/****************************************************************
+ * Global variables
+ ****************************************************************/
+static volatile int keepgoing = 1;	// Set to 0 when ctrl-c is pressed
+
+/****************************************************************
+ * signal_handler
+ ****************************************************************/
+// Callback called when SIGINT is sent to the process (Ctrl-C)
+static void signal_handler(int sig)
+{
+	(void)sig;
+	keepgoing = 0;
+}
+
+/****************************************************************
+ * drain
+ ****************************************************************/
+static void drain(struct gpio_edges *e, FILE *out)
+{
+	static struct gpio_edge buf[DRAIN_MAX];
+	int n, i;
+
+	while ((n = gpio_edges_read(e, buf, DRAIN_MAX)) > 0)
+		for (i = 0; out != NULL && i < n; i++)
+			fprintf(out, "%llu %u %c %u\n", buf[i].timestamp_ns,
+				buf[i].offset, buf[i].rising ? 'r' : 'f',
+				buf[i].latency_ns);
+}
+
+/****************************************************************
+ * Main
+ ****************************************************************/
+int main(int argc, char **argv)
+{
+	struct timespec tick = { 0, DRAIN_MS * 1000000L };
+	unsigned int offsets[GPIO_LINES_MAX];
+	struct gpio_edges *e;
+	const char *chip = NULL;
+	FILE *out = NULL;
+	unsigned long long last = 0, now;
+	int edges = GPIO_EDGE_BOTH;
+	int ringSize = 65536;
+	int seconds = 0, ticks = 0;
+	int n = 0, opt;
+
+	while ((opt = getopt(argc, argv, "c:e:t:r:o:")) != -1) {
+		switch (opt) {
+		case 'c': chip = optarg; break;
+		case 'e':
+			if (strcmp(optarg, "rising") == 0)
+				edges = GPIO_EDGE_RISING;
+			else if (strcmp(optarg, "falling") == 0)
+				edges = GPIO_EDGE_FALLING;
+			else if (strcmp(optarg, "both") == 0)
+				edges = GPIO_EDGE_BOTH;
+			else
+				goto usage;
+			break;
+		case 't': seconds = atoi(optarg); break;
+		case 'r': ringSize = atoi(optarg); break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (out == NULL) {
+				perror(optarg);
+				exit(-1);
+			}
+			break;
+		default: goto usage;
+		}
+	}
+	for (; optind < argc && n < GPIO_LINES_MAX; optind++)
+		offsets[n++] = atoi(argv[optind]);
+	if (n == 0)
+		goto usage;
+
+	// Set the signal callback for Ctrl-C
+	signal(SIGINT, signal_handler);
+
+	e = gpio_edges_start(chip, offsets, n, edges, ringSize);
+	if (e == NULL)
+		exit(-1);
+
+	while (keepgoing && (seconds == 0 || ticks < seconds * 1000 / DRAIN_MS)) {
+		nanosleep(&tick, NULL);
+		drain(e, out);
+
+		if (++ticks % (1000 / DRAIN_MS) == 0) {
+			now = gpio_edges_count(e);
+			printf("%llu edges/s\n", now - last);
+			fflush(stdout);
+			last = now;
+		}
+	}
+
+	gpio_edges_stop(e);
+	drain(e, out);
+	gpio_edges_report(e, stdout);
+	gpio_edges_close(e);
+	if (out != NULL)
+		fclose(out);
+	return 0;
+
+usage:
+	printf("Usage: %s [-c chip] [-e rising|falling|both] [-t seconds]\n"
+	       "       [-r ring] [-o file] offset...\n\n", argv[0]);
+	printf("Captures kernel-timestamped edges on chip lines\n");
+	exit(-1);
+}
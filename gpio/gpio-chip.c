@@ -0,0 +1,125 @@
+/*
+ * gpio-chip.c
+ *
+ * GPIO character device backend for gpio-lines (the v2 uAPI of Linux 5.10
+ * and later). The whole group is one line request, so a set or a get is a
+ * single ioctl that the kernel applies to every line together; sysfs needs
+ * a system call per line and has no way to make them atomic.
+ *
+ * Pins are line offsets on the chip, not global GPIO numbers; the spec's
+ * argument is the chip device and defaults to /dev/gpiochip0.
+ */
+
+#include "gpio-lines.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#define CHIP_DEFAULT	"/dev/gpiochip0"
+#define CHIP_CONSUMER	"gpio-lines"
+
+/****************************************************************
+ * gpio_chip_request
+ ****************************************************************/
+int gpio_chip_request(const char *chip, const unsigned int *offsets, int n,
+		      unsigned long long flags, int eventBuffer)
+{
+	struct gpio_v2_line_request req;
+	int fd, i;
+
+	if (n < 1 || n > GPIO_V2_LINES_MAX) {
+		fprintf(stderr, "gpio-chip: 1..%d lines per request\n",
+			GPIO_V2_LINES_MAX);
+		return -1;
+	}
+	if (chip == NULL || *chip == '\0')
+		chip = CHIP_DEFAULT;
+
+	fd = open(chip, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		perror(chip);
+		return -1;
+	}
+
+	memset(&req, 0, sizeof(req));
+	for (i = 0; i < n; i++)
+		req.offsets[i] = offsets[i];
+	req.num_lines = n;
+	strncpy(req.consumer, CHIP_CONSUMER, sizeof(req.consumer) - 1);
+	req.config.flags = flags;
+	req.event_buffer_size = eventBuffer;
+
+	if (ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+		perror("gpio-chip/GPIO_V2_GET_LINE_IOCTL");
+		close(fd);
+		return -1;
+	}
+
+	/* The request outlives the chip descriptor */
+	close(fd);
+	return req.fd;
+}
+
+/****************************************************************
+ * chip_open
+ ****************************************************************/
+static int chip_open(struct gpio_lines *lines, const char *arg)
+{
+	lines->fd[0] = gpio_chip_request(arg, lines->pins, lines->n,
+					 lines->dir == GPIO_LINES_OUT ?
+					 GPIO_V2_LINE_FLAG_OUTPUT :
+					 GPIO_V2_LINE_FLAG_INPUT, 0);
+	return lines->fd[0] < 0 ? -1 : 0;
+}
+
+/****************************************************************
+ * chip_set
+ ****************************************************************/
+static int chip_set(struct gpio_lines *lines, unsigned int values,
+		    unsigned int mask)
+{
+	struct gpio_v2_line_values lv;
+
+	lv.bits = values;
+	lv.mask = mask;
+	if (ioctl(lines->fd[0], GPIO_V2_LINE_SET_VALUES_IOCTL, &lv) < 0) {
+		perror("gpio-chip/set");
+		return -1;
+	}
+	return 0;
+}
+
+/****************************************************************
+ * chip_get
+ ****************************************************************/
+static int chip_get(struct gpio_lines *lines, unsigned int *values)
+{
+	struct gpio_v2_line_values lv;
+
+	lv.bits = 0;
+	lv.mask = lines->n < 64 ? (1ULL << lines->n) - 1 : ~0ULL;
+	if (ioctl(lines->fd[0], GPIO_V2_LINE_GET_VALUES_IOCTL, &lv) < 0) {
+		perror("gpio-chip/get");
+		return -1;
+	}
+	*values = (unsigned int)lv.bits;
+	return 0;
+}
+
+/****************************************************************
+ * chip_close
+ ****************************************************************/
+static void chip_close(struct gpio_lines *lines)
+{
+	if (lines->fd[0] >= 0)
+		close(lines->fd[0]);
+	lines->fd[0] = -1;
+}
+
+const struct gpio_backend gpio_chip_backend = {
+	"chip", chip_open, chip_set, chip_get, chip_close
+};
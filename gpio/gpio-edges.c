@@ -0,0 +1,331 @@
+/*
+ * gpio-edges.c
+ *
+ * gpio-int-test waits for POLLPRI on a sysfs value file, then seeks and
+ * reads it and prints, once per edge: the time of the edge is whenever
+ * the program got round to it and edges that come in the meantime are
+ * lost without a trace. Here the kernel stamps each edge in its interrupt
+ * handler and queues it, one read() collects as many as are waiting, and
+ * the kernel's per-request sequence number shows exactly how many fell
+ * off the end of its queue.
+ */
+
+#include "gpio-edges.h"
+#include "gpio-lines.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/gpio.h>
+
+#define EDGES_BATCH		64	/* Events per read() */
+#define EDGES_KERNEL_BUFFER	1024	/* Events the kernel may queue */
+#define EDGES_GROUPS		16	/* 0-1 us up to 8-16 ms, then overflow */
+
+struct gpio_edges {
+	int fd;				/* Line request */
+	int wake[2];			/* Written to stop the capture thread */
+	pthread_t thread;
+
+	struct gpio_edge *ring;
+	unsigned int ringMask;
+	unsigned int head;		/* Written by the capture thread only */
+	unsigned int tail;		/* Written by the reader only */
+
+	/* Written by the capture thread only */
+	unsigned long long events;
+	unsigned long long kernelLost;
+	unsigned long long ringLost;
+	unsigned long long firstNs, lastNs;
+	unsigned int lastSeqno;
+	unsigned int minNs, maxNs;
+	unsigned int hist[GPIO_EDGES_HIST_US + 1];
+};
+
+/****************************************************************
+ * edges_record
+ ****************************************************************/
+static void edges_record(struct gpio_edges *e,
+			 const struct gpio_v2_line_event *ev,
+			 unsigned long long now)
+{
+	struct gpio_edge *slot;
+	unsigned int head, lat, us;
+
+	if (now <= ev->timestamp_ns)
+		lat = 0;
+	else if (now - ev->timestamp_ns > 0xffffffffULL)
+		lat = 0xffffffff;
+	else
+		lat = now - ev->timestamp_ns;
+
+	if (e->events == 0) {
+		e->firstNs = ev->timestamp_ns;
+		e->minNs = lat;
+	}
+	/* lastSeqno starts at 0, so edges dropped before the first read count */
+	if (ev->seqno != e->lastSeqno + 1)
+		e->kernelLost += ev->seqno - e->lastSeqno - 1;
+	e->lastSeqno = ev->seqno;
+	e->lastNs = ev->timestamp_ns;
+
+	if (lat < e->minNs)
+		e->minNs = lat;
+	if (lat > e->maxNs)
+		e->maxNs = lat;
+	us = lat / 1000;
+	e->hist[us < GPIO_EDGES_HIST_US ? us : GPIO_EDGES_HIST_US]++;
+
+	head = e->head;
+	if (head - __atomic_load_n(&e->tail, __ATOMIC_ACQUIRE) > e->ringMask) {
+		e->ringLost++;
+	} else {
+		slot = &e->ring[head & e->ringMask];
+		slot->timestamp_ns = ev->timestamp_ns;
+		slot->latency_ns = lat;
+		slot->offset = ev->offset;
+		slot->rising = ev->id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+		slot->seqno = ev->seqno;
+		__atomic_store_n(&e->head, head + 1, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&e->events, e->events + 1, __ATOMIC_RELAXED);
+}
+
+/****************************************************************
+ * edges_thread
+ ****************************************************************/
+static void *edges_thread(void *arg)
+{
+	struct gpio_edges *e = arg;
+	struct gpio_v2_line_event ev[EDGES_BATCH];
+	struct pollfd pfd[2];
+	struct timespec ts;
+	unsigned long long now;
+	ssize_t len;
+	int i;
+
+	pfd[0].fd = e->fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = e->wake[0];
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (pfd[1].revents)
+			break;
+		if (pfd[0].revents & (POLLERR | POLLHUP))
+			break;
+		if (!(pfd[0].revents & POLLIN))
+			continue;
+
+		len = read(e->fd, ev, sizeof(ev));
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		if (len < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			break;
+		}
+
+		now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		for (i = 0; i < (int)(len / sizeof(ev[0])); i++)
+			edges_record(e, &ev[i], now);
+	}
+	return NULL;
+}
+
+/****************************************************************
+ * gpio_edges_start
+ ****************************************************************/
+struct gpio_edges *gpio_edges_start(const char *chip,
+				    const unsigned int *offsets, int n,
+				    int edges, int ringSize)
+{
+	struct gpio_edges *e;
+	unsigned long long flags = GPIO_V2_LINE_FLAG_INPUT;
+	unsigned int size;
+
+	/* Round the ring up to a power of two */
+	for (size = 16; size < (unsigned int)ringSize && size < (1u << 24); )
+		size <<= 1;
+
+	e = calloc(1, sizeof(*e));
+	if (e == NULL || (e->ring = calloc(size, sizeof(*e->ring))) == NULL) {
+		perror("gpio-edges");
+		free(e);
+		return NULL;
+	}
+	e->ringMask = size - 1;
+	e->wake[0] = e->wake[1] = -1;
+
+	if (edges & GPIO_EDGE_RISING)
+		flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+	if (edges & GPIO_EDGE_FALLING)
+		flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+	e->fd = gpio_chip_request(chip, offsets, n, flags, EDGES_KERNEL_BUFFER);
+	if (e->fd < 0)
+		goto fail;
+
+	if (pipe(e->wake) < 0) {
+		perror("gpio-edges/pipe");
+		goto fail;
+	}
+
+	if (pthread_create(&e->thread, NULL, edges_thread, e) != 0) {
+		perror("gpio-edges/pthread_create");
+		goto fail;
+	}
+	return e;
+
+fail:
+	if (e->fd >= 0)
+		close(e->fd);
+	if (e->wake[0] >= 0) {
+		close(e->wake[0]);
+		close(e->wake[1]);
+	}
+	free(e->ring);
+	free(e);
+	return NULL;
+}
+
+/****************************************************************
+ * gpio_edges_read
+ ****************************************************************/
+int gpio_edges_read(struct gpio_edges *e, struct gpio_edge *out, int max)
+{
+	unsigned int tail = e->tail;
+	unsigned int head = __atomic_load_n(&e->head, __ATOMIC_ACQUIRE);
+	int i;
+
+	for (i = 0; i < max && tail != head; i++, tail++)
+		out[i] = e->ring[tail & e->ringMask];
+
+	__atomic_store_n(&e->tail, tail, __ATOMIC_RELEASE);
+	return i;
+}
+
+/****************************************************************
+ * gpio_edges_count
+ ****************************************************************/
+unsigned long long gpio_edges_count(struct gpio_edges *e)
+{
+	return __atomic_load_n(&e->events, __ATOMIC_RELAXED);
+}
+
+/****************************************************************
+ * edges_percentile
+ ****************************************************************/
+/* Upper edge, in us, of the bucket holding the given fraction, as text */
+static const char *edges_percentile(struct gpio_edges *e, double fraction,
+				    char *buf, size_t len)
+{
+	unsigned long long want = e->events * fraction, seen = 0;
+	unsigned int us;
+
+	for (us = 0; us < GPIO_EDGES_HIST_US; us++) {
+		seen += e->hist[us];
+		if (seen > want)
+			break;
+	}
+	if (us == GPIO_EDGES_HIST_US)
+		snprintf(buf, len, ">=%u", GPIO_EDGES_HIST_US);
+	else
+		snprintf(buf, len, "<%u", us + 1);
+	return buf;
+}
+
+/****************************************************************
+ * gpio_edges_report
+ ****************************************************************/
+/* Exact once gpio_edges_stop() has been called, a snapshot before */
+void gpio_edges_report(struct gpio_edges *e, FILE *fp)
+{
+	unsigned long long group[EDGES_GROUPS], most = 0;
+	char p50[16], p90[16], p99[16], p999[16];
+	double sec = (e->lastNs - e->firstNs) * 1e-9;
+	unsigned int us, lo, hi;
+	int g;
+
+	fprintf(fp, "%llu edges", e->events);
+	if (e->events > 1 && sec > 0)
+		fprintf(fp, " in %.3f s, %.0f /s", sec, (e->events - 1) / sec);
+	fprintf(fp, "\nLost: %llu in the kernel queue, %llu in the ring\n",
+		e->kernelLost, e->ringLost);
+	if (e->events == 0)
+		return;
+
+	fprintf(fp, "Latency, edge to user space (us): min %.1f  p50 %s  "
+		"p90 %s  p99 %s  p99.9 %s  max %.1f\n",
+		e->minNs / 1000.0,
+		edges_percentile(e, 0.5, p50, sizeof(p50)),
+		edges_percentile(e, 0.9, p90, sizeof(p90)),
+		edges_percentile(e, 0.99, p99, sizeof(p99)),
+		edges_percentile(e, 0.999, p999, sizeof(p999)),
+		e->maxNs / 1000.0);
+
+	/* Fold the 1 us buckets into powers of two for display */
+	memset(group, 0, sizeof(group));
+	for (us = 0; us < GPIO_EDGES_HIST_US; us++) {
+		for (g = 0; us >= (1u << g); g++)
+			;
+		group[g] += e->hist[us];
+	}
+	group[EDGES_GROUPS - 1] = e->hist[GPIO_EDGES_HIST_US];
+	for (g = 0; g < EDGES_GROUPS; g++)
+		if (group[g] > most)
+			most = group[g];
+
+	for (g = 0; g < EDGES_GROUPS; g++) {
+		if (group[g] == 0)
+			continue;
+		lo = g ? 1u << (g - 1) : 0;
+		hi = 1u << g;
+		if (g == EDGES_GROUPS - 1)
+			fprintf(fp, "  %5u us and up ", GPIO_EDGES_HIST_US);
+		else
+			fprintf(fp, "  %5u-%-5u us   ", lo, hi);
+		fprintf(fp, "%10llu %.*s\n", group[g],
+			(int)(group[g] * 40 / most),
+			"########################################");
+	}
+}
+
+/****************************************************************
+ * gpio_edges_stop
+ ****************************************************************/
+/* Ends capture; what is in the ring can still be read */
+void gpio_edges_stop(struct gpio_edges *e)
+{
+	if (e->fd < 0)
+		return;
+	if (write(e->wake[1], "", 1) != 1)
+		perror("gpio-edges/stop");
+	pthread_join(e->thread, NULL);
+
+	close(e->fd);
+	close(e->wake[0]);
+	close(e->wake[1]);
+	e->fd = e->wake[0] = e->wake[1] = -1;
+}
+
+/****************************************************************
+ * gpio_edges_close
+ ****************************************************************/
+void gpio_edges_close(struct gpio_edges *e)
+{
+	if (e == NULL)
+		return;
+	gpio_edges_stop(e);
+	free(e->ring);
+	free(e);
+}
@@ -0,0 +1,39 @@
+/*
+ * gpio-edges.h
+ *
+ * Edge capture on character device lines. A capture thread reads the
+ * kernel's timestamped line events in batches and hands them to the
+ * caller through a single-producer, single-consumer ring, counting every
+ * event the kernel or the ring had to drop and how long each one took to
+ * reach user space. The capture thread never prints or blocks on the
+ * caller; gpio_edges_read() and gpio_edges_report() are for the caller's
+ * own thread.
+ */
+
+#include <stdio.h>
+
+#define GPIO_EDGE_RISING	1
+#define GPIO_EDGE_FALLING	2
+#define GPIO_EDGE_BOTH		(GPIO_EDGE_RISING | GPIO_EDGE_FALLING)
+
+/* Latency histogram: 1 us buckets up to 10 ms, then one overflow bucket */
+#define GPIO_EDGES_HIST_US	10000
+
+struct gpio_edge {
+	unsigned long long timestamp_ns;	/* Kernel CLOCK_MONOTONIC */
+	unsigned int latency_ns;	/* From timestamp to the capture read */
+	unsigned int offset;		/* Line on the chip */
+	unsigned int rising;
+	unsigned int seqno;		/* Kernel sequence number in the request */
+};
+
+struct gpio_edges;
+
+struct gpio_edges *gpio_edges_start(const char *chip,
+				    const unsigned int *offsets, int n,
+				    int edges, int ringSize);
+int gpio_edges_read(struct gpio_edges *e, struct gpio_edge *out, int max);
+unsigned long long gpio_edges_count(struct gpio_edges *e);
+void gpio_edges_report(struct gpio_edges *e, FILE *fp);
+void gpio_edges_stop(struct gpio_edges *e);
+void gpio_edges_close(struct gpio_edges *e);
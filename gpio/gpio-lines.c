@@ -0,0 +1,112 @@
+/*
+ * gpio-lines.c
+ *
+ * Backend selection and the calls every backend shares. The backends do
+ * the work; this file only parses the spec and checks arguments.
+ */
+
+#include "gpio-lines.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static const struct gpio_backend *backends[] = {
+	&gpio_sysfs_backend,
+	&gpio_chip_backend,
+	&gpio_mmap_backend,
+	NULL
+};
+
+/****************************************************************
+ * gpio_lines_open
+ ****************************************************************/
+struct gpio_lines *gpio_lines_open(const char *spec, const unsigned int *pins,
+				   int n, int dir)
+{
+	const struct gpio_backend **b;
+	struct gpio_lines *lines;
+	const char *arg = NULL;
+	size_t len;
+	int i;
+
+	if (n < 1 || n > GPIO_LINES_MAX) {
+		fprintf(stderr, "gpio-lines: 1..%d lines per group\n",
+			GPIO_LINES_MAX);
+		return NULL;
+	}
+
+	if (spec == NULL)
+		spec = "sysfs";
+	len = strcspn(spec, ":");
+	if (spec[len] == ':')
+		arg = spec + len + 1;
+
+	for (b = backends; *b != NULL; b++)
+		if (strlen((*b)->name) == len &&
+		    strncmp((*b)->name, spec, len) == 0)
+			break;
+	if (*b == NULL) {
+		fprintf(stderr, "gpio-lines: unknown backend %s\n", spec);
+		return NULL;
+	}
+
+	lines = calloc(1, sizeof(*lines));
+	if (lines == NULL) {
+		perror("gpio-lines");
+		return NULL;
+	}
+
+	lines->backend = *b;
+	lines->n = n;
+	lines->dir = dir;
+	for (i = 0; i < n; i++) {
+		lines->pins[i] = pins[i];
+		lines->fd[i] = -1;
+	}
+
+	if (lines->backend->open(lines, arg) < 0) {
+		free(lines);
+		return NULL;
+	}
+	return lines;
+}
+
+/****************************************************************
+ * gpio_lines_set
+ ****************************************************************/
+int gpio_lines_set(struct gpio_lines *lines, unsigned int values,
+		   unsigned int mask)
+{
+	if (lines->n < GPIO_LINES_MAX)
+		mask &= (1u << lines->n) - 1;
+	if (mask == 0)
+		return 0;
+	return lines->backend->set(lines, values, mask);
+}
+
+/****************************************************************
+ * gpio_lines_get
+ ****************************************************************/
+int gpio_lines_get(struct gpio_lines *lines, unsigned int *values)
+{
+	return lines->backend->get(lines, values);
+}
+
+/****************************************************************
+ * gpio_line_set
+ ****************************************************************/
+int gpio_line_set(struct gpio_lines *lines, int i, unsigned int value)
+{
+	return gpio_lines_set(lines, value ? 1u << i : 0, 1u << i);
+}
+
+/****************************************************************
+ * gpio_lines_close
+ ****************************************************************/
+void gpio_lines_close(struct gpio_lines *lines)
+{
+	if (lines == NULL)
+		return;
+	lines->backend->close(lines);
+	free(lines);
+}
@@ -0,0 +1,55 @@
+/*
+ * gpio-lines.h
+ *
+ * A group of GPIO lines that is opened once and then driven or sampled
+ * with one call, instead of opening a sysfs file on every access the way
+ * gpio_set_value() does. Bit i of every value and mask below refers to
+ * pins[i] as passed to gpio_lines_open(); a single pin is a group of one.
+ *
+ * The backend is picked by a spec string, "name" or "name:arg":
+ *	sysfs[:root]	/sys/class/gpio value files (or a copy under root)
+ *	chip[:dev]	a /dev/gpiochipN line request; pins are line offsets
+ *	mmap[:soc[=file]]	OMAP GPIO bank registers through /dev/mem
+ */
+
+#define GPIO_LINES_MAX	32
+
+#define GPIO_LINES_IN	0
+#define GPIO_LINES_OUT	1
+
+struct gpio_lines;
+
+struct gpio_backend {
+	const char *name;
+	int (*open)(struct gpio_lines *lines, const char *arg);
+	int (*set)(struct gpio_lines *lines, unsigned int values,
+		   unsigned int mask);
+	int (*get)(struct gpio_lines *lines, unsigned int *values);
+	void (*close)(struct gpio_lines *lines);
+};
+
+struct gpio_lines {
+	const struct gpio_backend *backend;
+	unsigned int pins[GPIO_LINES_MAX];
+	int n;
+	int dir;			/* GPIO_LINES_IN or GPIO_LINES_OUT */
+	int fd[GPIO_LINES_MAX];		/* Per line or per group, backend's choice */
+	void *priv;			/* Anything else the backend keeps */
+};
+
+extern const struct gpio_backend gpio_sysfs_backend;
+extern const struct gpio_backend gpio_chip_backend;
+extern const struct gpio_backend gpio_mmap_backend;
+
+/* Line request on a chip (NULL for the default) with GPIO_V2_LINE_FLAG_*
+   flags; returns the request descriptor, or -1 */
+int gpio_chip_request(const char *chip, const unsigned int *offsets, int n,
+		      unsigned long long flags, int eventBuffer);
+
+struct gpio_lines *gpio_lines_open(const char *spec, const unsigned int *pins,
+				   int n, int dir);
+int gpio_lines_set(struct gpio_lines *lines, unsigned int values,
+		   unsigned int mask);
+int gpio_lines_get(struct gpio_lines *lines, unsigned int *values);
+int gpio_line_set(struct gpio_lines *lines, int i, unsigned int value);
+void gpio_lines_close(struct gpio_lines *lines);
@@ -0,0 +1,259 @@
+/*
+ * gpio-mmap.c
+ *
+ * Register backend for gpio-lines: the OMAP GPIO banks are mapped from
+ * /dev/mem the way dm3730-pwm.c maps the GP timers, and lines are driven
+ * by storing to SETDATAOUT/CLEARDATAOUT. That is one bus write per bank
+ * with no system call, and since those registers only touch the bits
+ * written as 1 the other lines in the bank (the kernel's included) are
+ * never read-modify-written. Lines that go high in a call change before
+ * the ones that go low; both happen within a few bus cycles.
+ *
+ * Pins are global GPIO numbers, as in sysfs: bank pin / 32, bit pin % 32.
+ * The spec argument is "soc[=file]":
+ *	dm3730	BeagleBoard-xM / OMAP3 banks GPIO1-6 (the default)
+ *	am335x	BeagleBone banks GPIO0-3
+ * With =file the banks are a plain file, one 4 KB page per bank, instead
+ * of /dev/mem. The backend then plays the part of the hardware, folding
+ * SET/CLEAR into DATAOUT and looping DATAOUT back to DATAIN, so the API
+ * can be tested and timed on any machine.
+ *
+ * This does not claim the line or set up pinmux and clocks; export the
+ * pin through sysfs or request it from the chip first, so the kernel has
+ * the bank powered, and leave it alone while the map is in use.
+ */
+
+#include "gpio-lines.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define BANK_SIZE	4096
+#define BANKS_MAX	6
+
+/* Get a pointer to the 32 bit register at byte offset `offset` */
+#define REG32(bank, offset) (*(volatile uint32_t *)((bank) + (offset)))
+
+struct mmap_soc {
+	const char *name;
+	int banks;
+	uint32_t addr[BANKS_MAX];
+	/* Register offsets within a bank */
+	unsigned int oe, datain, dataout, cleardataout, setdataout;
+};
+
+static const struct mmap_soc socs[] = {
+	/* DM37x TRM, General-Purpose Interface */
+	{ "dm3730", 6,
+	  { 0x48310000, 0x49050000, 0x49052000,
+	    0x49054000, 0x49056000, 0x49058000 },
+	  0x034, 0x038, 0x03c, 0x090, 0x094 },
+	/* AM335x TRM, GPIO registers */
+	{ "am335x", 4,
+	  { 0x44e07000, 0x4804c000, 0x481ac000, 0x481ae000 },
+	  0x134, 0x138, 0x13c, 0x190, 0x194 },
+};
+
+struct mmap_priv {
+	const struct mmap_soc *soc;
+	int fake;
+	int nbanks;			/* Banks this group uses */
+	uint8_t *bank[BANKS_MAX];	/* Mapped register block per used bank */
+	int slot[GPIO_LINES_MAX];	/* Line i lives in bank[slot[i]] ... */
+	uint32_t bit[GPIO_LINES_MAX];	/* ... at this bit */
+};
+
+static void mmap_close(struct gpio_lines *lines);
+
+/****************************************************************
+ * fake_update
+ ****************************************************************/
+static void fake_update(const struct mmap_soc *soc, uint8_t *bank)
+{
+	uint32_t out = REG32(bank, soc->dataout);
+
+	out |= REG32(bank, soc->setdataout);
+	out &= ~REG32(bank, soc->cleardataout);
+	REG32(bank, soc->setdataout) = 0;
+	REG32(bank, soc->cleardataout) = 0;
+	REG32(bank, soc->dataout) = out;
+	REG32(bank, soc->datain) = out;
+}
+
+/****************************************************************
+ * mmap_open
+ ****************************************************************/
+static int mmap_open(struct gpio_lines *lines, const char *arg)
+{
+	struct mmap_priv *m;
+	const char *file = NULL;
+	int banknum[BANKS_MAX];
+	size_t len;
+	off_t off;
+	int fd, i, j, b;
+
+	m = calloc(1, sizeof(*m));
+	if (m == NULL) {
+		perror("gpio-mmap");
+		return -1;
+	}
+	lines->priv = m;
+
+	if (arg == NULL || *arg == '\0')
+		arg = socs[0].name;
+	len = strcspn(arg, "=");
+	if (arg[len] == '=')
+		file = arg + len + 1;
+	for (i = 0; i < (int)(sizeof(socs) / sizeof(socs[0])); i++)
+		if (strlen(socs[i].name) == len &&
+		    strncmp(socs[i].name, arg, len) == 0)
+			m->soc = &socs[i];
+	if (m->soc == NULL) {
+		fprintf(stderr, "gpio-mmap: unknown SoC %s\n", arg);
+		goto fail;
+	}
+	m->fake = file != NULL;
+
+	if (getpagesize() != BANK_SIZE) {
+		fprintf(stderr, "gpio-mmap: page size is %d, must be %d\n",
+			getpagesize(), BANK_SIZE);
+		goto fail;
+	}
+
+	/* Sort the lines into banks */
+	for (i = 0; i < lines->n; i++) {
+		b = lines->pins[i] / 32;
+		if (b >= m->soc->banks) {
+			fprintf(stderr, "gpio-mmap: no gpio %d on %s\n",
+				lines->pins[i], m->soc->name);
+			goto fail;
+		}
+		for (j = 0; j < m->nbanks && banknum[j] != b; j++)
+			;
+		if (j == m->nbanks)
+			banknum[m->nbanks++] = b;
+		m->slot[i] = j;
+		m->bit[i] = 1u << (lines->pins[i] % 32);
+	}
+
+	if (m->fake) {
+		fd = open(file, O_RDWR | O_CREAT, 0644);
+		if (fd < 0 || ftruncate(fd, m->soc->banks * BANK_SIZE) < 0) {
+			perror(file);
+			goto fail_fd;
+		}
+	} else {
+		fd = open("/dev/mem", O_RDWR | O_SYNC);
+		if (fd < 0) {
+			perror("/dev/mem");
+			goto fail;
+		}
+	}
+
+	for (j = 0; j < m->nbanks; j++) {
+		off = m->fake ? (off_t)banknum[j] * BANK_SIZE :
+			(off_t)m->soc->addr[banknum[j]];
+		m->bank[j] = mmap(NULL, BANK_SIZE, PROT_READ | PROT_WRITE,
+				  MAP_SHARED, fd, off);
+		if (m->bank[j] == MAP_FAILED) {
+			perror("gpio-mmap/mmap");
+			m->bank[j] = NULL;
+			goto fail_fd;
+		}
+	}
+	close(fd);
+
+	/* OE: 0 drives the pin, 1 leaves it an input */
+	for (i = 0; i < lines->n; i++) {
+		uint8_t *bank = m->bank[m->slot[i]];
+
+		if (lines->dir == GPIO_LINES_OUT)
+			REG32(bank, m->soc->oe) &= ~m->bit[i];
+		else
+			REG32(bank, m->soc->oe) |= m->bit[i];
+	}
+	return 0;
+
+fail_fd:
+	if (fd >= 0)
+		close(fd);
+fail:
+	mmap_close(lines);
+	return -1;
+}
+
+/****************************************************************
+ * mmap_set
+ ****************************************************************/
+static int mmap_set(struct gpio_lines *lines, unsigned int values,
+		    unsigned int mask)
+{
+	struct mmap_priv *m = lines->priv;
+	uint32_t set[BANKS_MAX], clear[BANKS_MAX];
+	int i, j;
+
+	for (j = 0; j < m->nbanks; j++)
+		set[j] = clear[j] = 0;
+	for (i = 0; i < lines->n; i++) {
+		if (!(mask & (1u << i)))
+			continue;
+		if (values & (1u << i))
+			set[m->slot[i]] |= m->bit[i];
+		else
+			clear[m->slot[i]] |= m->bit[i];
+	}
+
+	for (j = 0; j < m->nbanks; j++) {
+		if (set[j])
+			REG32(m->bank[j], m->soc->setdataout) = set[j];
+		if (clear[j])
+			REG32(m->bank[j], m->soc->cleardataout) = clear[j];
+		if (m->fake)
+			fake_update(m->soc, m->bank[j]);
+	}
+	return 0;
+}
+
+/****************************************************************
+ * mmap_get
+ ****************************************************************/
+static int mmap_get(struct gpio_lines *lines, unsigned int *values)
+{
+	struct mmap_priv *m = lines->priv;
+	uint32_t in[BANKS_MAX];
+	unsigned int v = 0;
+	int i, j;
+
+	for (j = 0; j < m->nbanks; j++)
+		in[j] = REG32(m->bank[j], m->soc->datain);
+	for (i = 0; i < lines->n; i++)
+		if (in[m->slot[i]] & m->bit[i])
+			v |= 1u << i;
+	*values = v;
+	return 0;
+}
+
+/****************************************************************
+ * mmap_close
+ ****************************************************************/
+static void mmap_close(struct gpio_lines *lines)
+{
+	struct mmap_priv *m = lines->priv;
+	int j;
+
+	if (m == NULL)
+		return;
+	for (j = 0; j < m->nbanks; j++)
+		if (m->bank[j] != NULL)
+			munmap(m->bank[j], BANK_SIZE);
+	free(m);
+	lines->priv = NULL;
+}
+
+const struct gpio_backend gpio_mmap_backend = {
+	"mmap", mmap_open, mmap_set, mmap_get, mmap_close
+};
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Create (or remove) a gpio-sim chip to stand in for real GPIOs, so the
+# gpio-lines "chip" backend can be tried on any Linux box with the
+# gpio-sim module (5.17 and later). Run as root.
+#
+#	./gpio-sim.sh [lines]	prints the /dev/gpiochipN it made
+#	./gpio-sim.sh stop
+#
+# e.g.	./gpio-bench -b chip:`./gpio-sim.sh 8` 0 1 2 3 4 5 6 7
+
+CFG=/sys/kernel/config/gpio-sim/gpio-lines
+
+if [ "$1" = "stop" ]; then
+  echo 0 > $CFG/live
+  rmdir $CFG/bank0 $CFG
+  exit 0
+fi
+
+LINES=${1:-8}
+
+modprobe gpio-sim || exit 1
+if [ ! -d /sys/kernel/config/gpio-sim ]; then
+  mount -t configfs none /sys/kernel/config || exit 1
+fi
+
+mkdir -p $CFG/bank0
+echo $LINES > $CFG/bank0/num_lines
+echo 1 > $CFG/live || exit 1
+
+echo /dev/`cat $CFG/bank0/chip_name`
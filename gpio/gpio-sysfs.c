@@ -0,0 +1,115 @@
+/*
+ * gpio-sysfs.c
+ *
+ * sysfs backend for gpio-lines. Each line's value file is opened once;
+ * after that a set or get is one pwrite()/pread() at offset 0, so there is
+ * no open/close and no lseek per access. A group still costs one system
+ * call per line: sysfs has no way to touch several lines at once.
+ */
+
+#include "gpio-lines.h"
+#include "gpio-utils.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define PATH_BUF 256
+
+static void sysfs_close(struct gpio_lines *lines);
+
+/****************************************************************
+ * sysfs_open
+ ****************************************************************/
+static int sysfs_open(struct gpio_lines *lines, const char *arg)
+{
+	char buf[PATH_BUF];
+	int i;
+
+	if (arg != NULL && *arg != '\0')
+		gpio_set_root(arg);
+
+	for (i = 0; i < lines->n; i++) {
+		snprintf(buf, sizeof(buf), "%s/gpio%d", gpio_get_root(),
+			 lines->pins[i]);
+		if (access(buf, F_OK) != 0 && gpio_export(lines->pins[i]) < 0)
+			goto fail;
+
+		if (gpio_set_dir(lines->pins[i],
+				 lines->dir == GPIO_LINES_OUT ? "out" : "in") < 0)
+			goto fail;
+
+		snprintf(buf, sizeof(buf), "%s/gpio%d/value", gpio_get_root(),
+			 lines->pins[i]);
+		lines->fd[i] = open(buf, lines->dir == GPIO_LINES_OUT ?
+				    O_RDWR : O_RDONLY);
+		if (lines->fd[i] < 0) {
+			perror("gpio-sysfs/open");
+			goto fail;
+		}
+	}
+	return 0;
+
+fail:
+	sysfs_close(lines);
+	return -1;
+}
+
+/****************************************************************
+ * sysfs_set
+ ****************************************************************/
+static int sysfs_set(struct gpio_lines *lines, unsigned int values,
+		     unsigned int mask)
+{
+	int i;
+
+	for (i = 0; i < lines->n; i++) {
+		if (!(mask & (1u << i)))
+			continue;
+		if (pwrite(lines->fd[i], values & (1u << i) ? "1" : "0",
+			   1, 0) != 1) {
+			perror("gpio-sysfs/set");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/****************************************************************
+ * sysfs_get
+ ****************************************************************/
+static int sysfs_get(struct gpio_lines *lines, unsigned int *values)
+{
+	unsigned int v = 0;
+	char ch;
+	int i;
+
+	for (i = 0; i < lines->n; i++) {
+		if (pread(lines->fd[i], &ch, 1, 0) != 1) {
+			perror("gpio-sysfs/get");
+			return -1;
+		}
+		if (ch != '0')
+			v |= 1u << i;
+	}
+	*values = v;
+	return 0;
+}
+
+/****************************************************************
+ * sysfs_close
+ ****************************************************************/
+static void sysfs_close(struct gpio_lines *lines)
+{
+	int i;
+
+	for (i = 0; i < lines->n; i++) {
+		if (lines->fd[i] >= 0)
+			close(lines->fd[i]);
+		lines->fd[i] = -1;
+	}
+}
+
+const struct gpio_backend gpio_sysfs_backend = {
+	"sysfs", sysfs_open, sysfs_set, sysfs_get, sysfs_close
+};
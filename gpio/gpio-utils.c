@@ -37,15 +37,42 @@ From https://www.ridgerun.com/developer/wiki/index.php/Gpio-int-test.c
 #include <fcntl.h>
 #include <string.h>
 
+/* Room for a sysfs root that is not /sys/class/gpio, e.g. a test's temp dir */
+#define PATH_BUF 256
+
+static const char *gpio_root;
+
+/****************************************************************
+ * gpio_set_root
+ ****************************************************************/
+void gpio_set_root(const char *dir)
+{
+	gpio_root = dir;
+}
+
+/****************************************************************
+ * gpio_get_root
+ ****************************************************************/
+const char *gpio_get_root(void)
+{
+	if (gpio_root == NULL) {
+		gpio_root = getenv("GPIO_SYSFS_ROOT");
+		if (gpio_root == NULL)
+			gpio_root = SYSFS_GPIO_DIR;
+	}
+	return gpio_root;
+}
+
 /****************************************************************
  * gpio_export
  ****************************************************************/
 int gpio_export(unsigned int gpio)
 {
 	int fd, len;
-	char buf[MAX_BUF];
+	char buf[PATH_BUF];
  
-	fd = open(SYSFS_GPIO_DIR "/export", O_WRONLY);
+	snprintf(buf, sizeof(buf), "%s/export", gpio_get_root());
+	fd = open(buf, O_WRONLY);
 	if (fd < 0) {
 		perror("gpio/export");
 		return fd;
@@ -64,9 +91,10 @@ int gpio_export(unsigned int gpio)
 int gpio_unexport(unsigned int gpio)
 {
 	int fd, len;
-	char buf[MAX_BUF];
+	char buf[PATH_BUF];
  
-	fd = open(SYSFS_GPIO_DIR "/unexport", O_WRONLY);
+	snprintf(buf, sizeof(buf), "%s/unexport", gpio_get_root());
+	fd = open(buf, O_WRONLY);
 	if (fd < 0) {
 		perror("gpio/export");
 		return fd;
@@ -84,9 +112,9 @@ int gpio_unexport(unsigned int gpio)
 int gpio_set_dir(unsigned int gpio, const char* dir)
 {
 	int fd, len;
-	char buf[MAX_BUF];
+	char buf[PATH_BUF];
  
-	len = snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR  "/gpio%d/direction", gpio);
+	len = snprintf(buf, sizeof(buf), "%s/gpio%d/direction", gpio_get_root(), gpio);
  
 	fd = open(buf, O_WRONLY);
 	if (fd < 0) {
@@ -94,7 +122,7 @@ int gpio_set_dir(unsigned int gpio, const char* dir)
 		return fd;
 	}
 
-	write(fd, dir, sizeof(dir)+1);
+	write(fd, dir, strlen(dir));
 
 	close(fd);
 	return 0;
@@ -106,9 +134,9 @@ int gpio_set_dir(unsigned int gpio, const char* dir)
 int gpio_set_value(unsigned int gpio, unsigned int value)
 {
 	int fd, len;
-	char buf[MAX_BUF];
+	char buf[PATH_BUF];
  
-	len = snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR "/gpio%d/value", gpio);
+	len = snprintf(buf, sizeof(buf), "%s/gpio%d/value", gpio_get_root(), gpio);
  
 	fd = open(buf, O_WRONLY);
 	if (fd < 0) {
@@ -131,10 +159,10 @@ int gpio_set_value(unsigned int gpio, unsigned int value)
 int gpio_get_value(unsigned int gpio, unsigned int *value)
 {
 	int fd, len;
-	char buf[MAX_BUF];
+	char buf[PATH_BUF];
 	char ch;
 
-	len = snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR "/gpio%d/value", gpio);
+	len = snprintf(buf, sizeof(buf), "%s/gpio%d/value", gpio_get_root(), gpio);
  
 	fd = open(buf, O_RDONLY);
 	if (fd < 0) {
@@ -162,9 +190,9 @@ int gpio_get_value(unsigned int gpio, unsigned int *value)
 int gpio_set_edge(unsigned int gpio, const char *edge)
 {
 	int fd, len;
-	char buf[MAX_BUF];
+	char buf[PATH_BUF];
 
-	len = snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR "/gpio%d/edge", gpio);
+	len = snprintf(buf, sizeof(buf), "%s/gpio%d/edge", gpio_get_root(), gpio);
  
 	fd = open(buf, O_WRONLY);
 	if (fd < 0) {
@@ -184,9 +212,9 @@ int gpio_set_edge(unsigned int gpio, const char *edge)
 int gpio_fd_open(unsigned int gpio, unsigned int dir)
 {
 	int fd, len;
-	char buf[MAX_BUF];
+	char buf[PATH_BUF];
 
-	len = snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR "/gpio%d/value", gpio);
+	len = snprintf(buf, sizeof(buf), "%s/gpio%d/value", gpio_get_root(), gpio);
  
 	fd = open(buf, dir | O_NONBLOCK );
 	if (fd < 0) {
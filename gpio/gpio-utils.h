@@ -2,6 +2,10 @@
 #define SYSFS_GPIO_DIR "/sys/class/gpio"
 #define MAX_BUF 64
 
+/* The sysfs tree used by every call below; GPIO_SYSFS_ROOT overrides it */
+void gpio_set_root(const char *dir);
+const char *gpio_get_root(void);
+
 int gpio_export(unsigned int gpio);
 int gpio_unexport(unsigned int gpio);
 int gpio_set_dir(unsigned int gpio, const char* dir);
@@ -29,6 +29,7 @@ From https://www.ridgerun.com/developer/wiki/index.php/Gpio-int-test.c
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE	// sched_setaffinity()
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,7 +38,13 @@ From https://www.ridgerun.com/developer/wiki/index.php/Gpio-int-test.c
 #include <fcntl.h>
 #include <poll.h>
 #include <signal.h>	// Defines signal-handling functions (i.e. trap Ctrl-C)
+#include <sched.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/gpio.h>
 #include "gpio-utils.h"
+#include "gpio-lines.h"
 
  /****************************************************************
  * Constants
@@ -46,6 +53,7 @@ From https://www.ridgerun.com/developer/wiki/index.php/Gpio-int-test.c
 #undef DEBUG
 #define POLL_TIMEOUT (3 * 1000) /* 3 seconds */
 #define MAX_BUF 64
+#define LOOP_TIMEOUT_NS 100000000LL	/* Loopback gives up on an edge after 100 ms */
 
 /****************************************************************
  * Global variables
@@ -62,6 +70,253 @@ void signal_handler(int sig)
 	keepgoing = 0;
 }
 
+/****************************************************************
+ * now_ns
+ ****************************************************************/
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/****************************************************************
+ * set_realtime
+ ****************************************************************/
+// Lock memory, move to SCHED_FIFO and onto one CPU (-1 to leave as is)
+static int set_realtime(int prio, int cpu)
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+
+	if (prio > 0) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+			perror("mlockall");
+		param.sched_priority = prio;
+		if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+			perror("sched_setscheduler");
+			return -1;
+		}
+	}
+	if (cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+			perror("sched_setaffinity");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/****************************************************************
+ * Input, either chip line events or a busy-polled gpio-lines group
+ ****************************************************************/
+struct thru_input {
+	int eventFd;			/* Line request with edges, or -1 */
+	struct gpio_lines *lines;	/* Polled otherwise */
+	unsigned int last;
+};
+
+// Edges only report changes; this reads the event line's current level
+static int input_level(struct thru_input *in)
+{
+	struct gpio_v2_line_values lv;
+
+	memset(&lv, 0, sizeof(lv));
+	lv.mask = 1;
+	if (ioctl(in->eventFd, GPIO_V2_LINE_GET_VALUES_IOCTL, &lv) < 0) {
+		perror("gpioThru/GPIO_V2_LINE_GET_VALUES_IOCTL");
+		return -1;
+	}
+	in->last = lv.bits & 1;
+	return 0;
+}
+
+static int input_open(struct thru_input *in, int events, const char *spec,
+		      unsigned int gpio)
+{
+	in->eventFd = -1;
+	in->lines = NULL;
+	if (events) {
+		/* For events the spec is "chip[:dev]", as for gpio-lines */
+		if (strncmp(spec, "chip", 4) == 0)
+			spec += spec[4] == ':' ? 5 : 4;
+		in->eventFd = gpio_chip_request(spec, &gpio, 1,
+						GPIO_V2_LINE_FLAG_INPUT |
+						GPIO_V2_LINE_FLAG_EDGE_RISING |
+						GPIO_V2_LINE_FLAG_EDGE_FALLING, 0);
+		return in->eventFd < 0 ? -1 : input_level(in);
+	}
+	in->lines = gpio_lines_open(spec, &gpio, 1, GPIO_LINES_IN);
+	if (in->lines == NULL || gpio_lines_get(in->lines, &in->last) < 0)
+		return -1;
+	return 0;
+}
+
+// Waits for the input to change, until deadline (ns, 0 = forever).
+// Returns the new value and when it was seen (and, for events, when the
+// kernel stamped it), or -1 on timeout, error or Ctrl-C.
+static int input_wait(struct thru_input *in, long long deadline,
+		      long long *seen, long long *stamped)
+{
+	struct gpio_v2_line_event ev;
+	struct pollfd fdset;
+	long long left;
+	unsigned int v;
+	int ms = -1;
+
+	if (in->eventFd >= 0) {
+		/* Wait no longer than the deadline for an edge to be queued */
+		if (deadline != 0) {
+			left = deadline - now_ns();
+			ms = left > 0 ? (left + 999999) / 1000000 : 0;
+		}
+		fdset.fd = in->eventFd;
+		fdset.events = POLLIN;
+		fdset.revents = 0;
+		/* SIGINT interrupts it since the handler is not SA_RESTART */
+		switch (poll(&fdset, 1, ms)) {
+		case 0:
+			/* Timed out: the edge was missed, take the level as it is */
+			input_level(in);
+			return -1;
+		case -1:
+			return -1;
+		}
+		if (read(in->eventFd, &ev, sizeof(ev)) != sizeof(ev))
+			return -1;
+		*seen = now_ns();
+		*stamped = ev.timestamp_ns;
+		in->last = ev.id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+		return in->last;
+	}
+
+	do {
+		if (gpio_lines_get(in->lines, &v) < 0)
+			return -1;
+		if (v != in->last) {
+			*seen = *stamped = now_ns();
+			in->last = v;
+			return v;
+		}
+	} while (keepgoing && (deadline == 0 || now_ns() < deadline));
+	return -1;
+}
+
+static void input_close(struct thru_input *in)
+{
+	if (in->eventFd >= 0)
+		close(in->eventFd);
+	gpio_lines_close(in->lines);
+}
+
+/****************************************************************
+ * compare_ll
+ ****************************************************************/
+static int compare_ll(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/****************************************************************
+ * report_latency
+ ****************************************************************/
+static void report_latency(const char *what, long long *ns, int n)
+{
+	if (n == 0)
+		return;
+	qsort(ns, n, sizeof(*ns), compare_ll);
+	printf("%-22s min %8.2f  median %8.2f  p99 %8.2f  max %8.2f us\n",
+	       what, ns[0] / 1000.0, ns[n / 2] / 1000.0,
+	       ns[(int)(n * 0.99)] / 1000.0, ns[n - 1] / 1000.0);
+}
+
+/****************************************************************
+ * loopback
+ ****************************************************************/
+// Output wired to input: toggle the output, time until the input follows
+static int loopback(struct thru_input *in, struct gpio_lines *out, int count)
+{
+	long long *seenNs, *stampNs, t0, seen, stamped;
+	unsigned int v;
+	int i, n = 0, missed = 0;
+
+	seenNs = calloc(count, sizeof(*seenNs));
+	stampNs = calloc(count, sizeof(*stampNs));
+	if (seenNs == NULL || stampNs == NULL) {
+		perror("loopback");
+		return -1;
+	}
+
+	v = in->last;
+	for (i = 0; i < count && keepgoing; i++) {
+		v = !v;
+		t0 = now_ns();
+		gpio_line_set(out, 0, v);
+		if (input_wait(in, t0 + LOOP_TIMEOUT_NS, &seen, &stamped) != (int)v) {
+			/* Resynchronise with whatever the input shows now */
+			missed++;
+			v = in->last;
+			continue;
+		}
+		seenNs[n] = seen - t0;
+		stampNs[n] = stamped - t0;
+		n++;
+	}
+
+	printf("%d loopback edges, %d missed\n", n, missed);
+	report_latency("output to user space", seenNs, n);
+	if (in->eventFd >= 0)
+		report_latency("output to kernel stamp", stampNs, n);
+
+	free(seenNs);
+	free(stampNs);
+	return missed ? -1 : 0;
+}
+
+/****************************************************************
+ * fast_thru
+ ****************************************************************/
+// No stdin, no timeout, no printing: copy each input change to the output
+static int fast_thru(struct thru_input *in, struct gpio_lines *out)
+{
+	long long seen, stamped;
+	unsigned long count = 0;
+	int v;
+
+	gpio_line_set(out, 0, in->last);
+	while (keepgoing) {
+		v = input_wait(in, 0, &seen, &stamped);
+		if (v < 0)
+			break;
+		gpio_line_set(out, 0, v);
+		count++;
+	}
+	printf("%lu edges passed through\n", count);
+	return 0;
+}
+
+/****************************************************************
+ * usage
+ ****************************************************************/
+static void usage(const char *prog)
+{
+	printf("Usage: %s [options] <gpio-input-pin> <gpio-output-pin>\n\n", prog);
+	printf("Waits for a change in the GPIO pin voltage level or input on stdin\n");
+	printf("Any option selects the low-latency mode instead:\n");
+	printf("  -f prio   run SCHED_FIFO at this priority, memory locked\n");
+	printf("  -a cpu    pin to this CPU\n");
+	printf("  -e        wait for chip line events on the input (default)\n");
+	printf("  -p        busy-poll the input; give it a CPU of its own\n");
+	printf("  -I spec   input gpio-lines backend (default chip)\n");
+	printf("  -O spec   output gpio-lines backend (default chip)\n");
+	printf("  -l count  loopback: output wired to input, time count edges\n");
+}
+
 /****************************************************************
  * Main
  ****************************************************************/
@@ -74,25 +329,66 @@ int main(int argc, char **argv, char **envp)
 	unsigned int gpioIn, gpioOut;
 	int len;
 	int count = 0;		// Counts the number of interupts
+	int fast = 0, prio = 0, cpu = -1, events = 1, loops = 0, opt;
+	const char *inSpec = "chip", *outSpec = "chip";
+	struct thru_input in;
+	struct gpio_lines *out;
+	struct sigaction sa;
+
+	while ((opt = getopt(argc, argv, "f:a:epI:O:l:")) != -1) {
+		fast = 1;
+		switch (opt) {
+		case 'f': prio = atoi(optarg); break;
+		case 'a': cpu = atoi(optarg); break;
+		case 'e': events = 1; break;
+		case 'p': events = 0; break;
+		case 'I': inSpec = optarg; break;
+		case 'O': outSpec = optarg; break;
+		case 'l': loops = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			exit(-1);
+		}
+	}
 
-	if (argc < 3) {
-		printf("Usage: %s <gpio-input-pin> <gpio-output-pin>\n\n", argv[0]);
-		printf("Waits for a change in the GPIO pin voltage level or input on stdin\n");
+	if (argc - optind < 2) {
+		usage(argv[0]);
 		exit(-1);
 	}
+	gpioIn = atoi(argv[optind]);
+	gpioOut = atoi(argv[optind + 1]);
+
+	if (fast) {
+		// Without SA_RESTART so Ctrl-C also ends a blocked event read
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = signal_handler;
+		sigaction(SIGINT, &sa, NULL);
+
+		if (input_open(&in, events, inSpec, gpioIn) < 0)
+			exit(-1);
+		out = gpio_lines_open(outSpec, &gpioOut, 1, GPIO_LINES_OUT);
+		if (out == NULL)
+			exit(-1);
+		if (set_realtime(prio, cpu) < 0)
+			exit(-1);
+
+		rc = loops ? loopback(&in, out, loops) : fast_thru(&in, out);
+
+		gpio_lines_close(out);
+		input_close(&in);
+		return rc;
+	}
 
 	// Set the signal callback for Ctrl-C
 	signal(SIGINT, signal_handler);
 
 	// Set up input
-	gpioIn = atoi(argv[1]);
 	gpio_export(gpioIn);
 	gpio_set_dir(gpioIn, "in");
 	gpio_set_edge(gpioIn, "both");
 	gpio_fdIn = gpio_fd_open(gpioIn, O_RDONLY);
 
 	// Set up output
-	gpioOut=atoi(argv[2]);
 	gpio_export(gpioOut);
 	gpio_set_dir(gpioOut, "out");
 	gpio_fdOut = gpio_fd_open(gpioOut, O_WRONLY);
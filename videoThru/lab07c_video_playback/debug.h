@@ -10,15 +10,24 @@
  */
 
 #include <stdio.h>
+#include "log.h"
+
+// Messages are queued to the logger thread (log.c) and formatted there;
+// build with -DLOG_SYNC to print them directly instead
+#ifdef LOG_SYNC
+    #define LOG_PRINT(fmt, args...) fprintf(stderr, fmt, ## args)
+#else
+    #define LOG_PRINT(fmt, args...) log_write(fmt, ## args)
+#endif
 
 // Enables or disables debug output
 #ifdef _DEBUG_
-    #define DBG(fmt, args...) fprintf(stderr, "Debug: " fmt, ## args)
+    #define DBG(fmt, args...) LOG_PRINT("Debug: " fmt, ## args)
     #define dspTraceDump(ce) Engine_fwriteTrace((ce), "[DSP] ", stderr)
 #else
     #define DBG(fmt, args...)
     #define dspTraceDump(ce)
 #endif
 
-#define ERR(fmt, args...) fprintf(stderr, "Error: " fmt, ## args)
+#define ERR(fmt, args...) LOG_PRINT("Error: " fmt, ## args)
 
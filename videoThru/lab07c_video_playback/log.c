@@ -0,0 +1,400 @@
+/*
+ *   log.c
+ *
+ *   log_write() never formats and never blocks. It walks the format string
+ *   just far enough to copy the arguments into a fixed-size binary record
+ *   (strings are copied, everything else by value) and pushes the record
+ *   onto a lock-free multi-producer ring. If the ring is full the message
+ *   is counted and dropped. A background thread pops the records, does the
+ *   printf formatting and writes them out.
+ *
+ *   The format must be a string literal (DBG/ERR always pass one), since
+ *   only the pointer is queued. Before log_init() and after log_shutdown()
+ *   messages are printed synchronously, as debug.h used to.
+ */
+
+/* Standard Linux headers */
+#include     <stdio.h>			// Always include stdio.h
+#include     <stdlib.h>			// Always include stdlib.h
+#include     <stdarg.h>
+#include     <string.h>			// Defines memcpy and strlen
+#include     <errno.h>
+#include     <time.h>			// nanosleep
+#include     <pthread.h>
+
+/* Application headers */
+#include     "log.h"
+
+#define     LOG_IDLE_NS      2000000	// Logger thread poll period when idle
+#define     SPEC_LEN         32		// Longest conversion spec we rebuild
+
+/* How an argument was captured */
+enum { ARG_INT, ARG_CHAR, ARG_DOUBLE, ARG_PTR, ARG_STR, ARG_NONE };
+
+typedef  union  LogArg
+{
+    long long     i;
+    double        d;
+    const void  * p;
+    int           s;		// Offset of a copied string in LogRecord.str
+} LogArg;
+
+typedef  struct  LogRecord
+{
+    unsigned int    seq;		// Ring protocol, see log_write
+    const char    * fmt;
+    int             nargs;
+    unsigned char   type[ LOG_MAX_ARGS ];
+    LogArg          arg[ LOG_MAX_ARGS ];
+    char            str[ LOG_STR_BYTES ];
+} LogRecord;
+
+static LogRecord        ring[ LOG_RING_SIZE ];
+static unsigned int     head = 0;		// Next slot a producer claims
+static unsigned int     tail = 0;		// Next slot the logger thread reads
+static unsigned int     dropped = 0;
+
+static FILE           * logOut;
+static pthread_t        logThread;
+static volatile int     logRunning = 0;
+
+/******************************************************************************
+ * parse_spec
+ ******************************************************************************/
+/*  Parses the conversion spec starting at p (just past the '%'). Fills the  */
+/*  number of '*' fields, the length modifier and the conversion character. */
+/*                                                                            */
+/*  return value:                                                             */
+/*      const char * -- first character after the spec                        */
+/******************************************************************************/
+static const char *parse_spec( const char * p, int * stars, char * len, char * conv )
+{
+    *stars = 0;
+    len[ 0 ] = len[ 1 ] = len[ 2 ] = '\0';
+
+    while( *p && strchr( "-+ #0'", *p ) )		// flags
+        p++;
+    if( *p == '*' ) { ( *stars )++; p++; }		// width
+    while( *p >= '0' && *p <= '9' ) p++;
+    if( *p == '.' ) {					// precision
+        p++;
+        if( *p == '*' ) { ( *stars )++; p++; }
+        while( *p >= '0' && *p <= '9' ) p++;
+    }
+    if( *p && strchr( "hlLqjzt", *p ) ) {		// length
+        len[ 0 ] = *p++;
+        if( ( len[ 0 ] == 'h' || len[ 0 ] == 'l' ) && *p == len[ 0 ] )
+            len[ 1 ] = *p++;
+    }
+
+    *conv = *p;
+    return *p ? p + 1 : p;
+}
+
+/******************************************************************************
+ * capture_args
+ ******************************************************************************/
+/*  Producer side: copies the arguments fmt refers to into rec.               */
+/******************************************************************************/
+static void capture_args( LogRecord * rec, const char * fmt, va_list ap )
+{
+    const char  *p = fmt;
+    int          stars, strUsed = 0, n = 0, savedErrno = errno;
+    char         len[ 3 ], conv;
+
+    while( ( p = strchr( p, '%' ) ) != NULL ) {
+        if( p[ 1 ] == '%' ) {
+            p += 2;
+            continue;
+        }
+
+        p = parse_spec( p + 1, &stars, len, &conv );
+
+        // '*' width and precision are stored as ordinary int arguments
+        while( stars-- > 0 ) {
+            if( n == LOG_MAX_ARGS )
+                goto full;
+            rec->type[ n ]  = ARG_INT;
+            rec->arg[ n++ ].i = va_arg( ap, int );
+        }
+
+        if( n == LOG_MAX_ARGS )
+            goto full;
+
+        switch( conv ) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            rec->type[ n ] = ARG_INT;
+            if( len[ 0 ] == 'l' && len[ 1 ] == 'l' )
+                rec->arg[ n ].i = va_arg( ap, long long );
+            else if( len[ 0 ] == 'l' || len[ 0 ] == 'z' || len[ 0 ] == 't' )
+                rec->arg[ n ].i = conv == 'd' || conv == 'i' ? va_arg( ap, long )
+                                  : ( long long ) va_arg( ap, unsigned long );
+            else if( len[ 0 ] == 'j' || len[ 0 ] == 'q' )
+                rec->arg[ n ].i = va_arg( ap, long long );
+            else if( conv == 'd' || conv == 'i' )
+                rec->arg[ n ].i = len[ 1 ] == 'h' ? ( signed char ) va_arg( ap, int )
+                                : len[ 0 ] == 'h' ? ( short ) va_arg( ap, int )
+                                : va_arg( ap, int );
+            else
+                rec->arg[ n ].i = len[ 1 ] == 'h' ? ( unsigned char ) va_arg( ap, unsigned int )
+                                : len[ 0 ] == 'h' ? ( unsigned short ) va_arg( ap, unsigned int )
+                                : va_arg( ap, unsigned int );
+            break;
+
+        case 'c':
+            rec->type[ n ]  = ARG_CHAR;
+            rec->arg[ n ].i = va_arg( ap, int );
+            break;
+
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            rec->type[ n ]  = ARG_DOUBLE;
+            rec->arg[ n ].d = len[ 0 ] == 'L' ? ( double ) va_arg( ap, long double )
+                                              : va_arg( ap, double );
+            break;
+
+        case 'p':
+            rec->type[ n ]  = ARG_PTR;
+            rec->arg[ n ].p = va_arg( ap, void * );
+            break;
+
+        case 's':
+        case 'm': {
+            const char *s = conv == 'm' ? strerror( savedErrno ) : va_arg( ap, const char * );
+            int         room = LOG_STR_BYTES - strUsed - 1, l;
+
+            // Strings are truncated to fit; once full they print as ""
+            if( s == NULL )
+                s = "(null)";
+            l = strlen( s );
+            if( l > room )
+                l = room;
+
+            memcpy( rec->str + strUsed, s, l );
+            rec->str[ strUsed + l ] = '\0';
+            rec->type[ n ]  = ARG_STR;
+            rec->arg[ n ].s = strUsed;
+            strUsed += l;
+            if( strUsed < LOG_STR_BYTES - 1 )
+                strUsed++;
+            break;
+        }
+
+        default:			// %n and anything we don't know
+            if( conv == 'n' )
+                ( void ) va_arg( ap, void * );
+            rec->type[ n ] = ARG_NONE;
+            break;
+        }
+        n++;
+    }
+
+full:
+    rec->nargs = n;
+}
+
+/******************************************************************************
+ * print_record
+ ******************************************************************************/
+/*  Logger side: formats one record, one conversion at a time.                */
+/******************************************************************************/
+static void print_record( FILE * out, LogRecord * rec )
+{
+    const char  *p = rec->fmt, *start, *end;
+    int          n = 0, stars, k, w;
+    char         len[ 3 ], conv, spec[ SPEC_LEN + 24 ], *q;
+
+    while( *p ) {
+        // Literal text up to the next conversion
+        end = strchr( p, '%' );
+        if( end == NULL ) {
+            fputs( p, out );
+            return;
+        }
+        fwrite( p, 1, end - p, out );
+
+        if( end[ 1 ] == '%' ) {
+            fputc( '%', out );
+            p = end + 2;
+            continue;
+        }
+
+        start = end;
+        p = parse_spec( end + 1, &stars, len, &conv );
+
+        if( n + stars >= rec->nargs ) {	// ran out of captured arguments
+            fputs( " [...]\n", out );
+            return;
+        }
+
+        // Rebuild the spec: '*' replaced by its value, length forced to
+        // what we stored
+        q = spec;
+        for( end = start; end < p - 1 && q < spec + SPEC_LEN; end++ ) {
+            if( *end == '*' ) {
+                w = ( int ) rec->arg[ n++ ].i;
+                q += sprintf( q, "%d", w );
+            }
+            else if( !strchr( "hlLqjzt", *end ) )
+                *q++ = *end;
+        }
+        if( rec->type[ n ] == ARG_INT ) {
+            *q++ = 'l';
+            *q++ = 'l';
+        }
+        *q++ = conv;
+        *q   = '\0';
+
+        k = n++;
+        switch( rec->type[ k ] ) {
+        case ARG_INT:    fprintf( out, spec, rec->arg[ k ].i );                 break;
+        case ARG_CHAR:   fprintf( out, spec, ( int ) rec->arg[ k ].i );         break;
+        case ARG_DOUBLE: fprintf( out, spec, rec->arg[ k ].d );                 break;
+        case ARG_PTR:    fprintf( out, spec, rec->arg[ k ].p );                 break;
+        case ARG_STR:
+            spec[ strlen( spec ) - 1 ] = 's';
+            fprintf( out, spec, rec->str + rec->arg[ k ].s );
+            break;
+        default:                                                                break;
+        }
+    }
+}
+
+/******************************************************************************
+ * log_thread_fxn
+ ******************************************************************************/
+static void *log_thread_fxn( void * arg )
+{
+    struct timespec  idle = { 0, LOG_IDLE_NS };
+    LogRecord       *rec;
+    int              printed;
+
+    for( ;; ) {
+        printed = 0;
+
+        // Single consumer: a slot is ready once its seq is tail + 1
+        for( ;; ) {
+            rec = &ring[ tail & ( LOG_RING_SIZE - 1 ) ];
+            if( __atomic_load_n( &rec->seq, __ATOMIC_ACQUIRE ) != tail + 1 )
+                break;
+
+            print_record( logOut, rec );
+            __atomic_store_n( &rec->seq, tail + LOG_RING_SIZE, __ATOMIC_RELEASE );
+            tail++;
+            printed = 1;
+        }
+
+        if( printed )
+            fflush( logOut );
+        else if( !logRunning )
+            break;
+        else
+            nanosleep( &idle, NULL );
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+ * log_init
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      FILE *out -- where messages go (NULL = stderr)                        */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  --  LOG_SUCCESS or LOG_FAILURE (messages stay synchronous)       */
+/******************************************************************************/
+int log_init( FILE * out )
+{
+    unsigned int  i;
+
+    if( logRunning )
+        return LOG_SUCCESS;
+
+    logOut = out ? out : stderr;
+
+    for( i = 0; i < LOG_RING_SIZE; i++ )
+        ring[ i ].seq = i;
+    head = tail = 0;
+
+    logRunning = 1;
+    if( pthread_create( &logThread, NULL, log_thread_fxn, NULL ) != 0 ) {
+        logRunning = 0;
+        fprintf( stderr, "Error: Failed to create logger thread\n" );
+        return LOG_FAILURE;
+    }
+
+    return LOG_SUCCESS;
+}
+
+/******************************************************************************
+ * log_write
+ ******************************************************************************/
+/*  printf-style; queues the message or drops it if the ring is full.         */
+/******************************************************************************/
+void log_write( const char * fmt, ... )
+{
+    va_list       ap;
+    LogRecord    *rec;
+    unsigned int  pos, seq;
+
+    va_start( ap, fmt );
+
+    if( !logRunning ) {
+        vfprintf( stderr, fmt, ap );
+        va_end( ap );
+        return;
+    }
+
+    // Claim a slot: it is free when its seq equals our position
+    pos = __atomic_load_n( &head, __ATOMIC_RELAXED );
+    for( ;; ) {
+        rec = &ring[ pos & ( LOG_RING_SIZE - 1 ) ];
+        seq = __atomic_load_n( &rec->seq, __ATOMIC_ACQUIRE );
+
+        if( seq == pos ) {
+            if( __atomic_compare_exchange_n( &head, &pos, pos + 1, 1,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                break;
+        }
+        else if( ( int ) ( seq - pos ) < 0 ) {
+            __atomic_fetch_add( &dropped, 1, __ATOMIC_RELAXED );
+            va_end( ap );
+            return;
+        }
+        else
+            pos = __atomic_load_n( &head, __ATOMIC_RELAXED );
+    }
+
+    rec->fmt = fmt;
+    capture_args( rec, fmt, ap );
+    va_end( ap );
+
+    // Publish to the logger thread
+    __atomic_store_n( &rec->seq, pos + 1, __ATOMIC_RELEASE );
+}
+
+/******************************************************************************
+ * log_shutdown
+ ******************************************************************************/
+/*  Prints everything still queued, stops the logger thread and reports how  */
+/*  many messages were dropped.                                               */
+/******************************************************************************/
+void log_shutdown( void )
+{
+    if( !logRunning )
+        return;
+
+    logRunning = 0;
+    pthread_join( logThread, NULL );
+
+    if( dropped )
+        fprintf( stderr, "Debug: logger dropped %u messages\n", dropped );
+}
+
+/******************************************************************************
+ * log_dropped
+ ******************************************************************************/
+unsigned int log_dropped( void )
+{
+    return __atomic_load_n( &dropped, __ATOMIC_RELAXED );
+}
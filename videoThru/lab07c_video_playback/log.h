@@ -0,0 +1,23 @@
+/*
+ *   log.h
+ *
+ *   Asynchronous backend for the DBG and ERR macros in debug.h.
+ */
+
+/* SUCCESS and FAILURE definitions for the logger functions */
+#define     LOG_SUCCESS      0
+#define     LOG_FAILURE      -1
+
+/* Ring and record sizes */
+#define     LOG_RING_SIZE    256	// Records, must be a power of two
+#define     LOG_MAX_ARGS     8		// Conversions kept per message
+#define     LOG_STR_BYTES    96		// Room for copied %s arguments per message
+
+/* Function prototypes */
+int          log_init( FILE * out );
+
+void         log_write( const char * fmt, ... ) __attribute__ (( format( printf, 1, 2 ) ));
+
+void         log_shutdown( void );
+
+unsigned int log_dropped( void );
@@ -47,6 +47,9 @@ int main(int argc, char *argv[])
 
     void *videoThreadReturn;
 
+    /* Move DBG/ERR output off the video thread */
+    log_init( stderr );
+
     /* Set the signal callback for Ctrl-C */
     pSigPrev = signal( SIGINT, signal_handler );
 
@@ -65,5 +68,8 @@ int main(int argc, char *argv[])
     /* Make video frame buffer invisible */
     system("cd ..; ./resetVideo");
 
+    /* Flush queued messages */
+    log_shutdown( );
+
     exit( status );
 }
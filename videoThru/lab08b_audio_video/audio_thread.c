@@ -12,27 +12,11 @@
 #include     "debug.h"			// DBG and ERR macros
 #include     "audio_thread.h"		// Audio thread definitions
 #include     "audio_input_output.h"	// Audio driver input and output functions
-
-// Timing routines
-#include <time.h>
-#if defined(_TMS320C6X)			// Here's how to test for the DSP
-#elif defined(__GNUC__)			// Test for the ARM
-  #include <sys/time.h>
-#endif
-
-typedef unsigned long long timestamp_t;
-
-static timestamp_t get_timestamp ()
-{
-#if defined(_TMS320C6X)
-  // There is no gettimeofday in DSP RTS or DSP/BIOS
-  return (timestamp_t) clock();
-#elif defined(__GNUC__)
-  struct timeval now;
-  gettimeofday (&now, NULL);
-  return  now.tv_usec + (timestamp_t)now.tv_sec * 1000000;
-#endif
-}
+#include     "instrument.h"		// Stage timing histograms
+#include     "trace.h"			// Timeline trace points
+#include     "perfctr.h"		// Hardware counters per stage
+#include     "thread.h"			// Deadline-miss counting, thread heap
+#include     "watchdog.h"		// Block budget and overload shedding
 
 //* ALSA devices **
 //#define     IN_SOUND_DEVICE      "plughw:0,0"	// Use for line in
@@ -52,6 +36,35 @@ static timestamp_t get_timestamp ()
 #define     BLOCKSIZE        48000	// Number of bytes
 
 
+//*******************************************************************************
+//*  bench_transfer                                                            **
+//*******************************************************************************
+//*  Moves a whole block through a non-blocking PCM: partial transfers carry   **
+//*  on from where they stopped and snd_pcm_wait() sleeps until the device is  **
+//*  ready, so a block costs what a blocking call would. Counts the waits.     **
+//*******************************************************************************
+static void bench_transfer( snd_pcm_t *handle, char *buf, snd_pcm_uframes_t frames,
+			    int capture, int *waits )
+{
+    snd_pcm_sframes_t n;
+
+    while( frames > 0 ) {
+	n = capture ? snd_pcm_readi( handle, buf, frames )
+		    : snd_pcm_writei( handle, buf, frames );
+	if( n == -EAGAIN ) {
+	    (*waits)++;
+	    snd_pcm_wait( handle, 1000 );
+	}
+	else if( n < 0 )
+	    snd_pcm_prepare( handle );
+	else {
+	    buf    += n * BYTESPERFRAME;
+	    frames -= n;
+	}
+    }
+}
+
+
 //*******************************************************************************
 //*  audio_thread_fxn                                                          **
 //*******************************************************************************
@@ -90,10 +103,30 @@ void *audio_thread_fxn( void *envByRef )
     int   blksize = BLOCKSIZE;	// Raw input or output frame size in bytes
     char *inputBuffer = NULL;	// Input buffer for driver to read into
     char *outputBuffer = NULL;	// Output buffer for driver to read from
+    char *heap;			// Pre-touched heap from launch_pthread_ex
+    size_t heapSize;
+    char *inDevice  = envPtr->inDevice  ? envPtr->inDevice  : IN_SOUND_DEVICE;
+    char *outDevice = envPtr->outDevice ? envPtr->outDevice : OUT_SOUND_DEVICE;
+
+    // Stage timing (see instrument.h)
+    int stRead  = inst_stage( "audio.read" );
+    int stProc  = inst_stage( "audio.process" );
+    int stWrite = inst_stage( "audio.write" );
+    int stBlock = inst_stage( "audio.block" );
+    int blocks  = 0;
+    int readsEmpty  = 0;	// Benchmark reads that waited for input
+    int writesFull  = 0;	// Benchmark writes that waited for room
+    int pcRead  = perf_stage( "audio.read" );
+    int pcProc  = perf_stage( "audio.process" );
+    int pcWrite = perf_stage( "audio.write" );
+    int wdAudio = WD_FAILURE;
 
 // Thread Create Phase -- secure and initialize resources
 // ******************************************************
 
+    trace_thread_name( "audio" );
+    perf_thread_open( );
+
     // Setup audio input device
     // ************************
 
@@ -102,7 +135,7 @@ void *audio_thread_fxn( void *envByRef )
     request_bufsize = exact_bufsize;
     DBG( "Requesting %d frame input buffer\n", (int) request_bufsize);
 
-    if( audio_io_setup( &pcm_capture_handle, IN_SOUND_DEVICE, SAMPLE_RATE, 
+    if( audio_io_setup( &pcm_capture_handle, inDevice, SAMPLE_RATE, 
 		SND_PCM_STREAM_CAPTURE, &exact_bufsize ) == AUDIO_FAILURE ) {
         ERR( "Audio_input_setup failed in audio_thread_fxn\n\n" );
         status = AUDIO_THREAD_FAILURE;
@@ -117,6 +150,20 @@ void *audio_thread_fxn( void *envByRef )
     initMask |= INPUT_ALSA_INITIALIZED;
 
     blksize = exact_bufsize*BYTESPERFRAME;
+
+    // A block that takes longer than it plays for is a missed deadline
+    thread_set_deadline( (unsigned long long) exact_bufsize * 1000000000ULL / SAMPLE_RATE );
+    wdAudio = wd_loop( "audio", (unsigned long long) exact_bufsize * 1000000000ULL / SAMPLE_RATE );
+
+    // Use the thread's locked, pre-touched heap for the blocks if it fits
+    heap = thread_heap( &heapSize );
+    if( heap != NULL && heapSize >= 2 * (size_t) blksize ) {
+        inputBuffer  = heap;
+        outputBuffer = heap + blksize;
+        DBG( "Using %d byte audio blocks from the thread heap at %p\n", blksize, heap );
+        goto buffers_ready;
+    }
+
     // Create input buffer to read into from ALSA input device
     if( ( inputBuffer = malloc( blksize ) ) == NULL ) {
         ERR( "Failed to allocate memory for input block (%d)\n", blksize );
@@ -141,6 +188,8 @@ void *audio_thread_fxn( void *envByRef )
     // Record that the output buffer was allocated in initialization bitmask
     initMask |= OUTPUT_BUFFER_ALLOCATED;
 
+buffers_ready:
+
     // Initialize audio output device
     // ******************************
 
@@ -151,7 +200,7 @@ void *audio_thread_fxn( void *envByRef )
     request_bufsize = exact_bufsize;
     DBG( "Requesting %d frame output buffer\n", (int) request_bufsize);
 
-    if( audio_io_setup( &pcm_output_handle, OUT_SOUND_DEVICE, SAMPLE_RATE, 
+    if( audio_io_setup( &pcm_output_handle, outDevice, SAMPLE_RATE, 
 		SND_PCM_STREAM_PLAYBACK, &exact_bufsize) == AUDIO_FAILURE ) {
         ERR( "audio_output_setup failed in audio_thread_fxn\n" );
         status = AUDIO_THREAD_FAILURE;
@@ -171,7 +220,7 @@ void *audio_thread_fxn( void *envByRef )
 // **************************************************
     int err;
     int errcnt =0;
-    timestamp_t t_start, t_read, t_proc, t_write, t_old=0;
+    inst_time_t t_start, t_read, t_proc, t_write, t_old=0;
     
     // Processing loop
     // Do a dummy call to the DSP to get it started.  This takes a while on the first call
@@ -206,29 +255,59 @@ void *audio_thread_fxn( void *envByRef )
 	    ERR( "<<<Pre Buffer Underrun >>> err=%d, errcnt=%d\n", err, errcnt);
 	    }
 	}
+    if( envPtr->benchmark ) {
+	// Non-blocking: a read or write moves what the device can take now
+	// and waits in snd_pcm_wait() for the rest, so whole blocks are timed
+	// as in blocking mode, and the waits are counted on their own.
+	snd_pcm_nonblock( pcm_capture_handle, 1 );
+	snd_pcm_nonblock( pcm_output_handle, 1 );
+	inst_enable( 1 );
+	printf( "Timing %d blocks of %d bytes from %s to %s\n",
+		envPtr->benchmark, blksize, inDevice, outDevice );
+    }
+
 //
 //	The main loop
 //
     while( !envPtr->quit ) {
 	// Read capture buffer from ALSA input device
-	t_start = get_timestamp();
+	INST_STAMP( t_start );
+	TRACE_BEGIN( "audio.read" );
+	PERF_BEGIN( );
+	if( envPtr->benchmark )
+	    bench_transfer( pcm_capture_handle, inputBuffer, exact_bufsize, 1, &readsEmpty );
+	else
         while( snd_pcm_readi(pcm_capture_handle, inputBuffer, exact_bufsize) < 0 ) {
 	    snd_pcm_prepare(pcm_capture_handle);
 	    ERR( "<<<<<<<<<<<<<<< Buffer Overrun >>>>>>>>>>>>>>>\n");
             ERR( "Error reading the data from file descriptor %d\n", 
 			(int) pcm_capture_handle );
         }
-	t_read = get_timestamp();
+	INST_STAMP( t_read );
+	PERF_END( pcRead );
+	TRACE_END( "audio.read" );
+	// The deadline and the budget cover the work, not the wait for input
+	thread_job_begin( );
+	wd_begin( wdAudio );
+	TRACE_BEGIN( "audio.process" );
+	PERF_BEGIN( );
 	// Audio process
 	//  I'm passing the data as short since we are processing 16-bit audio.
 	//	memcpy(outputBuffer, inputBuffer, blksize);
 //	audio_process((short *)outputBuffer, (short *)inputBuffer, blksize/2);
 	memcpy((char *)outputBuffer, (char *)inputBuffer, blksize);
-	t_proc = get_timestamp();
+	INST_STAMP( t_proc );
+	PERF_END( pcProc );
+	TRACE_END( "audio.process" );
+	TRACE_BEGIN( "audio.write" );
+	PERF_BEGIN( );
 
 	// Write output buffer into ALSA output device
 	errcnt = 0;	// The Beagle gets an underrun error the first time it trys to write,
 			// so I ignore the first error and it appear to work fine.
+	if( envPtr->benchmark )
+	    bench_transfer( pcm_output_handle, outputBuffer, exact_bufsize, 0, &writesFull );
+	else
 	while ((err = snd_pcm_writei(pcm_output_handle, outputBuffer,
 		exact_bufsize)) < 0) {
 	    snd_pcm_prepare(pcm_output_handle);
@@ -236,10 +315,27 @@ void *audio_thread_fxn( void *envByRef )
 	    memset(outputBuffer, 0, blksize);		// Clear the buffer
 	    snd_pcm_writei(pcm_output_handle, outputBuffer, exact_bufsize);
 	}
-	t_write= get_timestamp();
-//	DBG( "%d\t%d\t%d\t%d\n", t_start-t_old, t_read-t_start, t_proc-t_read,
-//		t_write-t_proc);
+	INST_STAMP( t_write );
+	PERF_END( pcWrite );
+	TRACE_END( "audio.write" );
+	wd_end( wdAudio );
+	thread_job_end( );
+	INST_RECORD( stRead,  t_start, t_read );
+	INST_RECORD( stProc,  t_read,  t_proc );
+	INST_RECORD( stWrite, t_proc,  t_write );
+	if( t_old )
+	    INST_RECORD( stBlock, t_old, t_start );
 	t_old = t_start;
+
+	// The benchmark stops by itself
+	if( envPtr->benchmark && ++blocks >= envPtr->benchmark )
+	    break;
+    }
+
+    if( envPtr->benchmark ) {
+	printf( "Audio benchmark: %d blocks, %d reads waited for input, %d writes waited for room\n",
+		blocks, readsEmpty, writesFull );
+	inst_report( stdout, "audio." );
     }
 
     DBG( "Exited audio_thread_fxn processing loop\n" );
@@ -291,6 +387,8 @@ cleanup:
         DBG( "Freed audio output buffer at location %p\n", outputBuffer );
     }
 
+    perf_thread_close( );
+
     // Return from audio_thread_fxn function
     // *************************************
 
@@ -10,6 +10,9 @@
 typedef  struct  audio_thread_env
 {
     int quit;                // Thread will run as long as quit = 0
+    char *inDevice;          // ALSA capture PCM name, NULL = default
+    char *outDevice;         // ALSA playback PCM name, NULL = default
+    int benchmark;           // Blocks to time before exiting, 0 = off
 } audio_thread_env;
 
 // Function prototypes
@@ -0,0 +1,373 @@
+/*
+ *   instrument.c
+ *
+ *   Lock-free per-stage latency histograms. Stages are registered during
+ *   thread setup (under a mutex); recording only does relaxed atomic adds,
+ *   so the loops never block on it. A snapshot thread can periodically
+ *   write the table to a file or to a POSIX shared-memory page.
+ */
+
+/* Standard Linux headers */
+#include     <stdio.h>			// Always include stdio.h
+#include     <stdlib.h>			// Always include stdlib.h
+#include     <string.h>			// Defines memset and strncmp
+#include     <errno.h>
+#include     <pthread.h>
+#include     <fcntl.h>			// O_CREAT etc.
+#include     <unistd.h>			// ftruncate, close
+#include     <sys/mman.h>		// shm_open, mmap
+
+/* Application headers */
+#include     "instrument.h"
+#include     "debug.h"			// DBG and ERR macros
+
+#define     SHM_PREFIX       "shm:"
+
+volatile int inst_enabled = 0;
+
+static InstStage        stages[ INST_MAX_STAGES ];
+static int              numStages = 0;
+static pthread_mutex_t  stageLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Snapshot thread state */
+static pthread_t        snapThread;
+static volatile int     snapRunning = 0;
+static char             snapPath[ 256 ];
+static int              snapPeriodMs;
+static char           * shmPage = NULL;
+
+/******************************************************************************
+ * bin_of / bin_floor
+ ******************************************************************************/
+/*  Values below 8 get a bin each. Above that, the bin is the power of two    */
+/*  (exponent e) plus the next three bits below the leading one.              */
+/******************************************************************************/
+static inline int bin_of( unsigned long long v )
+{
+    int  e;
+
+    if( v < ( 1ULL << INST_SUB_BITS ) )
+        return ( int ) v;
+
+    e = 63 - __builtin_clzll( v );
+    return ( ( e - INST_SUB_BITS + 1 ) << INST_SUB_BITS )
+         | ( int ) ( ( v >> ( e - INST_SUB_BITS ) ) & ( ( 1 << INST_SUB_BITS ) - 1 ) );
+}
+
+static unsigned long long bin_floor( int  bin )
+{
+    int  group = bin >> INST_SUB_BITS;
+    int  sub   = bin & ( ( 1 << INST_SUB_BITS ) - 1 );
+
+    if( group == 0 )
+        return sub;
+
+    return ( unsigned long long ) ( ( 1 << INST_SUB_BITS ) | sub )
+           << ( group - 1 );
+}
+
+/******************************************************************************
+ * inst_stage
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      const char *name -- stage name, e.g. "audio.read"                     */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  -- stage id for inst_record (same id for the same name), or     */
+/*              INST_FAILURE if the table is full                             */
+/******************************************************************************/
+int inst_stage( const char * name )
+{
+    int  i, id = INST_FAILURE;
+
+    pthread_mutex_lock( &stageLock );
+
+    for( i = 0; i < numStages; i++ )
+        if( strncmp( stages[ i ].name, name, INST_NAME_LEN - 1 ) == 0 ) {
+            id = i;
+            goto done;
+        }
+
+    if( numStages == INST_MAX_STAGES ) {
+        ERR( "No room for instrumentation stage %s\n", name );
+        goto done;
+    }
+
+    id = numStages;
+    memset( &stages[ id ], 0, sizeof( stages[ id ] ) );
+    strncpy( stages[ id ].name, name, INST_NAME_LEN - 1 );
+    stages[ id ].min = ~0ULL;
+    __atomic_store_n( &numStages, numStages + 1, __ATOMIC_RELEASE );
+
+done:
+    pthread_mutex_unlock( &stageLock );
+    return id;
+}
+
+/******************************************************************************
+ * inst_record
+ ******************************************************************************/
+/*  Adds one sample of ns nanoseconds to a stage. Safe from any thread.       */
+/******************************************************************************/
+void inst_record( int  stage, inst_time_t  ns )
+{
+    InstStage          *s;
+    unsigned long long  old;
+
+    if( ( unsigned ) stage >= ( unsigned ) INST_MAX_STAGES )
+        return;
+
+    s = &stages[ stage ];
+
+    __atomic_fetch_add( &s->bins[ bin_of( ns ) ], 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &s->count, 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &s->total, ns, __ATOMIC_RELAXED );
+
+    old = __atomic_load_n( &s->max, __ATOMIC_RELAXED );
+    while( ns > old &&
+           !__atomic_compare_exchange_n( &s->max, &old, ns, 1,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        ;
+
+    old = __atomic_load_n( &s->min, __ATOMIC_RELAXED );
+    while( ns < old &&
+           !__atomic_compare_exchange_n( &s->min, &old, ns, 1,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        ;
+}
+
+/******************************************************************************
+ * inst_enable / inst_reset
+ ******************************************************************************/
+void inst_enable( int  on )
+{
+    inst_enabled = on;
+}
+
+void inst_reset( void )
+{
+    int  i, n = __atomic_load_n( &numStages, __ATOMIC_ACQUIRE );
+
+    for( i = 0; i < n; i++ ) {
+        memset( stages[ i ].bins, 0, sizeof( stages[ i ].bins ) );
+        stages[ i ].count = stages[ i ].total = stages[ i ].max = 0;
+        stages[ i ].min   = ~0ULL;
+    }
+}
+
+/******************************************************************************
+ * inst_percentile
+ ******************************************************************************/
+/*  return value:                                                             */
+/*      inst_time_t -- upper edge of the bin holding the pct'th percentile,   */
+/*                     capped at the largest sample; 0 if no samples          */
+/******************************************************************************/
+inst_time_t inst_percentile( int  stage, double  pct )
+{
+    InstStage          *s;
+    unsigned long long  want, seen = 0, count;
+    int                 bin;
+
+    if( ( unsigned ) stage >= ( unsigned ) INST_MAX_STAGES )
+        return 0;
+
+    s     = &stages[ stage ];
+    count = __atomic_load_n( &s->count, __ATOMIC_RELAXED );
+    if( count == 0 )
+        return 0;
+
+    want = ( unsigned long long ) ( count * pct / 100.0 + 0.5 );
+    if( want == 0 )
+        want = 1;
+
+    for( bin = 0; bin < INST_BINS; bin++ ) {
+        seen += __atomic_load_n( &s->bins[ bin ], __ATOMIC_RELAXED );
+        if( seen >= want )
+            break;
+    }
+
+    if( bin >= INST_BINS - 1 || bin_floor( bin + 1 ) - 1 > s->max )
+        return s->max;
+
+    return bin_floor( bin + 1 ) - 1;
+}
+
+/******************************************************************************
+ * inst_report
+ ******************************************************************************/
+/*  Prints count, mean and percentiles (in us) for every stage whose name     */
+/*  starts with prefix (NULL or "" prints them all).                          */
+/******************************************************************************/
+void inst_report( FILE * fp, const char * prefix )
+{
+    int  i, n = __atomic_load_n( &numStages, __ATOMIC_ACQUIRE );
+    int  plen = prefix ? strlen( prefix ) : 0;
+
+    fprintf( fp, "%-16s %10s %9s %9s %9s %9s %9s %9s\n", "stage", "count",
+             "mean us", "min us", "p50 us", "p99 us", "p99.9 us", "max us" );
+
+    for( i = 0; i < n; i++ ) {
+        InstStage          *s = &stages[ i ];
+        unsigned long long  count = s->count;
+
+        if( plen && strncmp( s->name, prefix, plen ) != 0 )
+            continue;
+
+        if( count == 0 ) {
+            fprintf( fp, "%-16s %10llu\n", s->name, count );
+            continue;
+        }
+
+        fprintf( fp, "%-16s %10llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+                 s->name, count, s->total / 1000.0 / count, s->min / 1000.0,
+                 inst_percentile( i, 50.0 ) / 1000.0,
+                 inst_percentile( i, 99.0 ) / 1000.0,
+                 inst_percentile( i, 99.9 ) / 1000.0,
+                 s->max / 1000.0 );
+    }
+}
+
+/******************************************************************************
+ * snapshot_write
+ ******************************************************************************/
+/*  Writes one report. Files are replaced with rename() so readers never see  */
+/*  half a table; the shm page carries a generation line that is odd while    */
+/*  it is being rewritten.                                                    */
+/******************************************************************************/
+#define     GEN_LEN          15		// strlen( "gen 0000000000\n" )
+
+static void shm_set_gen( unsigned int  gen )
+{
+    char  hdr[ GEN_LEN + 1 ];
+
+    snprintf( hdr, sizeof( hdr ), "gen %010u\n", gen );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    memcpy( shmPage, hdr, GEN_LEN );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+}
+
+static int snapshot_write( void )
+{
+    static unsigned int  gen = 0;
+    char                 tmp[ sizeof( snapPath ) + 8 ];
+    FILE                *fp;
+
+    if( shmPage != NULL ) {
+        shm_set_gen( ++gen );		// odd: being rewritten
+
+        if( ( fp = fmemopen( shmPage + GEN_LEN, INST_SHM_SIZE - GEN_LEN, "w" ) ) == NULL )
+            return INST_FAILURE;
+        inst_report( fp, NULL );
+        fclose( fp );
+
+        shm_set_gen( ++gen );		// even: stable
+        return INST_SUCCESS;
+    }
+
+    snprintf( tmp, sizeof( tmp ), "%s.tmp", snapPath );
+    if( ( fp = fopen( tmp, "w" ) ) == NULL )
+        return INST_FAILURE;
+    inst_report( fp, NULL );
+    fclose( fp );
+
+    return rename( tmp, snapPath ) == 0 ? INST_SUCCESS : INST_FAILURE;
+}
+
+static void *snapshot_thread_fxn( void *arg )
+{
+    struct timespec  period;
+
+    period.tv_sec  = snapPeriodMs / 1000;
+    period.tv_nsec = ( snapPeriodMs % 1000 ) * 1000000L;
+
+    while( snapRunning ) {
+        nanosleep( &period, NULL );
+        if( snapshot_write( ) == INST_FAILURE )
+            ERR( "Failed to write instrumentation snapshot to %s\n", snapPath );
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+ * inst_snapshot_start
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      const char *path -- file to rewrite, or "shm:/name" for a POSIX       */
+/*                          shared-memory page (/dev/shm/name)                */
+/*      int periodMs     -- time between snapshots                            */
+/*                                                                            */
+/*  Also enables recording.                                                   */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  -- INST_SUCCESS or INST_FAILURE                                  */
+/******************************************************************************/
+int inst_snapshot_start( const char * path, int  periodMs )
+{
+    int  fd;
+
+    if( snapRunning ) {
+        ERR( "Instrumentation snapshot already running\n" );
+        return INST_FAILURE;
+    }
+
+    strncpy( snapPath, path, sizeof( snapPath ) - 1 );
+    snapPeriodMs = periodMs > 0 ? periodMs : 1000;
+
+    if( strncmp( path, SHM_PREFIX, strlen( SHM_PREFIX ) ) == 0 ) {
+        const char *name = path + strlen( SHM_PREFIX );
+
+        if( ( fd = shm_open( name, O_CREAT | O_RDWR, 0644 ) ) == -1 ) {
+            ERR( "shm_open %s failed: %s\n", name, strerror( errno ) );
+            return INST_FAILURE;
+        }
+        if( ftruncate( fd, INST_SHM_SIZE ) == -1 ) {
+            ERR( "ftruncate %s failed: %s\n", name, strerror( errno ) );
+            close( fd );
+            return INST_FAILURE;
+        }
+        shmPage = mmap( NULL, INST_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        close( fd );
+        if( shmPage == MAP_FAILED ) {
+            ERR( "mmap %s failed: %s\n", name, strerror( errno ) );
+            shmPage = NULL;
+            return INST_FAILURE;
+        }
+        memset( shmPage, 0, INST_SHM_SIZE );
+    }
+
+    snapRunning = 1;
+    if( pthread_create( &snapThread, NULL, snapshot_thread_fxn, NULL ) != 0 ) {
+        ERR( "Failed to create instrumentation snapshot thread\n" );
+        snapRunning = 0;
+        if( shmPage ) {
+            munmap( shmPage, INST_SHM_SIZE );
+            shmPage = NULL;
+        }
+        return INST_FAILURE;
+    }
+
+    DBG( "Writing instrumentation snapshots to %s every %d ms\n", path, snapPeriodMs );
+    inst_enable( 1 );
+    return INST_SUCCESS;
+}
+
+/******************************************************************************
+ * inst_snapshot_stop
+ ******************************************************************************/
+/*  Writes a final snapshot and stops the snapshot thread.                    */
+/******************************************************************************/
+void inst_snapshot_stop( void )
+{
+    if( !snapRunning )
+        return;
+
+    snapRunning = 0;
+    pthread_join( snapThread, NULL );
+    snapshot_write( );
+
+    if( shmPage ) {
+        munmap( shmPage, INST_SHM_SIZE );
+        shmPage = NULL;
+    }
+}
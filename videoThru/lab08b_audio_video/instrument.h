@@ -0,0 +1,74 @@
+/*
+ *   instrument.h
+ *
+ *   Per-stage latency histograms for the real-time loops.
+ *
+ *   Build with -DNO_INSTRUMENT to compile every INST_STAMP/INST_RECORD out.
+ *   Otherwise they cost one load and branch until inst_enable( 1 ).
+ */
+
+#include     <time.h>			// clock_gettime
+
+/* SUCCESS and FAILURE definitions for the instrumentation functions */
+#define     INST_SUCCESS     0
+#define     INST_FAILURE     -1
+
+/* Log-linear bins: 8 linear steps per power of two (<= 12.5% error) */
+#define     INST_SUB_BITS    3
+#define     INST_BINS        ( ( 64 - INST_SUB_BITS + 1 ) << INST_SUB_BITS )
+
+#define     INST_MAX_STAGES  32
+#define     INST_NAME_LEN    24
+
+/* Size of a "shm:<name>" snapshot page */
+#define     INST_SHM_SIZE    8192
+
+typedef unsigned long long inst_time_t;	// Nanoseconds, CLOCK_MONOTONIC
+
+/* One named stage; updated with atomics so any thread may record */
+typedef  struct  InstStage
+{
+    char                name[ INST_NAME_LEN ];
+    unsigned long long  count;
+    unsigned long long  total;		// ns
+    unsigned long long  min;		// ns
+    unsigned long long  max;		// ns
+    unsigned int        bins[ INST_BINS ];
+} InstStage;
+
+extern volatile int inst_enabled;
+
+static inline inst_time_t inst_now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( inst_time_t ) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#ifndef NO_INSTRUMENT
+#define INST_STAMP( t )                 ( ( t ) = inst_enabled ? inst_now_ns( ) : 0 )
+#define INST_RECORD( stage, from, to )  do { if( inst_enabled ) \
+                                            inst_record( ( stage ), ( to ) - ( from ) ); \
+                                        } while( 0 )
+#else
+#define INST_STAMP( t )                 ( ( t ) = 0 )
+#define INST_RECORD( stage, from, to )  ( ( void ) ( stage ), ( void ) ( from ), ( void ) ( to ) )
+#endif
+
+/* Function prototypes */
+int         inst_stage( const char * name );
+
+void        inst_record( int  stage, inst_time_t  ns );
+
+void        inst_enable( int  on );
+
+void        inst_reset( void );
+
+inst_time_t inst_percentile( int  stage, double  pct );
+
+void        inst_report( FILE * fp, const char * prefix );
+
+int         inst_snapshot_start( const char * path, int  periodMs );
+
+void        inst_snapshot_stop( void );
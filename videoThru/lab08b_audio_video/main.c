@@ -13,13 +13,20 @@
 #include     <stdio.h>	// Always include this header
 #include     <stdlib.h>	// Always include this header
 #include     <signal.h>	// Defines signal-handling functions (i.e. trap Ctrl-C)
-#include     <unistd.h>	// sleep()
+#include     <unistd.h>	// sleep(), getopt()
+#include     <sys/types.h>
 #include     <pthread.h>
 
 // Application headers
 #include     "debug.h"
 #include     "audio_thread.h"
 #include     "video_thread.h"
+#include     "video_output.h"	// null_output_probe()
+#include     "instrument.h"	// Stage timing snapshots
+#include     "trace.h"		// Chrome trace export
+#include     "perfctr.h"	// Per-stage hardware counters
+#include     "pool.h"		// Work-stealing thread pool
+#include     "watchdog.h"	// Overload shedding
 #include "thread.h"
 
 /* Global thread environments */
@@ -47,6 +54,56 @@ void signal_handler(int sig) {
         (*pSigPrev)( sig );
 }
 
+/* Stack and heap the audio thread prefaults with -L */
+#define AUDIO_STACK_PREFAULT  ( 64 * 1024 )
+#define AUDIO_HEAP_SIZE       ( 256 * 1024 )
+
+/* Time between instrumentation snapshots (-s) */
+#define SNAPSHOT_PERIOD_MS  1000
+
+/* Command line help */
+static void usage( const char *prog )
+{
+    fprintf( stderr,
+        "Usage: %s [-c capture] [-d display] [-b frames] [-n]\n"
+        "          [-i pcm] [-o pcm] [-a blocks] [-V] [-s file|shm:/name] [-t trace.json] [-P]\n"
+        "          [-A cpu] [-W cpu] [-F | -D runtime_us,period_us] [-L] [-j rt[,be]]\n"
+        "          [-T x,y,w,h[;x,y,w,h...]] [-E]\n"
+        "  -c  V4L2 node, pattern[@fps] or file:<raw UYVY>[@fps]\n"
+        "  -d  fbdev node or null[@hz]\n"
+        "  -b  time this many frames, print fps and per-stage latency, exit\n"
+        "  -n  do not start the audio thread\n"
+        "  -i  ALSA capture PCM, e.g. plughw:1,0 or null\n"
+        "  -o  ALSA playback PCM, e.g. null or file:FILE=out.raw,FORMAT=raw\n"
+        "  -a  time this many audio blocks, print stage percentiles, exit\n"
+        "  -V  do not start the video thread\n"
+        "  -s  write stage latency percentiles here once a second\n"
+        "  -t  record a Chrome trace, written on exit and on SIGUSR1\n"
+        "  -P  count cycles, instructions and misses per stage, print on exit\n"
+        "  -A  pin the audio thread to this CPU\n"
+        "  -W  pin the video thread to this CPU\n"
+        "  -F  run the audio thread SCHED_FIFO instead of SCHED_RR\n"
+        "  -D  run the audio thread SCHED_DEADLINE with this budget per period\n"
+        "  -L  lock memory, prefault the audio thread's stack and buffers\n"
+        "  -j  start a thread pool with this many real-time (and best-effort)\n"
+        "      workers; the video frame copy is split across the real-time ones\n"
+        "  -T  follow the colour inside each window (up to 4), as seen in the\n"
+        "      first frame\n"
+        "  -E  run our own exposure loop instead of the camera's\n", prog );
+}
+
+/* Affinity mask for a CPU number from the command line, 0 if it is bad */
+static unsigned long cpu_mask( const char *arg )
+{
+    char *end;
+    long  cpu = strtol( arg, &end, 10 );
+
+    if( end == arg || *end != '\0' || cpu < 0 ||
+        cpu >= (long) ( 8 * sizeof( unsigned long ) ) )
+        return 0;
+    return 1UL << cpu;
+}
+
 //*****************************************************************************
 //*  main
 //*****************************************************************************
@@ -58,20 +115,115 @@ int main(int argc, char *argv[])
 #define AUDIOTHREADCREATED      0x4
     unsigned int    initMask  = 0;
     int             status    = EXIT_SUCCESS;
+    int             noAudio   = 0;
+    int             noVideo   = 0;
+    int             opt;
+    char           *snapshot  = NULL;
+    char           *traceFile = NULL;
+    thread_config   audioConfig = { REALTIME, 99 };
+    thread_config   videoConfig = { TIMESLICE, 0 };
+    int             rtWorkers = 0;
+    int             beWorkers = 0;
 
     void *videoThreadReturn;
     void *audioThreadReturn;
 
+    while( ( opt = getopt( argc, argv, "c:d:b:ni:o:a:Vs:t:PA:W:FD:Lj:T:E" ) ) != -1 ) {
+        switch( opt ) {
+        case 'c': video_env.captureDevice = optarg;     break;
+        case 'd': video_env.displayDevice = optarg;     break;
+        case 'b': video_env.benchmark = atoi( optarg ); break;
+        case 'T': video_env.track = optarg;             break;
+        case 'E': video_env.agc = 1;                    break;
+        case 'n': noAudio = 1;                          break;
+        case 'i': audio_env.inDevice = optarg;          break;
+        case 'o': audio_env.outDevice = optarg;         break;
+        case 'a': audio_env.benchmark = atoi( optarg ); break;
+        case 'V': noVideo = 1;                          break;
+        case 's': snapshot = optarg;                    break;
+        case 't': traceFile = optarg;                   break;
+        case 'P': perf_enable( 1 );                     break;
+        case 'A':
+            if( ( audioConfig.cpuMask = cpu_mask( optarg ) ) == 0 ) {
+                usage( argv[0] );
+                exit( EXIT_FAILURE );
+            }
+            break;
+        case 'W':
+            if( ( videoConfig.cpuMask = cpu_mask( optarg ) ) == 0 ) {
+                usage( argv[0] );
+                exit( EXIT_FAILURE );
+            }
+            break;
+        case 'F': audioConfig.type = FIFO;              break;
+        case 'D':
+            audioConfig.type = DEADLINE;
+            if( sscanf( optarg, "%llu,%llu", &audioConfig.runtimeNs,
+                        &audioConfig.periodNs ) != 2 ) {
+                usage( argv[0] );
+                exit( EXIT_FAILURE );
+            }
+            audioConfig.runtimeNs *= 1000;
+            audioConfig.periodNs  *= 1000;
+            audioConfig.deadlineNs = audioConfig.periodNs;
+            break;
+        case 'L':
+            audioConfig.lockMemory    = 1;
+            audioConfig.stackPrefault = AUDIO_STACK_PREFAULT;
+            audioConfig.heapSize      = AUDIO_HEAP_SIZE;
+            break;
+        case 'j':
+            if( sscanf( optarg, "%d,%d", &rtWorkers, &beWorkers ) < 1 ||
+                rtWorkers < 0 || beWorkers < 0 ) {
+                usage( argv[0] );
+                exit( EXIT_FAILURE );
+            }
+            break;
+        default:
+            usage( argv[0] );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    /* Start tracing first so every later thread has the dump signal blocked */
+    if( traceFile != NULL && trace_init( traceFile ) == TRACE_FAILURE ) {
+        ERR( "Cannot start tracing to %s\n", traceFile );
+        exit( EXIT_FAILURE );
+    }
+
+    /* Move DBG/ERR output off the real-time threads */
+    log_init( stderr );
+
+    /* Periodically publish the loops' stage timing */
+    if( snapshot != NULL &&
+        inst_snapshot_start( snapshot, SNAPSHOT_PERIOD_MS ) == INST_FAILURE ) {
+        ERR( "Cannot write instrumentation snapshots to %s\n", snapshot );
+        exit( EXIT_FAILURE );
+    }
+
+    /* Workers inherit the blocked trace signal, so start them after it */
+    if( ( rtWorkers > 0 || beWorkers > 0 ) &&
+        pool_init( rtWorkers, beWorkers, 0 ) == POOL_FAILURE ) {
+        ERR( "Cannot start the thread pool\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    /* When a loop keeps running late, shed video work to keep audio whole */
+    wd_init( WD_SKIP_OPTIONAL | WD_HALF_RATE );
+
     /* Set the signal callback for Ctrl-C */
     pSigPrev = signal( SIGINT, signal_handler );
 
     /* Make video frame buffer visible */
-    system("cd ..; ./vid1Show");
+    if( !noVideo &&
+        ( video_env.displayDevice == NULL || !null_output_probe( video_env.displayDevice ) ) )
+        system("cd ..; ./vid1Show");
 
     // Call audio thread function
+    if( !noAudio ) {
     DBG( "Creating audio thread\n" );
 
-    if(launch_pthread(&audioThread, REALTIME, 99, &audio_thread_fxn, &audio_env) 
+    if(launch_pthread_ex(&audioThread, &audioConfig, &audio_thread_fxn, &audio_env) 
 		!= thread_SUCCESS){
 	ERR("pthread create failed for audio thread\n");
 	status = EXIT_FAILURE;
@@ -81,17 +233,20 @@ int main(int argc, char *argv[])
 #ifdef _DEBUG_
     sleep(1);
 #endif
+    }
     /* Create a thread for video */
+    if( !noVideo ) {
     DBG( "Creating video thread\n" );
 
     /* Create a thread for video loopthru */
-    if(launch_pthread(&videoThread, TIMESLICE, 0, &video_thread_fxn, &video_env) 
+    if(launch_pthread_ex(&videoThread, &videoConfig, &video_thread_fxn, &video_env) 
 		!= thread_SUCCESS){
 	ERR("pthread create failed for video thread\n");
 	status = EXIT_FAILURE;
 	goto cleanup;
 	}
     initMask |= VIDEOTHREADCREATED;    
+    }
 
     sleep(1);
 
@@ -99,18 +254,17 @@ cleanup:
     printf( "All application threads started\n" );
     printf( "\tPress Ctrl-C to exit\n" );
 
-    /* Wait until the audio thread terminates */
-    if ( initMask & AUDIOTHREADCREATED ) 
+    /* An audio-only benchmark ends on its own, then stops the video thread */
+    if ( ( initMask & AUDIOTHREADCREATED ) && audio_env.benchmark && !video_env.benchmark )
     {
         pthread_join( audioThread, &audioThreadReturn );
-
-        if( audioThreadReturn == AUDIO_THREAD_FAILURE )
-            DBG( "Audio thread exited with FAILURE status\n" );
-        else
-            DBG( "Audio thread exited with SUCCESS status\n" );
+        initMask &= ~AUDIOTHREADCREATED;
+        DBG( "Audio benchmark finished, stopping video thread\n" );
+        video_env.quit = 1;
     }
 
     /* Wait until the video thread terminates */
+    /*     (a benchmark run ends on its own, then stops the audio thread) */
     if ( initMask & VIDEOTHREADCREATED ) 
     {
         pthread_join( videoThread, &videoThreadReturn );
@@ -119,10 +273,39 @@ cleanup:
             DBG( "Video thread exited with FAILURE status\n" );
         else
             DBG( "Video thread exited with SUCCESS status\n" );
+
+        if( video_env.benchmark )
+            audio_env.quit = 1;
     }
 
+    /* Wait until the audio thread terminates */
+    if ( initMask & AUDIOTHREADCREATED ) 
+    {
+        pthread_join( audioThread, &audioThreadReturn );
+
+        if( audioThreadReturn == AUDIO_THREAD_FAILURE )
+            DBG( "Audio thread exited with FAILURE status\n" );
+        else
+            DBG( "Audio thread exited with SUCCESS status\n" );
+    }
+
+    /* Final snapshot and trace once both loops have stopped */
+    pool_shutdown( );
+    inst_snapshot_stop( );
+    trace_shutdown( );
+    if( perf_enabled )
+        perf_report( stdout );
+    wd_report( stdout );
+    if( !noAudio )
+        printf( "Audio deadline misses: %lu\n", thread_deadline_misses( ) );
+
     /* Make video frame buffer invisible */
-    system("cd ..; ./resetVideo");
+    if( !noVideo &&
+        ( video_env.displayDevice == NULL || !null_output_probe( video_env.displayDevice ) ) )
+        system("cd ..; ./resetVideo");
+
+    /* Flush queued messages */
+    log_shutdown( );
 
     exit( status );
 }
@@ -66,7 +66,7 @@ CC	:= gcc
 # CFLAGS       := -Wall -fno-strict-aliasing -march=armv7-a -D_REENTRANT -I$(DEVKIT)/armv7a/lib/gcc/arm-angstrom-linux-gnueabi/4.3.1/include
 # CFLAGS       := -Wall -fno-strict-aliasing -march=armv7-a -D_REENTRANT -I$(DEVKIT)/lib/gcc/arm-none-linux-gnueabi/4.3.3/include
 CFLAGS       := -Wall -fno-strict-aliasing -march=armv7-a -D_REENTRANT -lasound 
-LINKER_FLAGS := -lpthread
+LINKER_FLAGS := -lpthread -lrt -lm
 
 DEBUG_CFLAGS   := -g -D_DEBUG_
 RELEASE_CFLAGS := -O2
@@ -0,0 +1,291 @@
+/*
+ *   perfctr.c
+ *
+ *   Each thread opens its four counters as one perf event group, so a
+ *   single read() returns all of them consistently. A group only counts
+ *   its own thread, so every thread that does staged work (the pool
+ *   workers included) opens one. perf_begin() pushes a snapshot and
+ *   perf_end() pops it, reads again and adds the deltas to the stage with
+ *   atomic adds, so several threads can share a stage and stages can nest.
+ *   Samples from hardware and software counters measure different things,
+ *   so a stage keeps separate totals for each and the report prints them
+ *   as separate tables.
+ */
+
+/* Standard Linux headers */
+#include     <stdio.h>			// Always include stdio.h
+#include     <stdlib.h>			// Always include stdlib.h
+#include     <string.h>			// Defines memset and strncpy
+#include     <errno.h>
+#include     <unistd.h>			// read, close, syscall
+#include     <pthread.h>
+#include     <sys/ioctl.h>
+#include     <sys/syscall.h>		// __NR_perf_event_open
+#include     <linux/perf_event.h>
+
+/* Application headers */
+#include     "perfctr.h"
+#include     "debug.h"			// DBG and ERR macros
+
+#define     PERF_MAX_DEPTH       4		// Nested PERF_BEGINs per thread
+
+typedef  struct  PerfStage
+{
+    char                name[ PERF_NAME_LEN ];
+    unsigned long long  count[ 2 ];		// [ mode - PERF_MODE_HW ]
+    unsigned long long  total[ 2 ][ PERF_NUM_COUNTERS ];
+} PerfStage;
+
+/* Group read layout for PERF_FORMAT_GROUP */
+typedef  struct  PerfGroupRead
+{
+    unsigned long long  nr;
+    unsigned long long  values[ PERF_NUM_COUNTERS ];
+} PerfGroupRead;
+
+typedef  struct  PerfEvent
+{
+    unsigned int        type;
+    unsigned long long  config;
+} PerfEvent;
+
+static const PerfEvent hwEvents[ PERF_NUM_COUNTERS ] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+}, swEvents[ PERF_NUM_COUNTERS ] = {
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+};
+
+static const char *hwNames[ PERF_NUM_COUNTERS ] = { "cycles", "instr", "cache-miss", "branch-miss" };
+static const char *swNames[ PERF_NUM_COUNTERS ] = { "task-ns", "ctx-sw", "faults", "migrations" };
+
+volatile int perf_enabled = 0;
+
+static PerfStage        stages[ PERF_MAX_STAGES ];
+static int              numStages = 0;
+static pthread_mutex_t  stageLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Calling thread's counter group */
+static __thread int                 groupFd[ PERF_NUM_COUNTERS ] = { -1, -1, -1, -1 };
+static __thread int                 groupMode = PERF_MODE_NONE;
+static __thread unsigned long long  startValues[ PERF_MAX_DEPTH ][ PERF_NUM_COUNTERS ];
+static __thread int                 depth = 0;
+
+static long perf_event_open( struct perf_event_attr * attr, pid_t pid, int cpu,
+                             int groupFd, unsigned long flags )
+{
+    return syscall( __NR_perf_event_open, attr, pid, cpu, groupFd, flags );
+}
+
+/******************************************************************************
+ * open_group
+ ******************************************************************************/
+/*  Opens the four events as a group on the calling thread, disabled.        */
+/*  return value: PERF_SUCCESS or PERF_FAILURE (nothing left open)            */
+/******************************************************************************/
+static int open_group( const PerfEvent * events, int  userOnly )
+{
+    struct perf_event_attr  attr;
+    int                     i, j;
+
+    for( i = 0; i < PERF_NUM_COUNTERS; i++ ) {
+        memset( &attr, 0, sizeof( attr ) );
+        attr.size           = sizeof( attr );
+        attr.type           = events[ i ].type;
+        attr.config         = events[ i ].config;
+        attr.read_format    = PERF_FORMAT_GROUP;
+        attr.disabled       = ( i == 0 );		// the leader starts the group
+        attr.exclude_kernel = userOnly;
+        attr.exclude_hv     = 1;
+
+        groupFd[ i ] = perf_event_open( &attr, 0, -1, i == 0 ? -1 : groupFd[ 0 ], 0 );
+        if( groupFd[ i ] == -1 ) {
+            for( j = 0; j < i; j++ ) {
+                close( groupFd[ j ] );
+                groupFd[ j ] = -1;
+            }
+            return PERF_FAILURE;
+        }
+    }
+
+    return PERF_SUCCESS;
+}
+
+static int read_group( unsigned long long * values )
+{
+    PerfGroupRead  rd;
+
+    if( read( groupFd[ 0 ], &rd, sizeof( rd ) ) != sizeof( rd ) )
+        return PERF_FAILURE;
+
+    memcpy( values, rd.values, sizeof( rd.values ) );
+    return PERF_SUCCESS;
+}
+
+/******************************************************************************
+ * perf_enable
+ ******************************************************************************/
+/*  Must be set before the threads call perf_thread_open.                     */
+/******************************************************************************/
+void perf_enable( int  on )
+{
+    perf_enabled = on;
+}
+
+/******************************************************************************
+ * perf_stage
+ ******************************************************************************/
+/*  return value:                                                             */
+/*      int  -- stage id for PERF_END (same id for the same name), or         */
+/*              PERF_FAILURE if the table is full                             */
+/******************************************************************************/
+int perf_stage( const char * name )
+{
+    int  i, id = PERF_FAILURE;
+
+    pthread_mutex_lock( &stageLock );
+
+    for( i = 0; i < numStages; i++ )
+        if( strncmp( stages[ i ].name, name, PERF_NAME_LEN - 1 ) == 0 ) {
+            id = i;
+            goto done;
+        }
+
+    if( numStages < PERF_MAX_STAGES ) {
+        id = numStages;
+        memset( &stages[ id ], 0, sizeof( stages[ id ] ) );
+        strncpy( stages[ id ].name, name, PERF_NAME_LEN - 1 );
+        __atomic_store_n( &numStages, numStages + 1, __ATOMIC_RELEASE );
+    }
+
+done:
+    pthread_mutex_unlock( &stageLock );
+    return id;
+}
+
+/******************************************************************************
+ * perf_thread_open
+ ******************************************************************************/
+/*  Opens counters for the calling thread: hardware if possible, software    */
+/*  otherwise. Does nothing unless perf_enable( 1 ) was called.               */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  -- PERF_MODE_HW, PERF_MODE_SW or PERF_MODE_NONE                  */
+/******************************************************************************/
+int perf_thread_open( void )
+{
+    if( !perf_enabled || groupMode != PERF_MODE_NONE )
+        return groupMode;
+
+    if( open_group( hwEvents, 1 ) == PERF_SUCCESS )
+        groupMode = PERF_MODE_HW;
+    else {
+        DBG( "No hardware counters (%s), using software counters\n", strerror( errno ) );
+        if( open_group( swEvents, 0 ) == PERF_SUCCESS )
+            groupMode = PERF_MODE_SW;
+        else {
+            ERR( "perf_event_open failed: %s\n", strerror( errno ) );
+            return PERF_MODE_NONE;
+        }
+    }
+
+    ioctl( groupFd[ 0 ], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+    ioctl( groupFd[ 0 ], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+    return groupMode;
+}
+
+/******************************************************************************
+ * perf_thread_close
+ ******************************************************************************/
+void perf_thread_close( void )
+{
+    int  i;
+
+    for( i = PERF_NUM_COUNTERS - 1; i >= 0; i-- )
+        if( groupFd[ i ] != -1 ) {
+            close( groupFd[ i ] );
+            groupFd[ i ] = -1;
+        }
+
+    groupMode = PERF_MODE_NONE;
+    depth = 0;
+}
+
+/******************************************************************************
+ * perf_begin / perf_end
+ ******************************************************************************/
+/*  Every perf_begin must be matched by a perf_end on the same thread.        */
+/*  Beyond PERF_MAX_DEPTH levels the inner stages are not counted.            */
+/******************************************************************************/
+void perf_begin( void )
+{
+    if( groupMode != PERF_MODE_NONE && depth < PERF_MAX_DEPTH )
+        read_group( startValues[ depth ] );
+    depth++;
+}
+
+void perf_end( int  stage )
+{
+    unsigned long long  now[ PERF_NUM_COUNTERS ];
+    PerfStage          *s;
+    int                 i, m = groupMode - PERF_MODE_HW;
+
+    if( depth > 0 )
+        depth--;
+    if( groupMode == PERF_MODE_NONE || depth >= PERF_MAX_DEPTH ||
+        ( unsigned ) stage >= PERF_MAX_STAGES || read_group( now ) == PERF_FAILURE )
+        return;
+
+    s = &stages[ stage ];
+    for( i = 0; i < PERF_NUM_COUNTERS; i++ )
+        __atomic_fetch_add( &s->total[ m ][ i ], now[ i ] - startValues[ depth ][ i ],
+                            __ATOMIC_RELAXED );
+    __atomic_fetch_add( &s->count[ m ], 1, __ATOMIC_RELAXED );
+}
+
+/******************************************************************************
+ * perf_report
+ ******************************************************************************/
+/*  Prints per-call averages for every stage with samples, hardware counts    */
+/*  and software counts in separate tables (a stage run by threads with       */
+/*  different counters shows up in both). For hardware counters IPC is        */
+/*  shown too: a low IPC with many cache misses marks a memory-bound stage.   */
+/******************************************************************************/
+void perf_report( FILE * fp )
+{
+    int   i, j, m, header, n = __atomic_load_n( &numStages, __ATOMIC_ACQUIRE );
+
+    for( m = 0; m < 2; m++ ) {
+        const char **names = m == 0 ? hwNames : swNames;
+
+        header = 0;
+        for( i = 0; i < n; i++ ) {
+            PerfStage          *s = &stages[ i ];
+            unsigned long long  count = s->count[ m ];
+
+            if( count == 0 )
+                continue;
+
+            if( !header ) {
+                header = 1;
+                fprintf( fp, "%-16s %10s", m == 0 ? "stage (hw)" : "stage (sw)", "calls" );
+                for( j = 0; j < PERF_NUM_COUNTERS; j++ )
+                    fprintf( fp, " %12s", names[ j ] );
+                fprintf( fp, m == 0 ? " %6s\n" : "\n", "IPC" );
+            }
+
+            fprintf( fp, "%-16s %10llu", s->name, count );
+            for( j = 0; j < PERF_NUM_COUNTERS; j++ )
+                fprintf( fp, " %12.1f", ( double ) s->total[ m ][ j ] / count );
+            if( m == 0 )
+                fprintf( fp, " %6.2f", s->total[ m ][ 0 ] ?
+                         ( double ) s->total[ m ][ 1 ] / s->total[ m ][ 0 ] : 0.0 );
+            fprintf( fp, "\n" );
+        }
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ *   perfctr.h
+ *
+ *   Per-thread perf_event_open counters attributed to named stages.
+ *   Hardware counters (cycles, instructions, cache and branch misses) are
+ *   used when the PMU is available; otherwise software counters (task
+ *   clock, context switches, page faults, migrations) stand in.
+ *   Build with -DNO_PERFCTR to compile PERF_BEGIN/PERF_END out.
+ */
+
+/* SUCCESS and FAILURE definitions for the counter functions */
+#define     PERF_SUCCESS         0
+#define     PERF_FAILURE         -1
+
+#define     PERF_NUM_COUNTERS    4
+#define     PERF_MAX_STAGES      16
+#define     PERF_NAME_LEN        24
+
+/* Which kind of counters the calling thread ended up with */
+#define     PERF_MODE_NONE       0
+#define     PERF_MODE_HW         1
+#define     PERF_MODE_SW         2
+
+extern volatile int perf_enabled;
+
+#ifndef NO_PERFCTR
+#define PERF_BEGIN( )         do { if( perf_enabled ) perf_begin( ); } while( 0 )
+#define PERF_END( stage )     do { if( perf_enabled ) perf_end( stage ); } while( 0 )
+#else
+#define PERF_BEGIN( )         ( ( void ) 0 )
+#define PERF_END( stage )     ( ( void ) ( stage ) )
+#endif
+
+/* Function prototypes */
+void perf_enable( int  on );
+
+int  perf_stage( const char * name );
+
+int  perf_thread_open( void );
+
+void perf_thread_close( void );
+
+void perf_begin( void );
+
+void perf_end( int  stage );
+
+void perf_report( FILE * fp );
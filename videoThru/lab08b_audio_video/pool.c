@@ -0,0 +1,474 @@
+/*
+ *   pool.c
+ *
+ *   The per-worker deques are Chase-Lev deques on a fixed ring: the owner
+ *   pushes and pops at the bottom without locking, thieves take from the
+ *   top with a compare-and-swap. A full deque spills into the lane's shared
+ *   queue. Idle workers spin briefly, then sleep on the lane's condition
+ *   variable until a submitter sees them sleeping and wakes them.
+ *
+ *   A thread waiting on a group runs queued tasks of that lane itself
+ *   instead of blocking, so pool_parallel_for() on a lane with no workers
+ *   still works, just serially.
+ */
+
+/* Standard Linux headers */
+#include     <stdio.h>			// Always include stdio.h
+#include     <stdlib.h>			// Always include stdlib.h
+#include     <string.h>			// Defines memset
+#include     <sched.h>			// sched_yield
+#include     <pthread.h>
+
+/* Application headers */
+#include     "pool.h"
+#include     "thread.h"			// launch_pthread_ex
+#include     "trace.h"			// Worker track names
+#include     "perfctr.h"		// Workers count their own stages
+#include     "debug.h"			// DBG and ERR macros
+
+#define     POOL_SPINS           64		// Empty polls before a worker sleeps
+
+typedef  struct  PoolDeque
+{
+    long       top;			// Next to steal
+    long       bottom;			// Next free slot, owner only
+    PoolTask  *buf[ POOL_DEQUE_SIZE ];
+} PoolDeque;
+
+struct PoolLane;
+
+typedef  struct  PoolWorker
+{
+    PoolDeque         dq;
+    struct PoolLane  *lane;
+    int               index;
+    pthread_t         thread;
+    char              name[ 24 ];
+} PoolWorker;
+
+typedef  struct  PoolLane
+{
+    PoolWorker       workers[ POOL_MAX_WORKERS ];
+    int              numWorkers;
+    int              queued;		// Submitted, not yet taken
+    int              sleepers;
+    pthread_mutex_t  lock;		// Guards inject and the sleep/wake handshake
+    pthread_cond_t   wake;
+    PoolTask        *inject[ POOL_DEQUE_SIZE ];
+    unsigned int     injectHead, injectTail;
+} PoolLane;
+
+static PoolLane              lanes[ POOL_NUM_LANES ];
+static int                   poolQuit = 0;
+static int                   poolStarted = 0;
+static __thread PoolWorker  *myWorker = NULL;
+
+/******************************************************************************
+ * Chase-Lev deque
+ ******************************************************************************/
+static int deque_push( PoolDeque * d, PoolTask * t )
+{
+    long  b   = __atomic_load_n( &d->bottom, __ATOMIC_RELAXED );
+    long  top = __atomic_load_n( &d->top, __ATOMIC_ACQUIRE );
+
+    if( b - top >= POOL_DEQUE_SIZE )
+        return POOL_FAILURE;
+
+    __atomic_store_n( &d->buf[ b & ( POOL_DEQUE_SIZE - 1 ) ], t, __ATOMIC_RELAXED );
+    __atomic_store_n( &d->bottom, b + 1, __ATOMIC_RELEASE );
+    return POOL_SUCCESS;
+}
+
+static PoolTask *deque_pop( PoolDeque * d )
+{
+    long       b = __atomic_load_n( &d->bottom, __ATOMIC_RELAXED ) - 1;
+    long       t;
+    PoolTask  *task = NULL;
+
+    __atomic_store_n( &d->bottom, b, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    t = __atomic_load_n( &d->top, __ATOMIC_RELAXED );
+
+    if( t <= b ) {
+        task = __atomic_load_n( &d->buf[ b & ( POOL_DEQUE_SIZE - 1 ) ], __ATOMIC_RELAXED );
+        if( t == b ) {
+            // Last task: race any thief for it
+            if( !__atomic_compare_exchange_n( &d->top, &t, t + 1, 0,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) )
+                task = NULL;
+            __atomic_store_n( &d->bottom, b + 1, __ATOMIC_RELAXED );
+        }
+    }
+    else
+        __atomic_store_n( &d->bottom, b + 1, __ATOMIC_RELAXED );
+
+    return task;
+}
+
+static PoolTask *deque_steal( PoolDeque * d )
+{
+    long       t = __atomic_load_n( &d->top, __ATOMIC_ACQUIRE );
+    long       b;
+    PoolTask  *task;
+
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    b = __atomic_load_n( &d->bottom, __ATOMIC_ACQUIRE );
+
+    if( t >= b )
+        return NULL;
+
+    task = __atomic_load_n( &d->buf[ t & ( POOL_DEQUE_SIZE - 1 ) ], __ATOMIC_RELAXED );
+    if( !__atomic_compare_exchange_n( &d->top, &t, t + 1, 0,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) )
+        return NULL;
+
+    return task;
+}
+
+/******************************************************************************
+ * Shared queue for submissions from outside the lane
+ ******************************************************************************/
+static int inject_push( PoolLane * lane, PoolTask * t )
+{
+    int  status = POOL_SUCCESS;
+
+    pthread_mutex_lock( &lane->lock );
+    if( lane->injectTail - lane->injectHead >= POOL_DEQUE_SIZE )
+        status = POOL_FAILURE;
+    else {
+        lane->inject[ lane->injectTail & ( POOL_DEQUE_SIZE - 1 ) ] = t;
+        __atomic_store_n( &lane->injectTail, lane->injectTail + 1, __ATOMIC_RELAXED );
+    }
+    pthread_mutex_unlock( &lane->lock );
+
+    return status;
+}
+
+static PoolTask *inject_pop( PoolLane * lane )
+{
+    PoolTask  *t = NULL;
+
+    if( __atomic_load_n( &lane->injectTail, __ATOMIC_RELAXED ) ==
+        __atomic_load_n( &lane->injectHead, __ATOMIC_RELAXED ) )
+        return NULL;
+
+    pthread_mutex_lock( &lane->lock );
+    if( lane->injectHead != lane->injectTail ) {
+        t = lane->inject[ lane->injectHead & ( POOL_DEQUE_SIZE - 1 ) ];
+        __atomic_store_n( &lane->injectHead, lane->injectHead + 1, __ATOMIC_RELAXED );
+    }
+    pthread_mutex_unlock( &lane->lock );
+
+    return t;
+}
+
+/******************************************************************************
+ * find_task
+ ******************************************************************************/
+/*  Own deque first (most recently pushed, still in cache), then the shared  */
+/*  queue, then steal the oldest task of another worker.                      */
+/******************************************************************************/
+static PoolTask *find_task( PoolLane * lane, PoolWorker * self )
+{
+    PoolTask  *t = NULL;
+    int        i, start, n = __atomic_load_n( &lane->numWorkers, __ATOMIC_ACQUIRE );
+
+    if( self != NULL && ( t = deque_pop( &self->dq ) ) != NULL )
+        goto found;
+
+    if( ( t = inject_pop( lane ) ) != NULL )
+        goto found;
+
+    start = self != NULL ? self->index + 1 : 0;
+    for( i = 0; i < n; i++ ) {
+        PoolWorker *victim = &lane->workers[ ( start + i ) % n ];
+
+        if( victim != self && ( t = deque_steal( &victim->dq ) ) != NULL )
+            goto found;
+    }
+    return NULL;
+
+found:
+    __atomic_fetch_sub( &lane->queued, 1, __ATOMIC_RELAXED );
+    return t;
+}
+
+static void run_task( PoolTask * t )
+{
+    PoolGroup *group = t->group;
+
+    t->fxn( t->arg );
+    __atomic_fetch_sub( &group->pending, 1, __ATOMIC_RELEASE );
+}
+
+static void wake_workers( PoolLane * lane, int  all )
+{
+    if( __atomic_load_n( &lane->sleepers, __ATOMIC_SEQ_CST ) == 0 )
+        return;
+
+    pthread_mutex_lock( &lane->lock );
+    if( all )
+        pthread_cond_broadcast( &lane->wake );
+    else
+        pthread_cond_signal( &lane->wake );
+    pthread_mutex_unlock( &lane->lock );
+}
+
+/******************************************************************************
+ * worker_fxn
+ ******************************************************************************/
+static void *worker_fxn( void * arg )
+{
+    PoolWorker  *self = arg;
+    PoolLane    *lane = self->lane;
+    PoolTask    *t;
+    int          idle = 0;
+
+    myWorker = self;
+    trace_thread_name( self->name );
+    perf_thread_open( );
+
+    while( !__atomic_load_n( &poolQuit, __ATOMIC_RELAXED ) ) {
+        if( ( t = find_task( lane, self ) ) != NULL ) {
+            run_task( t );
+            idle = 0;
+            continue;
+        }
+
+        if( ++idle < POOL_SPINS ) {
+            sched_yield( );
+            continue;
+        }
+
+        // Announce the sleep before the last look, see pool_submit
+        pthread_mutex_lock( &lane->lock );
+        __atomic_fetch_add( &lane->sleepers, 1, __ATOMIC_SEQ_CST );
+        while( !__atomic_load_n( &poolQuit, __ATOMIC_RELAXED ) &&
+               __atomic_load_n( &lane->queued, __ATOMIC_SEQ_CST ) <= 0 )
+            pthread_cond_wait( &lane->wake, &lane->lock );
+        __atomic_fetch_sub( &lane->sleepers, 1, __ATOMIC_SEQ_CST );
+        pthread_mutex_unlock( &lane->lock );
+        idle = 0;
+    }
+
+    perf_thread_close( );
+    return NULL;
+}
+
+/******************************************************************************
+ * pool_init
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      int rtWorkers, beWorkers -- threads per lane (0 = the waiting thread  */
+/*                                  runs that lane's tasks itself)            */
+/*      unsigned long rtCpuMask  -- CPUs for the real-time workers, 0 = any   */
+/*                                                                            */
+/*  Real-time workers run SCHED_RR at POOL_RT_PRIORITY when allowed, and     */
+/*  time-sliced otherwise.                                                    */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  --  POOL_SUCCESS or POOL_FAILURE                                 */
+/******************************************************************************/
+int pool_init( int  rtWorkers, int  beWorkers, unsigned long  rtCpuMask )
+{
+    thread_config  config;
+    int            l, i, counts[ POOL_NUM_LANES ] = { rtWorkers, beWorkers };
+
+    poolQuit = 0;
+
+    for( l = 0; l < POOL_NUM_LANES; l++ ) {
+        PoolLane *lane = &lanes[ l ];
+
+        memset( lane, 0, sizeof( *lane ) );
+        pthread_mutex_init( &lane->lock, NULL );
+        pthread_cond_init( &lane->wake, NULL );
+
+        if( counts[ l ] > POOL_MAX_WORKERS )
+            counts[ l ] = POOL_MAX_WORKERS;
+
+        for( i = 0; i < counts[ l ]; i++ ) {
+            PoolWorker *w = &lane->workers[ i ];
+
+            w->lane  = lane;
+            w->index = i;
+            snprintf( w->name, sizeof( w->name ), "pool.%s%d", l == POOL_LANE_RT ? "rt" : "be", i );
+            // Publish the worker before it can be stolen from
+            __atomic_store_n( &lane->numWorkers, i + 1, __ATOMIC_RELEASE );
+
+            memset( &config, 0, sizeof( config ) );
+            if( l == POOL_LANE_RT ) {
+                config.type     = REALTIME;
+                config.priority = POOL_RT_PRIORITY;
+                config.cpuMask  = rtCpuMask;
+            }
+
+            if( launch_pthread_ex( &w->thread, &config, worker_fxn, w ) != thread_SUCCESS ) {
+                DBG( "Cannot start %s real-time, using time-slicing\n", w->name );
+                config.type = TIMESLICE;
+                if( launch_pthread_ex( &w->thread, &config, worker_fxn, w ) != thread_SUCCESS ) {
+                    ERR( "Failed to start pool worker %s\n", w->name );
+                    __atomic_store_n( &lane->numWorkers, i, __ATOMIC_RELEASE );
+                    pool_shutdown( );
+                    return POOL_FAILURE;
+                }
+            }
+        }
+    }
+
+    poolStarted = 1;
+    DBG( "Thread pool: %d real-time, %d best-effort workers\n",
+         lanes[ POOL_LANE_RT ].numWorkers, lanes[ POOL_LANE_BE ].numWorkers );
+    return POOL_SUCCESS;
+}
+
+/******************************************************************************
+ * pool_shutdown
+ ******************************************************************************/
+/*  Stops and joins the workers. Wait for outstanding groups first.          */
+/******************************************************************************/
+void pool_shutdown( void )
+{
+    int  l, i;
+
+    __atomic_store_n( &poolQuit, 1, __ATOMIC_RELAXED );
+
+    for( l = 0; l < POOL_NUM_LANES; l++ ) {
+        PoolLane *lane = &lanes[ l ];
+
+        pthread_mutex_lock( &lane->lock );
+        pthread_cond_broadcast( &lane->wake );
+        pthread_mutex_unlock( &lane->lock );
+
+        for( i = 0; i < lane->numWorkers; i++ )
+            pthread_join( lane->workers[ i ].thread, NULL );
+        lane->numWorkers = 0;
+    }
+
+    poolStarted = 0;
+}
+
+int pool_workers( int  lane )
+{
+    return lanes[ lane ].numWorkers;
+}
+
+void pool_group_init( PoolGroup * group )
+{
+    group->pending = 0;
+}
+
+/******************************************************************************
+ * pool_submit
+ ******************************************************************************/
+/*  A worker of the lane pushes onto its own deque; anyone else (or a full   */
+/*  deque) goes through the shared queue. If even that is full the task is  */
+/*  run right away.                                                           */
+/******************************************************************************/
+static int pool_post( int  laneId, PoolGroup * group, PoolTask * task )
+{
+    PoolLane  *lane = &lanes[ laneId ];
+
+    task->group = group;
+    __atomic_fetch_add( &group->pending, 1, __ATOMIC_RELAXED );
+
+    if( ( myWorker != NULL && myWorker->lane == lane &&
+          deque_push( &myWorker->dq, task ) == POOL_SUCCESS ) ||
+        inject_push( lane, task ) == POOL_SUCCESS ) {
+        __atomic_fetch_add( &lane->queued, 1, __ATOMIC_SEQ_CST );
+        return POOL_SUCCESS;
+    }
+
+    run_task( task );
+    return POOL_FAILURE;
+}
+
+void pool_submit( int  lane, PoolGroup * group, PoolTask * task )
+{
+    if( pool_post( lane, group, task ) == POOL_SUCCESS )
+        wake_workers( &lanes[ lane ], 0 );
+}
+
+/******************************************************************************
+ * pool_group_wait
+ ******************************************************************************/
+/*  Helps run the lane's tasks until every task of the group has finished.   */
+/******************************************************************************/
+void pool_group_wait( int  laneId, PoolGroup * group )
+{
+    PoolLane  *lane = &lanes[ laneId ];
+    PoolWorker *self = myWorker != NULL && myWorker->lane == lane ? myWorker : NULL;
+    PoolTask  *t;
+
+    while( __atomic_load_n( &group->pending, __ATOMIC_ACQUIRE ) > 0 ) {
+        if( ( t = find_task( lane, self ) ) != NULL )
+            run_task( t );
+        else
+            sched_yield( );
+    }
+}
+
+/******************************************************************************
+ * pool_parallel_for
+ ******************************************************************************/
+/*  Calls fxn( arg, b, e ) over [begin, end) in pieces of at least grain     */
+/*  items and returns when all are done. The calling thread runs the first   */
+/*  piece itself. Nothing is allocated: the pieces live on this stack.       */
+/******************************************************************************/
+typedef  struct  PoolRange
+{
+    PoolTask      task;
+    PoolRangeFxn  fxn;
+    void         *arg;
+    int           begin, end;
+} PoolRange;
+
+static void range_fxn( void * arg )
+{
+    PoolRange *r = arg;
+
+    r->fxn( r->arg, r->begin, r->end );
+}
+
+void pool_parallel_for( int  lane, int  begin, int  end, int  grain,
+                        PoolRangeFxn  fxn, void * arg )
+{
+    PoolRange  ranges[ POOL_MAX_CHUNKS ];
+    PoolGroup  group;
+    int        n = end - begin, chunks, i, posted = 0;
+
+    if( n <= 0 )
+        return;
+    if( grain < 1 )
+        grain = 1;
+
+    // A few pieces per thread so stealing can even out the load
+    chunks = ( pool_workers( lane ) + 1 ) * 4;
+    if( chunks > ( n + grain - 1 ) / grain )
+        chunks = ( n + grain - 1 ) / grain;
+    if( chunks > POOL_MAX_CHUNKS )
+        chunks = POOL_MAX_CHUNKS;
+
+    if( chunks <= 1 || !poolStarted ) {
+        fxn( arg, begin, end );
+        return;
+    }
+
+    pool_group_init( &group );
+    for( i = 0; i < chunks; i++ ) {
+        ranges[ i ].fxn       = fxn;
+        ranges[ i ].arg       = arg;
+        ranges[ i ].begin     = begin + ( int ) ( ( long long ) n * i / chunks );
+        ranges[ i ].end       = begin + ( int ) ( ( long long ) n * ( i + 1 ) / chunks );
+        ranges[ i ].task.fxn  = range_fxn;
+        ranges[ i ].task.arg  = &ranges[ i ];
+    }
+
+    // Post the tail pieces, then get going on the first one
+    for( i = chunks - 1; i > 0; i-- )
+        posted |= pool_post( lane, &group, &ranges[ i ].task ) == POOL_SUCCESS;
+    if( posted )
+        wake_workers( &lanes[ lane ], 1 );
+
+    range_fxn( &ranges[ 0 ] );
+    pool_group_wait( lane, &group );
+}
@@ -0,0 +1,58 @@
+/*
+ *   pool.h
+ *
+ *   Work-stealing thread pool. Each worker owns a deque: it pushes and pops
+ *   its own tasks at one end while idle workers steal from the other.
+ *   Tasks submitted from outside the pool go through a shared queue.
+ *
+ *   There are two lanes with separate workers, so best-effort work (e.g.
+ *   recording) can never hold up a worker the real-time loops are waiting
+ *   on. Tasks only run on workers of the lane they were submitted to, or
+ *   on the thread waiting for their group.
+ */
+
+/* SUCCESS and FAILURE definitions for the pool functions */
+#define     POOL_SUCCESS         0
+#define     POOL_FAILURE         -1
+
+#define     POOL_LANE_RT         0
+#define     POOL_LANE_BE         1
+#define     POOL_NUM_LANES       2
+
+#define     POOL_MAX_WORKERS     8		// Per lane
+#define     POOL_DEQUE_SIZE      256		// Per worker, power of two
+#define     POOL_MAX_CHUNKS      64		// Most pieces pool_parallel_for makes
+
+#define     POOL_RT_PRIORITY     90		// Below the audio thread's 99
+
+/* Counts the unfinished tasks submitted to it */
+typedef  struct  PoolGroup
+{
+    int  pending;
+} PoolGroup;
+
+/* Caller-owned; must stay valid until pool_group_wait() returns */
+typedef  struct  PoolTask
+{
+    void      (*fxn)( void * arg );
+    void       *arg;
+    PoolGroup  *group;
+} PoolTask;
+
+typedef void (*PoolRangeFxn)( void * arg, int  begin, int  end );
+
+/* Function prototypes */
+int  pool_init( int  rtWorkers, int  beWorkers, unsigned long  rtCpuMask );
+
+void pool_shutdown( void );
+
+int  pool_workers( int  lane );
+
+void pool_group_init( PoolGroup * group );
+
+void pool_submit( int  lane, PoolGroup * group, PoolTask * task );
+
+void pool_group_wait( int  lane, PoolGroup * group );
+
+void pool_parallel_for( int  lane, int  begin, int  end, int  grain,
+                        PoolRangeFxn  fxn, void * arg );
@@ -2,13 +2,142 @@
  *   thread.c
  */
 
+#define _GNU_SOURCE                             // pthread_attr_setaffinity_np
+
 #include <stdio.h>                              //  Always include this header
 #include <stdlib.h>                             //  Always include this header
+#include <string.h>                             // memset
+#include <errno.h>
+#include <unistd.h>                             // syscall
+#include <time.h>                               // clock_gettime
+#include <sched.h>                              // cpu_set_t, sched_yield
+#include <malloc.h>                             // mallopt
+#include <sys/mman.h>                           // mlockall
+#include <sys/syscall.h>                        // SYS_sched_setattr
 
 #include <pthread.h>                            // posix thread definitions
+#include <semaphore.h>                          // start-up handshake
 #include "thread.h"                             // header file for this module
 #include "debug.h"                              // provides DBG macro
 
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE  6
+#endif
+
+// glibc has no wrapper for sched_setattr, so the struct is declared here
+struct thread_sched_attr {
+    unsigned int        size;
+    unsigned int        sched_policy;
+    unsigned long long  sched_flags;
+    int                 sched_nice;
+    unsigned int        sched_priority;
+    unsigned long long  sched_runtime;
+    unsigned long long  sched_deadline;
+    unsigned long long  sched_period;
+};
+
+// What the new thread needs to finish its own setup before thread_fxn runs,
+// and how it tells the launcher whether that worked
+typedef struct thread_start
+{
+    thread_config config;
+    void *(*thread_fxn)(void *env);
+    void *env;
+    sem_t ready;                                // posted once setup is done
+    int status;                                 // thread_SUCCESS or thread_FAILURE
+} thread_start;
+
+static __thread void *heap = NULL;              // this thread's pre-touched heap
+static __thread size_t heapSize = 0;
+static __thread unsigned long long jobDeadline = 0;     // ns, 0 = not counted
+static __thread unsigned long long jobStart = 0;
+static __thread int jobYield = 0;               // SCHED_DEADLINE: yield at job end
+
+static unsigned long deadlineMisses = 0;
+
+static unsigned long long now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**************************************************************************
+ *  prefault_stack
+ *  --------------
+ *  Touches the next "bytes" of stack so the pages are mapped (and, with
+ *  mlockall, locked) before the thread's loop first needs them.
+ **************************************************************************/
+
+static void prefault_stack( size_t bytes )
+{
+    volatile char *stack = alloca( bytes );
+    size_t i;
+
+    for( i = 0; i < bytes; i += 4096 )
+        stack[ i ] = 0;
+}
+
+/**************************************************************************
+ *  thread_trampoline
+ *  -----------------
+ *  Runs in the new thread: switches to SCHED_DEADLINE (which cannot be
+ *  requested through pthread attributes), prefaults the stack and heap,
+ *  reports how that went to launch_pthread_ex, then calls the real thread
+ *  function.
+ **************************************************************************/
+
+static void *thread_trampoline( void *arg )
+{
+    thread_start *start = arg;
+    thread_config config = start->config;
+    void *(*thread_fxn)(void *env) = start->thread_fxn;
+    void *env = start->env;
+    int status = thread_SUCCESS;
+
+    if( config.type == DEADLINE ) {
+        struct thread_sched_attr attr;
+
+        memset( &attr, 0, sizeof( attr ) );
+        attr.size           = sizeof( attr );
+        attr.sched_policy   = SCHED_DEADLINE;
+        attr.sched_runtime  = config.runtimeNs;
+        attr.sched_deadline = config.deadlineNs;
+        attr.sched_period   = config.periodNs ? config.periodNs : config.deadlineNs;
+
+        if( syscall( SYS_sched_setattr, 0, &attr, 0 ) ) {
+            ERR( "sched_setattr(SCHED_DEADLINE) failed: %s\n", strerror( errno ) );
+            status = thread_FAILURE;
+        }
+        jobYield = 1;
+    }
+
+    if( status == thread_SUCCESS && config.stackPrefault )
+        prefault_stack( config.stackPrefault );
+
+    if( status == thread_SUCCESS && config.heapSize ) {
+        if( ( heap = malloc( config.heapSize ) ) == NULL ) {
+            ERR( "Failed to allocate %lu byte thread heap\n", (unsigned long) config.heapSize );
+            status = thread_FAILURE;
+        }
+        else {
+            memset( heap, 0, config.heapSize );
+            heapSize = config.heapSize;
+        }
+    }
+
+    /* start belongs to the launcher, which frees it once woken */
+    start->status = status;
+    sem_post( &start->ready );
+    if( status != thread_SUCCESS )
+        return (void *) -1;
+
+    jobDeadline = config.deadlineNs;
+
+    return thread_fxn( env );
+}
+
 /**************************************************************************
  *  launch_pthread
  *  --------------
@@ -37,16 +166,52 @@ int launch_pthread( pthread_t *hThread_byref,
                     int priority, 
                     void *(*thread_fxn)(void *env), 
                     void *env )
+{
+    thread_config config;
+
+    memset( &config, 0, sizeof( config ) );
+    config.type = type;
+    config.priority = priority;
+
+    return launch_pthread_ex( hThread_byref, &config, thread_fxn, env );
+}
+
+/**************************************************************************
+ *  launch_pthread_ex
+ *  -----------------
+ *  Launches a linux posix thread with the settings in a thread_config
+ *
+ *  INPUTS
+ *  const thread_config *config -- scheduling type and priority, CPU
+ *              affinity, SCHED_DEADLINE parameters, memory locking and
+ *              prefaulting as described in thread.h. lockMemory calls
+ *              mlockall() and so applies to the whole process.
+ *  thread_fxn, env -- as for launch_pthread
+ *
+ *  OUTPUTS
+ *  pthread_t *hThread_byref -- as for launch_pthread
+ *
+ *  int (return) -- thread_SUCCESS or thread_FAUILURE as defined in 
+ *             thread.h. Returns once the thread has finished the setup
+ *             it does itself; if that failed, the thread has been joined.
+ **************************************************************************/
+
+int launch_pthread_ex( pthread_t *hThread_byref,
+                       const thread_config *config,
+                       void *(*thread_fxn)(void *env),
+                       void *env )
 {
     pthread_attr_t  threadAttrs;
     struct sched_param threadParams;
+    thread_start *start = NULL;
+    int policy;
     int status = thread_SUCCESS;
 
     /* Initialize thread attributes structures */
+    /* Nothing to destroy if this fails, so skip the cleanup label     */
     if( pthread_attr_init( &threadAttrs ) ) {
         ERR( "threadAttrs initialization failed\n" );
-        status = EXIT_FAILURE;
-        goto cleanup;
+        return EXIT_FAILURE;
     }
 
     /* This library defaults to inherited scheduling characteristics!   */
@@ -59,41 +224,168 @@ int launch_pthread( pthread_t *hThread_byref,
     }
 
     /* Setthread scheduling policy to real-time or time-slice           */
-    /* SCHED_RR available only to threads running as superuser          */
+    /* SCHED_RR and SCHED_FIFO available only to threads running as     */
+    /* superuser. SCHED_DEADLINE is set by the thread itself, so it     */
+    /* starts out as SCHED_OTHER.                                       */
 
-    if(type == REALTIME) {
-        if( pthread_attr_setschedpolicy( &threadAttrs, SCHED_RR ) ) {
-            ERR( "pthread_attr_setschedpolicy failed\n" );
+    switch( config->type ) {
+    case REALTIME:  policy = SCHED_RR;     break;
+    case FIFO:      policy = SCHED_FIFO;   break;
+    default:        policy = SCHED_OTHER;  break;
+    }
+
+    if( pthread_attr_setschedpolicy( &threadAttrs, policy ) ) {
+        ERR( "pthread_attr_setschedpolicy failed\n" );
+        status = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    /* Set thread priority */
+    threadParams.sched_priority = policy == SCHED_OTHER ? 0 : config->priority;
+
+    if( pthread_attr_setschedparam( &threadAttrs, &threadParams ) ) {
+        ERR( "pthread_attr_setschedparam failed\n" );
+        status = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    /* Keep the thread on the given CPUs, so it is never migrated       */
+    if( config->cpuMask ) {
+        cpu_set_t cpus;
+        unsigned int cpu;
+
+        CPU_ZERO( &cpus );
+        for( cpu = 0; cpu < 8 * sizeof( config->cpuMask ); cpu++ )
+            if( config->cpuMask & ( 1UL << cpu ) )
+                CPU_SET( cpu, &cpus );
+
+        if( pthread_attr_setaffinity_np( &threadAttrs, sizeof( cpus ), &cpus ) ) {
+            ERR( "pthread_attr_setaffinity_np failed\n" );
             status = EXIT_FAILURE;
             goto cleanup;
         }
-    } else {
-        if( pthread_attr_setschedpolicy( &threadAttrs, SCHED_OTHER ) ) {
-            ERR( "pthread_attr_setschedpolicy failed\n" );
+    }
+
+    /* Lock current and future pages and stop free() from handing heap  */
+    /* back to the kernel, so nothing the loop touches can fault later  */
+    if( config->lockMemory ) {
+        if( mlockall( MCL_CURRENT | MCL_FUTURE ) ) {
+            ERR( "mlockall failed: %s\n", strerror( errno ) );
             status = EXIT_FAILURE;
             goto cleanup;
         }
+        mallopt( M_TRIM_THRESHOLD, -1 );
+        mallopt( M_MMAP_MAX, 0 );
     }
 
-    /* Set thread priority */
-    threadParams.sched_priority = priority;
-
-    if( pthread_attr_setschedparam( &threadAttrs, &threadParams ) ) {
-        ERR( "pthread_attr_setschedparam failed\n" );
+    if( ( start = malloc( sizeof( *start ) ) ) == NULL ) {
+        ERR( "Failed to allocate thread start block\n" );
+        status = EXIT_FAILURE;
+        goto cleanup;
+    }
+    start->config = *config;
+    start->thread_fxn = thread_fxn;
+    start->env = env;
+    start->status = thread_FAILURE;
+    if( sem_init( &start->ready, 0, 0 ) ) {
+        ERR( "Failed to create thread start semaphore\n" );
+        free( start );
         status = EXIT_FAILURE;
         goto cleanup;
     }
  
     /*  Create the thread  */
 
-    if ( pthread_create(hThread_byref, &threadAttrs, thread_fxn, env ) ) {
+    if ( pthread_create(hThread_byref, &threadAttrs, thread_trampoline, start ) ) {
         ERR( "Failed to create thread\n" );
+        sem_destroy( &start->ready );
+        free( start );
         status = EXIT_FAILURE;
         goto cleanup;
     }
 
+    /*  Wait for the thread's own setup (SCHED_DEADLINE, heap) and  */
+    /*  fail the launch if that did not work                        */
+
+    while( sem_wait( &start->ready ) && errno == EINTR )
+        ;
+    if( start->status != thread_SUCCESS ) {
+        pthread_join( *hThread_byref, NULL );
+        status = EXIT_FAILURE;
+    }
+    sem_destroy( &start->ready );
+    free( start );
+
 cleanup:
+    pthread_attr_destroy( &threadAttrs );
     return status;
 
 }
 
+/**************************************************************************
+ *  thread_heap
+ *  -----------
+ *  Returns the calling thread's pre-touched heap (NULL if none was asked
+ *  for) and its size. It is freed when the process exits.
+ **************************************************************************/
+
+void *thread_heap( size_t *size_byref )
+{
+    if( size_byref != NULL )
+        *size_byref = heapSize;
+    return heap;
+}
+
+/**************************************************************************
+ *  thread_set_deadline
+ *  -------------------
+ *  Sets the calling thread's relative job deadline for miss counting,
+ *  unless launch_pthread_ex already gave it one.
+ **************************************************************************/
+
+void thread_set_deadline( unsigned long long deadlineNs )
+{
+    if( jobDeadline == 0 )
+        jobDeadline = deadlineNs;
+}
+
+/**************************************************************************
+ *  thread_job_begin / thread_job_end
+ *  ---------------------------------
+ *  Bracket one job (one pass of the thread's loop). A job that takes
+ *  longer than the deadline counts as a miss. A SCHED_DEADLINE thread
+ *  yields at the end of each job to give back the rest of its runtime.
+ *
+ *  int (return) -- 1 if this job missed its deadline, 0 otherwise
+ **************************************************************************/
+
+void thread_job_begin( void )
+{
+    jobStart = now_ns( );
+}
+
+int thread_job_end( void )
+{
+    int missed = 0;
+
+    if( jobDeadline && jobStart && now_ns( ) - jobStart > jobDeadline ) {
+        __atomic_fetch_add( &deadlineMisses, 1, __ATOMIC_RELAXED );
+        missed = 1;
+    }
+
+    if( jobYield )
+        sched_yield( );
+
+    return missed;
+}
+
+/**************************************************************************
+ *  thread_deadline_misses
+ *  ----------------------
+ *  Total missed deadlines over all threads since the program started.
+ **************************************************************************/
+
+unsigned long thread_deadline_misses( void )
+{
+    return __atomic_load_n( &deadlineMisses, __ATOMIC_RELAXED );
+}
@@ -10,5 +10,35 @@
 #define REALTIME   1
 #define TIMESLICE  0
 
+// further scheduling types for launch_pthread_ex (REALTIME is SCHED_RR)
+#define FIFO       2
+#define DEADLINE   3
+
+// Everything launch_pthread_ex can set up for a thread; zero fields are off
+typedef struct thread_config
+{
+    int type;                           // TIMESLICE, REALTIME, FIFO or DEADLINE
+    int priority;                       // REALTIME and FIFO only
+    unsigned long cpuMask;              // bit n = may run on CPU n, 0 = any CPU
+    unsigned long long runtimeNs;       // DEADLINE: CPU time per period
+    unsigned long long deadlineNs;      // relative deadline of a job; also used
+                                        //   for miss counting with other types
+    unsigned long long periodNs;        // DEADLINE: period, 0 = deadlineNs
+    int lockMemory;                     // mlockall() and no malloc trimming
+    size_t stackPrefault;               // bytes of stack to touch at start
+    size_t heapSize;                    // bytes of pre-touched heap, see thread_heap()
+} thread_config;
+
 int launch_pthread( pthread_t *hThread_byref, int type, int priority, void *(*thread_fxn)(void *env), void *env );
 
+int launch_pthread_ex( pthread_t *hThread_byref, const thread_config *config, void *(*thread_fxn)(void *env), void *env );
+
+void *thread_heap( size_t *size_byref );
+
+void thread_set_deadline( unsigned long long deadlineNs );
+
+void thread_job_begin( void );
+
+int thread_job_end( void );
+
+unsigned long thread_deadline_misses( void );
@@ -0,0 +1,270 @@
+/*
+ *   trace.c
+ *
+ *   Each thread records into its own ring of events, so a trace point is a
+ *   clock read, three stores and a release store of the ring head, with no
+ *   locks and no sharing between threads. The dumper copies every ring,
+ *   throws away anything the owner overwrote while it was copying, and
+ *   writes Chrome trace JSON.
+ *
+ *   trace_init() must be called before the threads are created: it blocks
+ *   TRACE_DUMP_SIGNAL so that the threads inherit the mask and only the
+ *   dump thread (which sigwait()s for it) ever receives the signal.
+ */
+
+/* Standard Linux headers */
+#include     <stdio.h>			// Always include stdio.h
+#include     <stdlib.h>			// Always include stdlib.h
+#include     <string.h>			// Defines strncpy
+#include     <signal.h>
+#include     <time.h>			// clock_gettime
+#include     <unistd.h>			// getpid, syscall
+#include     <pthread.h>
+#include     <sys/syscall.h>		// SYS_gettid
+
+/* Application headers */
+#include     "trace.h"
+#include     "debug.h"			// DBG and ERR macros
+
+typedef  struct  TraceEvent
+{
+    unsigned long long  ts;		// ns, CLOCK_MONOTONIC
+    const char        * name;
+    char                phase;		// 'B' or 'E'
+} TraceEvent;
+
+typedef  struct  TraceBuffer
+{
+    int           tid;
+    char          name[ 16 ];
+    unsigned int  head;			// Events ever written
+    TraceEvent    ev[ TRACE_EVENTS ];
+} TraceBuffer;
+
+volatile int trace_enabled = 0;
+
+static TraceBuffer         * buffers[ TRACE_MAX_THREADS ];
+static int                   numBuffers = 0;
+static __thread TraceBuffer * myBuffer = NULL;
+
+static char                  tracePath[ 256 ];
+static pthread_t             dumpThread;
+static volatile int          dumpQuit = 0;
+static pthread_mutex_t       dumpLock = PTHREAD_MUTEX_INITIALIZER;
+
+/******************************************************************************
+ * trace_register
+ ******************************************************************************/
+/*  Gives the calling thread a buffer. Only runs on a thread's first event.  */
+/******************************************************************************/
+static TraceBuffer *trace_register( void )
+{
+    TraceBuffer  *buf;
+    int           slot;
+
+    slot = __atomic_fetch_add( &numBuffers, 1, __ATOMIC_RELAXED );
+    if( slot >= TRACE_MAX_THREADS ) {
+        __atomic_fetch_sub( &numBuffers, 1, __ATOMIC_RELAXED );
+        return NULL;
+    }
+
+    if( ( buf = calloc( 1, sizeof( *buf ) ) ) == NULL ) {
+        __atomic_store_n( &buffers[ slot ], NULL, __ATOMIC_RELEASE );
+        return NULL;
+    }
+
+    buf->tid = syscall( SYS_gettid );
+    snprintf( buf->name, sizeof( buf->name ), "tid %d", buf->tid );
+    __atomic_store_n( &buffers[ slot ], buf, __ATOMIC_RELEASE );
+
+    myBuffer = buf;
+    return buf;
+}
+
+/******************************************************************************
+ * trace_thread_name
+ ******************************************************************************/
+/*  Names the calling thread's track in the trace (call at thread start, so  */
+/*  the buffer allocation happens outside the loop).                          */
+/******************************************************************************/
+void trace_thread_name( const char * name )
+{
+    if( myBuffer == NULL && trace_register( ) == NULL )
+        return;
+
+    strncpy( myBuffer->name, name, sizeof( myBuffer->name ) - 1 );
+}
+
+/******************************************************************************
+ * trace_event
+ ******************************************************************************/
+void trace_event( const char * name, char  phase )
+{
+    TraceBuffer     *buf = myBuffer;
+    TraceEvent      *ev;
+    struct timespec  ts;
+    unsigned int     head;
+
+    if( buf == NULL && ( buf = trace_register( ) ) == NULL )
+        return;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    head      = buf->head;
+    ev        = &buf->ev[ head & ( TRACE_EVENTS - 1 ) ];
+    ev->ts    = ( unsigned long long ) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    ev->name  = name;
+    ev->phase = phase;
+
+    __atomic_store_n( &buf->head, head + 1, __ATOMIC_RELEASE );
+}
+
+/******************************************************************************
+ * trace_dump
+ ******************************************************************************/
+/*  Writes every thread's recent events to the trace file (via a temporary    */
+/*  file and rename, so a viewer never loads half a trace).                   */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  --  TRACE_SUCCESS or TRACE_FAILURE                               */
+/******************************************************************************/
+int trace_dump( void )
+{
+    static TraceEvent  copy[ TRACE_EVENTS ];
+    char               tmp[ sizeof( tracePath ) + 8 ];
+    FILE              *fp;
+    int                i, n, first = 1, pid = getpid( );
+    unsigned int       start, end, j, k;
+
+    pthread_mutex_lock( &dumpLock );
+
+    snprintf( tmp, sizeof( tmp ), "%s.tmp", tracePath );
+    if( ( fp = fopen( tmp, "w" ) ) == NULL ) {
+        ERR( "Cannot write trace file %s\n", tmp );
+        pthread_mutex_unlock( &dumpLock );
+        return TRACE_FAILURE;
+    }
+
+    fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+    n = __atomic_load_n( &numBuffers, __ATOMIC_RELAXED );
+    for( i = 0; i < n && i < TRACE_MAX_THREADS; i++ ) {
+        TraceBuffer *buf = __atomic_load_n( &buffers[ i ], __ATOMIC_ACQUIRE );
+
+        if( buf == NULL )
+            continue;
+
+        fprintf( fp, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,"
+                 "\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", pid, buf->tid, buf->name );
+        first = 0;
+
+        // Copy the window, then keep only what was not overwritten meanwhile
+        end   = __atomic_load_n( &buf->head, __ATOMIC_ACQUIRE );
+        start = end > TRACE_EVENTS ? end - TRACE_EVENTS : 0;
+        for( j = start; j != end; j++ )
+            copy[ j & ( TRACE_EVENTS - 1 ) ] = buf->ev[ j & ( TRACE_EVENTS - 1 ) ];
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        k = __atomic_load_n( &buf->head, __ATOMIC_RELAXED );
+        if( k + 1 - start > TRACE_EVENTS )		// slot k may be half written
+            start = k + 1 - TRACE_EVENTS;
+        if( ( int ) ( end - start ) < 0 )
+            start = end;
+
+        for( j = start; j != end; j++ ) {
+            TraceEvent *ev = &copy[ j & ( TRACE_EVENTS - 1 ) ];
+
+            fprintf( fp, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03llu}",
+                     ev->phase, ev->name, pid, buf->tid, ev->ts / 1000, ev->ts % 1000 );
+        }
+    }
+
+    fprintf( fp, "\n]}\n" );
+    fclose( fp );
+
+    i = rename( tmp, tracePath );
+    pthread_mutex_unlock( &dumpLock );
+
+    if( i != 0 ) {
+        ERR( "Cannot rename %s to %s\n", tmp, tracePath );
+        return TRACE_FAILURE;
+    }
+
+    DBG( "Wrote trace to %s\n", tracePath );
+    return TRACE_SUCCESS;
+}
+
+/******************************************************************************
+ * dump_thread_fxn
+ ******************************************************************************/
+static void *dump_thread_fxn( void * arg )
+{
+    sigset_t  set;
+    int       sig;
+
+    sigemptyset( &set );
+    sigaddset( &set, TRACE_DUMP_SIGNAL );
+
+    while( sigwait( &set, &sig ) == 0 && !dumpQuit )
+        trace_dump( );
+
+    return NULL;
+}
+
+/******************************************************************************
+ * trace_init
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      const char *path -- JSON file written on TRACE_DUMP_SIGNAL and by     */
+/*                          trace_shutdown                                    */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  --  TRACE_SUCCESS or TRACE_FAILURE                               */
+/******************************************************************************/
+int trace_init( const char * path )
+{
+    sigset_t  set;
+
+    strncpy( tracePath, path, sizeof( tracePath ) - 1 );
+
+    // Every thread created from here on inherits the blocked signal
+    sigemptyset( &set );
+    sigaddset( &set, TRACE_DUMP_SIGNAL );
+    pthread_sigmask( SIG_BLOCK, &set, NULL );
+
+    if( pthread_create( &dumpThread, NULL, dump_thread_fxn, NULL ) != 0 ) {
+        ERR( "Failed to create trace dump thread\n" );
+        return TRACE_FAILURE;
+    }
+
+    trace_thread_name( "main" );
+    trace_enabled = 1;
+    return TRACE_SUCCESS;
+}
+
+/******************************************************************************
+ * trace_shutdown
+ ******************************************************************************/
+/*  Stops recording, writes the trace file and frees the buffers. Call after */
+/*  the traced threads have been joined.                                      */
+/******************************************************************************/
+void trace_shutdown( void )
+{
+    int  i;
+
+    if( !trace_enabled )
+        return;
+
+    trace_enabled = 0;
+    dumpQuit = 1;
+    pthread_kill( dumpThread, TRACE_DUMP_SIGNAL );
+    pthread_join( dumpThread, NULL );
+
+    trace_dump( );
+
+    for( i = 0; i < numBuffers && i < TRACE_MAX_THREADS; i++ ) {
+        free( buffers[ i ] );
+        buffers[ i ] = NULL;
+    }
+    numBuffers = 0;
+    myBuffer   = NULL;
+}
@@ -0,0 +1,36 @@
+/*
+ *   trace.h
+ *
+ *   Begin/end trace points dumped as Chrome trace JSON (chrome://tracing,
+ *   ui.perfetto.dev). Names must be string literals; only the pointer is
+ *   stored. Build with -DNO_TRACE to compile the trace points out.
+ */
+
+/* SUCCESS and FAILURE definitions for the trace functions */
+#define     TRACE_SUCCESS        0
+#define     TRACE_FAILURE        -1
+
+#define     TRACE_EVENTS         16384	// Per thread, power of two; oldest are overwritten
+#define     TRACE_MAX_THREADS    16
+#define     TRACE_DUMP_SIGNAL    SIGUSR1	// kill -USR1 <pid> writes the trace file
+
+extern volatile int trace_enabled;
+
+#ifndef NO_TRACE
+#define TRACE_BEGIN( name )  do { if( trace_enabled ) trace_event( ( name ), 'B' ); } while( 0 )
+#define TRACE_END( name )    do { if( trace_enabled ) trace_event( ( name ), 'E' ); } while( 0 )
+#else
+#define TRACE_BEGIN( name )  ( ( void ) 0 )
+#define TRACE_END( name )    ( ( void ) 0 )
+#endif
+
+/* Function prototypes */
+int  trace_init( const char * path );
+
+void trace_thread_name( const char * name );
+
+void trace_event( const char * name, char  phase );
+
+int  trace_dump( void );
+
+void trace_shutdown( void );
@@ -0,0 +1,382 @@
+/*
+ *   video_agc.c
+ */
+
+// Software auto-exposure.  The camera's own AGC (V4L2_CID_AUTOGAIN) is slow
+// to settle and hunts under fluorescent light, so we turn it off and close
+// the loop ourselves: every VAGC_FRAME_INTERVAL frames a subsampled luma
+// histogram is taken from the capture buffer and exposure/gain are nudged
+// toward VAGC_TARGET_LUMA, at most once per VAGC_MIN_UPDATE_US.
+
+// Standard Linux headers
+#include     <stdio.h>		// Always include stdio.h
+#include     <stdlib.h>		// Always include stdlib.h
+#include     <string.h>		// Defines memset
+#include     <errno.h>
+#include     <time.h>		// clock_gettime
+#include     <sys/ioctl.h>	// Defines ioctl method
+
+#include     <asm/types.h>	// Standard typedefs required by v4l2 header
+#include     <linux/videodev2.h>	// v4l2 driver definitions
+
+#if defined(__ARM_NEON__)
+#include     <arm_neon.h>	// NEON intrinsics for the histogram
+#endif
+
+// Application header files
+#include     "video_agc.h"	// Software AGC definitions
+#include     "debug.h"		// DBG and ERR macros
+
+// Macro for clearing structures
+#define     CLEAR(x)       memset ( &(x), 0 , sizeof(x) )
+
+// Fixed point ratios are scaled by 256
+#define     ONE            256
+
+static unsigned long long agc_now_us( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return now.tv_nsec / 1000 + (unsigned long long) now.tv_sec * 1000000;
+}
+
+/******************************************************************************
+ * agc_query_control
+ ******************************************************************************/
+/*  Fills in range and current value of one control.  Leaves ctl->valid = 0   */
+/*  if the driver does not have it.                                           */
+/******************************************************************************/
+static void agc_query_control( int fd, VideoAgcControl * ctl, unsigned int id )
+{
+    struct  v4l2_queryctrl  query;
+    struct  v4l2_control    control;
+
+    CLEAR( *ctl );
+    ctl->id = id;
+
+    CLEAR( query );
+    query.id = id;
+    if( ioctl( fd, VIDIOC_QUERYCTRL, &query ) == -1 ||
+        ( query.flags & V4L2_CTRL_FLAG_DISABLED ) )
+        return;
+
+    CLEAR( control );
+    control.id = id;
+    if( ioctl( fd, VIDIOC_G_CTRL, &control ) == -1 )
+        return;
+
+    ctl->min   = query.minimum;
+    ctl->max   = query.maximum;
+    ctl->value = control.value;
+    ctl->valid = 1;
+}
+
+/******************************************************************************
+ * agc_write_controls
+ ******************************************************************************/
+/*  Sends exposure and gain to the driver.  Both go in one VIDIOC_S_EXT_CTRLS */
+/*  so the sensor never sees a half-applied step; older drivers without the   */
+/*  extended API fall back to one VIDIOC_S_CTRL each.                         */
+/******************************************************************************/
+static int agc_write_controls( VideoAgc * agc, int exposure, int gain )
+{
+    struct  v4l2_ext_control   ctrl[ 2 ];
+    struct  v4l2_ext_controls  ctrls;
+    struct  v4l2_control       control;
+    int     count = 0;
+    int     i;
+
+    CLEAR( ctrl );
+    if( agc->exposure.valid && exposure != agc->exposure.value ) {
+        ctrl[ count ].id    = agc->exposure.id;
+        ctrl[ count ].value = exposure;
+        count++;
+    }
+    if( agc->gain.valid && gain != agc->gain.value ) {
+        ctrl[ count ].id    = agc->gain.id;
+        ctrl[ count ].value = gain;
+        count++;
+    }
+    if( count == 0 )
+        return VAGC_SUCCESS;
+
+    if( agc->useExtCtrls ) {
+        CLEAR( ctrls );
+        ctrls.ctrl_class = V4L2_CTRL_CLASS_USER;
+        ctrls.count      = count;
+        ctrls.controls   = ctrl;
+
+        if( ioctl( agc->fd, VIDIOC_S_EXT_CTRLS, &ctrls ) == 0 )
+            goto written;
+
+        if( errno != EINVAL && errno != ENOTTY ) {
+            ERR( "VIDIOC_S_EXT_CTRLS failed on file descriptor %d\n", agc->fd );
+            return VAGC_FAILURE;
+        }
+        DBG( "VIDIOC_S_EXT_CTRLS not supported, using VIDIOC_S_CTRL\n" );
+        agc->useExtCtrls = 0;
+    }
+
+    for( i = 0; i < count; i++ ) {
+        control.id    = ctrl[ i ].id;
+        control.value = ctrl[ i ].value;
+        if( ioctl( agc->fd, VIDIOC_S_CTRL, &control ) == -1 ) {
+            ERR( "VIDIOC_S_CTRL %#x failed on file descriptor %d\n",
+                 control.id, agc->fd );
+            return VAGC_FAILURE;
+        }
+    }
+
+written:
+    if( agc->exposure.valid )
+        agc->exposure.value = exposure;
+    if( agc->gain.valid )
+        agc->gain.value = gain;
+    agc->updates++;
+    return VAGC_SUCCESS;
+}
+
+/******************************************************************************
+ * video_agc_setup
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      VideoAgc *agc   -- state to initialize                                */
+/*      int captureFd   -- V4L2 capture device from video_input_setup         */
+/*                                                                            */
+/*  Takes exposure and gain away from the camera.  If the driver exposes      */
+/*  neither control, the camera's AGC is left alone and VAGC_FAILURE is       */
+/*  returned so the caller can carry on without the software loop.            */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  -- VAGC_SUCCESS or VAGC_FAILURE as defined in video_agc.h        */
+/******************************************************************************/
+int video_agc_setup( VideoAgc * agc, int  captureFd )
+{
+    struct  v4l2_control  control;
+
+    CLEAR( *agc );
+    agc->fd          = captureFd;
+    agc->useExtCtrls = 1;
+
+    agc_query_control( captureFd, &agc->exposure, V4L2_CID_EXPOSURE );
+    agc_query_control( captureFd, &agc->gain,     V4L2_CID_GAIN );
+
+    if( !agc->exposure.valid && !agc->gain.valid ) {
+        ERR( "Capture device has no exposure or gain control\n" );
+        return VAGC_FAILURE;
+    }
+
+    DBG( "AGC: exposure %d [%d..%d]%s, gain %d [%d..%d]%s\n",
+         agc->exposure.value, agc->exposure.min, agc->exposure.max,
+         agc->exposure.valid ? "" : " (n/a)",
+         agc->gain.value, agc->gain.min, agc->gain.max,
+         agc->gain.valid ? "" : " (n/a)" );
+
+    // Turn off the camera's own loops; not all drivers have both.
+    // Remember how they were so cleanup can put them back.
+    control.id = V4L2_CID_AUTOGAIN;
+    if( ioctl( captureFd, VIDIOC_G_CTRL, &control ) == 0 ) {
+        agc->autoGain      = control.value;
+        agc->autoGainSaved = 1;
+    }
+    control.id = V4L2_CID_EXPOSURE_AUTO;
+    if( ioctl( captureFd, VIDIOC_G_CTRL, &control ) == 0 ) {
+        agc->exposureAuto      = control.value;
+        agc->exposureAutoSaved = 1;
+    }
+
+    control.id    = V4L2_CID_AUTOGAIN;
+    control.value = 0;
+    if( ioctl( captureFd, VIDIOC_S_CTRL, &control ) == -1 )
+        DBG( "AGC: could not clear V4L2_CID_AUTOGAIN\n" );
+
+    control.id    = V4L2_CID_EXPOSURE_AUTO;
+    control.value = V4L2_EXPOSURE_MANUAL;
+    if( ioctl( captureFd, VIDIOC_S_CTRL, &control ) == -1 )
+        DBG( "AGC: could not set V4L2_EXPOSURE_MANUAL\n" );
+
+    return VAGC_SUCCESS;
+}
+
+/******************************************************************************
+ * video_agc_histogram
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      unsigned int *hist -- VAGC_HIST_BINS bins, overwritten                */
+/*      unsigned int *samplesByRef -- returns number of pixels counted        */
+/*      unsigned char *frame -- UYVY frame                                    */
+/*      int width, height   -- frame size in pixels                           */
+/*      int rowStep         -- only every rowStep'th line is sampled          */
+/*                                                                            */
+/*  Only Y0 of each UYVY macropixel is used, so with rowStep = 4 one pixel    */
+/*  in eight is looked at.  With NEON, vld4 de-interleaves 16 macropixels at  */
+/*  a time and the bin index is computed in-register; the increments go to    */
+/*  four interleaved sub-histograms so back-to-back hits on the same bin do   */
+/*  not stall on a load-after-store.                                          */
+/******************************************************************************/
+void video_agc_histogram( unsigned int * hist, unsigned int * samplesByRef,
+                          const unsigned char * frame, int  width, int  height,
+                          int  rowStep )
+{
+    unsigned int  sub[ 4 ][ VAGC_HIST_BINS ];
+    int           macropixels = width / 2;
+    int           lineBytes   = width * 2;
+    int           x, y, b;
+    unsigned int  samples = 0;
+
+    memset( sub, 0, sizeof( sub ) );
+
+    for( y = 0; y < height; y += rowStep ) {
+        const unsigned char * row = frame + y * lineBytes;
+
+        x = 0;
+#if defined(__ARM_NEON__)
+        for( ; x + 16 <= macropixels; x += 16 ) {
+            uint8x16x4_t  px  = vld4q_u8( row + 4 * x );
+            uint8x16_t    bin = vshrq_n_u8( px.val[ 1 ], 2 );
+            unsigned char idx[ 16 ];
+            int           k;
+
+            vst1q_u8( idx, bin );
+            for( k = 0; k < 16; k += 4 ) {
+                sub[ 0 ][ idx[ k     ] ]++;
+                sub[ 1 ][ idx[ k + 1 ] ]++;
+                sub[ 2 ][ idx[ k + 2 ] ]++;
+                sub[ 3 ][ idx[ k + 3 ] ]++;
+            }
+        }
+#endif
+        for( ; x < macropixels; x++ )
+            sub[ x & 3 ][ row[ 4 * x + 1 ] >> 2 ]++;
+
+        samples += macropixels;
+    }
+
+    for( b = 0; b < VAGC_HIST_BINS; b++ )
+        hist[ b ] = sub[ 0 ][ b ] + sub[ 1 ][ b ] + sub[ 2 ][ b ] + sub[ 3 ][ b ];
+
+    *samplesByRef = samples;
+}
+
+/******************************************************************************
+ * agc_scale
+ ******************************************************************************/
+/*  Multiplies the part of a control above its minimum by ratio/ONE and       */
+/*  clamps it to the control's range.                                         */
+/******************************************************************************/
+static int agc_scale( VideoAgcControl * ctl, int ratio )
+{
+    long long  v;
+
+    if( !ctl->valid )
+        return ctl->value;
+
+    v = ( (long long) ( ctl->value - ctl->min + 1 ) * ratio + ONE / 2 ) / ONE
+        + ctl->min - 1;
+    if( v == ctl->value && ratio != ONE )		// Always make progress
+        v += ( ratio > ONE ) ? 1 : -1;
+    if( v < ctl->min ) v = ctl->min;
+    if( v > ctl->max ) v = ctl->max;
+    return (int) v;
+}
+
+/******************************************************************************
+ * video_agc_process
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      VideoAgc *agc   -- state from video_agc_setup                         */
+/*      unsigned char *frame -- UYVY capture buffer (still owned by caller)   */
+/*      int width, height    -- capture size in pixels                        */
+/*                                                                            */
+/*  Call on every VAGC_FRAME_INTERVAL'th frame.  Returns immediately if the   */
+/*  last control write was less than VAGC_MIN_UPDATE_US ago, since the        */
+/*  sensor needs a frame or two before a change shows up in the image.        */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  -- VAGC_SUCCESS or VAGC_FAILURE as defined in video_agc.h        */
+/******************************************************************************/
+int video_agc_process( VideoAgc * agc, const unsigned char * frame,
+                       int  width, int  height )
+{
+    unsigned long long  now = agc_now_us();
+    unsigned long long  sum = 0;
+    int     target = VAGC_TARGET_LUMA;
+    int     ratio, exposure, gain, b;
+
+    if( now - agc->lastUpdate < VAGC_MIN_UPDATE_US )
+        return VAGC_SUCCESS;
+
+    video_agc_histogram( agc->hist, &agc->samples, frame, width, height,
+                         VAGC_ROW_STEP );
+    if( agc->samples == 0 )
+        return VAGC_SUCCESS;
+
+    for( b = 0; b < VAGC_HIST_BINS; b++ )
+        sum += (unsigned long long) agc->hist[ b ] * ( b * 4 + 2 );
+    agc->meanLuma = sum / agc->samples;
+
+    // Highlights blown: aim below the current mean regardless of target
+    if( agc->hist[ VAGC_HIST_BINS - 1 ] * 100ULL >
+        (unsigned long long) agc->samples * VAGC_CLIP_PERCENT &&
+        agc->meanLuma * 3 / 4 < target )
+        target = agc->meanLuma * 3 / 4;
+
+    ratio = target * ONE / ( agc->meanLuma > 0 ? agc->meanLuma : 1 );
+
+    if( abs( ratio - ONE ) * 100 < ONE * VAGC_DEADBAND )
+        return VAGC_SUCCESS;
+
+    // Move half way per step and never more than 2x, so the loop stays
+    // stable with the sensor's one-to-two frame latency
+    ratio = ONE + ( ratio - ONE ) / 2;
+    if( ratio > 2 * ONE ) ratio = 2 * ONE;
+    if( ratio < ONE / 2 ) ratio = ONE / 2;
+
+    // Brighten with exposure first (no noise), darken with gain first
+    exposure = agc->exposure.value;
+    gain     = agc->gain.value;
+    if( ratio > ONE ) {
+        if( agc->exposure.valid && agc->exposure.value < agc->exposure.max )
+            exposure = agc_scale( &agc->exposure, ratio );
+        else
+            gain = agc_scale( &agc->gain, ratio );
+    } else {
+        if( agc->gain.valid && agc->gain.value > agc->gain.min )
+            gain = agc_scale( &agc->gain, ratio );
+        else
+            exposure = agc_scale( &agc->exposure, ratio );
+    }
+
+    agc->lastUpdate = now;
+    return agc_write_controls( agc, exposure, gain );
+}
+
+/******************************************************************************
+ * video_agc_cleanup
+ ******************************************************************************/
+/*  Hands exposure back to the camera, with the auto exposure and auto gain   */
+/*  modes it had before video_agc_setup.  Must be called before the capture   */
+/*  device is closed.                                                         */
+/******************************************************************************/
+void video_agc_cleanup( VideoAgc * agc )
+{
+    struct  v4l2_control  control;
+
+    if( agc->exposureAutoSaved ) {
+        control.id    = V4L2_CID_EXPOSURE_AUTO;
+        control.value = agc->exposureAuto;
+        if( ioctl( agc->fd, VIDIOC_S_CTRL, &control ) == -1 )
+            DBG( "AGC: could not restore V4L2_CID_EXPOSURE_AUTO\n" );
+    }
+
+    if( agc->autoGainSaved ) {
+        control.id    = V4L2_CID_AUTOGAIN;
+        control.value = agc->autoGain;
+        if( ioctl( agc->fd, VIDIOC_S_CTRL, &control ) == -1 )
+            DBG( "AGC: could not restore V4L2_CID_AUTOGAIN\n" );
+    }
+
+    DBG( "AGC: %u control updates, last mean luma %d\n",
+         agc->updates, agc->meanLuma );
+}
@@ -0,0 +1,58 @@
+/*
+ *   video_agc.h
+ */
+
+/* SUCCESS and FAILURE definitions for the software AGC functions */
+#define     VAGC_SUCCESS     0
+#define     VAGC_FAILURE     -1
+
+/* Luminance histogram resolution (luma >> 2 gives 64 bins) */
+#define     VAGC_HIST_BINS   64
+
+/* Loop tuning */
+#define     VAGC_FRAME_INTERVAL  4	// Histogram 1 out of this many frames
+#define     VAGC_ROW_STEP        4	// Only every 4th line is sampled
+#define     VAGC_MIN_UPDATE_US   100000	// At most 10 control writes per second
+#define     VAGC_TARGET_LUMA     110	// Mean luma we try to hold (0-255)
+#define     VAGC_DEADBAND        8	// Percent error ignored around target
+#define     VAGC_CLIP_PERCENT    4	// Pull down if more than this is clipped
+
+/* Describes one V4L2 integer control we drive */
+typedef  struct  VideoAgcControl
+{
+    unsigned int  id;		// V4L2_CID_xxx
+    int           min;		// Range reported by VIDIOC_QUERYCTRL
+    int           max;
+    int           value;	// Last value written to the driver
+    int           valid;	// Driver supports this control
+} VideoAgcControl;
+
+/* Software auto-exposure state, one per capture device */
+typedef  struct  VideoAgc
+{
+    int              fd;			// Capture device
+    VideoAgcControl  exposure;
+    VideoAgcControl  gain;
+    unsigned int     hist[ VAGC_HIST_BINS ];	// Last luminance histogram
+    unsigned int     samples;			// Pixels in hist
+    int              meanLuma;			// Mean of last histogram
+    unsigned long long lastUpdate;		// usec, monotonic
+    unsigned int     updates;			// Number of control writes
+    int              useExtCtrls;		// VIDIOC_S_EXT_CTRLS works
+    int              autoGain;			// Camera settings found at setup,
+    int              exposureAuto;		// restored by cleanup
+    int              autoGainSaved;
+    int              exposureAutoSaved;
+} VideoAgc;
+
+/* Function prototypes */
+int  video_agc_setup( VideoAgc * agc, int  captureFd );
+
+int  video_agc_process( VideoAgc * agc, const unsigned char * frame,
+                        int  width, int  height );
+
+void video_agc_histogram( unsigned int * hist, unsigned int * samplesByRef,
+                          const unsigned char * frame, int  width, int  height,
+                          int  rowStep );
+
+void video_agc_cleanup( VideoAgc * agc );
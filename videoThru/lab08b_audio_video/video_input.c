@@ -29,7 +29,8 @@
 /*  input parameters:                                                         */
 /*      int *fdByRef  --   file descriptor passed by reference. Used to       */
 /*                         return the file descriptor of newly opened device  */
-/*      char *device  --   device node for V4L2 capture driver                */
+/*      char *device  --   device node for V4L2 capture driver, or the name  */
+/*                         of a synthetic source (see video_input.h)          */
 /*      VideoBuffer **vidBufsPtrByRef  --  pointer to VideoBuffer structure   */
 /*                         that is passed by reference.                       */
 /*                         (VideoBuffer struct def in video_capture.h )       */
@@ -72,6 +73,11 @@ int video_input_setup( int * fdByRef, char * device, VideoBuffer ** vidBufsPtrBy
                 *captureHeightByRef = 0;	\
                 return VIN_FAILURE
 
+    /* Synthetic sources have their own setup */
+    if( synth_input_probe( device ) )
+        return synth_input_setup( fdByRef, device, vidBufsPtrByRef, numVidBufsByRef,
+                                  captureWidthByRef, captureHeightByRef );
+
     DBG( "Initializing video capture device: %s\n", device );
 
     /* Open video capture device */
@@ -265,6 +271,9 @@ int video_input_cleanup( int  fd, VideoBuffer *vidBufsPtr, int  numVidBufs )
     unsigned  int        i;                                     //  < for loop index >
               int        status = VIN_SUCCESS;                  //  < return value for function >
 
+    if( synth_input_owns( fd ) )
+        return synth_input_cleanup( fd, vidBufsPtr, numVidBufs );
+
     /* Shut off the video capture */
     type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     if( ioctl( fd, VIDIOC_STREAMOFF, &type ) == -1 ) {
@@ -297,3 +306,65 @@ int video_input_cleanup( int  fd, VideoBuffer *vidBufsPtr, int  numVidBufs )
     return status;
 }
 
+
+/******************************************************************************
+ * video_input_dequeue
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      int fd          -- file descriptor returned by video_input_setup      */
+/*      int *indexByRef -- returns the index of the filled buffer            */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  --  VIN_SUCCESS or VIN_FAILURE as defined in video_input.h       */
+/*                                                                            */
+/******************************************************************************/
+int video_input_dequeue( int  fd, int * indexByRef )
+{
+    struct  v4l2_buffer  buf;                                  //  < dequeued frame >
+
+    if( synth_input_owns( fd ) )
+        return synth_input_dequeue( fd, indexByRef );
+
+    CLEAR( buf );
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+
+    if( ioctl( fd, VIDIOC_DQBUF, &buf ) == -1 ) {
+        ERR( "VIDIOC_DQBUF failed on file descriptor %d\n", fd );
+        return VIN_FAILURE;
+    }
+
+    *indexByRef = buf.index;
+    return VIN_SUCCESS;
+}
+
+/******************************************************************************
+ * video_input_requeue
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      int fd          -- file descriptor returned by video_input_setup      */
+/*      int index       -- buffer index returned by video_input_dequeue       */
+/*                                                                            */
+/*  return value:                                                             */
+/*      int  --  VIN_SUCCESS or VIN_FAILURE as defined in video_input.h       */
+/*                                                                            */
+/******************************************************************************/
+int video_input_requeue( int  fd, int  index )
+{
+    struct  v4l2_buffer  buf;                                  //  < frame to give back >
+
+    if( synth_input_owns( fd ) )
+        return synth_input_requeue( fd, index );
+
+    CLEAR( buf );
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index  = index;
+
+    if( ioctl( fd, VIDIOC_QBUF, &buf ) == -1 ) {
+        ERR( "VIDIOC_QBUF failed on file descriptor %d\n", fd );
+        return VIN_FAILURE;
+    }
+
+    return VIN_SUCCESS;
+}
@@ -13,11 +13,34 @@ typedef  struct  VideoBuffer
   size_t  length;
 } VideoBuffer;
 
+/* Device names that select a synthetic source instead of a V4L2 node */
+/*     "pattern[@fps]" or "file:<raw UYVY file>[@fps]"                  */
+#define     VIN_PATTERN_PREFIX  "pattern"
+#define     VIN_FILE_PREFIX     "file:"
+
 /* Function prototypes */
         int video_input_setup( int * fdByRef, char * device, VideoBuffer ** vidBufsPtrByRef, unsigned int * numVidBufsByRef,
                                int * captureWidthByRef, int * captureHeightByRef );
 
         int video_input_cleanup( int  fd, VideoBuffer * vidBufsPtr, int  numVidBufs );
 
+        int video_input_dequeue( int  fd, int * indexByRef );
+
+        int video_input_requeue( int  fd, int  index );
+
 inline  int wait_for_frame( int  fd );
 
+/* Synthetic capture backend (video_input_synth.c) */
+        int synth_input_probe( const char * device );
+
+        int synth_input_owns( int  fd );
+
+        int synth_input_setup( int * fdByRef, char * device, VideoBuffer ** vidBufsPtrByRef, unsigned int * numVidBufsByRef,
+                               int * captureWidthByRef, int * captureHeightByRef );
+
+        int synth_input_dequeue( int  fd, int * indexByRef );
+
+        int synth_input_requeue( int  fd, int  index );
+
+        int synth_input_cleanup( int  fd, VideoBuffer * vidBufsPtr, int  numVidBufs );
+
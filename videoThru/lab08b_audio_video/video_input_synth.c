@@ -0,0 +1,334 @@
+/*
+ *   video_input_synth.c
+ *
+ *   Synthetic capture sources that stand in for the V4L2 camera so the
+ *   video pipeline can be run and timed on a box without one.
+ *
+ *      pattern[@fps]         moving colour bars, pre-rendered at setup
+ *      file:<path>[@fps]     raw UYVY frames replayed from a file (loops)
+ *
+ *   Without @fps frames are handed out as fast as they are asked for.
+ */
+
+/* Standard Linux headers */
+#include     <stdio.h>                       //always include stdio.h
+#include     <stdlib.h>                      //always include stdlib.h
+#include     <string.h>                      //defines memset and memcpy methods
+#include     <errno.h>
+#include     <time.h>                        //clock_nanosleep
+
+#include     <fcntl.h>                       //defines open, read, write methods
+#include     <unistd.h>                      //defines close and sleep methods
+
+/* Application header files */
+#include     "video_input.h"
+#include     "debug.h"                        //DBG and ERR macros
+
+#define     SYNTH_BPP       2                // UYVY, 2 bytes per pixel
+#define     SYNTH_MAX_BUFS  32
+
+/* One synthetic source per process, identified by its file descriptor */
+static struct
+{
+    int           fd;              // Descriptor returned to the caller (/dev/null)
+    int           fileFd;          // Replay file, -1 for the pattern source
+    VideoBuffer * bufs;
+    int           numBufs;
+    int           frameSize;
+    int           next;            // Next buffer to hand out
+    unsigned int  busy;            // Bit per buffer held by the application
+    long          periodNs;        // Frame period, 0 = free-running
+    struct timespec deadline;      // When the next frame is "captured"
+} synth = { -1, -1 };
+
+/* 75% colour bars, one UYVY macropixel (U, Y, V, Y) per bar */
+static const unsigned char bars[ 8 ][ 4 ] = {
+    { 128, 180, 128, 180 },     // white
+    {  44, 162, 142, 162 },     // yellow
+    { 156, 131,  44, 131 },     // cyan
+    {  72, 112,  58, 112 },     // green
+    { 184,  84, 198,  84 },     // magenta
+    { 100,  65, 212,  65 },     // red
+    { 212,  35, 114,  35 },     // blue
+    { 128,  16, 128,  16 },     // black
+};
+
+/******************************************************************************
+ * synth_parse_rate
+ ******************************************************************************/
+/*  Strips an optional "@fps" suffix from name and returns the frame period   */
+/*  in nanoseconds (0 if there is none).                                      */
+/******************************************************************************/
+static long synth_parse_rate( char * name )
+{
+    char * at = strrchr( name, '@' );
+    int    fps;
+
+    if( at == NULL )
+        return 0;
+
+    *at = '\0';
+    fps = atoi( at + 1 );
+
+    return fps > 0 ? 1000000000L / fps : 0;
+}
+
+/******************************************************************************
+ * synth_render_pattern
+ ******************************************************************************/
+/*  Draws colour bars over the top three quarters of the frame and a luma     */
+/*  ramp below them, both shifted right by phase pixels.                      */
+/******************************************************************************/
+static void synth_render_pattern( unsigned char * frame, int width, int height,
+                                  int phase )
+{
+    int   x, y, bar;
+    unsigned char * p;
+
+    for( y = 0; y < height; y++ ) {
+        p = frame + y * width * SYNTH_BPP;
+
+        for( x = 0; x < width; x += 2, p += 4 ) {
+            int  sx = ( x + phase ) % width;
+
+            if( y < height * 3 / 4 ) {
+                bar = sx * 8 / width;
+                memcpy( p, bars[ bar ], 4 );
+            }
+            else {
+                p[ 0 ] = 128;
+                p[ 1 ] = p[ 3 ] = 16 + sx * 219 / width;
+                p[ 2 ] = 128;
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * synth_read_frame
+ ******************************************************************************/
+/*  Reads the next frame of the replay file into buf, rewinding at EOF.       */
+/*  return value: VIN_SUCCESS or VIN_FAILURE                                  */
+/******************************************************************************/
+static int synth_read_frame( void * buf )
+{
+    int   done = 0, n, rewound = 0;
+
+    while( done < synth.frameSize ) {
+        n = read( synth.fileFd, ( char * ) buf + done, synth.frameSize - done );
+
+        if( n < 0 ) {
+            if( errno == EINTR )
+                continue;
+            ERR( "Read from replay file failed: %s\n", strerror( errno ) );
+            return VIN_FAILURE;
+        }
+
+        if( n == 0 ) {
+            // Drop a trailing partial frame and start over from the top
+            if( rewound ) {
+                ERR( "Replay file holds less than one frame\n" );
+                return VIN_FAILURE;
+            }
+            lseek( synth.fileFd, 0, SEEK_SET );
+            done    = 0;
+            rewound = 1;
+            continue;
+        }
+
+        done += n;
+    }
+
+    return VIN_SUCCESS;
+}
+
+/******************************************************************************
+ * synth_input_probe
+ ******************************************************************************/
+/*  return value: non-zero if device names a synthetic source                 */
+/******************************************************************************/
+int synth_input_probe( const char * device )
+{
+    return strncmp( device, VIN_PATTERN_PREFIX, strlen( VIN_PATTERN_PREFIX ) ) == 0
+        || strncmp( device, VIN_FILE_PREFIX, strlen( VIN_FILE_PREFIX ) ) == 0;
+}
+
+/******************************************************************************
+ * synth_input_owns
+ ******************************************************************************/
+/*  return value: non-zero if fd was returned by synth_input_setup            */
+/******************************************************************************/
+int synth_input_owns( int  fd )
+{
+    return synth.fd != -1 && fd == synth.fd;
+}
+
+/******************************************************************************
+ * synth_input_setup
+ ******************************************************************************/
+/*  Same parameters and return values as video_input_setup. Width and height */
+/*  are always granted as requested.                                          */
+/******************************************************************************/
+int synth_input_setup( int * fdByRef, char * device, VideoBuffer ** vidBufsPtrByRef,
+                       unsigned int * numVidBufsByRef, int * captureWidthByRef,
+                       int * captureHeightByRef )
+{
+    char   name[ 256 ];
+    int    i;
+
+    if( synth.fd != -1 ) {
+        ERR( "Only one synthetic capture source may be open\n" );
+        return VIN_FAILURE;
+    }
+
+    if( *numVidBufsByRef == 0 || *numVidBufsByRef > SYNTH_MAX_BUFS ) {
+        ERR( "Synthetic source supports 1..%d buffers\n", SYNTH_MAX_BUFS );
+        return VIN_FAILURE;
+    }
+
+    DBG( "Initializing synthetic capture source: %s\n", device );
+
+    strncpy( name, device, sizeof( name ) - 1 );
+    name[ sizeof( name ) - 1 ] = '\0';
+
+    synth.periodNs  = synth_parse_rate( name );
+    synth.numBufs   = *numVidBufsByRef;
+    synth.frameSize = *captureWidthByRef * *captureHeightByRef * SYNTH_BPP;
+    synth.next      = 0;
+    synth.busy      = 0;
+    synth.fileFd    = -1;
+
+    if( strncmp( name, VIN_FILE_PREFIX, strlen( VIN_FILE_PREFIX ) ) == 0 ) {
+        char * path = name + strlen( VIN_FILE_PREFIX );
+
+        if( ( synth.fileFd = open( path, O_RDONLY ) ) == -1 ) {
+            ERR( "Cannot open replay file %s\n", path );
+            goto failure;
+        }
+    }
+
+    // Stand-in descriptor so close() and fd comparisons behave normally
+    if( ( synth.fd = open( "/dev/null", O_RDWR ) ) == -1 ) {
+        ERR( "Cannot open /dev/null\n" );
+        goto failure;
+    }
+
+    synth.bufs = calloc( synth.numBufs, sizeof( *synth.bufs ) );
+    if( synth.bufs == NULL ) {
+        ERR( "Failed to allocate memory for capture buffer structs.\n" );
+        goto failure;
+    }
+
+    for( i = 0; i < synth.numBufs; i++ ) {
+        synth.bufs[ i ].length = synth.frameSize;
+        synth.bufs[ i ].start  = malloc( synth.frameSize );
+
+        if( synth.bufs[ i ].start == NULL ) {
+            ERR( "Failed to allocate synthetic capture buffer %d\n", i );
+            goto failure;
+        }
+
+        // Pattern frames are drawn once so a dequeue costs what DMA would
+        if( synth.fileFd == -1 )
+            synth_render_pattern( synth.bufs[ i ].start, *captureWidthByRef,
+                                  *captureHeightByRef,
+                                  ( i * *captureWidthByRef / synth.numBufs ) & ~1 );
+
+        DBG( "\tSynthetic buffer %d, size %d at address %p\n",
+             i, synth.frameSize, synth.bufs[ i ].start );
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &synth.deadline );
+
+    *fdByRef         = synth.fd;
+    *vidBufsPtrByRef = synth.bufs;
+    return VIN_SUCCESS;
+
+failure:
+    synth_input_cleanup( synth.fd, synth.bufs, synth.bufs ? synth.numBufs : 0 );
+    *fdByRef            = -1;
+    *vidBufsPtrByRef    = NULL;
+    *numVidBufsByRef    = 0;
+    *captureWidthByRef  = 0;
+    *captureHeightByRef = 0;
+    return VIN_FAILURE;
+}
+
+/******************************************************************************
+ * synth_input_dequeue
+ ******************************************************************************/
+/*  Hands out the next buffer, sleeping until its frame time if paced.        */
+/*  return value: VIN_SUCCESS or VIN_FAILURE (all buffers held by caller)     */
+/******************************************************************************/
+int synth_input_dequeue( int  fd, int * indexByRef )
+{
+    int   idx = synth.next;
+
+    if( synth.busy & ( 1u << idx ) ) {
+        ERR( "No synthetic capture buffer queued\n" );
+        return VIN_FAILURE;
+    }
+
+    if( synth.periodNs ) {
+        synth.deadline.tv_nsec += synth.periodNs;
+        while( synth.deadline.tv_nsec >= 1000000000L ) {
+            synth.deadline.tv_nsec -= 1000000000L;
+            synth.deadline.tv_sec++;
+        }
+        while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                &synth.deadline, NULL ) == EINTR )
+            ;
+    }
+
+    if( synth.fileFd != -1 &&
+        synth_read_frame( synth.bufs[ idx ].start ) == VIN_FAILURE )
+        return VIN_FAILURE;
+
+    synth.busy |= 1u << idx;
+    synth.next  = ( idx + 1 ) % synth.numBufs;
+
+    *indexByRef = idx;
+    return VIN_SUCCESS;
+}
+
+/******************************************************************************
+ * synth_input_requeue
+ ******************************************************************************/
+int synth_input_requeue( int  fd, int  index )
+{
+    if( index < 0 || index >= synth.numBufs ) {
+        ERR( "Bad synthetic capture buffer index %d\n", index );
+        return VIN_FAILURE;
+    }
+
+    synth.busy &= ~( 1u << index );
+    return VIN_SUCCESS;
+}
+
+/******************************************************************************
+ * synth_input_cleanup
+ ******************************************************************************/
+/*  Same parameters and return values as video_input_cleanup.                 */
+/******************************************************************************/
+int synth_input_cleanup( int  fd, VideoBuffer * vidBufsPtr, int  numVidBufs )
+{
+    int   i;
+
+    for( i = 0; vidBufsPtr && i < numVidBufs; i++ )
+        free( vidBufsPtr[ i ].start );
+    free( vidBufsPtr );
+
+    if( synth.fileFd != -1 )
+        close( synth.fileFd );
+
+    if( fd != -1 )
+        close( fd );
+
+    DBG( "\tClosed synthetic capture source (file descriptor %d)\n", fd );
+
+    synth.fd     = -1;
+    synth.fileFd = -1;
+    synth.bufs   = NULL;
+
+    return VIN_SUCCESS;
+}
@@ -17,6 +17,7 @@
 // Application header files
 #include     "video_output.h"                   // Video driver definitions
 #include     "debug.h"                          // DBG and ERR macros
+#include     "trace.h"                          // Timeline trace points
 
 // Bits per pixel for video window
 // Note:	The gfx buffer used by the OSD is 32 bits/pixel
@@ -31,7 +32,8 @@
  *      int *fdByRef      --  File descriptor passed by reference. It is used *
  *                            to return the file descriptor of the device     *
  *                            opened by this function.                        *
- *      char *device      --  Device node for FBDEV driver                    *
+ *      char *device      --  Device node for FBDEV driver, or "null[@hz]"    *
+ *                            for the in-memory sink                          *
  *      char **displayBuffersArray -- an array of output buffer pointers.     *
  *                            The array must be allocated (i.e not just a     *
  *                            pointer with no memory assocaited with it)      *
@@ -74,6 +76,11 @@ int video_output_setup( int *fdByRef, char *device, char **displayBuffersArray,
                 *displayHeightByRef = 0;                   \
                 return VOUT_FAILURE
 
+    // The in-memory sink has its own setup
+    if( null_output_probe( device ) )
+        return null_output_setup( fdByRef, device, displayBuffersArray, numDisplayBuffers,
+                                  displayWidthByRef, displayHeightByRef, zoomFactor );
+
     DBG( "Initializing display device: %s\n", device );
 
     // Open the display device
@@ -198,6 +205,10 @@ From: http://groups.google.com/group/beagleboard/browse_thread/thread/9bc347f5f0
 int flip_display_buffers( int  displayFd, int  displayIdx )
 {
     struct  fb_var_screeninfo  vInfo;	// Variable info for display screen
+    int                        i;	// ioctl return value
+
+    if( null_output_owns( displayFd ) )
+        return null_output_flip( displayFd, displayIdx );
 
     // Get current state of the display screen variable information
     if( ioctl( displayFd, FBIOGET_VSCREENINFO, &vInfo ) == -1 ) {
@@ -209,7 +220,10 @@ int flip_display_buffers( int  displayFd, int  displayIdx )
     vInfo.yoffset = vInfo.yres * displayIdx;
 
     // Swap the working buffer for the displayed buffer
-    if( ioctl( displayFd, FBIOPAN_DISPLAY, &vInfo ) == -1 ) {
+    TRACE_BEGIN( "flip.pan" );
+    i = ioctl( displayFd, FBIOPAN_DISPLAY, &vInfo );
+    TRACE_END( "flip.pan" );
+    if( i == -1 ) {
         ERR( "Failed FBIOPAN_DISPLAY\n" );
         return VOUT_FAILURE;
     }
@@ -220,7 +234,10 @@ int flip_display_buffers( int  displayFd, int  displayIdx )
 	// but doesn't work from there.
 #define OMAP_IO(num)		_IO('O', num)
 #define OMAPFB_WAITFORVSYNC	OMAP_IO(57)
-    if( ioctl( displayFd, OMAPFB_WAITFORVSYNC, &vInfo ) == -1 ) {
+    TRACE_BEGIN( "flip.vsync" );
+    i = ioctl( displayFd, OMAPFB_WAITFORVSYNC, &vInfo );
+    TRACE_END( "flip.vsync" );
+    if( i == -1 ) {
         ERR( "Failed OMAPFB_WAITFORVSYNC\n" );
         return VOUT_FAILURE;
     }
@@ -250,6 +267,11 @@ void video_output_cleanup( int  displayFd, char ** displayBuffersArray, int  num
     struct  fb_var_screeninfo  varInfo;                         // Variable display screen info
     int                        frameSize;                       // Display frame size in bytes
 
+    if( null_output_owns( displayFd ) ) {
+        null_output_cleanup( displayFd, displayBuffersArray, numDisplayBuffers );
+        return;
+    }
+
     // Get display frame resolution from the variable info
     if( ioctl( displayFd, FBIOGET_VSCREENINFO, &varInfo ) == -1 ) {
         ERR( "Failed FBIOFET_VSCREENINFO for file descriptor %d\n", displayFd );
@@ -24,6 +24,10 @@ struct  Zoom_Params
   u_int32_t Zoom_V;
 } ;
 
+/* Device name that selects the in-memory sink instead of an fbdev node, */
+/*     "null[@hz]" (see video_output_null.c)                             */
+#define     VOUT_NULL_PREFIX "null"
+
 /*  Function prototypes */
 int  video_attribute_setup( char * device, unsigned char  trans );
 
@@ -34,3 +38,15 @@ int  flip_display_buffers( int  fd, int  displayIdx );
 
 void video_output_cleanup( int  fd, char ** displayBuffersArray, int  numDisplayBuffers );
 
+/* In-memory display sink (video_output_null.c) */
+int  null_output_probe( const char * device );
+
+int  null_output_owns( int  fd );
+
+int  null_output_setup( int * fdByRef, char * device, char ** displayBuffersArray, int  numDisplayBuffers,
+                        int * displayWidthByRef, int * displayHeightByRef, u_int32_t  zoomFactor );
+
+int  null_output_flip( int  fd, int  displayIdx );
+
+void null_output_cleanup( int  fd, char ** displayBuffersArray, int  numDisplayBuffers );
+
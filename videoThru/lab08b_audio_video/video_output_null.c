@@ -0,0 +1,161 @@
+/*
+ *   video_output_null.c
+ *
+ *   In-memory display sink used in place of the fbdev video plane:
+ *
+ *      null[@hz]     frames land in an anonymous mapping; with @hz each
+ *                    flip waits for the next emulated vsync
+ */
+
+// Standard Linux headers
+#include     <stdio.h>                          // Always include stdio.h
+#include     <stdlib.h>                         // Always include stdlib.h
+#include     <string.h>                         // Defines memset and memcpy methods
+#include     <errno.h>
+#include     <time.h>                           // clock_nanosleep
+
+#include     <fcntl.h>                          // Defines open, read, write methods
+#include     <unistd.h>                         // Defines close and sleep methods
+#include     <sys/mman.h>                       // Defines mmap method
+#include     <sys/types.h>
+
+// Application header files
+#include     "video_output.h"                   // Video driver definitions
+#include     "debug.h"                          // DBG and ERR macros
+
+#define     NULL_BPP     2                      // Same UYVY layout as the video plane
+
+// One null sink per process, identified by its file descriptor
+static struct
+{
+    int        fd;                // Descriptor returned to the caller (/dev/null)
+    char     * mem;               // All display buffers, back to back
+    size_t     size;
+    int        shown;             // Index of the buffer last flipped to
+    long       periodNs;          // Emulated refresh period, 0 = no vsync wait
+    struct timespec vsync;        // Time of the next emulated vsync
+} sink = { -1 };
+
+/******************************************************************************
+ * null_output_probe
+ ******************************************************************************
+ *  Return Value:                                                             *
+ *      int  -- non-zero if device names the null sink                        *
+ ******************************************************************************/
+int null_output_probe( const char * device )
+{
+    return strncmp( device, VOUT_NULL_PREFIX, strlen( VOUT_NULL_PREFIX ) ) == 0;
+}
+
+/******************************************************************************
+ * null_output_owns
+ ******************************************************************************
+ *  Return Value:                                                             *
+ *      int  -- non-zero if fd was returned by null_output_setup              *
+ ******************************************************************************/
+int null_output_owns( int  fd )
+{
+    return sink.fd != -1 && fd == sink.fd;
+}
+
+/******************************************************************************
+ * null_output_setup
+ ******************************************************************************
+ *  Same parameters and return values as video_output_setup. The requested    *
+ *  resolution is always granted; zoomFactor is ignored.                      *
+ ******************************************************************************/
+int null_output_setup( int *fdByRef, char *device, char **displayBuffersArray,
+                       int  numDisplayBuffers, int *displayWidthByRef,
+                       int *displayHeightByRef, u_int32_t zoomFactor )
+{
+    const char * at;
+    int          frameSize, hz, i;
+
+    if( sink.fd != -1 ) {
+        ERR( "Only one null display may be open\n" );
+        return VOUT_FAILURE;
+    }
+
+    DBG( "Initializing null display: %s\n", device );
+
+    at            = strchr( device, '@' );
+    hz            = at ? atoi( at + 1 ) : 0;
+    sink.periodNs = hz > 0 ? 1000000000L / hz : 0;
+
+    frameSize = *displayWidthByRef * *displayHeightByRef * NULL_BPP;
+    sink.size = ( size_t ) frameSize * numDisplayBuffers;
+    sink.mem  = mmap( NULL, sink.size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+    if( sink.mem == MAP_FAILED ) {
+        ERR( "Failed to map %d null display buffers\n", numDisplayBuffers );
+        sink.mem = NULL;
+        return VOUT_FAILURE;
+    }
+
+    if( ( sink.fd = open( "/dev/null", O_RDWR ) ) == -1 ) {
+        ERR( "Cannot open /dev/null\n" );
+        munmap( sink.mem, sink.size );
+        sink.mem = NULL;
+        return VOUT_FAILURE;
+    }
+
+    for( i = 0; i < numDisplayBuffers; i++ ) {
+        displayBuffersArray[ i ] = sink.mem + i * frameSize;
+        DBG( "\tNull display buffer %d, size %d at location %p\n", i, frameSize,
+             displayBuffersArray[ i ] );
+    }
+
+    sink.shown = 0;
+    clock_gettime( CLOCK_MONOTONIC, &sink.vsync );
+
+    *fdByRef = sink.fd;
+    return VOUT_SUCCESS;
+}
+
+/******************************************************************************
+ * null_output_flip
+ ******************************************************************************
+ *  Same parameters and return values as flip_display_buffers.                *
+ ******************************************************************************/
+int null_output_flip( int  displayFd, int  displayIdx )
+{
+    struct timespec  now;
+
+    sink.shown = displayIdx;
+
+    if( sink.periodNs == 0 )
+        return VOUT_SUCCESS;
+
+    // Emulated vsync: like the panel, a late flip waits for the next tick
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    do {
+        sink.vsync.tv_nsec += sink.periodNs;
+        while( sink.vsync.tv_nsec >= 1000000000L ) {
+            sink.vsync.tv_nsec -= 1000000000L;
+            sink.vsync.tv_sec++;
+        }
+    } while( sink.vsync.tv_sec < now.tv_sec ||
+             ( sink.vsync.tv_sec == now.tv_sec && sink.vsync.tv_nsec <= now.tv_nsec ) );
+    while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &sink.vsync, NULL ) == EINTR )
+        ;
+
+    return VOUT_SUCCESS;
+}
+
+/******************************************************************************
+ * null_output_cleanup
+ ******************************************************************************
+ *  Same parameters as video_output_cleanup.                                  *
+ ******************************************************************************/
+void null_output_cleanup( int  displayFd, char ** displayBuffersArray, int  numDisplayBuffers )
+{
+    if( sink.mem != NULL )
+        munmap( sink.mem, sink.size );
+
+    close( displayFd );
+    DBG( "Closed null display (file descriptor %d)\n", displayFd );
+
+    sink.fd  = -1;
+    sink.mem = NULL;
+}
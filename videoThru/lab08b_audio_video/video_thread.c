@@ -17,6 +17,13 @@
 #include     "video_osd.h"	// OSD device functions
 #include     "video_output.h"	// Display device functions
 #include     "video_input.h"	// Display device functions
+#include     "video_agc.h"	// Software auto-exposure
+#include     "video_track.h"	// Colour tracker
+#include     "instrument.h"	// Stage timing histograms
+#include     "trace.h"		// Timeline trace points
+#include     "perfctr.h"		// Hardware counters per stage
+#include     "pool.h"		// Work-stealing thread pool
+#include     "watchdog.h"	// Frame budget and overload shedding
 
 //* Video capture and display devices used **
 #define     FBVID_GFX      "/dev/fb0"
@@ -44,6 +51,31 @@
 //* Macro for clearing structures **
 #define     CLEAR(x)       memset ( &(x), 0 , sizeof(x) )
 
+//* Time allowed from a dequeued frame to its flip (30 fps) **
+#define     VIDEO_FRAME_BUDGET_NS  ( 1000000000ULL / 30 )
+
+//* Rows per piece when the frame copy is split across the pool **
+#define     COPY_GRAIN_ROWS  16
+
+//* One frame copy, handed to pool_parallel_for as row bands **
+typedef  struct  FrameCopy
+{
+    char       *dst;
+    const char *src;
+    int         rowBytes;
+    int         pcRows;		// Counted on whichever thread runs the band
+} FrameCopy;
+
+static void copy_rows( void *arg, int begin, int end )
+{
+    FrameCopy *fc = arg;
+
+    PERF_BEGIN( );
+    memcpy( fc->dst + begin * fc->rowBytes, fc->src + begin * fc->rowBytes,
+            ( end - begin ) * fc->rowBytes );
+    PERF_END( fc->pcRows );
+}
+
 //*******************************************************************************
 //*  video_thread_fxn                                                          **
 //*******************************************************************************
@@ -81,6 +113,8 @@ void *video_thread_fxn( void *envByRef )
     #define     OSDSETUPCOMPLETE             0x1
     #define     DISPLAYDEVICEINITIALIZED     0x2
     #define     CAPTUREDEVICEINITIALIZED     0x4
+    #define     AGCINITIALIZED               0x8
+    #define     TRACKINITIALIZED             0x10
 
     unsigned  int   initMask =  0x0;	// Used to only cleanup items that were init'd
 
@@ -97,7 +131,10 @@ void *video_thread_fxn( void *envByRef )
     int captureWidth;		// Width of a capture frame
     int captureHeight;		// Height of a capture frame
     int captureSize = 0;	// Bytes in a capture frame
-    struct  v4l2_buffer   v4l2buf;	// Stores a dequeue'd frame
+    int   capIdx;		// Index of the dequeue'd frame
+    char * captureDevice = envPtr->captureDevice ? envPtr->captureDevice : V4L2_DEVICE;
+    VideoAgc  agc;		// Software auto-exposure state
+    VideoTracker  tracker;	// Colour targets being followed
 
     #define     PICTURE_WIDTH      640
     #define     PICTURE_HEIGHT     480
@@ -111,15 +148,38 @@ void *video_thread_fxn( void *envByRef )
     int   displayIdx = 0;		// Frame being displayed
     int   workingIdx = 1;		// Next frame, being built
     char * dst;				// Pointer to working frame
+    FrameCopy  copy;			// Current frame copy for the pool
+    int   copyRows;			// Capture rows that fit in a display frame
+    char * displayDevice = envPtr->displayDevice ? envPtr->displayDevice : FBVID_VID0;
+
+    // Stage timing (see instrument.h)
+    int   stDequeue = inst_stage( "video.dequeue" );
+    int   stProcess = inst_stage( "video.process" );
+    int   stFlip    = inst_stage( "video.flip" );
+    inst_time_t  t0, t1, t2, t3, start, elapsed;
+    int   pcDequeue = perf_stage( "video.dequeue" );
+    int   pcCopy    = perf_stage( "video.copy" );
+    int   pcRows    = perf_stage( "video.copy.rows" );
+    int   pcAgc     = perf_stage( "video.agc" );
+    int   pcTrack   = perf_stage( "video.track" );
+    int   pcFlip    = perf_stage( "video.flip" );
+    int   wdVideo   = wd_loop( "video", VIDEO_FRAME_BUDGET_NS );
 
 // Thread Create Phase -- secure and initialize resources
 // ******************************************************
 
+    trace_thread_name( "video" );
+    perf_thread_open( );
+
     // Setup video OSD
     // ***************
 
     // Initialize video attribute window
 #ifndef _DEBUG_
+    // No OSD plane to draw on without a real display
+    if( null_output_probe( displayDevice ) )
+        goto no_osd;
+
     if( video_osd_setup( &osdFd, FBVID_GFX, 0x00, &osdDisplay ) == VOSD_FAILURE ) {
         ERR( "Failed video_osd_setup in video_thread_function\n" );
         status = VIDEO_THREAD_FAILURE;
@@ -156,6 +216,7 @@ void *video_thread_fxn( void *envByRef )
     DBG( "OSD Picture read successful, placing picture\n" );
 
     video_osd_place(osdDisplay, picture, 100, 100, PICTURE_WIDTH, PICTURE_HEIGHT);
+no_osd:
 #endif
 
     // Initialize the video display device
@@ -166,11 +227,11 @@ void *video_thread_fxn( void *envByRef )
     //displayWidth  = osdInfo.xres;     // Get width/height from driver settings
     //displayHeight = osdInfo.yres;     //   configured as Linux boot variables
 
-    if( video_output_setup( &fbFd, FBVID_VID0, displays, NUM_DISP_BUFS,
+    if( video_output_setup( &fbFd, displayDevice, displays, NUM_DISP_BUFS,
      &displayWidth, &displayHeight, ZOOM_1X )
          == VOUT_FAILURE ) {
         ERR( "Failed video_output_setup on %s in video_thread_function\n",
-		FBVID_GFX );
+		displayDevice );
         status = VIDEO_THREAD_FAILURE;
         goto cleanup;
     }
@@ -187,7 +248,7 @@ void *video_thread_fxn( void *envByRef )
     captureWidth   = D1_WIDTH;
     captureHeight  = D1_HEIGHT;
 
-    if( video_input_setup( &captureFd, V4L2_DEVICE, &vidBufs, &numVidBufs, 
+    if( video_input_setup( &captureFd, captureDevice, &vidBufs, &numVidBufs, 
 			&captureWidth, &captureHeight )
          == VIN_FAILURE ) {
         ERR( "Failed video_input_setup in video_thread_function\n" );
@@ -200,9 +261,33 @@ void *video_thread_fxn( void *envByRef )
 
     DBG( "captureSize = %d\n", captureSize);
 
+    // Copy whole rows, but never past the end of a display buffer
+    copyRows = ( captureSize < displayBufSize ? captureSize : displayBufSize )
+               / ( captureWidth * SCREEN_BPP );
+
     // Record that capture device was opened in initialization bitmask
     initMask    |= CAPTUREDEVICEINITIALIZED;
 
+    // Take exposure away from the camera's slow AGC
+    // *********************************************
+
+    //     (synthetic sources have no controls to drive)
+    if( envPtr->agc && !synth_input_owns( captureFd ) ) {
+        if( video_agc_setup( &agc, captureFd ) == VAGC_SUCCESS )
+            initMask |= AGCINITIALIZED;
+        else
+            DBG( "Software AGC unavailable, leaving camera AGC on\n" );
+    }
+
+    // Colour targets to follow, modelled from the first frame
+    if( envPtr->track != NULL ) {
+        if( video_track_setup( &tracker, envPtr->track ) == VTRACK_FAILURE ) {
+            status = VIDEO_THREAD_FAILURE;
+            goto cleanup;
+        }
+        initMask |= TRACKINITIALIZED;
+    }
+
 // Thread Execute Phase -- perform I/O and processing
 // **************************************************
 
@@ -212,13 +297,18 @@ void *video_thread_fxn( void *envByRef )
     int frameNumber = 0;
     int skipFrame = 100;	// Display message for 1 out of this many frames
 
+    if( envPtr->benchmark ) {
+        inst_enable( 1 );
+        printf( "Timing %d frames from %s to %s\n", envPtr->benchmark,
+                captureDevice, displayDevice );
+    }
+    start = inst_now_ns( );
+
     while( !envPtr->quit )
     {
-
-       // Initialize v4l2buf buffer for DQBUF call
-        CLEAR( v4l2buf );
-        v4l2buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        v4l2buf.memory = V4L2_MEMORY_MMAP;
+        INST_STAMP( t0 );
+        TRACE_BEGIN( "video.dequeue" );
+        PERF_BEGIN( );
 
         // Wait for video frame to be available
         // *************************************************************
@@ -234,40 +324,103 @@ void *video_thread_fxn( void *envByRef )
         // *************************************************************
 
         // Dequeue a frame buffer from the capture device driver
-        if( ioctl( captureFd, VIDIOC_DQBUF, &v4l2buf ) == -1 ) {
-            ERR( "VIDIOC_DQBUF failed in video_thread_fxn\n" );
+        if( video_input_dequeue( captureFd, &capIdx ) == VIN_FAILURE ) {
+            ERR( "video_input_dequeue failed in video_thread_fxn\n" );
             status = VIDEO_THREAD_FAILURE;
             break;
         }
+        INST_STAMP( t1 );
+        PERF_END( pcDequeue );
+        TRACE_END( "video.dequeue" );
+
+        // Overloaded: hand odd frames straight back without processing them
+        if( wd_shedding( WD_HALF_RATE ) && ( frameNumber & 1 ) ) {
+            if( video_input_requeue( captureFd, capIdx ) == VIN_FAILURE ) {
+                ERR( "video_input_requeue failed in video_thread_fxn\n" );
+                status = VIDEO_THREAD_FAILURE;
+                break;
+            }
+            frameNumber++;
+            continue;
+        }
+
+        wd_begin( wdVideo );
+        TRACE_BEGIN( "video.process" );
 
         // Set display index to "working" buffer in fbdev display driver
         dst = displays[ workingIdx ];
 
-	if(frameNumber % skipFrame == 0)
+	if(frameNumber % skipFrame == 0 && !wd_shedding( WD_SKIP_OPTIONAL ))
 	    DBG("%d: dst = %d, ", frameNumber, (int) dst);
 
         // Read raw video data from camera to display
 
-	memcpy(dst, vidBufs[ v4l2buf.index ].start, captureSize);
+        PERF_BEGIN( );
+	// in row bands across the pool's real-time lane (serial without a pool),
+	// no more rows than the display buffer holds
+	copy.dst      = dst;
+	copy.src      = vidBufs[ capIdx ].start;
+	copy.rowBytes = captureWidth * SCREEN_BPP;
+	copy.pcRows   = pcRows;
+	pool_parallel_for( POOL_LANE_RT, 0, copyRows, COPY_GRAIN_ROWS,
+	                   copy_rows, &copy );
+        PERF_END( pcCopy );
+
+        // Feed the exposure loop from the (cached) capture buffer
+        if( ( initMask & AGCINITIALIZED ) && !wd_shedding( WD_SKIP_OPTIONAL ) &&
+            frameNumber % VAGC_FRAME_INTERVAL == 0 ) {
+            PERF_BEGIN( );
+            video_agc_process( &agc, vidBufs[ capIdx ].start,
+                               captureWidth, captureHeight );
+            PERF_END( pcAgc );
+        }
+
+        // Follow the colour targets, and show where they are
+        if( initMask & TRACKINITIALIZED ) {
+            TRACE_BEGIN( "video.track" );
+            PERF_BEGIN( );
+            video_track_process( &tracker, vidBufs[ capIdx ].start,
+                                 captureWidth, captureHeight );
+            PERF_END( pcTrack );
+            if( !wd_shedding( WD_SKIP_OPTIONAL ) )
+                video_track_draw( &tracker, (unsigned char *) dst,
+                                  captureWidth, captureHeight );
+            TRACE_END( "video.track" );
+        }
 
         // Issue capture buffer back to capture device driver
-        if( ioctl( captureFd, VIDIOC_QBUF, &v4l2buf ) == -1 ) {
-            ERR( "VIDIOC_QBUF failed in video_thread_fxn\n" );
+        if( video_input_requeue( captureFd, capIdx ) == VIN_FAILURE ) {
+            ERR( "video_input_requeue failed in video_thread_fxn\n" );
             status = VIDEO_THREAD_FAILURE;
             break;
         }
+        INST_STAMP( t2 );
+        TRACE_END( "video.process" );
 
         // Calculate the next buffer for display/work
         displayIdx = ( displayIdx + 1 ) % NUM_DISP_BUFS;
         workingIdx = ( workingIdx + 1 ) % NUM_DISP_BUFS;
 
-	if(frameNumber % skipFrame == 0)
+	if(frameNumber % skipFrame == 0 && !wd_shedding( WD_SKIP_OPTIONAL ))
 	    DBG( "displayIdx = %d, workingIdx = %d\n", displayIdx, workingIdx);
 
         // Flip display and working buffers
+        TRACE_BEGIN( "video.flip" );
+        PERF_BEGIN( );
         flip_display_buffers( fbFd, displayIdx );
+        PERF_END( pcFlip );
+        TRACE_END( "video.flip" );
+        INST_STAMP( t3 );
+        wd_end( wdVideo );
+
+        INST_RECORD( stDequeue, t0, t1 );
+        INST_RECORD( stProcess, t1, t2 );
+        INST_RECORD( stFlip,    t2, t3 );
 
 	frameNumber++;
+
+        if( envPtr->benchmark && frameNumber >= envPtr->benchmark )
+            break;
 #ifdef HACK
 	if(frameNumber > 1000)
 	    break;
@@ -276,6 +429,15 @@ void *video_thread_fxn( void *envByRef )
 
     DBG( "Exited video_thread_fxn processing loop\n" );
 
+    elapsed = inst_now_ns( ) - start;
+    if( envPtr->benchmark && frameNumber && elapsed ) {
+        printf( "Video benchmark: %d frames in %llu ms, %.1f fps\n", frameNumber,
+                elapsed / 1000000, frameNumber * 1e9 / elapsed );
+        inst_report( stdout, "video." );
+    }
+    if( initMask & TRACKINITIALIZED )
+        video_track_report( &tracker, stdout );
+
 
 // Thread Delete Phase -- free up resources allocated by this file
 // ***************************************************************
@@ -293,6 +455,11 @@ cleanup:
         video_osd_cleanup( osdFd, osdDisplay );
     }
 
+    // Give exposure back to the camera before its device is closed
+    if( initMask & AGCINITIALIZED ) {
+        video_agc_cleanup( &agc );
+    }
+
     // Close video capture device
     if( initMask & CAPTUREDEVICEINITIALIZED ) {
         video_input_cleanup( captureFd, vidBufs, numVidBufs );
@@ -304,6 +471,8 @@ cleanup:
     }
 
 
+    perf_thread_close( );
+
     // Return from video_thread_fxn function
     // *************************************
 
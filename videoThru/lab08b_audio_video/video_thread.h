@@ -10,6 +10,11 @@
 typedef  struct  video_thread_env
 {
     int quit;                         // Thread will run as long as quit = 0
+    int agc;                          // Run software auto-exposure if != 0
+    char *captureDevice;              // V4L2 node or synthetic source, NULL = default
+    char *displayDevice;              // fbdev node or "null[@hz]", NULL = default
+    int benchmark;                    // Frames to time before exiting, 0 = off
+    char *track;                      // "x,y,w,h[;...]" windows to follow, NULL = none
 } video_thread_env;
 
 // Function prototypes
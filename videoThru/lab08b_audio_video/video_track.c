@@ -0,0 +1,311 @@
+/*
+ *   video_track.c
+ */
+
+// Colour tracker.  Each target is modelled by a 16 x 16 histogram of the
+// Cb/Cr values inside the window the user picked, turned into a weight per
+// bin (a back-projection table).  Every frame, mean-shift moves the window
+// to the centroid of the weights around it until it settles, then the
+// window is resized from the second moments of the weights (CAMShift), so
+// it follows an object that grows or shrinks.  Only the window plus
+// VTRACK_MARGIN is ever looked at, which keeps several targets cheap.
+
+// Standard Linux headers
+#include     <stdio.h>		// Always include stdio.h
+#include     <stdlib.h>		// Always include stdlib.h
+#include     <string.h>		// Defines memset
+#include     <math.h>		// sqrt
+
+#if defined(__ARM_NEON__)
+#include     <arm_neon.h>	// NEON intrinsics for the back-projection
+#endif
+
+// Application header files
+#include     "video_track.h"	// Colour tracker definitions
+#include     "debug.h"		// DBG and ERR macros
+
+// Weighted moments of a back-projected rectangle
+typedef  struct  TrackMoments
+{
+    unsigned long long  m00, m10, m01, m20, m02;
+} TrackMoments;
+
+/******************************************************************************
+ * track_bins
+ ******************************************************************************/
+/*  Writes the model bin of n macropixels of a UYVY row: the top four bits    */
+/*  of Cb in the high nibble, of Cr in the low one.  With NEON, vld4 splits   */
+/*  16 macropixels into U, Y, V, Y lanes and the bins are formed in-register. */
+/******************************************************************************/
+static void track_bins( unsigned char * bins, const unsigned char * row, int  n )
+{
+    int  i = 0;
+
+#if defined(__ARM_NEON__)
+    for( ; i + 16 <= n; i += 16 ) {
+        uint8x16x4_t  px = vld4q_u8( row + 4 * i );
+
+        vst1q_u8( bins + i, vsriq_n_u8( px.val[ 0 ], px.val[ 2 ], 4 ) );
+    }
+#endif
+
+    for( ; i < n; i++ )
+        bins[ i ] = ( row[ 4 * i ] & 0xf0 ) | ( row[ 4 * i + 2 ] >> 4 );
+}
+
+/******************************************************************************
+ * track_moments
+ ******************************************************************************/
+/*  Back-projects the rectangle [x0,x1) x [y0,y1) (x0, x1 even) through the   */
+/*  target's weights and sums the moments; second moments only if asked.     */
+/*  A macropixel counts once, at its centre x + 1.                            */
+/******************************************************************************/
+static void track_moments( const VideoTrackTarget * t, const unsigned char * frame,
+                           int  width, int  x0, int  y0, int  x1, int  y1,
+                           int  second, TrackMoments * m )
+{
+    unsigned char  bins[ 4096 ];
+    int            n = ( x1 - x0 ) / 2;
+    int            x, y;
+
+    memset( m, 0, sizeof( *m ) );
+
+    for( y = y0; y < y1; y++ ) {
+        unsigned int        r00 = 0, r10 = 0;
+        unsigned long long  r20 = 0;
+
+        track_bins( bins, frame + ( y * width + x0 ) * 2, n );
+
+        for( x = 0; x < n; x++ ) {
+            unsigned int  wgt = t->weight[ bins[ x ] ];
+
+            // Coordinates relative to x0 keep the row sums in 32 bits
+            r00 += wgt;
+            r10 += wgt * ( 2 * x + 1 );
+            if( second )
+                r20 += ( unsigned long long ) wgt * ( 2 * x + 1 ) * ( 2 * x + 1 );
+        }
+
+        m->m00 += r00;
+        m->m10 += r10 + ( unsigned long long ) r00 * x0;
+        m->m01 += ( unsigned long long ) r00 * y;
+        if( second ) {
+            m->m20 += r20 + 2ULL * x0 * r10 + ( unsigned long long ) r00 * x0 * x0;
+            m->m02 += ( unsigned long long ) r00 * y * y;
+        }
+    }
+}
+
+// Keeps a window inside the frame, with an even left edge and width
+static void track_clamp( VideoTrackTarget * t, int  width, int  height )
+{
+    t->w = ( t->w + 1 ) & ~1;
+    if( t->w < VTRACK_MIN_SIZE ) t->w = VTRACK_MIN_SIZE;
+    if( t->h < VTRACK_MIN_SIZE ) t->h = VTRACK_MIN_SIZE;
+    if( t->w > width )  t->w = width;
+    if( t->h > height ) t->h = height;
+    if( t->x < 0 ) t->x = 0;
+    if( t->y < 0 ) t->y = 0;
+    if( t->x + t->w > width )  t->x = width - t->w;
+    if( t->y + t->h > height ) t->y = height - t->h;
+    t->x &= ~1;
+}
+
+/******************************************************************************
+ * track_model
+ ******************************************************************************/
+/*  Takes the target's colour model from its window in this frame.          */
+/******************************************************************************/
+static void track_model( VideoTrackTarget * t, const unsigned char * frame, int  width )
+{
+    unsigned char  bins[ 4096 ];
+    unsigned int   hist[ VTRACK_BINS ], peak = 0;
+    int            x, y, b;
+
+    memset( hist, 0, sizeof( hist ) );
+    for( y = t->y; y < t->y + t->h; y++ ) {
+        track_bins( bins, frame + ( y * width + t->x ) * 2, t->w / 2 );
+        for( x = 0; x < t->w / 2; x++ )
+            hist[ bins[ x ] ]++;
+    }
+
+    for( b = 0; b < VTRACK_BINS; b++ )
+        if( hist[ b ] > peak )
+            peak = hist[ b ];
+    for( b = 0; b < VTRACK_BINS; b++ )
+        t->weight[ b ] = peak ? hist[ b ] * 255 / peak : 0;
+}
+
+/******************************************************************************
+ * video_track_setup
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      VideoTracker *trk -- tracker to initialize                            */
+/*      char *spec        -- "x,y,w,h[;x,y,w,h...]", one window per target    */
+/*                                                                            */
+/*  The colour models are taken from the first frame processed.              */
+/*                                                                            */
+/*  return value: VTRACK_SUCCESS or VTRACK_FAILURE (bad spec)                 */
+/******************************************************************************/
+int video_track_setup( VideoTracker * trk, const char * spec )
+{
+    VideoTrackTarget  *t;
+    int                used;
+
+    memset( trk, 0, sizeof( *trk ) );
+
+    while( *spec && trk->numTargets < VTRACK_MAX_TARGETS ) {
+        t = &trk->target[ trk->numTargets ];
+        if( sscanf( spec, "%d,%d,%d,%d%n", &t->x, &t->y, &t->w, &t->h, &used ) != 4 ||
+            t->w <= 0 || t->h <= 0 ) {
+            ERR( "Bad tracking window \"%s\", want x,y,w,h[;x,y,w,h...]\n", spec );
+            return VTRACK_FAILURE;
+        }
+        trk->numTargets++;
+        spec += used;
+        if( *spec == ';' )
+            spec++;
+    }
+
+    trk->pending = trk->numTargets > 0;
+    DBG( "Tracking %d target(s)\n", trk->numTargets );
+    return VTRACK_SUCCESS;
+}
+
+/******************************************************************************
+ * video_track_process
+ ******************************************************************************/
+/*  input parameters:                                                         */
+/*      VideoTracker *trk    -- tracker state                                 */
+/*      unsigned char *frame -- UYVY frame                                    */
+/*      int width, height    -- frame size in pixels                          */
+/*                                                                            */
+/*  A lost target keeps its model and searches a growing window until its   */
+/*  colour turns up again.                                                    */
+/*                                                                            */
+/*  return value: number of targets currently found                           */
+/******************************************************************************/
+int video_track_process( VideoTracker * trk, const unsigned char * frame,
+                         int  width, int  height )
+{
+    TrackMoments  m;
+    int           i, iter, found = 0;
+
+    for( i = 0; i < trk->numTargets; i++ ) {
+        VideoTrackTarget  *t = &trk->target[ i ];
+        int                x0, y0, x1, y1, cx, cy;
+
+        if( trk->pending ) {
+            track_clamp( t, width, height );
+            track_model( t, frame, width );
+            found++;
+            continue;
+        }
+
+        // Mean-shift: centre the window on the weights around it
+        for( iter = 0; iter < VTRACK_MAX_ITER; iter++ ) {
+            x0 = ( t->x - VTRACK_MARGIN ) & ~1;
+            y0 = t->y - VTRACK_MARGIN;
+            x1 = t->x + t->w + VTRACK_MARGIN;
+            y1 = t->y + t->h + VTRACK_MARGIN;
+            if( x0 < 0 ) x0 = 0;
+            if( y0 < 0 ) y0 = 0;
+            if( x1 > width )  x1 = width;
+            if( y1 > height ) y1 = height;
+
+            track_moments( t, frame, width, x0, y0, x1, y1, 0, &m );
+            t->iterations++;
+            if( m.m00 < VTRACK_LOST_MASS )
+                break;
+
+            cx = m.m10 / m.m00;
+            cy = m.m01 / m.m00;
+            if( abs( cx - ( t->x + t->w / 2 ) ) < 2 && abs( cy - ( t->y + t->h / 2 ) ) < 2 )
+                break;
+            t->x = cx - t->w / 2;
+            t->y = cy - t->h / 2;
+            track_clamp( t, width, height );
+        }
+
+        if( m.m00 < VTRACK_LOST_MASS ) {
+            t->lost++;
+            t->x -= VTRACK_MARGIN;
+            t->y -= VTRACK_MARGIN;
+            t->w += 2 * VTRACK_MARGIN;
+            t->h += 2 * VTRACK_MARGIN;
+            track_clamp( t, width, height );
+            continue;
+        }
+
+        // CAMShift: a uniform blob of side s has variance s * s / 12
+        track_moments( t, frame, width, x0, y0, x1, y1, 1, &m );
+        {
+            double  mx = ( double ) m.m10 / m.m00, my = ( double ) m.m01 / m.m00;
+            double  vx = ( double ) m.m20 / m.m00 - mx * mx;
+            double  vy = ( double ) m.m02 / m.m00 - my * my;
+            int     w  = vx > 0 ? sqrt( 12 * vx ) : 0;
+            int     h  = vy > 0 ? sqrt( 12 * vy ) : 0;
+
+            // Smoothed, so one noisy frame does not jolt the window
+            t->w = ( 3 * t->w + w + 2 ) / 4;
+            t->h = ( 3 * t->h + h + 2 ) / 4;
+            t->x = ( int ) mx - t->w / 2;
+            t->y = ( int ) my - t->h / 2;
+            track_clamp( t, width, height );
+        }
+
+        t->lost = 0;
+        t->frames++;
+        found++;
+    }
+
+    trk->pending = 0;
+    return found;
+}
+
+/******************************************************************************
+ * video_track_draw
+ ******************************************************************************/
+/*  Outlines every found target in white on a UYVY frame.                    */
+/******************************************************************************/
+void video_track_draw( VideoTracker * trk, unsigned char * frame,
+                       int  width, int  height )
+{
+    static const unsigned char  white[ 4 ] = { 128, 235, 128, 235 };
+    int                         i, x, y;
+
+    for( i = 0; i < trk->numTargets; i++ ) {
+        VideoTrackTarget  *t = &trk->target[ i ];
+        unsigned char     *top, *bottom;
+
+        if( t->lost )
+            continue;
+
+        top    = frame + ( t->y * width + t->x ) * 2;
+        bottom = frame + ( ( t->y + t->h - 1 ) * width + t->x ) * 2;
+        for( x = 0; x < t->w; x += 2 ) {
+            memcpy( top + 2 * x, white, 4 );
+            memcpy( bottom + 2 * x, white, 4 );
+        }
+        for( y = t->y; y < t->y + t->h; y++ ) {
+            memcpy( frame + ( y * width + t->x ) * 2, white, 4 );
+            memcpy( frame + ( y * width + t->x + t->w - 2 ) * 2, white, 4 );
+        }
+    }
+}
+
+/******************************************************************************
+ * video_track_report
+ ******************************************************************************/
+void video_track_report( VideoTracker * trk, FILE * fp )
+{
+    int  i;
+
+    for( i = 0; i < trk->numTargets; i++ ) {
+        VideoTrackTarget  *t = &trk->target[ i ];
+
+        fprintf( fp, "Target %d: %dx%d at (%d,%d)%s, tracked %u frames, %.1f mean-shift steps/frame\n",
+                 i, t->w, t->h, t->x, t->y, t->lost ? " (lost)" : "", t->frames,
+                 t->frames ? ( double ) t->iterations / t->frames : 0.0 );
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ *   video_track.h
+ */
+
+/* SUCCESS and FAILURE definitions for the colour tracker functions */
+#define     VTRACK_SUCCESS       0
+#define     VTRACK_FAILURE       -1
+
+/* CbCr model: each channel >> 4, so 16 x 16 bins */
+#define     VTRACK_BINS          256
+
+/* Tracker tuning */
+#define     VTRACK_MAX_TARGETS   4
+#define     VTRACK_MAX_ITER      8	// Mean-shift steps per frame
+#define     VTRACK_MARGIN        16	// Pixels searched beyond the window
+#define     VTRACK_MIN_SIZE      8	// Smallest window side, pixels
+#define     VTRACK_LOST_MASS     ( 255 * 16 )	// Below this the target is lost
+
+/* One followed object: its colour model and where it was last seen */
+typedef  struct  VideoTrackTarget
+{
+    unsigned char   weight[ VTRACK_BINS ];	// Back-projection, model / peak * 255
+    int             x, y;			// Window top left, pixels (x even)
+    int             w, h;			// Window size, pixels (w even)
+    int             lost;			// Frames in a row below VTRACK_LOST_MASS
+    unsigned int    frames;			// Frames tracked
+    unsigned int    iterations;			// Mean-shift steps over all frames
+} VideoTrackTarget;
+
+/* All targets in one video stream */
+typedef  struct  VideoTracker
+{
+    int               numTargets;
+    int               pending;			// Models still to take from a frame
+    VideoTrackTarget  target[ VTRACK_MAX_TARGETS ];
+} VideoTracker;
+
+/* Function prototypes */
+int  video_track_setup( VideoTracker * trk, const char * spec );
+
+int  video_track_process( VideoTracker * trk, const unsigned char * frame,
+                          int  width, int  height );
+
+void video_track_draw( VideoTracker * trk, unsigned char * frame,
+                       int  width, int  height );
+
+void video_track_report( VideoTracker * trk, FILE * fp );